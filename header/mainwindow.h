@@ -2,12 +2,19 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 QT_BEGIN_NAMESPACE
 class QAction;
+class QComboBox;
+class QDockWidget;
+class QLabel;
+class QListWidget;
 class QMenu;
 class QMenuBar;
+class QSlider;
 class QStatusBar;
 class QToolBar;
 QT_END_NAMESPACE
@@ -18,6 +25,9 @@ class GLFiberWidget;
 namespace DTIFiberLib {
     class TrkFileReader;
     class GLFiberRenderer;
+    class TrackROIFilter;
+    class TrackStatistics;
+    enum class ROIShape;
 }
 
 class MainWindow : public QMainWindow
@@ -35,20 +45,68 @@ private slots:
     void createStatusBar();
     void setupOpenGLWidget();
     void openTrkFile();
+    void appendTrkFile();
+    void openTrkOutOfCore();
+    void runDrawBenchmark();
+    void exportTrackDensity();
 
 private:
+    // ROI filtering
+    void createRoiDock();
+    void invalidateRoiIndex();
+    void rebuildRoiIndex();
+    void addRoi(DTIFiberLib::ROIShape shape);
+    void removeSelectedRoi();
+    void syncRoiControls();
+    void updateSelectedRoi();
+    void applyRoiFilter();
+
+    // Slab view
+    void createSlabDock();
+    void updateSlab();
+
+    // Per-track statistics and the length filter
+    void createLengthDock();
+    void rebuildTrackStatistics();
+    void applyLengthFilter();
+    bool isLengthVisible(uint32_t track) const;
+
     // UI components
     GLFiberWidget *glWidget;
     QMenu *fileMenu;
+    QMenu *toolsMenu;
     QMenu *helpMenu;
     QToolBar *fileToolBar;
     QAction *exitAct;
     QAction *aboutAct;
     QAction *openTrkAct;
+    QAction *appendTrkAct;
+    QAction *openOutOfCoreAct;
+    QAction *benchmarkAct;
+    QAction *hudAct;
+    QAction *tdiAct;
+    QAction *densityVolumeAct;
+    QAction *pickAct;
+    QDockWidget *roiDock;
+    QListWidget *roiList;
+    QComboBox *roiModeBox;
+    QSlider *roiSliders[4];     // Center x, y, z and size (mm)
+    QLabel *roiStatusLabel;
+    bool roiIndexStale;
+    QDockWidget *slabDock;
+    QComboBox *slabAxisBox;
+    QSlider *slabSliders[2];    // Position (per mille of the extent) and thickness (mm)
+    QLabel *slabStatusLabel;
+    QDockWidget *lengthDock;
+    QSlider *lengthSliders[2];  // Shortest and longest shown length (mm)
+    QLabel *lengthStatusLabel;
+    std::vector<uint8_t> lengthMask;    // Empty while every length is shown
 
     // DTI library components
     std::unique_ptr<DTIFiberLib::TrkFileReader> trkReader;
     std::unique_ptr<DTIFiberLib::GLFiberRenderer> glFiberRenderer;
+    std::unique_ptr<DTIFiberLib::TrackROIFilter> roiFilter;
+    std::unique_ptr<DTIFiberLib::TrackStatistics> trackStats;
 };
 
 #endif // MAINWINDOW_H
\ No newline at end of file
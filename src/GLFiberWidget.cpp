@@ -1,6 +1,14 @@
 #include <glad/glad.h>  // MUST be first, before any OpenGL headers
 #include "GLFiberWidget.h"
 #include "DTIFiberLib.h"
+#include <QStandardPaths>
+#include <QPainter>
+#include <QCursor>
+#include <QFontDatabase>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QWindow>
+#include <algorithm>
 #include <iostream>
 
 GLFiberWidget::GLFiberWidget(QWidget* parent)
@@ -12,17 +20,44 @@ GLFiberWidget::GLFiberWidget(QWidget* parent)
     , m_centerX(0.0f)
     , m_centerY(0.0f)
     , m_centerZ(0.0f)
+    , m_hudVisible(false)
+    , m_hoverPicking(false)
+    , m_hoverPickWanted(false)
+    , m_hoveredTrack(-1)
+    , m_hoveredPoint(0)
+    , m_frameScheduled(false)
+    , m_mvpDirty(true)
+    , m_pendingInputNs(-1)
+    , m_paintedInputNs(-1)
+    , m_lastFrameNs(0)
 {
     setFocusPolicy(Qt::StrongFocus);
+    m_hoveredPosition[0] = m_hoveredPosition[1] = m_hoveredPosition[2] = 0.0f;
+
+    m_clock.start();
+    resetLatencyStats();
+    m_frameTimer.setSingleShot(true);
+    m_frameTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_frameTimer, &QTimer::timeout, this, [this]() { update(); });
+    connect(this, &QOpenGLWidget::frameSwapped, this, &GLFiberWidget::onFrameSwapped);
 }
 
 GLFiberWidget::~GLFiberWidget()
 {
+    // The cached frame's framebuffer belongs to this widget's context
+    if (m_frameCache) {
+        makeCurrent();
+        m_frameCache->cleanup();
+        doneCurrent();
+    }
 }
 
 void GLFiberWidget::setFiberRenderer(DTIFiberLib::GLFiberRenderer* renderer)
 {
     m_fiberRenderer = renderer;
+    if (m_fiberRenderer) {
+        m_fiberRenderer->setProfilingEnabled(m_hudVisible);
+    }
 }
 
 void GLFiberWidget::setBoundingBox(float minX, float maxX, float minY, float maxY, float minZ, float maxZ)
@@ -44,8 +79,118 @@ void GLFiberWidget::setBoundingBox(float minX, float maxX, float minY, float max
     std::cout << "Data center: (" << m_centerX << ", " << m_centerY << ", " << m_centerZ << ")" << std::endl;
     std::cout << "Camera distance: " << m_cameraDistance << std::endl;
 
-    updateMVPMatrix();
-    update();
+    m_mvpDirty = true;
+    requestFrame();
+}
+
+void GLFiberWidget::setHudVisible(bool visible)
+{
+    // The profiler only runs while its numbers are shown
+    m_hudVisible = visible;
+    if (m_fiberRenderer) {
+        m_fiberRenderer->setProfilingEnabled(visible);
+    }
+    requestFrame();
+}
+
+void GLFiberWidget::setHoverPickingEnabled(bool enable)
+{
+    m_hoverPicking = enable;
+    setMouseTracking(enable);
+    m_hoverPickWanted = enable && underMouse();
+    if (enable) {
+        m_hoverPos = mapFromGlobal(QCursor::pos());
+    } else {
+        setHoveredTrack(-1);
+    }
+    requestFrame();
+}
+
+void GLFiberWidget::setHoveredTrack(int trackIndex)
+{
+    if (trackIndex == m_hoveredTrack) {
+        return;
+    }
+    if (m_fiberRenderer) {
+        if (m_hoveredTrack >= 0) {
+            m_fiberRenderer->setTrackHighlighted(static_cast<size_t>(m_hoveredTrack), false);
+        }
+        if (trackIndex >= 0) {
+            m_fiberRenderer->setTrackHighlighted(static_cast<size_t>(trackIndex), true);
+        }
+    }
+    m_hoveredTrack = trackIndex;
+    requestFrame();
+}
+
+QPoint GLFiberWidget::framebufferPixel(const QPoint& pos) const
+{
+    const qreal ratio = devicePixelRatioF();
+    return QPoint(static_cast<int>(pos.x() * ratio), static_cast<int>((height() - pos.y()) * ratio) - 1);
+}
+
+void GLFiberWidget::requestFrame()
+{
+    scheduleFrame(false);
+}
+
+void GLFiberWidget::resetLatencyStats()
+{
+    m_latencyStats.lastMs = 0.0;
+    m_latencyStats.averageMs = 0.0;
+    m_latencyStats.maxMs = 0.0;
+    m_latencyStats.presentedFrames = 0;
+    m_latencyStats.coalescedEvents = 0;
+}
+
+qint64 GLFiberWidget::refreshIntervalNs() const
+{
+    QScreen* screen = window()->windowHandle() ? window()->windowHandle()->screen() : QGuiApplication::primaryScreen();
+    qreal rate = screen ? screen->refreshRate() : 60.0;
+    if (rate < 1.0) {
+        rate = 60.0;
+    }
+    return static_cast<qint64>(1.0e9 / rate);
+}
+
+void GLFiberWidget::scheduleFrame(bool fromInput)
+{
+    const qint64 now = m_clock.nsecsElapsed();
+    if (fromInput && m_pendingInputNs < 0) {
+        m_pendingInputNs = now;
+    }
+
+    if (m_frameScheduled) {
+        if (fromInput) {
+            m_latencyStats.coalescedEvents++;
+        }
+        return;
+    }
+    m_frameScheduled = true;
+
+    // Paint right away if a refresh interval has passed since the last frame, else at the next slot
+    const qint64 waitNs = m_lastFrameNs + refreshIntervalNs() - now;
+    if (waitNs <= 0) {
+        update();
+    } else {
+        m_frameTimer.start(static_cast<int>((waitNs + 999999) / 1000000));
+    }
+}
+
+void GLFiberWidget::onFrameSwapped()
+{
+    if (m_paintedInputNs < 0) {
+        return;
+    }
+
+    const double latencyMs = static_cast<double>(m_clock.nsecsElapsed() - m_paintedInputNs) / 1.0e6;
+    m_paintedInputNs = -1;
+
+    m_latencyStats.lastMs = latencyMs;
+    m_latencyStats.averageMs = m_latencyStats.presentedFrames == 0 ? latencyMs
+                                                                   : m_latencyStats.averageMs * 0.9 + latencyMs * 0.1;
+    m_latencyStats.maxMs = std::max(m_latencyStats.maxMs, latencyMs);
+    m_latencyStats.presentedFrames++;
 }
 
 void GLFiberWidget::initializeGL()
@@ -63,10 +208,18 @@ void GLFiberWidget::initializeGL()
     glEnable(GL_DEPTH_TEST);
     glClearColor(0.1f, 0.2f, 0.4f, 1.0f);
 
+    // Reuse linked shader binaries from earlier runs
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (!cacheDir.isEmpty()) {
+        DTIFiberLib::GLShaderProgram::setBinaryCacheDirectory((cacheDir + "/shaders").toStdString());
+    }
+
     // Initialize fiber renderer
     if (m_fiberRenderer) {
         m_fiberRenderer->initialize();
     }
+
+    m_frameCache = std::make_unique<DTIFiberLib::GLFrameCache>();
 }
 
 void GLFiberWidget::resizeGL(int w, int h)
@@ -78,17 +231,145 @@ void GLFiberWidget::resizeGL(int w, int h)
     float aspect = float(w) / float(h > 0 ? h : 1);
     m_projectionMatrix.perspective(45.0f, aspect, 0.1f, 1000.0f);
 
-    updateMVPMatrix();
+    m_mvpDirty = true;
 }
 
 void GLFiberWidget::paintGL()
 {
+    // Everything requested so far is drawn by this frame, including Qt-initiated paints
+    m_frameTimer.stop();
+    m_frameScheduled = false;
+    m_lastFrameNs = m_clock.nsecsElapsed();
+    if (m_pendingInputNs >= 0) {
+        m_paintedInputNs = m_pendingInputNs;
+        m_pendingInputNs = -1;
+    }
+
+    // QPainter leaves depth testing disabled after drawing the overlay
+    glEnable(GL_DEPTH_TEST);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     if (m_fiberRenderer && m_fiberRenderer->isInitialized()) {
-        updateMVPMatrix();
-        m_fiberRenderer->render(m_mvpMatrix.constData());
+        if (m_mvpDirty) {
+            updateMVPMatrix();
+        }
+
+        // Redraws without scene or camera changes reuse the last full frame, except while
+        // out-of-core nodes are still arriving or the density volume waits for visibility edits to settle
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        const uint64_t revision = m_fiberRenderer->getSceneRevision();
+        const GLuint target = defaultFramebufferObject();
+        const bool streaming = m_fiberRenderer->hasPendingStreaming() || m_fiberRenderer->hasPendingDensityVolume();
+        if (streaming || !m_frameCache->restore(target, revision, m_mvpMatrix.constData(), viewport)) {
+            m_fiberRenderer->render(m_mvpMatrix.constData());
+            m_frameCache->store(target, revision, m_mvpMatrix.constData(), viewport);
+        }
+        if (m_fiberRenderer->hasPendingStreaming() || m_fiberRenderer->hasPendingDensityVolume()) {
+            requestFrame();
+        }
+        if (m_hoverPicking) {
+            updateHoverPick(viewport);
+        }
+
+        if (m_hudVisible) {
+            drawHud();
+        }
+    }
+}
+
+void GLFiberWidget::updateHoverPick(const GLint* viewport)
+{
+    // The pick queued by an earlier frame; its result highlights one frame late
+    DTIFiberLib::TrackPickResult result;
+    if (m_fiberRenderer->pollPick(result)) {
+        if (result.hit) {
+            m_hoveredPoint = static_cast<int>(result.pointIndex);
+            std::copy(result.position, result.position + 3, m_hoveredPosition);
+        }
+        setHoveredTrack(result.hit ? static_cast<int>(result.trackIndex) : -1);
+    }
+
+    if (m_hoverPickWanted) {
+        const QPoint pixel = framebufferPixel(m_hoverPos);
+        m_fiberRenderer->requestPick(m_mvpMatrix.constData(), viewport, pixel.x(), pixel.y());
+        m_hoverPickWanted = false;
+    }
+    if (m_fiberRenderer->hasPendingPick()) {
+        requestFrame();
+    }
+}
+
+void GLFiberWidget::drawHud()
+{
+    const DTIFiberLib::FrameStatistics& stats = m_fiberRenderer->getFrameStatistics();
+
+    // GPU times are one frame behind; "-" marks sections without a result
+    auto gpuText = [](double ms) { return ms < 0.0 ? QString("    -") : QString::number(ms, 'f', 2).rightJustified(5); };
+
+    QStringList lines;
+    lines << QString("帧 %1   CPU %2 ms   GPU %3 ms")
+                 .arg(stats.frameIndex)
+                 .arg(stats.frameCpuMs, 0, 'f', 2)
+                 .arg(stats.frameGpuMs, 0, 'f', 2);
+    for (int i = 0; i < static_cast<int>(DTIFiberLib::ProfilerSection::COUNT); ++i) {
+        lines << QString("%1 CPU %2  GPU %3")
+                     .arg(QString(DTIFiberLib::GLFrameProfiler::sectionName(static_cast<DTIFiberLib::ProfilerSection>(i))), -9)
+                     .arg(QString::number(stats.cpuMs[i], 'f', 2).rightJustified(5))
+                     .arg(gpuText(stats.gpuMs[i]));
+    }
+    lines << QString("纤维 %1 / %2   顶点 %3%4")
+                 .arg(stats.submittedTracks)
+                 .arg(m_fiberRenderer->getRenderedTrackCount())
+                 .arg(stats.submittedVertices)
+                 .arg(m_fiberRenderer->isDensityVolumeActive() ? "   (密度体)" : "");
+    lines << QString("绘制调用 %1   上传 %2 KB")
+                 .arg(stats.drawCalls)
+                 .arg(stats.uploadedBytes / 1024.0, 0, 'f', 1);
+    lines << QString("输入延迟 %1 ms   平均 %2   最大 %3   合并 %4")
+                 .arg(m_latencyStats.lastMs, 0, 'f', 1)
+                 .arg(m_latencyStats.averageMs, 0, 'f', 1)
+                 .arg(m_latencyStats.maxMs, 0, 'f', 1)
+                 .arg(m_latencyStats.coalescedEvents);
+    lines << QString("帧缓存 命中 %1   重绘 %2")
+                 .arg(m_frameCache->getHitCount())
+                 .arg(m_frameCache->getMissCount());
+    if (m_hoverPicking) {
+        lines << (m_hoveredTrack < 0 ? QString("拾取 -")
+                                     : QString("拾取 纤维 %1  点 %2  (%3, %4, %5)")
+                                           .arg(m_hoveredTrack)
+                                           .arg(m_hoveredPoint)
+                                           .arg(m_hoveredPosition[0], 0, 'f', 1)
+                                           .arg(m_hoveredPosition[1], 0, 'f', 1)
+                                           .arg(m_hoveredPosition[2], 0, 'f', 1));
     }
+    if (m_fiberRenderer->isOutOfCore()) {
+        const DTIFiberLib::StreamingStatistics& streaming = m_fiberRenderer->getStreamingStatistics();
+        lines << QString("流式 节点 %1 / 常驻 %2   缓存 %3 / %4 MB   待加载 %5")
+                     .arg(streaming.drawnNodes)
+                     .arg(streaming.residentNodes)
+                     .arg(streaming.cacheBytesUsed >> 20)
+                     .arg(streaming.cacheBytesCapacity >> 20)
+                     .arg(streaming.pendingRequests);
+        if (streaming.unloadableNodes > 0) {
+            lines << QString("超出缓存而跳过的节点 %1").arg(streaming.unloadableNodes);
+        }
+    }
+
+    QPainter painter(this);
+    painter.setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    const QFontMetrics metrics = painter.fontMetrics();
+    int width = 0;
+    for (const QString& line : lines) {
+        width = std::max(width, metrics.horizontalAdvance(line));
+    }
+    const QRect box(8, 8, width + 16, metrics.height() * lines.size() + 12);
+    painter.fillRect(box, QColor(0, 0, 0, 160));
+    painter.setPen(Qt::white);
+    for (int i = 0; i < lines.size(); ++i) {
+        painter.drawText(box.left() + 8, box.top() + 6 + metrics.ascent() + i * metrics.height(), lines[i]);
+    }
+    painter.end();
 }
 
 void GLFiberWidget::updateMVPMatrix()
@@ -106,11 +387,16 @@ void GLFiberWidget::updateMVPMatrix()
 
     // MVP = Projection * View * Model
     m_mvpMatrix = m_projectionMatrix * m_viewMatrix * m_modelMatrix;
+    m_mvpDirty = false;
+
+    // A different track may now lie under the resting cursor
+    m_hoverPickWanted = m_hoverPicking && underMouse();
 }
 
 void GLFiberWidget::mousePressEvent(QMouseEvent* event)
 {
     m_lastMousePos = event->pos();
+    m_pressMousePos = event->pos();
 }
 
 void GLFiberWidget::mouseMoveEvent(QMouseEvent* event)
@@ -120,15 +406,62 @@ void GLFiberWidget::mouseMoveEvent(QMouseEvent* event)
         int dx = event->x() - m_lastMousePos.x();
         int dy = event->y() - m_lastMousePos.y();
 
-        m_rotationY += dx * 0.5f;
-        m_rotationX += dy * 0.5f;
+        float rotationX = m_rotationX + dy * 0.5f;
+        float rotationY = m_rotationY + dx * 0.5f;
 
         // Clamp rotation
-        if (m_rotationX > 89.0f) m_rotationX = 89.0f;
-        if (m_rotationX < -89.0f) m_rotationX = -89.0f;
+        if (rotationX > 89.0f) rotationX = 89.0f;
+        if (rotationX < -89.0f) rotationX = -89.0f;
 
         m_lastMousePos = event->pos();
-        update();
+
+        // Moves that leave the camera unchanged (e.g. against the clamp) need no frame
+        if (rotationX != m_rotationX || rotationY != m_rotationY) {
+            m_rotationX = rotationX;
+            m_rotationY = rotationY;
+            m_mvpDirty = true;
+            scheduleFrame(true);
+        }
+    } else if (m_hoverPicking && event->buttons() == Qt::NoButton) {
+        m_hoverPos = event->pos();
+        m_hoverPickWanted = true;
+        scheduleFrame(true);
+    }
+}
+
+void GLFiberWidget::mouseReleaseEvent(QMouseEvent* event)
+{
+    // A click rather than the end of a rotation
+    if (event->button() != Qt::LeftButton || (event->pos() - m_pressMousePos).manhattanLength() > 3) {
+        return;
+    }
+    if (!m_fiberRenderer || !m_fiberRenderer->isInitialized()) {
+        return;
+    }
+
+    makeCurrent();
+    if (m_mvpDirty) {
+        updateMVPMatrix();
+    }
+    const qreal ratio = devicePixelRatioF();
+    const GLint viewport[4] = { 0, 0, static_cast<GLint>(width() * ratio), static_cast<GLint>(height() * ratio) };
+    const QPoint pixel = framebufferPixel(event->pos());
+    DTIFiberLib::TrackPickResult result;
+    const bool picked = m_fiberRenderer->pick(m_mvpMatrix.constData(), viewport, pixel.x(), pixel.y(), result);
+    doneCurrent();
+
+    if (picked && result.hit) {
+        emit trackPicked(static_cast<int>(result.trackIndex), static_cast<int>(result.pointIndex),
+                         result.position[0], result.position[1], result.position[2]);
+    }
+}
+
+void GLFiberWidget::leaveEvent(QEvent* event)
+{
+    QOpenGLWidget::leaveEvent(event);
+    if (m_hoverPicking) {
+        m_hoverPickWanted = false;
+        setHoveredTrack(-1);
     }
 }
 
@@ -136,11 +469,15 @@ void GLFiberWidget::wheelEvent(QWheelEvent* event)
 {
     // Zoom in/out
     float delta = event->angleDelta().y() / 120.0f;
-    m_cameraDistance -= delta * 10.0f;
+    float distance = m_cameraDistance - delta * 10.0f;
 
     // Clamp camera distance
-    if (m_cameraDistance < 10.0f) m_cameraDistance = 10.0f;
-    if (m_cameraDistance > 500.0f) m_cameraDistance = 500.0f;
+    if (distance < 10.0f) distance = 10.0f;
+    if (distance > 500.0f) distance = 500.0f;
 
-    update();
+    if (distance != m_cameraDistance) {
+        m_cameraDistance = distance;
+        m_mvpDirty = true;
+        scheduleFrame(true);
+    }
 }
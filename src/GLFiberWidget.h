@@ -5,17 +5,35 @@
 #include <QMatrix4x4>
 #include <QMouseEvent>
 #include <QWheelEvent>
+#include <QElapsedTimer>
+#include <QTimer>
 #include <memory>
 
 // Forward declaration
 namespace DTIFiberLib {
     class GLFiberRenderer;
+    class GLFrameCache;
 }
 
+// Input-to-present latency of camera interaction
+struct FrameLatencyStats {
+    double lastMs;              // Oldest input folded into the latest presented frame
+    double averageMs;           // Exponential moving average
+    double maxMs;               // Since the last reset
+    quint64 presentedFrames;    // Frames that carried camera input
+    quint64 coalescedEvents;    // Input events merged into an already scheduled frame
+};
+
 /**
  * OpenGL Widget for rendering fiber bundles
  * Handles OpenGL context, camera control, and user interaction
  * Note: Uses GLAD for OpenGL function loading (not Qt's OpenGL functions)
+ * Repaints are render-on-demand: camera changes are coalesced into at most one frame
+ * per display refresh, and input that does not change the camera schedules nothing.
+ * Paints with an unchanged scene and camera (expose, overlay toggles, dialogs closing)
+ * blit the last full frame from a GLFrameCache instead of drawing the tracks again.
+ * Hover picking highlights the track under the cursor one frame late, from a pick the
+ * previous frame queued without waiting for it; a click picks immediately.
  */
 class GLFiberWidget : public QOpenGLWidget {
     Q_OBJECT
@@ -27,6 +45,24 @@ public:
     void setFiberRenderer(DTIFiberLib::GLFiberRenderer* renderer);
     void setBoundingBox(float minX, float maxX, float minY, float maxY, float minZ, float maxZ);
 
+    // Schedule a repaint; repeated requests before the next refresh share one frame
+    void requestFrame();
+
+    const FrameLatencyStats& getLatencyStats() const { return m_latencyStats; }
+    void resetLatencyStats();
+
+    // Performance overlay with the renderer's frame statistics
+    void setHudVisible(bool visible);
+    bool isHudVisible() const { return m_hudVisible; }
+
+    // Highlight the track under the cursor
+    void setHoverPickingEnabled(bool enable);
+    bool isHoverPickingEnabled() const { return m_hoverPicking; }
+
+signals:
+    // Left click without dragging on a track
+    void trackPicked(int trackIndex, int pointIndex, float x, float y, float z);
+
 protected:
     // Qt OpenGL interface
     void initializeGL() override;
@@ -36,10 +72,21 @@ protected:
     // Mouse interaction
     void mousePressEvent(QMouseEvent* event) override;
     void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
     void wheelEvent(QWheelEvent* event) override;
+    void leaveEvent(QEvent* event) override;
+
+private slots:
+    void onFrameSwapped();
 
 private:
     void updateMVPMatrix();
+    void drawHud();
+    void updateHoverPick(const GLint* viewport);
+    void setHoveredTrack(int trackIndex);
+    QPoint framebufferPixel(const QPoint& pos) const;   // Origin at the bottom left
+    void scheduleFrame(bool fromInput);
+    qint64 refreshIntervalNs() const;
 
     DTIFiberLib::GLFiberRenderer* m_fiberRenderer;
 
@@ -48,10 +95,33 @@ private:
     float m_rotationX;
     float m_rotationY;
     QPoint m_lastMousePos;
+    QPoint m_pressMousePos;
 
     // Data bounding box center
     float m_centerX, m_centerY, m_centerZ;
 
+    bool m_hudVisible;
+
+    // Hover picking
+    bool m_hoverPicking;
+    bool m_hoverPickWanted;     // Cursor or camera moved since the last queued pick
+    QPoint m_hoverPos;
+    int m_hoveredTrack;         // -1 if none
+    int m_hoveredPoint;
+    float m_hoveredPosition[3];
+
+    // Frame scheduling
+    QTimer m_frameTimer;        // Single shot, fires at the next refresh slot
+    QElapsedTimer m_clock;
+    bool m_frameScheduled;      // A paint is pending (timer running or update() issued)
+    bool m_mvpDirty;
+    qint64 m_pendingInputNs;    // Oldest unpainted input, -1 if none
+    qint64 m_paintedInputNs;    // Input carried by the frame awaiting present, -1 if none
+    qint64 m_lastFrameNs;       // Start of the last paint
+    FrameLatencyStats m_latencyStats;
+
+    std::unique_ptr<DTIFiberLib::GLFrameCache> m_frameCache;    // Created with the context
+
     // Matrices
     QMatrix4x4 m_projectionMatrix;
     QMatrix4x4 m_viewMatrix;
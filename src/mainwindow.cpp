@@ -14,7 +14,16 @@
 #include <QTimer>
 #include <QLabel>
 #include <QDir>
-#include <random>
+#include <QDockWidget>
+#include <QListWidget>
+#include <QComboBox>
+#include <QSlider>
+#include <QPushButton>
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QSignalBlocker>
+#include <chrono>
+#include <cmath>
 #include <algorithm>
 #include <iostream>
 
@@ -24,13 +33,19 @@
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , glWidget(nullptr)
+    , roiIndexStale(true)
     , trkReader(std::make_unique<DTIFiberLib::TrkFileReader>())
     , glFiberRenderer(std::make_unique<DTIFiberLib::GLFiberRenderer>())
+    , roiFilter(std::make_unique<DTIFiberLib::TrackROIFilter>())
+    , trackStats(std::make_unique<DTIFiberLib::TrackStatistics>())
 {
     setWindowTitle("DTI Fiber Viewer - OpenGL");
     resize(800, 600);
 
     createActions();
+    createRoiDock();
+    createSlabDock();
+    createLengthDock();
     createMenus();
     createToolBars();
     createStatusBar();
@@ -64,15 +79,82 @@ void MainWindow::createActions()
     openTrkAct->setShortcut(QKeySequence::Open);
     openTrkAct->setStatusTip("打开TrackVis .trk文件");
     connect(openTrkAct, &QAction::triggered, this, &MainWindow::openTrkFile);
+
+    // 追加TRK文件动作
+    appendTrkAct = new QAction("追加TRK文件(&A)...", this);
+    appendTrkAct->setStatusTip("将另一个.trk文件的纤维束追加到当前场景，不重新加载已有数据");
+    connect(appendTrkAct, &QAction::triggered, this, &MainWindow::appendTrkFile);
+
+    // 流式打开超大TRK文件动作
+    openOutOfCoreAct = new QAction("流式打开超大TRK文件(&L)...", this);
+    openOutOfCoreAct->setStatusTip("将TRK文件预处理为磁盘八叉树，按视图按需加载到固定大小的显存缓存中，适用于千万级纤维束");
+    connect(openOutOfCoreAct, &QAction::triggered, this, &MainWindow::openTrkOutOfCore);
+
+    // 绘制路径基准测试动作
+    benchmarkAct = new QAction("绘制路径基准测试(&B)", this);
+    benchmarkAct->setStatusTip("比较glMultiDrawArrays与图元重启两种绘制路径，并选用较快者");
+    connect(benchmarkAct, &QAction::triggered, this, &MainWindow::runDrawBenchmark);
+
+    // 性能统计叠加层
+    hudAct = new QAction("性能统计(&P)", this);
+    hudAct->setShortcut(QKeySequence(Qt::Key_F3));
+    hudAct->setCheckable(true);
+    hudAct->setStatusTip("在视图中显示每帧CPU/GPU耗时、提交的纤维数和上传数据量");
+    connect(hudAct, &QAction::toggled, [this](bool checked) {
+        if (glWidget) {
+            glWidget->setHudVisible(checked);
+        }
+    });
+
+    // 纤维密度图(TDI)导出
+    tdiAct = new QAction("导出纤维密度图(&D)...", this);
+    tdiAct->setStatusTip("按TRK文件头的参考网格计算全部纤维束的密度图（每体素纤维长度），保存为NIfTI");
+    connect(tdiAct, &QAction::triggered, this, &MainWindow::exportTrackDensity);
+
+    // 缩小视图时自动切换为密度体绘制
+    densityVolumeAct = new QAction("远景密度体绘制(&V)", this);
+    densityVolumeAct->setCheckable(true);
+    densityVolumeAct->setStatusTip("视图缩小、线条严重重叠时，以方向加权的纤维密度体光线投射代替逐条绘制");
+    connect(densityVolumeAct, &QAction::toggled, [this](bool checked) {
+        if (glFiberRenderer) {
+            glFiberRenderer->setRenderMode(checked ? DTIFiberLib::FiberRenderMode::AUTOMATIC
+                                                   : DTIFiberLib::FiberRenderMode::LINES);
+        }
+        if (glWidget) {
+            glWidget->requestFrame();
+        }
+    });
+
+    // 悬停拾取纤维
+    pickAct = new QAction("悬停拾取纤维(&I)", this);
+    pickAct->setCheckable(true);
+    pickAct->setStatusTip("高亮鼠标下方的纤维；单击纤维在状态栏显示其编号、最近点和位置");
+    connect(pickAct, &QAction::toggled, [this](bool checked) {
+        if (glWidget) {
+            glWidget->setHoverPickingEnabled(checked);
+        }
+    });
 }
 
 void MainWindow::createMenus()
 {
     fileMenu = menuBar()->addMenu("文件(&F)");
     fileMenu->addAction(openTrkAct);
+    fileMenu->addAction(appendTrkAct);
+    fileMenu->addAction(openOutOfCoreAct);
     fileMenu->addSeparator();
     fileMenu->addAction(exitAct);
 
+    toolsMenu = menuBar()->addMenu("工具(&T)");
+    toolsMenu->addAction(benchmarkAct);
+    toolsMenu->addAction(hudAct);
+    toolsMenu->addAction(tdiAct);
+    toolsMenu->addAction(densityVolumeAct);
+    toolsMenu->addAction(pickAct);
+    toolsMenu->addAction(roiDock->toggleViewAction());
+    toolsMenu->addAction(slabDock->toggleViewAction());
+    toolsMenu->addAction(lengthDock->toggleViewAction());
+
     helpMenu = menuBar()->addMenu("帮助(&H)");
     helpMenu->addAction(aboutAct);
 }
@@ -100,6 +182,14 @@ void MainWindow::setupOpenGLWidget()
 
         // Set the fiber renderer
         glWidget->setFiberRenderer(glFiberRenderer.get());
+        connect(glWidget, &GLFiberWidget::trackPicked, [this](int track, int point, float x, float y, float z) {
+            statusBar()->showMessage(QString("纤维 %1，点 %2，位置 (%3, %4, %5)")
+                                         .arg(track)
+                                         .arg(point)
+                                         .arg(x, 0, 'f', 1)
+                                         .arg(y, 0, 'f', 1)
+                                         .arg(z, 0, 'f', 1));
+        });
 
         statusBar()->showMessage("OpenGL集成到Qt界面成功！", 2000);
     } catch (const std::exception& e) {
@@ -132,35 +222,28 @@ void MainWindow::openTrkFile()
 
                 const auto& allTracks = trkReader->GetAllTracks();
 
-                // Auto-downsample if too many tracks (>500K)
-                std::vector<DTIFiberLib::FiberTrack> tracksToRender;
-                size_t maxTracks = 500000;  // 50万条限制
-                if (allTracks.size() > maxTracks) {
-                    // Random sampling using reservoir sampling (efficient for large datasets)
-                    tracksToRender.reserve(maxTracks);
-                    std::random_device rd;
-                    std::mt19937 gen(rd());
-
-                    // Reservoir sampling algorithm
-                    for (size_t i = 0; i < allTracks.size(); ++i) {
-                        if (i < maxTracks) {
-                            tracksToRender.push_back(allTracks[i]);
-                        } else {
-                            std::uniform_int_distribution<size_t> dist(0, i);
-                            size_t j = dist(gen);
-                            if (j < maxTracks) {
-                                tracksToRender[j] = allTracks[i];
-                            }
-                        }
+                // Fit the upload to the GPU memory budget: coarser point stride first, then fewer tracks
+                glWidget->makeCurrent();
+                DTIFiberLib::GLMemoryBudget memoryBudget;
+                memoryBudget.queryAvailableBytes();
+                DTIFiberLib::MemoryBudgetPlan budgetPlan = memoryBudget.plan(allTracks, *glFiberRenderer);
+                glWidget->doneCurrent();
+
+                // The renderer draws the selected tracks straight from the reader's data;
+                // an equal quota per spatial/orientation cell keeps thin bundles visible
+                DTIFiberLib::TrackSampler sampler;
+                std::vector<uint32_t> selection = sampler.selectStratified(allTracks, budgetPlan.trackCount);
+                if (budgetPlan.pointStride > 1) {
+                    // Coarser tracks are new data; only the selected ones are built
+                    auto decimated = std::make_shared<std::vector<DTIFiberLib::FiberTrack>>();
+                    decimated->reserve(selection.size());
+                    for (uint32_t index : selection) {
+                        decimated->push_back(DTIFiberLib::GLMemoryBudget::decimate(allTracks[index], budgetPlan.pointStride));
                     }
-
-                    std::cout << "Downsampled " << allTracks.size() << " tracks to "
-                              << tracksToRender.size() << " (reservoir sampling)" << std::endl;
+                    glFiberRenderer->setTracks(decimated, DTIFiberLib::TrackSampler::selectAll(decimated->size()));
                 } else {
-                    tracksToRender = allTracks;
+                    glFiberRenderer->setTracks(trkReader->GetSharedTracks(), std::move(selection));
                 }
-
-                glFiberRenderer->setTracks(tracksToRender);  // This now builds vertex data and calculates bounding box
                 glFiberRenderer->setColorMode(DTIFiberLib::FiberColoringMode::DIRECTION_RGB);
                 glFiberRenderer->setLineWidth(2.0f);
 
@@ -168,12 +251,20 @@ void MainWindow::openTrkFile()
                 float minX, maxX, minY, maxY, minZ, maxZ;
                 glFiberRenderer->getBoundingBox(minX, maxX, minY, maxY, minZ, maxZ);
                 glWidget->setBoundingBox(minX, maxX, minY, maxY, minZ, maxZ);
+                rebuildTrackStatistics();
+                invalidateRoiIndex();
+                updateSlab();
 
                 // Update OpenGL widget
-                glWidget->update();
-
-                QString successMsg = QString("成功加载 %1 条纤维束")
-                    .arg(trackCount);
+                glWidget->requestFrame();
+
+                static const char* kBudgetSources[] = { "NVX", "ATI", "默认值" };
+                QString successMsg = QString("成功加载 %1 条纤维束 (显存预算 %2 MB [%3]，保留 %4%，点间隔 %5)")
+                    .arg(trackCount)
+                    .arg(budgetPlan.budgetBytes >> 20)
+                    .arg(kBudgetSources[static_cast<int>(budgetPlan.source)])
+                    .arg(budgetPlan.fraction * 100.0, 0, 'f', 1)
+                    .arg(budgetPlan.pointStride);
                 statusBar()->showMessage(successMsg, 5000);
 
                 // Export JSON (optional)
@@ -213,4 +304,578 @@ void MainWindow::openTrkFile()
             QString("读取TRK文件时发生异常：%1").arg(e.what()));
         statusBar()->showMessage("读取TRK文件异常", 3000);
     }
-}
\ No newline at end of file
+}
+
+void MainWindow::appendTrkFile()
+{
+    QString fileName = QFileDialog::getOpenFileName(
+        this,
+        "追加TRK文件",
+        "data",
+        "TRK Files (*.trk);;All Files (*)"
+    );
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    statusBar()->showMessage("正在读取TRK文件...", 1000);
+    DTIFiberLib::TrkFileReader reader;
+    if (!reader.LoadTractographyFile(fileName.toStdString())) {
+        QMessageBox::warning(this, "读取失败",
+            QString("无法读取TRK文件：\n%1\n\n错误信息：%2")
+            .arg(fileName)
+            .arg(QString::fromStdString(reader.GetLastErrorMessage())));
+        statusBar()->showMessage("TRK文件读取失败", 3000);
+        return;
+    }
+
+    // Only the new tracks are converted and uploaded
+    glFiberRenderer->appendTracks(reader.GetAllTracks());
+
+    float minX, maxX, minY, maxY, minZ, maxZ;
+    glFiberRenderer->getBoundingBox(minX, maxX, minY, maxY, minZ, maxZ);
+    glWidget->setBoundingBox(minX, maxX, minY, maxY, minZ, maxZ);
+    rebuildTrackStatistics();
+    invalidateRoiIndex();
+    updateSlab();
+    glWidget->requestFrame();
+
+    statusBar()->showMessage(QString("已追加 %1 条纤维束，共 %2 条")
+        .arg(reader.GetTrackCount())
+        .arg(glFiberRenderer->getRenderedTrackCount()), 5000);
+}
+
+void MainWindow::runDrawBenchmark()
+{
+    statusBar()->showMessage("正在运行绘制路径基准测试...");
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+
+    // The benchmark renders offscreen in the widget's OpenGL context
+    glWidget->makeCurrent();
+    DTIFiberLib::GLDrawBenchmark benchmark;
+    std::vector<DTIFiberLib::DrawBenchmarkResult> results = benchmark.run();
+    glWidget->doneCurrent();
+
+    QApplication::restoreOverrideCursor();
+
+    QString report;
+    for (const auto& result : results) {
+        if (result.completed) {
+            report += QString("%1 条: MultiDraw CPU %2 ms / GPU %3 ms, 图元重启 CPU %4 ms / GPU %5 ms\n")
+                .arg(result.trackCount)
+                .arg(result.multiDrawCpuMs, 0, 'f', 2)
+                .arg(result.multiDrawGpuMs, 0, 'f', 2)
+                .arg(result.restartCpuMs, 0, 'f', 2)
+                .arg(result.restartGpuMs, 0, 'f', 2);
+        } else {
+            report += QString("%1 条: 内存或显存不足，已跳过\n").arg(result.trackCount);
+        }
+    }
+
+    DTIFiberLib::FiberDrawPath path = DTIFiberLib::GLDrawBenchmark::recommendedPath(results);
+    glFiberRenderer->setDrawPath(path);
+    glWidget->requestFrame();
+
+    QString pathName = (path == DTIFiberLib::FiberDrawPath::PRIMITIVE_RESTART) ? "图元重启 glDrawElements" : "glMultiDrawArrays";
+    QMessageBox::information(this, "绘制路径基准测试",
+        QString("%1\n已选用: %2").arg(report).arg(pathName));
+    statusBar()->showMessage("基准测试完成，已选用 " + pathName, 5000);
+}
+
+void MainWindow::openTrkOutOfCore()
+{
+    QString fileName = QFileDialog::getOpenFileName(
+        this,
+        "流式打开超大TRK文件",
+        "data",
+        "TRK Files (*.trk);;All Files (*)"
+    );
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    // The octree sits next to the source and is rebuilt when the source is newer
+    const QFileInfo trkInfo(fileName);
+    const QString octreePath = trkInfo.absolutePath() + "/" + trkInfo.completeBaseName() + ".tko";
+    auto buildOctree = [&]() {
+        statusBar()->showMessage("正在生成纤维八叉树...");
+        QApplication::setOverrideCursor(Qt::WaitCursor);
+        DTIFiberLib::TrackOctreeBuilder builder;
+        bool built = builder.build(fileName.toStdString(), octreePath.toStdString());
+        QApplication::restoreOverrideCursor();
+        if (!built) {
+            QMessageBox::warning(this, "打开失败",
+                QString("无法生成纤维八叉树：\n%1\n\n%2")
+                .arg(octreePath)
+                .arg(QString::fromStdString(builder.getLastErrorMessage())));
+            statusBar()->showMessage("纤维八叉树生成失败", 3000);
+        }
+        return built;
+    };
+    const QFileInfo octreeInfo(octreePath);
+    bool rebuilt = false;
+    if (!octreeInfo.exists() || octreeInfo.lastModified() < trkInfo.lastModified()) {
+        if (!buildOctree()) {
+            return;
+        }
+        rebuilt = true;
+    }
+
+    bool opened = glFiberRenderer->openOutOfCore(octreePath.toStdString());
+    if (!opened && !rebuilt) {
+        // A cached octree that no longer reads (truncated or from an older build) is rebuilt once
+        if (!buildOctree()) {
+            return;
+        }
+        opened = glFiberRenderer->openOutOfCore(octreePath.toStdString());
+    }
+    if (!opened) {
+        QMessageBox::warning(this, "打开失败", QString("无法读取纤维八叉树：\n%1").arg(octreePath));
+        return;
+    }
+    glFiberRenderer->setColorMode(DTIFiberLib::FiberColoringMode::DIRECTION_RGB);
+    glFiberRenderer->setLineWidth(1.0f);
+
+    float minX, maxX, minY, maxY, minZ, maxZ;
+    glFiberRenderer->getBoundingBox(minX, maxX, minY, maxY, minZ, maxZ);
+    glWidget->setBoundingBox(minX, maxX, minY, maxY, minZ, maxZ);
+    rebuildTrackStatistics();
+    invalidateRoiIndex();
+    updateSlab();
+    glWidget->requestFrame();
+
+    statusBar()->showMessage(QString("流式显示 %1 条纤维束，%2 个点")
+        .arg(glFiberRenderer->getRenderedTrackCount())
+        .arg(glFiberRenderer->getTotalPointCount()), 5000);
+}
+
+void MainWindow::exportTrackDensity()
+{
+    if (!trkReader->IsValidFile() || trkReader->GetTrackCount() == 0) {
+        QMessageBox::information(this, "导出纤维密度图", "请先打开TRK文件。");
+        return;
+    }
+
+    QString fileName = QFileDialog::getSaveFileName(
+        this,
+        "导出纤维密度图",
+        "data/track_density.nii",
+        "NIfTI (*.nii *.nii.gz)"
+    );
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    statusBar()->showMessage("正在计算纤维密度图...");
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+
+    // All tracks of the file, not just the subset uploaded for display
+    DTIFiberLib::TrackDensityImager imager;
+    bool ok = imager.setGridFromHeader(trkReader->GetHeader()) &&
+              imager.compute(trkReader->GetAllTracks()) &&
+              imager.writeNifti(fileName.toStdString());
+
+    QApplication::restoreOverrideCursor();
+
+    if (!ok) {
+        QMessageBox::warning(this, "导出失败",
+            QString("无法导出纤维密度图：\n%1\n\n%2")
+            .arg(fileName)
+            .arg(QString::fromStdString(imager.getLastErrorMessage())));
+        statusBar()->showMessage("纤维密度图导出失败", 3000);
+        return;
+    }
+
+    const DTIFiberLib::DensityGrid& grid = imager.getGrid();
+    statusBar()->showMessage(QString("纤维密度图 %1x%2x%3 已导出，耗时 %4 ms")
+        .arg(grid.dim[0])
+        .arg(grid.dim[1])
+        .arg(grid.dim[2])
+        .arg(imager.getElapsedMs(), 0, 'f', 0), 5000);
+}
+
+void MainWindow::createRoiDock()
+{
+    // ROI筛选面板：球形/立方体ROI，包含(AND)/排除(NOT)，拖动滑块实时筛选
+    roiDock = new QDockWidget("ROI筛选", this);
+    roiDock->setObjectName("roiDock");
+    roiDock->toggleViewAction()->setText("ROI筛选(&R)");
+    roiDock->toggleViewAction()->setStatusTip("用球形/立方体ROI按包含/排除逻辑筛选纤维束，拖动时实时更新");
+
+    QWidget *panel = new QWidget(roiDock);
+    QVBoxLayout *layout = new QVBoxLayout(panel);
+    roiList = new QListWidget(panel);
+    layout->addWidget(roiList);
+
+    QHBoxLayout *buttons = new QHBoxLayout();
+    QPushButton *addSphereButton = new QPushButton("添加球形", panel);
+    QPushButton *addBoxButton = new QPushButton("添加立方体", panel);
+    QPushButton *removeButton = new QPushButton("删除", panel);
+    buttons->addWidget(addSphereButton);
+    buttons->addWidget(addBoxButton);
+    buttons->addWidget(removeButton);
+    layout->addLayout(buttons);
+
+    QFormLayout *form = new QFormLayout();
+    roiModeBox = new QComboBox(panel);
+    roiModeBox->addItem("包含 (AND)");
+    roiModeBox->addItem("排除 (NOT)");
+    form->addRow("模式", roiModeBox);
+    static const char *kSliderNames[] = { "X (mm)", "Y (mm)", "Z (mm)", "半径/半边长" };
+    for (int i = 0; i < 4; ++i) {
+        roiSliders[i] = new QSlider(Qt::Horizontal, panel);
+        form->addRow(kSliderNames[i], roiSliders[i]);
+        connect(roiSliders[i], &QSlider::valueChanged, [this](int) { updateSelectedRoi(); });
+    }
+    roiSliders[3]->setRange(1, 60);
+    layout->addLayout(form);
+
+    roiStatusLabel = new QLabel(panel);
+    layout->addWidget(roiStatusLabel);
+    layout->addStretch();
+    roiDock->setWidget(panel);
+    addDockWidget(Qt::RightDockWidgetArea, roiDock);
+    roiDock->hide();
+
+    connect(addSphereButton, &QPushButton::clicked, [this]() { addRoi(DTIFiberLib::ROIShape::SPHERE); });
+    connect(addBoxButton, &QPushButton::clicked, [this]() { addRoi(DTIFiberLib::ROIShape::BOX); });
+    connect(removeButton, &QPushButton::clicked, this, &MainWindow::removeSelectedRoi);
+    connect(roiList, &QListWidget::currentRowChanged, [this](int) { syncRoiControls(); });
+    connect(roiModeBox, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int) { updateSelectedRoi(); });
+    // The index is built the first time the panel is shown, not with every file
+    connect(roiDock, &QDockWidget::visibilityChanged, [this](bool visible) {
+        if (visible && roiIndexStale) {
+            rebuildRoiIndex();
+        }
+    });
+    syncRoiControls();
+}
+
+static QString roiLabel(const DTIFiberLib::TrackROI& roi, int number)
+{
+    return QString("%1 %2  %3")
+        .arg(roi.shape == DTIFiberLib::ROIShape::SPHERE ? "球形" : "立方体")
+        .arg(number)
+        .arg(roi.mode == DTIFiberLib::ROIMode::INCLUDE ? "包含" : "排除");
+}
+
+void MainWindow::invalidateRoiIndex()
+{
+    roiIndexStale = true;
+    if (roiDock->isVisible()) {
+        rebuildRoiIndex();
+    }
+}
+
+void MainWindow::rebuildRoiIndex()
+{
+    roiIndexStale = false;
+    if (glFiberRenderer->isOutOfCore()) {
+        roiFilter->clear();
+        roiStatusLabel->setText("流式模式下不支持ROI筛选");
+        return;
+    }
+
+    // Indexed like the renderer, straight from its track data
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    roiFilter->build(glFiberRenderer->getTrackSource(), glFiberRenderer->getTrackSelection(),
+                     glFiberRenderer->getAppendedTracks());
+    QApplication::restoreOverrideCursor();
+
+    float bounds[6];
+    glFiberRenderer->getBoundingBox(bounds[0], bounds[1], bounds[2], bounds[3], bounds[4], bounds[5]);
+    for (int a = 0; a < 3; ++a) {
+        const QSignalBlocker blocker(roiSliders[a]);
+        roiSliders[a]->setRange(static_cast<int>(std::floor(bounds[a * 2])), static_cast<int>(std::ceil(bounds[a * 2 + 1])));
+    }
+    syncRoiControls();
+
+    // Existing ROIs apply to the new tracks; every flag is set once
+    std::vector<uint8_t> visible = roiFilter->evaluate();
+    for (size_t i = 0; i < lengthMask.size() && i < visible.size(); ++i) {
+        visible[i] &= lengthMask[i];
+    }
+    glFiberRenderer->setTrackVisibility(visible);
+    applyRoiFilter();
+    statusBar()->showMessage(QString("ROI索引：%1 条纤维，%2 个点段，耗时 %3 ms")
+        .arg(roiFilter->getTrackCount())
+        .arg(roiFilter->getIndexEntryCount())
+        .arg(roiFilter->getBuildMs(), 0, 'f', 0), 5000);
+}
+
+void MainWindow::addRoi(DTIFiberLib::ROIShape shape)
+{
+    if (roiIndexStale) {
+        rebuildRoiIndex();
+    }
+    if (!roiFilter->isBuilt()) {
+        return;
+    }
+
+    // New ROIs start at the center of the data
+    DTIFiberLib::TrackROI roi;
+    roi.shape = shape;
+    roi.mode = DTIFiberLib::ROIMode::INCLUDE;
+    for (int a = 0; a < 3; ++a) {
+        roi.center[a] = static_cast<float>((roiSliders[a]->minimum() + roiSliders[a]->maximum()) / 2);
+        roi.size[a] = 10.0f;
+    }
+    const size_t index = roiFilter->addROI(roi);
+    roiList->addItem(roiLabel(roi, static_cast<int>(index) + 1));
+    roiList->setCurrentRow(static_cast<int>(index));
+    applyRoiFilter();
+}
+
+void MainWindow::removeSelectedRoi()
+{
+    const int row = roiList->currentRow();
+    if (row < 0) {
+        return;
+    }
+    roiFilter->removeROI(static_cast<size_t>(row));
+    delete roiList->takeItem(row);
+    for (int i = 0; i < roiList->count(); ++i) {
+        roiList->item(i)->setText(roiLabel(roiFilter->getROI(static_cast<size_t>(i)), i + 1));
+    }
+    applyRoiFilter();
+}
+
+void MainWindow::syncRoiControls()
+{
+    const int row = roiList->currentRow();
+    const bool selected = row >= 0 && static_cast<size_t>(row) < roiFilter->getROICount();
+    roiModeBox->setEnabled(selected);
+    for (QSlider *slider : roiSliders) {
+        slider->setEnabled(selected);
+    }
+    if (!selected) {
+        return;
+    }
+
+    const DTIFiberLib::TrackROI& roi = roiFilter->getROI(static_cast<size_t>(row));
+    const QSignalBlocker modeBlocker(roiModeBox);
+    roiModeBox->setCurrentIndex(roi.mode == DTIFiberLib::ROIMode::INCLUDE ? 0 : 1);
+    for (int a = 0; a < 3; ++a) {
+        const QSignalBlocker blocker(roiSliders[a]);
+        roiSliders[a]->setValue(static_cast<int>(std::lround(roi.center[a])));
+    }
+    const QSignalBlocker sizeBlocker(roiSliders[3]);
+    roiSliders[3]->setValue(static_cast<int>(std::lround(roi.size[0])));
+}
+
+void MainWindow::updateSelectedRoi()
+{
+    const int row = roiList->currentRow();
+    if (row < 0 || static_cast<size_t>(row) >= roiFilter->getROICount()) {
+        return;
+    }
+
+    DTIFiberLib::TrackROI roi = roiFilter->getROI(static_cast<size_t>(row));
+    roi.mode = roiModeBox->currentIndex() == 0 ? DTIFiberLib::ROIMode::INCLUDE : DTIFiberLib::ROIMode::EXCLUDE;
+    for (int a = 0; a < 3; ++a) {
+        roi.center[a] = static_cast<float>(roiSliders[a]->value());
+        roi.size[a] = static_cast<float>(roiSliders[3]->value());
+    }
+    roiFilter->setROI(static_cast<size_t>(row), roi);
+    roiList->item(row)->setText(roiLabel(roi, row + 1));
+    applyRoiFilter();
+}
+
+void MainWindow::applyRoiFilter()
+{
+    if (!roiFilter->isBuilt()) {
+        return;
+    }
+
+    // Only tracks whose result flipped change their visibility flag; vertex data stays
+    const std::vector<uint8_t>& visible = roiFilter->evaluate();
+    for (uint32_t track : roiFilter->getChangedTracks()) {
+        glFiberRenderer->setTrackVisible(track, visible[track] != 0 && isLengthVisible(track));
+    }
+    if (glWidget) {
+        glWidget->requestFrame();
+    }
+
+    roiStatusLabel->setText(QString("显示 %1 / %2 条纤维\n筛选耗时 %3 ms")
+        .arg(roiFilter->getSelectedCount())
+        .arg(roiFilter->getTrackCount())
+        .arg(roiFilter->getEvaluateMs(), 0, 'f', 2));
+}
+
+void MainWindow::createSlabDock()
+{
+    // 剖切面板：沿坐标轴的薄层视图，由两个裁剪平面限定，完全在层外的纤维不提交绘制
+    slabDock = new QDockWidget("剖切视图", this);
+    slabDock->setObjectName("slabDock");
+    slabDock->toggleViewAction()->setText("剖切视图(&S)");
+    slabDock->toggleViewAction()->setStatusTip("只显示沿X/Y/Z轴的一层纤维，面板关闭时取消剖切");
+
+    QWidget *panel = new QWidget(slabDock);
+    QVBoxLayout *layout = new QVBoxLayout(panel);
+    QFormLayout *form = new QFormLayout();
+    slabAxisBox = new QComboBox(panel);
+    slabAxisBox->addItem("X (矢状)");
+    slabAxisBox->addItem("Y (冠状)");
+    slabAxisBox->addItem("Z (轴位)");
+    form->addRow("方向", slabAxisBox);
+    static const char *kSliderNames[] = { "位置", "厚度 (mm)" };
+    for (int i = 0; i < 2; ++i) {
+        slabSliders[i] = new QSlider(Qt::Horizontal, panel);
+        form->addRow(kSliderNames[i], slabSliders[i]);
+    }
+    slabSliders[0]->setRange(0, 1000);
+    slabSliders[0]->setValue(500);
+    slabSliders[1]->setRange(1, 100);
+    slabSliders[1]->setValue(10);
+    layout->addLayout(form);
+
+    slabStatusLabel = new QLabel(panel);
+    layout->addWidget(slabStatusLabel);
+    layout->addStretch();
+    slabDock->setWidget(panel);
+    addDockWidget(Qt::RightDockWidgetArea, slabDock);
+    slabDock->hide();
+
+    for (QSlider *slider : slabSliders) {
+        connect(slider, &QSlider::valueChanged, [this](int) { updateSlab(); });
+    }
+    connect(slabAxisBox, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int) { updateSlab(); });
+    connect(slabDock, &QDockWidget::visibilityChanged, [this](bool) { updateSlab(); });
+}
+
+void MainWindow::updateSlab()
+{
+    // A tabbed-away panel still clips; closing it removes the planes
+    if (slabDock->isHidden() || glFiberRenderer->isOutOfCore()) {
+        glFiberRenderer->clearClipPlanes();
+        slabStatusLabel->setText(glFiberRenderer->isOutOfCore() ? "流式模式下不支持剖切" : "");
+    } else {
+        float bounds[6];
+        glFiberRenderer->getBoundingBox(bounds[0], bounds[1], bounds[2], bounds[3], bounds[4], bounds[5]);
+        const int axis = slabAxisBox->currentIndex();
+        const float normal[3] = { axis == 0 ? 1.0f : 0.0f, axis == 1 ? 1.0f : 0.0f, axis == 2 ? 1.0f : 0.0f };
+        const float center = bounds[axis * 2] + (bounds[axis * 2 + 1] - bounds[axis * 2]) * slabSliders[0]->value() / 1000.0f;
+        const float thickness = static_cast<float>(slabSliders[1]->value());
+        glFiberRenderer->setSlab(normal, center, thickness);
+        slabStatusLabel->setText(QString("中心 %1 mm，厚度 %2 mm").arg(center, 0, 'f', 1).arg(thickness, 0, 'f', 0));
+    }
+    if (glWidget) {
+        glWidget->requestFrame();
+    }
+}
+
+void MainWindow::createLengthDock()
+{
+    // 长度筛选面板：按纤维长度区间显示，查询走预先排序的统计表
+    lengthDock = new QDockWidget("长度筛选", this);
+    lengthDock->setObjectName("lengthDock");
+    lengthDock->toggleViewAction()->setText("长度筛选(&L)");
+    lengthDock->toggleViewAction()->setStatusTip("只显示长度在给定区间内的纤维束，可与ROI筛选叠加");
+
+    QWidget *panel = new QWidget(lengthDock);
+    QVBoxLayout *layout = new QVBoxLayout(panel);
+    QFormLayout *form = new QFormLayout();
+    static const char *kSliderNames[] = { "最短长度 (mm)", "最长长度 (mm)" };
+    for (int i = 0; i < 2; ++i) {
+        lengthSliders[i] = new QSlider(Qt::Horizontal, panel);
+        lengthSliders[i]->setRange(0, 0);
+        form->addRow(kSliderNames[i], lengthSliders[i]);
+        connect(lengthSliders[i], &QSlider::valueChanged, [this](int) { applyLengthFilter(); });
+    }
+    layout->addLayout(form);
+
+    lengthStatusLabel = new QLabel(panel);
+    layout->addWidget(lengthStatusLabel);
+    layout->addStretch();
+    lengthDock->setWidget(panel);
+    addDockWidget(Qt::RightDockWidgetArea, lengthDock);
+    lengthDock->hide();
+}
+
+void MainWindow::rebuildTrackStatistics()
+{
+    // A new track set starts unfiltered; the ROI index is rebuilt after this
+    if (!lengthMask.empty()) {
+        lengthMask.clear();
+        glFiberRenderer->setAllTracksVisible(true);
+    }
+
+    const std::shared_ptr<const std::vector<DTIFiberLib::FiberTrack>> source = glFiberRenderer->getTrackSource();
+    if (glFiberRenderer->isOutOfCore() || !source) {
+        trackStats->clear();
+        for (QSlider *slider : lengthSliders) {
+            const QSignalBlocker blocker(slider);
+            slider->setRange(0, 0);
+        }
+        lengthStatusLabel->setText("流式模式下不支持长度筛选");
+        return;
+    }
+
+    // Indexed like the renderer, so a selected range maps straight onto its visibility flags
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    trackStats->build(*source, glFiberRenderer->getTrackSelection(), glFiberRenderer->getAppendedTracks().get());
+    QApplication::restoreOverrideCursor();
+
+    float shortest = 0.0f, longest = 0.0f;
+    trackStats->getRange(DTIFiberLib::TrackStatistics::LENGTH, shortest, longest);
+    const int lower = static_cast<int>(std::floor(shortest));
+    const int upper = static_cast<int>(std::ceil(longest));
+    for (int i = 0; i < 2; ++i) {
+        const QSignalBlocker blocker(lengthSliders[i]);
+        lengthSliders[i]->setRange(lower, upper);
+        lengthSliders[i]->setValue(i == 0 ? lower : upper);
+    }
+    lengthStatusLabel->setText(QString("%1 条纤维，长度 %2 - %3 mm\n统计耗时 %4 ms")
+        .arg(trackStats->getTrackCount())
+        .arg(shortest, 0, 'f', 1)
+        .arg(longest, 0, 'f', 1)
+        .arg(trackStats->getBuildMs(), 0, 'f', 0));
+}
+
+bool MainWindow::isLengthVisible(uint32_t track) const
+{
+    return lengthMask.empty() || (track < lengthMask.size() && lengthMask[track] != 0);
+}
+
+void MainWindow::applyLengthFilter()
+{
+    if (!trackStats->isBuilt()) {
+        return;
+    }
+
+    // Sliders at both ends show every track; otherwise the sorted lengths give the mask
+    const int shortest = lengthSliders[0]->value();
+    const int longest = lengthSliders[1]->value();
+    const auto start = std::chrono::steady_clock::now();
+    if (shortest <= lengthSliders[0]->minimum() && longest >= lengthSliders[1]->maximum()) {
+        lengthMask.clear();
+    } else {
+        trackStats->selectRange(DTIFiberLib::TrackStatistics::LENGTH, static_cast<float>(shortest), static_cast<float>(longest), lengthMask);
+    }
+    const double queryMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // Combined with the ROI result; only the flags that differ are uploaded
+    std::vector<uint8_t> visible = lengthMask;
+    if (visible.empty()) {
+        visible.assign(trackStats->getTrackCount(), 1);
+    }
+    if (roiFilter->isBuilt() && !roiIndexStale) {
+        const std::vector<uint8_t>& roiVisible = roiFilter->evaluate();
+        for (size_t i = 0; i < visible.size() && i < roiVisible.size(); ++i) {
+            visible[i] &= roiVisible[i];
+        }
+    }
+    glFiberRenderer->setTrackVisibility(visible);
+    if (glWidget) {
+        glWidget->requestFrame();
+    }
+
+    const size_t shown = lengthMask.empty() ? trackStats->getTrackCount()
+        : trackStats->countRange(DTIFiberLib::TrackStatistics::LENGTH, static_cast<float>(shortest), static_cast<float>(longest));
+    lengthStatusLabel->setText(QString("长度 %1 - %2 mm：%3 / %4 条纤维\n查询耗时 %5 ms")
+        .arg(shortest)
+        .arg(longest)
+        .arg(shown)
+        .arg(trackStats->getTrackCount())
+        .arg(queryMs, 0, 'f', 2));
+}
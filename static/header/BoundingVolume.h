@@ -0,0 +1,112 @@
+#ifndef BOUNDINGVOLUME_H
+#define BOUNDINGVOLUME_H
+
+#include <algorithm>
+
+namespace DTIFiberLib {
+
+/**
+ * Axis-aligned bounding box
+ * Starts empty (min > max) so the first expand() initializes it
+ */
+struct BoundingBox {
+    float min[3];
+    float max[3];
+
+    BoundingBox() { reset(); }
+
+    void reset()
+    {
+        min[0] = min[1] = min[2] = 1e30f;
+        max[0] = max[1] = max[2] = -1e30f;
+    }
+
+    void expand(float x, float y, float z)
+    {
+        min[0] = std::min(min[0], x); max[0] = std::max(max[0], x);
+        min[1] = std::min(min[1], y); max[1] = std::max(max[1], y);
+        min[2] = std::min(min[2], z); max[2] = std::max(max[2], z);
+    }
+
+    void expand(const BoundingBox& other)
+    {
+        for (int i = 0; i < 3; ++i) {
+            min[i] = std::min(min[i], other.min[i]);
+            max[i] = std::max(max[i], other.max[i]);
+        }
+    }
+
+    bool isValid() const { return min[0] <= max[0] && min[1] <= max[1] && min[2] <= max[2]; }
+
+    float center(int axis) const { return (min[axis] + max[axis]) * 0.5f; }
+};
+
+/**
+ * View frustum extracted from a column-major Model-View-Projection matrix
+ * Planes are stored as (a, b, c, d) with the inside satisfying ax + by + cz + d >= 0.
+ * Clip planes can be added after the six view planes; a frustum without any planes
+ * contains everything.
+ */
+struct Frustum {
+    enum Containment {
+        OUTSIDE,
+        INTERSECTS,
+        INSIDE
+    };
+
+    static const int kMaxPlanes = 12;
+
+    float planes[kMaxPlanes][4];
+    int planeCount;
+
+    Frustum() : planeCount(0) {}
+
+    // Replaces all planes with the six view planes (left, right, bottom, top, near, far)
+    void extract(const float* mvp)
+    {
+        // Row r of a column-major matrix is (m[r], m[4 + r], m[8 + r], m[12 + r])
+        for (int p = 0; p < 6; ++p) {
+            int row = p / 2;
+            float sign = (p % 2 == 0) ? 1.0f : -1.0f;
+            for (int c = 0; c < 4; ++c) {
+                planes[p][c] = mvp[c * 4 + 3] + sign * mvp[c * 4 + row];
+            }
+        }
+        planeCount = 6;
+    }
+
+    bool addPlane(const float* plane)
+    {
+        if (planeCount >= kMaxPlanes) return false;
+        std::copy(plane, plane + 4, planes[planeCount++]);
+        return true;
+    }
+
+    Containment classify(const BoundingBox& box) const
+    {
+        Containment result = INSIDE;
+        for (int p = 0; p < planeCount; ++p) {
+            const float* pl = planes[p];
+
+            // Box corner furthest along the plane normal (p-vertex) and its opposite (n-vertex)
+            float px = pl[0] >= 0.0f ? box.max[0] : box.min[0];
+            float py = pl[1] >= 0.0f ? box.max[1] : box.min[1];
+            float pz = pl[2] >= 0.0f ? box.max[2] : box.min[2];
+            if (pl[0] * px + pl[1] * py + pl[2] * pz + pl[3] < 0.0f) {
+                return OUTSIDE;
+            }
+
+            float nx = pl[0] >= 0.0f ? box.min[0] : box.max[0];
+            float ny = pl[1] >= 0.0f ? box.min[1] : box.max[1];
+            float nz = pl[2] >= 0.0f ? box.min[2] : box.max[2];
+            if (pl[0] * nx + pl[1] * ny + pl[2] * nz + pl[3] < 0.0f) {
+                result = INTERSECTS;
+            }
+        }
+        return result;
+    }
+};
+
+} // namespace DTIFiberLib
+
+#endif // BOUNDINGVOLUME_H
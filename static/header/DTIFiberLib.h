@@ -9,6 +9,21 @@
  * - TRK file reading and parsing (TrkFileReader)
  * - OpenGL fiber bundle rendering (GLFiberRenderer)
  * - OpenGL shader management (GLShaderProgram)
+ * - Spatial chunking and frustum culling of tracks (TrackChunkBVH)
+ * - Draw path benchmarking (GLDrawBenchmark)
+ * - Per-frame CPU/GPU profiling (GLFrameProfiler)
+ * - Offscreen snapshots with camera presets and PNG output (GLSnapshotRenderer, PngWriter)
+ * - Reuse of the last full frame for redraws with unchanged scene state (GLFrameCache)
+ * - Multi-threaded track density imaging with NIfTI output (TrackDensityImager, NiftiWriter)
+ * - Raymarched density volume in place of lines for zoomed-out views (GLDensityVolume)
+ * - Out-of-core octree preprocessing and streaming for 10M+ track datasets (TrackOctreeBuilder, GLTrackStreamer)
+ * - GPU memory budget choosing point stride and track fraction for uploads (GLMemoryBudget)
+ * - Random and coverage-preserving stratified track index selections, drawn without copying (TrackSampler)
+ * - Track, point and position picking under the cursor through a small id target (GLTrackPicker)
+ * - Sphere/box ROI include/exclude filtering over a voxel-to-track inverted index (TrackROIFilter)
+ * - Linear BVH over track segments for ray, box and nearest-segment queries (SegmentBVH)
+ * - Columnar per-track statistics with sorted range queries (TrackStatistics)
+ * - Headless EGL context, with DTIFIBERLIB_HEADLESS (GLHeadlessContext)
  *
  * Version: 2.0.0 - OpenGL Implementation
  * Author: DTI Visualization Project
@@ -18,6 +33,26 @@
 #include "TrkFileReader.h"
 #include "GLFiberRenderer.h"
 #include "GLShaderProgram.h"
+#include "TrackChunkBVH.h"
+#include "GLDrawBenchmark.h"
+#include "GLFrameProfiler.h"
+#include "GLSnapshotRenderer.h"
+#include "PngWriter.h"
+#include "GLFrameCache.h"
+#include "TrackDensityImager.h"
+#include "NiftiWriter.h"
+#include "GLDensityVolume.h"
+#include "TrackOctreeBuilder.h"
+#include "GLTrackStreamer.h"
+#include "GLMemoryBudget.h"
+#include "TrackSampler.h"
+#include "GLTrackPicker.h"
+#include "TrackROIFilter.h"
+#include "SegmentBVH.h"
+#include "TrackStatistics.h"
+#ifdef DTIFIBERLIB_HEADLESS
+#include "GLHeadlessContext.h"
+#endif
 
 // Library version information
 #define DTIFIBERLIB_VERSION_MAJOR 2
@@ -0,0 +1,59 @@
+#ifndef GLDENSITYVOLUME_H
+#define GLDENSITYVOLUME_H
+
+#include "TrkFileReader.h"
+#include "GLShaderProgram.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glad/glad.h>
+
+namespace DTIFiberLib {
+
+/**
+ * Density Volume
+ * Direction-weighted track density (TrackDensityImager) on a grid fitted to the data,
+ * stored as an RGBA16F 3D texture: |direction|-weighted lengths in RGB, length in A,
+ * scaled so the 99th percentile of occupied voxels is 1. Drawing raymarches it with a
+ * fixed step budget, so the cost depends on the screen size and not on the track count.
+ */
+class GLDensityVolume {
+public:
+    GLDensityVolume();
+    ~GLDensityVolume();
+
+    bool initialize();  // Needs a current context
+    void cleanup();
+    bool isAvailable() const { return m_shader != nullptr; }
+
+    // Longest box axis gets `resolution` voxels; empty selection clears the volume.
+    // Selection indices past the end of `tracks` address `appended`
+    bool build(const std::vector<FiberTrack>& tracks, const std::vector<uint32_t>& selection,
+               const float* boundsMin, const float* boundsMax, int resolution,
+               const std::vector<FiberTrack>* appended = nullptr);
+    bool isBuilt() const { return m_built; }
+
+    // Into the current framebuffer; direction colors, or the colormap bound to texture unit 2
+    void draw(const float* mvpMatrix, const GLint* viewport, bool colorByDirection);
+
+    void setOpacityScale(float scale) { m_opacityScale = scale; }  // Extinction per voxel at the reference density
+    float getOpacityScale() const { return m_opacityScale; }
+
+    size_t getTextureBytes() const;
+    double getBuildMs() const { return m_buildMs; }
+
+private:
+    std::unique_ptr<GLShaderProgram> m_shader;
+    GLuint m_texture;
+    GLuint m_VAO;           // Empty; the full-screen triangle comes from gl_VertexID
+    bool m_built;
+    int m_dim[3];
+    float m_origin[3];      // World-space corner of voxel (0, 0, 0)
+    float m_extent[3];      // World-space size of the whole grid
+    float m_opacityScale;
+    double m_buildMs;
+};
+
+} // namespace DTIFiberLib
+
+#endif // GLDENSITYVOLUME_H
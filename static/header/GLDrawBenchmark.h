@@ -0,0 +1,62 @@
+#ifndef GLDRAWBENCHMARK_H
+#define GLDRAWBENCHMARK_H
+
+#include "GLFiberRenderer.h"
+#include <vector>
+#include <glad/glad.h>
+
+namespace DTIFiberLib {
+
+/**
+ * Timing of both track submission paths for one synthetic dataset size
+ * CPU times cover the draw calls only; GPU times come from GL_TIME_ELAPSED queries
+ */
+struct DrawBenchmarkResult {
+    size_t trackCount;
+    size_t vertexCount;
+    double multiDrawCpuMs;
+    double multiDrawGpuMs;
+    double restartCpuMs;
+    double restartGpuMs;
+    bool completed;     // False if the dataset did not fit in host or GPU memory
+};
+
+/**
+ * Draw Path Benchmark
+ * Renders synthetic random-walk tracks offscreen with glMultiDrawArrays and with a
+ * single primitive-restart glDrawElements, so the faster path can be chosen per driver.
+ * Requires a current OpenGL context.
+ */
+class GLDrawBenchmark {
+public:
+    GLDrawBenchmark();
+    ~GLDrawBenchmark();
+
+    void setTrackCounts(const std::vector<size_t>& counts);  // Default: 10K, 100K, 1M, 10M
+    void setPointsPerTrack(size_t points);
+    void setFrameCount(int frames);
+
+    std::vector<DrawBenchmarkResult> run();
+
+    // Path with the lower total frame cost (slower of CPU submit and GPU time) over completed sizes
+    static FiberDrawPath recommendedPath(const std::vector<DrawBenchmarkResult>& results);
+
+private:
+    bool createTarget();
+    void destroyTarget();
+    DrawBenchmarkResult runSize(size_t trackCount);
+
+    std::vector<size_t> m_trackCounts;
+    size_t m_pointsPerTrack;
+    int m_frameCount;
+
+    GLShaderProgram m_shader;
+    GLuint m_FBO;
+    GLuint m_colorRBO;
+    GLuint m_depthRBO;
+    GLuint m_query;
+};
+
+} // namespace DTIFiberLib
+
+#endif // GLDRAWBENCHMARK_H
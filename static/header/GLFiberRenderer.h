@@ -3,16 +3,46 @@
 
 #include "TrkFileReader.h"
 #include "GLShaderProgram.h"
+#include "TrackChunkBVH.h"
+#include "GLFrameProfiler.h"
+#include "GLDensityVolume.h"
+#include "GLTrackStreamer.h"
+#include "GLTrackPicker.h"
+#include <chrono>
+#include <cstdint>
+#include <map>
 #include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 #include <glad/glad.h>
 
 namespace DTIFiberLib {
 
+// Values match COLOR_MODE in the track shader permutations
 enum class FiberColoringMode {
     SOLID_COLOR,
     DIRECTION_RGB,
-    RANDOM_COLORS
+    RANDOM_COLORS,      // Stable hash of the track index
+    BUNDLE_COLORS,      // Stable hash of the bundle id set with setTrackBundle()
+    CUSTOM_COLORS,      // Colors set with setTrackColor()
+    SCALAR_COLORMAP     // Per-point scalar selected with setScalarIndex(), through the colormap
+};
+
+enum class FiberDrawPath {
+    MULTI_DRAW_ARRAYS,   // One GL_LINE_STRIP sub-draw per track
+    PRIMITIVE_RESTART    // One index buffer, tracks separated by the restart index
+};
+
+enum class TransparencyMode {
+    ALPHA_BLEND,        // Ordered blending in submission (file) order
+    WEIGHTED_BLENDED    // Order-independent: accumulation + revealage targets, then composite
+};
+
+enum class FiberRenderMode {
+    LINES,              // Every track as geometry
+    DENSITY_VOLUME,     // Raymarched direction-weighted density of the visible tracks
+    AUTOMATIC           // Density volume while the estimated line overdraw exceeds the threshold
 };
 
 /**
@@ -27,9 +57,46 @@ public:
 
     // Data interface
     void setTracks(const std::vector<FiberTrack>& tracks);
+    // Renderer track i is (*tracks)[selection[i]]; the data is shared, not copied, and never modified
+    void setTracks(std::shared_ptr<const std::vector<FiberTrack>> tracks, std::vector<uint32_t> selection);
+    void appendTracks(const std::vector<FiberTrack>& tracks);     // New tracks take the next indices
+    void removeTracks(const std::vector<uint32_t>& trackIndices);  // Removed indices stay, as empty tracks
+    // The data behind the drawn tracks: track i is source[selection[i]], or appended[selection[i] - source size]
+    // for indices past the source; removed tracks point past both. Neither ever changes while held:
+    // the source is never edited, and appends to a held tail go to a new copy of the tail only
+    std::shared_ptr<const std::vector<FiberTrack>> getTrackSource() const { return m_trackSource; }
+    std::shared_ptr<const std::vector<FiberTrack>> getAppendedTracks() const { return m_appendedTracks; }  // Null until appendTracks()
+    const std::vector<uint32_t>& getTrackSelection() const { return m_trackSelection; }
+    // Flat vertex data (6 floats per point: position, direction) and each track's point range in it
+    const std::vector<float>& getVertexData() const { return m_vertexData; }
+    const std::vector<GLint>& getTrackStarts() const { return m_trackStarts; }
+    const std::vector<GLsizei>& getTrackCounts() const { return m_trackCounts; }
     void setColorMode(FiberColoringMode mode);
     void setLineWidth(float width);
     void setOpacity(float opacity);
+    void setTransparencyMode(TransparencyMode mode);  // Applies while opacity < 1
+    void setTubeImpostorsEnabled(bool enable);  // Lit camera-facing tubes instead of GL lines
+    void setTubeRadius(float radius);           // World units (mm)
+
+    // Per-track attributes, indexed like setTracks(); only the changed entries are re-uploaded
+    static const uint32_t kMaxBundleId = 0xFFFFFFu;    // Bundle ids take the 24 bits above the flags
+    void setTrackColor(size_t trackIndex, float r, float g, float b);
+    bool setTrackBundle(size_t trackIndex, uint32_t bundleId);  // False, leaving the track as is, above kMaxBundleId
+    void setTrackVisible(size_t trackIndex, bool visible);
+    void setTrackHighlighted(size_t trackIndex, bool highlighted);
+    void setTracksVisible(const std::vector<uint32_t>& trackIndices, bool visible);
+    void setAllTracksVisible(bool visible);
+    void setTrackVisibility(const std::vector<uint8_t>& visible);  // Nonzero per track, e.g. an ROI filter result
+    void clearHighlights();
+    bool isTrackVisible(size_t trackIndex) const;
+
+    // Scalar colormap: the selected TrackPoint::scalars entry is uploaded as its own stream
+    void setScalarIndex(int index);     // -1 for none; switching re-uploads only the scalar stream
+    int getScalarIndex() const { return m_scalarIndex; }
+    size_t getScalarCount() const;      // Scalars per point in the current tracks
+    void setScalarWindow(float window, float level);  // Reset to the data range on selection
+    bool getScalarRange(float& minValue, float& maxValue) const;
+    void setColormap(const std::vector<float>& rgb);  // At least two RGB triples in [0, 1]
 
     // Rendering control
     void initialize();  // Must be called after OpenGL context is created
@@ -39,10 +106,66 @@ public:
     // Performance control
     void setLODEnabled(bool enable);
     void setMaxPointsPerTrack(size_t maxPoints);
+    void setFrustumCullingEnabled(bool enable);
+    void setDrawPath(FiberDrawPath path);
+    FiberDrawPath getDrawPath() const { return m_drawPath; }
+    void setGPUCullingEnabled(bool enable);  // Compute-shader culling + LOD with indirect draws
+    bool isGPUCullingSupported() const { return m_gpuCullingSupported; }
+
+    // Clipping: world-space planes (a, b, c, d) keeping ax + by + cz + d >= 0, applied per
+    // vertex with gl_ClipDistance. Tracks wholly outside a plane are culled by their bounds
+    // before submission. The density volume and out-of-core mode ignore them.
+    static const int kMaxClipPlanes = 6;
+    void setClipPlanes(const float* planes, int count);     // count * 4 floats; 0 disables
+    void setSlab(const float* normal, float center, float thickness);  // Two planes: |normal . p - center| <= thickness / 2
+    void clearClipPlanes() { setClipPlanes(nullptr, 0); }
+    int getClipPlaneCount() const { return m_clipPlaneCount; }
+    bool getClipPlane(int index, float plane[4]) const;     // False, leaving plane untouched, past getClipPlaneCount()
+
+    // Zoomed-out views of huge tractograms: a density volume whose cost is independent of the track count
+    void setRenderMode(FiberRenderMode mode);
+    FiberRenderMode getRenderMode() const { return m_renderMode; }
+    bool isDensityVolumeActive() const { return m_densityVolumeActive; }   // Mode used by the last frame
+    void setDensityVolumeResolution(int voxels);    // Along the longest bounding box axis
+    void setDensityVolumeThreshold(float overdraw); // AUTOMATIC: covered pixels per screen pixel
+    void setDensityVolumeOpacity(float scale);
+    // Visibility changes reach the volume after a short pause; redraw until this is false
+    bool hasPendingDensityVolume() const { return m_densityVolumeActive && m_densityVolumeVisibilityDirty; }
+
+    // Out-of-core mode: streams a TrackOctreeBuilder file through a bounded GPU cache instead
+    // of drawing setTracks() data; setTracks() leaves it. Direction colors only.
+    bool openOutOfCore(const std::string& octreePath);
+    void closeOutOfCore();
+    bool isOutOfCore() const { return m_streamer.isOpen(); }
+    void setOutOfCoreBudget(size_t cacheBytes, size_t pointsPerFrame);
+    bool hasPendingStreaming() const { return m_streamer.isOpen() && m_streamer.hasPendingWork(); }
+    const StreamingStatistics& getStreamingStatistics() const { return m_streamer.getStatistics(); }
+
+    // Picking: the track, point and position under a framebuffer pixel (origin bottom left).
+    // Only tracks near the pixel are drawn into a small id target; not available out of core.
+    bool pick(const float* mvpMatrix, const GLint* viewport, int x, int y, TrackPickResult& result);  // Waits for the GPU
+    bool requestPick(const float* mvpMatrix, const GLint* viewport, int x, int y);    // Replaces an unfinished request
+    bool pollPick(TrackPickResult& result) { return m_picker.poll(result, false); }   // True once the request completes
+    bool hasPendingPick() const { return m_picker.isPending(); }
+    void setPickRadius(int pixels) { m_picker.setRadius(pixels); }
 
     // Statistics
     size_t getRenderedTrackCount() const { return m_renderedTrackCount; }
     size_t getTotalPointCount() const { return m_totalPointCount; }
+    size_t getVisibleTrackCount() const { return m_visibleTrackCount; }  // Tracks submitted in the last frame
+
+    // GPU memory of track data with the current draw path, culling and scalar settings
+    size_t estimateGPUBytes(size_t trackCount, size_t pointCount) const;
+    size_t getGPUBufferBytes() const;   // Track buffers allocated now
+
+    // Profiling: per-section CPU/GPU times and counters of the last completed frame; off by
+    // default, since the timer queries cost every frame
+    void setProfilingEnabled(bool enable) { m_profiler.setEnabled(enable); }
+    bool isProfilingEnabled() const { return m_profiler.isEnabled(); }
+    const FrameStatistics& getFrameStatistics() const { return m_profiler.getLastFrame(); }
+
+    // Incremented by every change that can alter the rendered image other than the MVP and viewport
+    uint64_t getSceneRevision() const { return m_sceneRevision; }
 
     // Bounding box
     void getBoundingBox(float& minX, float& maxX, float& minY, float& maxY, float& minZ, float& maxZ) const;
@@ -50,29 +173,167 @@ public:
     bool isInitialized() const { return m_initialized; }
 
 private:
+    // Track program permutations, one per vertex format x color mode x OIT output
+    enum class TrackVertexFormat {
+        LINES,              // Position/direction attributes, track from the slot table + gl_DrawID
+        LINES_TRACK_ID,     // Same with a per-vertex track index (primitive-restart path)
+        TUBES,              // Segment quads pulled from the vertex buffer
+        PULL                // Strided vertex pulling for GPU-culled indirect draws
+    };
+
+    void setTrackSource(std::shared_ptr<const std::vector<FiberTrack>> tracks, std::vector<uint32_t> selection);
+    const FiberTrack& trackAt(size_t trackIndex) const;     // Empty once removed
     void uploadToGPU();
     void buildVertexData();
     void calculateDirectionColors();
+    void buildDrawChunks();
+    void refreshDrawSlots();
+    size_t allocatePoints(size_t count);
+    void releasePoints(size_t first, size_t count);
+    void uploadPendingTracks();
+    void uploadTrackInfo();
+    void uploadIndexBuffer();
+    void uploadTrackAttributes();
+    void markAttributesDirty(size_t first, size_t last);
+    void markVisibilityChanged();
+    bool isTrackSourceShared() const;
+    std::vector<FiberTrack>& editAppendedTracks(size_t extraCapacity);
+    void bindColoringResources();
+    void buildScalarData();
+    void uploadScalarData();
+    void uploadColormap();
+    FiberColoringMode effectiveColorMode() const;
+    GLShaderProgram* getTrackProgram(TrackVertexFormat format, FiberColoringMode mode, bool oitOutput);
+    void updateFrameParameters(const float* mvpMatrix, const GLint* viewport, bool drawTubes);
+    void drawTracksCPU(const float* mvpMatrix);
+    void drawTracksGPU();
+    void updateClipRanges();
+    void addClipPlanes(Frustum& frustum) const;
+    void setClipDistancesEnabled(bool enable);
+    bool ensureOITTargets(GLsizei width, GLsizei height);
+    void beginOITPass(const GLint* viewport);
+    void compositeOIT(GLint targetFBO, const GLint* viewport);
+    void releaseOITTargets();
+    void renderOutOfCore(const float* mvpMatrix);
+    bool shouldUseDensityVolume(const float* mvpMatrix, const GLint* viewport);
+    void renderDensityVolume(const float* mvpMatrix, const GLint* viewport);
+    bool drawPickIds(const float* mvpMatrix, const GLint* viewport, int x, int y);
 
     // OpenGL resources
     GLuint m_VAO;
     GLuint m_VBO;
-    std::unique_ptr<GLShaderProgram> m_shader;
+    GLuint m_IBO;   // Primitive-restart indices in chunk slot order
+    GLuint m_trackIdVBO;        // Per-vertex track index (location 2), primitive-restart path only
+    GLuint m_trackAttributeSSBO;    // Per track: uvec2(RGBA8 color, flags | bundleId << 8)
+    GLuint m_slotTrackSSBO;     // Draw slot -> track index, resolves gl_DrawID in multi-draws
+    GLuint m_scalarSSBO;        // One float per point for SCALAR_COLORMAP
+    GLuint m_colormapTexture;   // 1D RGBA8 lookup table
+    GLuint m_frameUBO;          // FrameParameters block (binding 0), written once per frame
+    std::map<uint32_t, std::unique_ptr<GLShaderProgram>> m_trackPrograms;  // Built on first use; nullptr if a variant failed
+    bool m_tubeImpostorsSupported;
+
+    // GPU-driven culling resources
+    std::unique_ptr<GLShaderProgram> m_cullShader;      // Compute: frustum/screen-size cull + LOD
+    GLuint m_trackInfoSSBO;     // Per track: vec4(boundsMin, start), vec4(boundsMax, count)
+    GLuint m_trackLodSSBO;      // Per track: vertex stride chosen by the cull pass
+    GLuint m_indirectBuffer;    // DrawArraysIndirectCommand per track
+    GLuint m_drawCountBuffer;   // Number of commands written this frame
+
+    // Weighted blended order-independent transparency
+    std::unique_ptr<GLShaderProgram> m_compositeShader;
+    GLuint m_oitFBO;
+    GLuint m_oitAccumTexture;   // RGBA16F: sum of weighted premultiplied color and alpha
+    GLuint m_oitRevealTexture;  // R16F: product of (1 - alpha)
+    GLsizei m_oitWidth;
+    GLsizei m_oitHeight;
+    bool m_oitPassActive;
+
+    // Density volume render mode
+    GLDensityVolume m_densityVolume;
+    FiberRenderMode m_renderMode;
+    bool m_densityVolumeActive;
+    bool m_densityVolumeDirty;      // Tracks changed since the last build
+    bool m_densityVolumeVisibilityDirty;    // Visibility changed; rebuilt after m_densityVolumeSettleTime
+    std::chrono::steady_clock::time_point m_densityVolumeSettleTime;
+    int m_densityVolumeResolution;
+    float m_densityVolumeThreshold;
+    double m_totalTrackLength;      // World units, for the overdraw estimate
+
+    GLTrackStreamer m_streamer;     // Out-of-core mode while a file is open
+
+    GLTrackPicker m_picker;
+    std::vector<GLint> m_pickFirsts;        // Candidate strips of the last pick
+    std::vector<GLsizei> m_pickCounts;
+    std::vector<uint32_t> m_pickTracks;
 
     // Data
-    std::vector<FiberTrack> m_tracks;
+    std::shared_ptr<const std::vector<FiberTrack>> m_trackSource;
+    std::shared_ptr<std::vector<FiberTrack>> m_ownedTracks;    // m_trackSource when the renderer holds the only copy
+    std::shared_ptr<std::vector<FiberTrack>> m_appendedTracks; // Tracks added by appendTracks(), indexed after m_trackSource
+    std::vector<uint32_t> m_trackSelection;     // Source index of each track
     std::vector<float> m_vertexData;  // Interleaved: pos.x, pos.y, pos.z, dir.x, dir.y, dir.z
     std::vector<GLint> m_trackStarts;  // Start index of each track
     std::vector<GLsizei> m_trackCounts;  // Point count of each track
+    std::vector<BoundingBox> m_trackBounds;  // Bounding box of each track
+    std::vector<uint32_t> m_trackAttributes;    // CPU mirror of m_trackAttributeSSBO
+    size_t m_attributesDirtyBegin;  // Track range [begin, end) awaiting upload
+    size_t m_attributesDirtyEnd;
+    std::vector<std::pair<size_t, size_t>> m_freeRanges;  // Released (first point, count), sorted
+    std::vector<uint32_t> m_pendingTracks;  // Appended or removed since the last upload
+
+    // Allocated GPU buffer sizes; incremental updates grow them geometrically
+    GLsizeiptr m_vertexBufferBytes;
+    GLsizeiptr m_trackInfoBytes;
+    GLsizeiptr m_trackLodBytes;
+    GLsizeiptr m_indirectBytes;
+    GLsizeiptr m_attributeBufferBytes;
+    GLsizeiptr m_slotTrackBytes;
+    GLsizeiptr m_scalarBufferBytes;
+    GLsizeiptr m_elementBufferBytes;    // Primitive-restart indices
+    GLsizeiptr m_trackIdBufferBytes;    // Per-vertex track ids
+    std::vector<float> m_scalarData;    // Pending scalar stream, released once uploaded
+    std::vector<unsigned char> m_colormap;  // RGBA8 lookup table texels
+
+    // Frustum culling: starts/counts permuted into chunk order so visible chunks are contiguous
+    TrackChunkBVH m_chunkBVH;
+    std::vector<GLint> m_drawStarts;
+    std::vector<GLsizei> m_drawCounts;
+    std::vector<SlotRange> m_visibleRanges;
+    std::vector<SlotRange> m_drawRanges;    // m_visibleRanges without empty slots, for the multi-draws
+    size_t m_uploadedSlotCount;             // Slots already in m_slotTrackSSBO
+    std::vector<size_t> m_slotIndexOffsets;  // First index of each slot in m_IBO (+ end sentinel)
+    size_t m_uploadedIndexSlots;            // Slots whose ranges are in m_IBO; 0 rebuilds it
+    size_t m_deadIndexCount;                // Indices in m_IBO left by removed points
+    std::vector<uint32_t> m_staleIndexSlots;  // Uploaded slots whose track shrank since
+    std::vector<GLint> m_tubeStarts;    // 6 * first point of each slot (two triangles per segment)
+    std::vector<GLsizei> m_tubeCounts;  // 6 * segment count of each slot
+
+    // Clip planes and the slot ranges of tracks not wholly outside them, rebuilt when planes or slots change
+    float m_clipPlanes[kMaxClipPlanes][4];
+    int m_clipPlaneCount;
+    std::vector<SlotRange> m_clipRanges;
+    std::vector<SlotRange> m_cullRanges;    // Frustum ranges before intersecting them with m_clipRanges
+    bool m_clipRangesDirty;
 
     // Rendering state
     FiberColoringMode m_colorMode;
     float m_lineWidth;
     float m_opacity;
+    TransparencyMode m_transparencyMode;
+    bool m_tubeImpostorsEnabled;
+    float m_tubeRadius;
+    int m_scalarIndex;
+    bool m_hasScalarStream;
+    float m_scalarMin, m_scalarMax;
+    float m_scalarWindow, m_scalarLevel;
+    bool m_needsScalarUpload;
+    bool m_needsColormapUpload;
 
     // Statistics
     size_t m_renderedTrackCount;
     size_t m_totalPointCount;
+    size_t m_visibleTrackCount;
+    GLFrameProfiler m_profiler;
 
     // Bounding box
     float m_minX, m_maxX, m_minY, m_maxY, m_minZ, m_maxZ;
@@ -80,9 +341,17 @@ private:
     // Performance options
     bool m_lodEnabled;
     size_t m_maxPointsPerTrack;
+    bool m_frustumCullingEnabled;
+    FiberDrawPath m_drawPath;
+    bool m_needsIndexUpload;
+    bool m_gpuCullingEnabled;
+    bool m_gpuCullingSupported;
+    float m_minScreenSize;      // Tracks smaller than this (pixels) are culled on the GPU path
+    float m_lodPixelsPerVertex; // Target on-screen spacing between LOD vertices
 
     bool m_initialized;
     bool m_needsUpload;
+    uint64_t m_sceneRevision;
 };
 
 } // namespace DTIFiberLib
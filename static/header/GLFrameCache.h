@@ -0,0 +1,62 @@
+#ifndef GLFRAMECACHE_H
+#define GLFRAMECACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+
+namespace DTIFiberLib {
+
+/**
+ * Full-Frame Cache
+ * Keeps a copy of the last fully rendered color and depth buffers, tagged with the
+ * scene state that produced them (renderer scene revision, MVP and viewport). Redraws
+ * with unchanged state blit the copy back instead of drawing the geometry again.
+ * The cache matches the source framebuffer's sample count and formats so both
+ * directions are plain blits, including between multisampled framebuffers.
+ */
+class GLFrameCache {
+public:
+    GLFrameCache();
+    ~GLFrameCache();
+
+    // Blits the cached frame into targetFBO if it was stored with the same state
+    bool restore(GLuint targetFBO, uint64_t sceneRevision, const float* mvpMatrix, const GLint* viewport);
+
+    // Copies the viewport region of sourceFBO into the cache
+    bool store(GLuint sourceFBO, uint64_t sceneRevision, const float* mvpMatrix, const GLint* viewport);
+
+    void invalidate() { m_valid = false; }
+    void cleanup();     // Needs the context the cache was created in
+
+    bool isValid() const { return m_valid; }
+    size_t getHitCount() const { return m_hitCount; }
+    size_t getMissCount() const { return m_missCount; }
+
+private:
+    bool matches(uint64_t sceneRevision, const float* mvpMatrix, const GLint* viewport) const;
+    bool ensureStorage(GLuint sourceFBO, GLsizei width, GLsizei height);
+
+    GLuint m_FBO;
+    GLuint m_colorRBO;
+    GLuint m_depthRBO;
+    GLsizei m_width;
+    GLsizei m_height;
+    GLint m_samples;
+    GLenum m_colorFormat;
+    GLenum m_depthFormat;       // GL_NONE if the source has no depth buffer
+    GLbitfield m_blitMask;
+
+    // State of the cached frame
+    bool m_valid;
+    uint64_t m_sceneRevision;
+    float m_mvpMatrix[16];
+    GLint m_viewport[4];
+
+    size_t m_hitCount;
+    size_t m_missCount;
+};
+
+} // namespace DTIFiberLib
+
+#endif // GLFRAMECACHE_H
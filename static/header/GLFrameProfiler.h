@@ -0,0 +1,91 @@
+#ifndef GLFRAMEPROFILER_H
+#define GLFRAMEPROFILER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+
+namespace DTIFiberLib {
+
+// Timed sections of a frame; sections never nest
+enum class ProfilerSection {
+    BUILD,      // Vertex data, scalar stream and chunk hierarchy (CPU only)
+    UPLOAD,     // Buffer and texture uploads
+    CULL,       // BVH traversal on the CPU path, compute dispatch on the GPU path
+    DRAW,
+    COMPOSITE,  // OIT resolve
+    COUNT
+};
+
+/**
+ * Timings and counters of one frame
+ * GPU times lag one frame behind the CPU times (double-buffered queries) and are
+ * negative when a section issued no GPU work or its result was not ready in time.
+ */
+struct FrameStatistics {
+    double cpuMs[static_cast<int>(ProfilerSection::COUNT)];
+    double gpuMs[static_cast<int>(ProfilerSection::COUNT)];
+    double frameCpuMs;          // Whole render() call
+    double frameGpuMs;          // Sum of the available GPU sections
+    size_t submittedTracks;
+    size_t submittedVertices;   // Upper bound before LOD on the GPU-culled path
+    size_t drawCalls;
+    size_t uploadedBytes;       // Including uploads made between frames
+    uint64_t frameIndex;
+};
+
+/**
+ * Frame Profiler
+ * CPU section timers plus GL_TIME_ELAPSED queries per section. Each section owns two
+ * queries used on alternate frames, so results are read one frame later without stalling.
+ * Requires a current OpenGL context between initialize() and cleanup().
+ */
+class GLFrameProfiler {
+public:
+    GLFrameProfiler();
+    ~GLFrameProfiler();
+
+    void initialize();
+    void cleanup();
+
+    void setEnabled(bool enable);
+    bool isEnabled() const { return m_enabled; }
+
+    void beginFrame();
+    void endFrame();
+    void beginSection(ProfilerSection section);  // CPU-only outside a frame
+    void endSection();
+
+    void addUploadedBytes(size_t bytes);
+    void addDraw(size_t tracks, size_t vertices, size_t drawCalls);
+
+    // Last completed frame
+    const FrameStatistics& getLastFrame() const { return m_lastFrame; }
+
+    static const char* sectionName(ProfilerSection section);
+
+private:
+    typedef std::chrono::high_resolution_clock Clock;
+    static const int kSectionCount = static_cast<int>(ProfilerSection::COUNT);
+
+    void resetCurrent();
+    void collectGPUResults(int queryBuffer);
+
+    bool m_enabled;
+    bool m_inFrame;
+    GLuint m_queries[2][kSectionCount];
+    bool m_queryIssued[2][kSectionCount];
+    int m_queryBuffer;          // Query set used by the current frame
+    int m_openSection;          // -1 when none
+    bool m_openSectionTimed;    // A GPU query is running for the open section
+    Clock::time_point m_sectionStart;
+    Clock::time_point m_frameStart;
+
+    FrameStatistics m_current;
+    FrameStatistics m_lastFrame;
+};
+
+} // namespace DTIFiberLib
+
+#endif // GLFRAMEPROFILER_H
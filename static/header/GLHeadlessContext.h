@@ -0,0 +1,33 @@
+#ifndef GLHEADLESSCONTEXT_H
+#define GLHEADLESSCONTEXT_H
+
+namespace DTIFiberLib {
+
+/**
+ * Headless OpenGL Context
+ * Creates a surfaceless EGL context (EGL_MESA_platform_surfaceless, falling back to the
+ * default display) and loads GL through GLAD, so the renderer runs without a window
+ * system. Works with Mesa llvmpipe; all rendering must go to a framebuffer object.
+ * Available when the library is built with DTIFIBERLIB_HEADLESS.
+ */
+class GLHeadlessContext {
+public:
+    GLHeadlessContext();
+    ~GLHeadlessContext();
+
+    // Prefers a 4.6 core context and accepts 4.5 (draw parameters through ARB extensions)
+    bool create();
+    void destroy();
+
+    bool makeCurrent();
+    bool isValid() const { return m_context != nullptr; }
+
+private:
+    // EGL handles, kept opaque so this header does not pull in EGL
+    void* m_display;
+    void* m_context;
+};
+
+} // namespace DTIFiberLib
+
+#endif // GLHEADLESSCONTEXT_H
@@ -0,0 +1,70 @@
+#ifndef GLMEMORYBUDGET_H
+#define GLMEMORYBUDGET_H
+
+#include "TrkFileReader.h"
+#include <cstddef>
+#include <vector>
+
+namespace DTIFiberLib {
+
+class GLFiberRenderer;
+
+enum class MemoryInfoSource {
+    NVX_GPU_MEMORY_INFO,    // GL_NVX_gpu_memory_info: current available video memory
+    ATI_MEMINFO,            // GL_ATI_meminfo: free VBO memory
+    FALLBACK                // Nothing reported; the configured fallback size
+};
+
+// What fits, and how it was decided
+struct MemoryBudgetPlan {
+    MemoryInfoSource source;
+    size_t availableBytes;      // Reported free memory plus what the renderer holds now
+    size_t budgetBytes;         // Part of it given to track data
+    size_t requiredBytes;       // Every track at full resolution
+    size_t plannedBytes;        // The tracks and stride below
+    size_t totalTrackCount;
+    size_t trackCount;          // Tracks to keep
+    double fraction;            // trackCount / totalTrackCount
+    int pointStride;            // Keep every n-th point (ends always kept); 1 is full resolution
+    float meanPointSpacing;     // At full resolution, from a sample of the tracks
+};
+
+/**
+ * GPU Memory Budget
+ * Decides how much of a dataset to upload: estimates track bytes for the renderer's
+ * current vertex format, takes the free video memory from GL_NVX_gpu_memory_info or
+ * GL_ATI_meminfo (or a configured fallback), and first coarsens the point stride while
+ * points stay closer than a maximum spacing, then subsamples tracks to fit.
+ */
+class GLMemoryBudget {
+public:
+    GLMemoryBudget();
+
+    void setFallbackBytes(size_t bytes) { m_fallbackBytes = bytes; }  // Used when the driver reports nothing
+    void setUsableFraction(float fraction);     // Of the available memory (default 0.75)
+    void setReserveBytes(size_t bytes) { m_reserveBytes = bytes; }    // Framebuffers, OIT targets, textures
+    void setMaxPointStride(int stride);         // Coarsest stride before tracks are dropped
+    void setMaxPointSpacing(float spacing);     // Strides may not space points further apart (mm)
+
+    // Needs a current context; falls back when neither extension is present
+    size_t queryAvailableBytes();
+    MemoryInfoSource getSource() const { return m_source; }
+
+    MemoryBudgetPlan plan(const std::vector<FiberTrack>& tracks, const GLFiberRenderer& renderer) const;
+
+    // Every stride-th point, keeping the last one
+    static FiberTrack decimate(const FiberTrack& track, int stride);
+
+private:
+    size_t m_fallbackBytes;
+    float m_usableFraction;
+    size_t m_reserveBytes;
+    int m_maxPointStride;
+    float m_maxPointSpacing;
+    size_t m_availableBytes;
+    MemoryInfoSource m_source;
+};
+
+} // namespace DTIFiberLib
+
+#endif // GLMEMORYBUDGET_H
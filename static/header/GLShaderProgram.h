@@ -2,13 +2,18 @@
 #define GLSHADERPROGRAM_H
 
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <glad/glad.h>
 
 namespace DTIFiberLib {
 
 /**
  * OpenGL Shader Program Manager
- * Handles shader compilation, linking, and uniform variable management
+ * Handles shader compilation, linking, and uniform variable management.
+ * Uniform locations are resolved once after linking, so setters never query GL by name.
+ * With a binary cache directory set, linked programs are stored with glGetProgramBinary
+ * and later loads skip compilation unless the driver rejects the stored binary.
  */
 class GLShaderProgram {
 public:
@@ -17,6 +22,17 @@ public:
 
     // Load and compile shaders from source strings
     bool loadFromString(const char* vertexSource, const char* fragmentSource);
+    bool loadComputeFromString(const char* computeSource);
+
+    // Compile a permutation: each entry becomes "#define <entry>" after the #version/#extension lines
+    bool loadFromString(const char* vertexSource, const char* fragmentSource, const std::vector<std::string>& defines);
+
+    // Directory for cached program binaries; empty (the default) disables the cache
+    static void setBinaryCacheDirectory(const std::string& directory);
+    static const std::string& getBinaryCacheDirectory() { return s_binaryCacheDirectory; }
+
+    // Insert text after the leading #version/#extension lines of a shader source
+    static std::string insertPreamble(const char* source, const std::string& preamble);
 
     // Use this shader program
     void use();
@@ -25,7 +41,12 @@ public:
     void setUniformMatrix4fv(const char* name, const float* value);
     void setUniform1i(const char* name, int value);
     void setUniform1f(const char* name, float value);
+    void setUniform2f(const char* name, float v0, float v1);
     void setUniform3f(const char* name, float v0, float v1, float v2);
+    void setUniform4fv(const char* name, int count, const float* value);
+
+    // Cached location (-1 if the uniform is not active) for per-draw updates
+    GLint getUniformLocation(const char* name) const;
 
     // Get program ID
     GLuint getProgramID() const { return m_programID; }
@@ -36,9 +57,17 @@ public:
 private:
     GLuint compileShader(const char* source, GLenum shaderType);
     bool linkProgram(GLuint vertexShader, GLuint fragmentShader);
+    bool linkProgram(GLuint computeShader);
     void checkCompileErrors(GLuint shader, const char* type);
+    void cacheUniformLocations();
+    static std::string binaryCacheKey(const char* stageTag, const char* firstSource, const char* secondSource);
+    bool loadCachedBinary(const std::string& key);
+    void saveCachedBinary(const std::string& key);
 
     GLuint m_programID;
+    std::unordered_map<std::string, GLint> m_uniformLocations;
+
+    static std::string s_binaryCacheDirectory;
 };
 
 } // namespace DTIFiberLib
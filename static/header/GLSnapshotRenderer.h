@@ -0,0 +1,68 @@
+#ifndef GLSNAPSHOTRENDERER_H
+#define GLSNAPSHOTRENDERER_H
+
+#include "GLFiberRenderer.h"
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+namespace DTIFiberLib {
+
+// View directions, assuming RAS+ world axes (x right, y anterior, z superior)
+enum class CameraPreset {
+    LEFT,
+    RIGHT,
+    ANTERIOR,
+    POSTERIOR,
+    SUPERIOR,
+    INFERIOR,
+    OBLIQUE,        // Left-anterior-superior three-quarter view
+    COUNT
+};
+
+/**
+ * Offscreen Snapshot Renderer
+ * Renders a GLFiberRenderer into its own (optionally multisampled) framebuffer from a
+ * camera preset fitted to the dataset bounding box, then reads the image back or writes
+ * it as PNG. Needs a current context, from a window or from GLHeadlessContext.
+ */
+class GLSnapshotRenderer {
+public:
+    GLSnapshotRenderer();
+    ~GLSnapshotRenderer();
+
+    bool initialize(int width, int height, int samples = 4);
+    void cleanup();
+
+    void setBackgroundColor(float r, float g, float b);
+    void setFieldOfView(float degrees);
+
+    // Column-major MVP that frames the box [minX, maxX, minY, maxY, minZ, maxZ]
+    void computeCameraMatrix(CameraPreset preset, const float* bounds, float* mvpMatrix) const;
+
+    // RGBA rows, first row at the top
+    bool renderSnapshot(GLFiberRenderer& renderer, CameraPreset preset, std::vector<unsigned char>& rgba);
+    bool writeSnapshot(GLFiberRenderer& renderer, CameraPreset preset, const std::string& path);
+
+    int getWidth() const { return m_width; }
+    int getHeight() const { return m_height; }
+
+    static const char* presetName(CameraPreset preset);
+    static bool presetFromName(const std::string& name, CameraPreset& preset);
+
+private:
+    GLuint m_renderFBO;
+    GLuint m_colorRBO;
+    GLuint m_depthRBO;
+    GLuint m_resolveFBO;        // Single-sample copy for readback when multisampling
+    GLuint m_resolveRBO;
+    int m_width;
+    int m_height;
+    int m_samples;
+    float m_background[3];
+    float m_fieldOfView;
+};
+
+} // namespace DTIFiberLib
+
+#endif // GLSNAPSHOTRENDERER_H
@@ -0,0 +1,78 @@
+#ifndef GLTRACKPICKER_H
+#define GLTRACKPICKER_H
+
+#include "GLShaderProgram.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glad/glad.h>
+
+namespace DTIFiberLib {
+
+struct TrackPickResult {
+    bool hit;
+    uint32_t trackIndex;    // As passed to drawStrips()
+    uint32_t pointIndex;    // Nearest point of the picked segment, within its track
+    float position[3];      // World position on the track under the cursor
+    float depth;            // Window depth [0, 1]
+};
+
+/**
+ * Track Picker
+ * Renders track ids into a small integer target covering only the pixels around the
+ * cursor: a pick matrix stretches that window over clip space, so ordinary frustum
+ * culling with it leaves just the tracks near the cursor. Each pixel stores the track,
+ * the nearest point and the interpolated world position; the hit closest to the cursor
+ * wins. Results are read back through a pixel buffer and a fence, so hover picking
+ * never waits for the GPU; pick() with wait = true does, for clicks.
+ */
+class GLTrackPicker {
+public:
+    GLTrackPicker();
+    ~GLTrackPicker();
+
+    bool initialize();  // Needs a current context
+    void cleanup();
+    bool isAvailable() const { return m_shader != nullptr; }
+
+    void setRadius(int pixels);     // Hits within this many pixels of the cursor count
+    int getRadius() const { return m_radius; }
+
+    // x, y in framebuffer pixels, origin at the bottom left; pickMatrix receives the narrowed MVP
+    bool begin(const float* mvpMatrix, const GLint* viewport, int x, int y, float* pickMatrix, float lineWidth);
+    // World-space clip planes (a, b, c, d) for the strips drawn next; the caller enables the clip distances
+    void setClipPlanes(const float* planes, int count);
+    // Line strips with positions at attribute 0 of the bound VAO; trackIds label each strip
+    void drawStrips(const GLint* firsts, const GLsizei* counts, const uint32_t* trackIds, GLsizei drawCount);
+    void end();         // Restores state and queues the readback; replaces an unfinished pick
+
+    bool isPending() const { return m_fence != nullptr; }
+    bool poll(TrackPickResult& result, bool wait);   // True once per completed pick
+
+private:
+    bool ensureTargets();
+
+    std::unique_ptr<GLShaderProgram> m_shader;
+    GLuint m_FBO;
+    GLuint m_idTexture;         // RG32UI: track + 1, point
+    GLuint m_positionTexture;   // RGBA32F: world xyz, window depth
+    GLuint m_depthBuffer;
+    GLuint m_drawBuffer;        // SSBO of (track, first vertex) per strip
+    GLuint m_PBO;
+    GLsync m_fence;
+    int m_radius;
+    int m_targetSize;           // Allocated width and height
+    int m_size;                 // Of the pick in flight
+
+    // State saved by begin()
+    GLint m_previousFBO;
+    GLint m_previousViewport[4];
+    GLboolean m_previousDepthTest;
+    GLboolean m_previousBlend;
+    GLfloat m_previousLineWidth;
+    std::vector<GLuint> m_drawData;
+};
+
+} // namespace DTIFiberLib
+
+#endif // GLTRACKPICKER_H
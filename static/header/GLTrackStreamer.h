@@ -0,0 +1,133 @@
+#ifndef GLTRACKSTREAMER_H
+#define GLTRACKSTREAMER_H
+
+#include "TrackOctreeBuilder.h"
+#include "GLShaderProgram.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <glad/glad.h>
+
+namespace DTIFiberLib {
+
+struct StreamingStatistics {
+    size_t residentNodes;
+    size_t drawnNodes;
+    size_t drawnPieces;
+    size_t drawnPoints;
+    size_t pendingRequests;     // Queued or being read
+    size_t cacheBytesUsed;
+    size_t cacheBytesCapacity;
+    size_t uploadedBytes;       // This frame
+    size_t evictedNodes;        // Since open()
+    size_t unloadableNodes;     // Larger than the whole cache; skipped, their children still refine
+};
+
+/**
+ * Out-of-core Track Streamer
+ * Draws a TrackOctreeBuilder file through a fixed-size GPU vertex cache.
+ * Each frame the octree is traversed in order of screen-space error (node spacing in
+ * pixels), drawing resident nodes and refining while the error is above the threshold
+ * and the point budget allows. Missing nodes are requested from a loader thread in
+ * the same priority order; loaded nodes are uploaded into the cache, evicting the
+ * least recently drawn nodes when it is full. Memory use is bounded by the cache and
+ * point budgets, not by the size of the dataset.
+ */
+class GLTrackStreamer {
+public:
+    GLTrackStreamer();
+    ~GLTrackStreamer();
+
+    bool open(const std::string& octreePath);   // Reads the node table and starts the loader
+    void close();
+    bool isOpen() const { return !m_nodes.empty(); }
+
+    bool initialize();  // Needs a current context; called by the first render() otherwise
+    void cleanup();     // GL resources only; the file stays open
+
+    void setCacheBytes(size_t bytes);       // GPU vertex cache, reallocated on the next frame
+    void setPointBudget(size_t points);     // Points drawn per frame
+    void setErrorThreshold(float pixels);   // Refine while node spacing exceeds this on screen
+    void setOpacity(float opacity) { m_opacity = opacity; }
+
+    // Into the current framebuffer, with the viewport already set
+    void render(const float* mvpMatrix, const GLint* viewport);
+
+    bool hasPendingWork() const;    // Requests in flight; more frames will refine the view
+    const StreamingStatistics& getStatistics() const { return m_statistics; }
+    const TrackOctreeFileHeader& getFileHeader() const { return m_fileHeader; }
+    void getBoundingBox(float* boundsMin, float* boundsMax) const;
+
+private:
+    enum class NodeState : uint8_t {
+        ABSENT,
+        REQUESTED,      // Queued for or being read by the loader
+        RESIDENT,
+        UNLOADABLE      // Does not fit in the cache even when empty; never requested again
+    };
+
+    struct LoadedNode {
+        uint32_t node;
+        std::vector<float> vertices;    // Interleaved position + direction
+        std::vector<GLsizei> pieceCounts;
+    };
+
+    struct ResidentNode {
+        size_t firstVertex;
+        size_t vertexCount;
+        std::vector<GLsizei> pieceCounts;
+        uint64_t lastDrawnFrame;
+    };
+
+    void loaderLoop();
+    bool readNode(std::ifstream& file, uint32_t node, LoadedNode& loaded) const;
+    void uploadLoadedNodes();
+    bool allocateVertices(size_t count, size_t& first);
+    void evictNode(uint32_t node);
+    void traverse(const float* mvpMatrix, const GLint* viewport, std::vector<uint32_t>& drawList);
+    void ensureCache();
+
+    // Octree
+    std::string m_path;
+    TrackOctreeFileHeader m_fileHeader;
+    std::vector<TrackOctreeNode> m_nodes;
+    std::vector<NodeState> m_nodeStates;
+    std::vector<ResidentNode> m_resident;   // Indexed by node; valid while RESIDENT
+
+    // Loader thread: priority-ordered requests in, parsed nodes out
+    std::thread m_loader;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::vector<uint32_t> m_requests;       // Highest priority last
+    std::deque<LoadedNode> m_loaded;
+    size_t m_loadedBytes;
+    size_t m_loading;                       // Nodes taken by the loader, not yet in m_loaded
+    bool m_stopLoader;
+
+    // GPU cache
+    std::unique_ptr<GLShaderProgram> m_shader;
+    GLuint m_VAO;
+    GLuint m_VBO;
+    size_t m_cacheBytes;
+    size_t m_cacheVertices;                 // Allocated capacity
+    std::vector<std::pair<size_t, size_t>> m_freeRanges;  // (first vertex, count), sorted
+
+    size_t m_pointBudget;
+    float m_errorThreshold;
+    float m_opacity;
+    uint64_t m_frame;
+    StreamingStatistics m_statistics;
+    std::vector<GLint> m_drawFirsts;
+    std::vector<GLsizei> m_drawCounts;
+};
+
+} // namespace DTIFiberLib
+
+#endif // GLTRACKSTREAMER_H
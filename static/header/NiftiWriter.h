@@ -0,0 +1,21 @@
+#ifndef NIFTIWRITER_H
+#define NIFTIWRITER_H
+
+#include <string>
+
+namespace DTIFiberLib {
+
+/**
+ * Minimal NIfTI-1 writer for float32 volumes (single file, .nii)
+ * Paths ending in .gz are gzip-compressed when the library is built with DTIFIBERLIB_HAS_ZLIB.
+ */
+class NiftiWriter {
+public:
+    // data holds dim[0] * dim[1] * dim[2] values, x fastest; voxToRas is the row-major sform
+    static bool write(const std::string& path, const int* dim, const float* voxelSize,
+                      const float voxToRas[4][4], const float* data, const std::string& description = std::string());
+};
+
+} // namespace DTIFiberLib
+
+#endif // NIFTIWRITER_H
@@ -0,0 +1,25 @@
+#ifndef PNGWRITER_H
+#define PNGWRITER_H
+
+#include <string>
+#include <vector>
+
+namespace DTIFiberLib {
+
+/**
+ * Minimal PNG encoder for snapshots (8-bit RGBA, no interlacing)
+ * Image data is deflated with zlib when the library is built with DTIFIBERLIB_HAS_ZLIB,
+ * otherwise it is written as stored (uncompressed) deflate blocks.
+ */
+class PngWriter {
+public:
+    // rgba holds width * height * 4 bytes, first row at the top
+    static bool write(const std::string& path, int width, int height, const unsigned char* rgba);
+
+    // Same, but into memory
+    static bool encode(int width, int height, const unsigned char* rgba, std::vector<unsigned char>& png);
+};
+
+} // namespace DTIFiberLib
+
+#endif // PNGWRITER_H
@@ -0,0 +1,111 @@
+#ifndef SEGMENTBVH_H
+#define SEGMENTBVH_H
+
+#include "BoundingVolume.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace DTIFiberLib {
+
+/**
+ * A track segment: points `point` and `point + 1` of track `track`
+ */
+struct SegmentRef {
+    uint32_t track;
+    uint32_t point;
+};
+
+/**
+ * Result of a distance query against one segment
+ */
+struct SegmentHit {
+    uint32_t track;
+    uint32_t point;
+    float distance;     // From the query point or ray
+    float t;            // Ray parameter of the closest approach; 0 for point queries
+    float position[3];  // Closest point on the segment
+};
+
+/**
+ * Bounding Volume Hierarchy over line segments
+ * A linear BVH: segment centroids are sorted along a 30-bit Morton curve and every
+ * node splits its range where the highest differing code bit flips. Codes, the sort
+ * and the subtrees below the top levels are built in parallel; subtrees are cut at a
+ * fixed size and spliced in order, so the result does not depend on the thread count.
+ *
+ * Nodes are 32 bytes (bounds plus either a child pair or a segment range) and segments
+ * are stored in leaf order as 32-byte records with both endpoints, so traversal never
+ * touches the source vertices. Box tests run on SSE2 where available.
+ *
+ * Built from flat vertex data such as GLFiberRenderer::getVertexData(); it keeps its
+ * own copy and does not follow later changes to the tracks.
+ */
+class SegmentBVH {
+public:
+    SegmentBVH();
+
+    void setThreadCount(int threads);   // 0 uses all hardware threads
+    void setLeafSize(int segments);     // Segments per leaf at most (default 4)
+
+    // Positions are the first three floats of every `vertexStride` floats; track i covers
+    // points [trackStarts[i], trackStarts[i] + trackCounts[i])
+    void build(const float* vertices, size_t vertexStride, const int* trackStarts, const int* trackCounts, size_t trackCount);
+    void clear();
+
+    bool isEmpty() const { return m_nodes.empty(); }
+    size_t getSegmentCount() const { return m_segments.size(); }
+    size_t getNodeCount() const { return m_nodes.size(); }
+    BoundingBox getBounds() const;
+    double getBuildMs() const { return m_buildMs; }
+
+    // Segment passing within `radius` of the ray that is met first, for t in [0, maxT]; direction need not be unit length
+    bool intersectRay(const float* origin, const float* direction, float radius, float maxT, SegmentHit& hit) const;
+
+    // Every segment with a part inside the box
+    void queryBox(const BoundingBox& box, std::vector<SegmentRef>& segments) const;
+
+    // Up to k segments within maxDistance of the point, nearest first; with distinctTracks
+    // only the nearest segment of each track counts. Returns the number found.
+    size_t nearest(const float* point, size_t k, float maxDistance, bool distinctTracks, std::vector<SegmentHit>& hits) const;
+
+private:
+    struct Node {
+        float min[3];
+        uint32_t index;     // Interior: children at index, index + 1; leaf: first segment
+        float max[3];
+        uint32_t count;     // Segments of a leaf, 0 for interior nodes
+    };
+
+    struct Segment {
+        float a[3];
+        uint32_t track;
+        float b[3];
+        uint32_t point;
+    };
+
+    // Subtree left to a worker thread by the serial top-level build
+    struct BuildTask {
+        uint32_t node;
+        uint32_t first;
+        uint32_t last;
+    };
+
+    void buildNodes(std::vector<Node>& nodes, uint32_t node, uint32_t first, uint32_t last,
+                    std::vector<BuildTask>* tasks) const;
+    void topBounds(uint32_t node, uint32_t topNodeCount);
+    uint32_t splitRange(uint32_t first, uint32_t last) const;
+    void leafBounds(Node& node) const;
+    size_t threadCount(size_t items, size_t itemsPerThread) const;
+
+    std::vector<Node> m_nodes;          // Root first
+    std::vector<Segment> m_segments;    // Leaf order
+    std::vector<uint32_t> m_codes;      // Morton code per segment while building
+    int m_threadCount;
+    uint32_t m_leafSize;
+    double m_buildMs;
+};
+
+} // namespace DTIFiberLib
+
+#endif // SEGMENTBVH_H
@@ -0,0 +1,75 @@
+#ifndef TRACKCHUNKBVH_H
+#define TRACKCHUNKBVH_H
+
+#include "BoundingVolume.h"
+#include <cstdint>
+#include <vector>
+
+namespace DTIFiberLib {
+
+/**
+ * A group of spatially coherent tracks
+ * Covers the draw slots [firstSlot, firstSlot + slotCount) of TrackChunkBVH::getSlotOrder()
+ */
+struct TrackChunk {
+    uint32_t firstSlot;
+    uint32_t slotCount;
+    BoundingBox bounds;
+};
+
+/**
+ * Contiguous run of visible draw slots produced by frustum culling
+ */
+struct SlotRange {
+    uint32_t firstSlot;
+    uint32_t slotCount;
+};
+
+/**
+ * Bounding Volume Hierarchy over track chunks
+ * Tracks are ordered along a Morton curve of their bounding box centers and cut
+ * into fixed-size chunks. Because every subtree covers a contiguous range of
+ * slots, culling emits a handful of merged slot ranges that can be passed
+ * straight to glMultiDrawArrays.
+ */
+class TrackChunkBVH {
+public:
+    TrackChunkBVH();
+
+    // Build chunks and hierarchy from one bounding box per track
+    void build(const std::vector<BoundingBox>& trackBounds, size_t tracksPerChunk = 256);
+    // Add chunks for trackBounds[firstTrack..] after the existing slots, which keep their order
+    void append(const std::vector<BoundingBox>& trackBounds, size_t firstTrack, size_t tracksPerChunk = 256);
+    void clear();
+
+    // Collect visible slot ranges for a column-major MVP matrix
+    void cullFrustum(const float* mvpMatrix, std::vector<SlotRange>& visibleRanges) const;
+    void cullFrustum(const Frustum& frustum, std::vector<SlotRange>& visibleRanges) const;
+
+    // Draw slot -> track index, ordered chunk by chunk
+    const std::vector<uint32_t>& getSlotOrder() const { return m_slotOrder; }
+    const std::vector<TrackChunk>& getChunks() const { return m_chunks; }
+
+    bool isEmpty() const { return m_nodes.empty(); }
+
+private:
+    struct Node {
+        BoundingBox bounds;
+        uint32_t firstChunk;
+        uint32_t chunkCount;
+        int32_t left;   // -1 for leaves
+        int32_t right;
+    };
+
+    void appendChunks(const std::vector<BoundingBox>& trackBounds, size_t firstTrack, size_t tracksPerChunk);
+    int32_t buildNode(uint32_t firstChunk, uint32_t chunkCount);
+    static void appendRange(std::vector<SlotRange>& ranges, uint32_t firstSlot, uint32_t slotCount);
+
+    std::vector<uint32_t> m_slotOrder;
+    std::vector<TrackChunk> m_chunks;
+    std::vector<Node> m_nodes;
+};
+
+} // namespace DTIFiberLib
+
+#endif // TRACKCHUNKBVH_H
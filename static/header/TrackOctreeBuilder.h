@@ -0,0 +1,81 @@
+#ifndef TRACKOCTREEBUILDER_H
+#define TRACKOCTREEBUILDER_H
+
+#include "TrkFileReader.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace DTIFiberLib {
+
+// On-disk layout: TrackOctreeFileHeader, nodeCount TrackOctreeNode records, then node data.
+// A node's data is pieceCount records of (uint32 pointCount, pointCount * float xyz).
+struct TrackOctreeFileHeader {
+    char magic[8];              // "TRKOCT1"
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t maxDepth;
+    uint32_t reserved;
+    float rootMin[3];           // Cube the cells subdivide
+    float rootSize;
+    uint64_t trackCount;
+    uint64_t pointCount;        // Stored points: decimated, plus the shared point at each cut
+};
+
+struct TrackOctreeNode {
+    float boundsMin[3];         // Tight bounds of the node's pieces and all its descendants
+    float boundsMax[3];
+    float spacing;              // Point spacing of this level; 0 at full resolution
+    uint32_t depth;
+    uint64_t dataOffset;        // From the start of the file
+    uint64_t dataBytes;
+    uint32_t pointCount;
+    uint32_t pieceCount;
+    int32_t children[8];        // Node indices, -1 where a child holds nothing
+};
+
+/**
+ * Out-of-core Track Octree Builder
+ * Converts a .trk file into an octree of polyline pieces without loading it whole.
+ * Every track is assigned to one level by a hash of its index, eight times more
+ * tracks per level, decimated to that level's spacing and cut at that level's cell
+ * boundaries. Levels are additive: a node plus its ancestors is a uniform subsample
+ * of the tracks through its cell, and each deeper level fills in more of them.
+ * The source is streamed twice (sizing, then writing), with bounded write buffers.
+ */
+class TrackOctreeBuilder {
+public:
+    TrackOctreeBuilder();
+
+    void setMaxDepth(int depth);                // 0 picks the depth from the file size
+    void setWriteBufferBytes(size_t bytes);     // Memory for pending node data
+
+    bool build(const std::string& trkPath, const std::string& octreePath);
+
+    const TrackOctreeFileHeader& getFileHeader() const { return m_fileHeader; }
+    double getElapsedMs() const { return m_elapsedMs; }
+    const std::string& getLastErrorMessage() const { return m_lastErrorMessage; }
+
+private:
+    struct TrkStream;
+    struct PieceWriter;
+
+    template <typename PieceVisitor>
+    bool forEachPiece(TrkStream& stream, PieceVisitor&& visit);
+    uint32_t findNode(uint32_t depth, const int* cell);
+    void finalizeNodes();
+
+    int m_maxDepthOption;
+    size_t m_writeBufferBytes;
+    TrackOctreeFileHeader m_fileHeader;
+    std::vector<TrackOctreeNode> m_nodes;
+    std::vector<uint64_t> m_nodeKeys;       // Depth and Morton code of each node
+    std::unordered_map<uint64_t, uint32_t> m_nodeIndex;
+    double m_elapsedMs;
+    std::string m_lastErrorMessage;
+};
+
+} // namespace DTIFiberLib
+
+#endif // TRACKOCTREEBUILDER_H
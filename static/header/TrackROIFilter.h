@@ -0,0 +1,133 @@
+#ifndef TRACKROIFILTER_H
+#define TRACKROIFILTER_H
+
+#include "TrkFileReader.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace DTIFiberLib {
+
+enum class ROIShape {
+    SPHERE,     // size[0] is the radius
+    BOX         // size is the half extent per axis
+};
+
+enum class ROIMode {
+    INCLUDE,    // Tracks must pass through every include ROI
+    EXCLUDE     // Tracks passing through any exclude ROI are dropped
+};
+
+struct TrackROI {
+    ROIShape shape;
+    ROIMode mode;
+    float center[3];
+    float size[3];
+};
+
+/**
+ * Track ROI Filter
+ * Sphere and box ROIs combined with AND (include) / NOT (exclude) logic, evaluated
+ * against a voxel-to-track inverted index: for every voxel of a regular grid over the
+ * data, the runs of consecutive track points inside it, ordered by track. The index is
+ * built once, in parallel, from the same shared tracks and selection the renderer
+ * draws, so result index i is the renderer's track i.
+ *
+ * A track passes an ROI when one of its points lies inside it. Tracks with a run in a
+ * voxel entirely inside the ROI pass without a test. Each run also records which of its
+ * voxel's 2x2x2 sub-voxels it touches, so in voxels cut by the ROI surface only runs in
+ * cut sub-voxels have their points tested, in parallel.
+ *
+ * Each ROI keeps its hits, and per-track include/exclude counters combine them: moving
+ * one ROI only visits the tracks entering or leaving it, so a drag costs nothing per
+ * unaffected track. The result is a per-track mask for the renderer's visibility flags,
+ * which change without rebuilding vertex data; getChangedTracks() lists the flips so
+ * only those need to be passed on.
+ */
+class TrackROIFilter {
+public:
+    TrackROIFilter();
+
+    void setThreadCount(int threads);       // 0 uses all hardware threads
+    void setVoxelSize(float size);          // Index grid (mm, default 4), applied by the next build
+
+    // Selection entries outside the data (e.g. removed tracks) never pass; indices past the end
+    // of `tracks` address `appended`
+    bool build(std::shared_ptr<const std::vector<FiberTrack>> tracks, std::vector<uint32_t> selection,
+               std::shared_ptr<const std::vector<FiberTrack>> appended = nullptr);
+    void clear();
+    bool isBuilt() const { return m_tracks != nullptr; }
+    size_t getTrackCount() const { return m_selection.size(); }
+    size_t getIndexEntryCount() const { return m_voxelRuns.size(); }
+    float getGridVoxelSize() const { return m_gridVoxelSize; }  // May exceed the requested size on huge extents
+    double getBuildMs() const { return m_buildMs; }
+
+    size_t addROI(const TrackROI& roi);
+    void setROI(size_t index, const TrackROI& roi);
+    void removeROI(size_t index);
+    void clearROIs();
+    size_t getROICount() const { return m_rois.size(); }
+    const TrackROI& getROI(size_t index) const { return m_rois[index].roi; }
+    size_t getROIHitCount(size_t index) const { return m_rois[index].hitList.size(); }
+
+    // 1 for tracks passing every ROI; all present tracks pass when there are none
+    const std::vector<uint8_t>& evaluate();
+    // Tracks whose result flipped in the last evaluate(); after build() every present track starts passing
+    const std::vector<uint32_t>& getChangedTracks() const { return m_changedTracks; }
+    size_t getSelectedCount() const { return m_selectedCount; }
+    double getEvaluateMs() const { return m_evaluateMs; }     // Of the last evaluate() that did work
+
+private:
+    struct VoxelRun {
+        uint32_t track;
+        uint32_t firstPoint : 24;   // The run continues while points stay in the voxel
+        uint32_t cells : 8;         // Sub-voxels touched, bit x + 2y + 4z
+    };
+
+    struct ROIState {
+        TrackROI roi;
+        std::vector<uint8_t> hits;      // Per track
+        std::vector<uint32_t> hitList;  // The set entries of hits
+        bool dirty;
+    };
+
+    void collectHits(const TrackROI& roi, std::vector<uint32_t>& hits);   // Marks them in m_scratch
+    void updateHits(ROIState& state, std::vector<uint32_t>& touched);
+    void rebuildCounters();
+    bool runHits(const VoxelRun& run, size_t voxel, const TrackROI& roi) const;
+    const FiberTrack* findTrack(uint32_t sourceIndex) const;   // Null outside the data
+    size_t voxelOf(const TrackPoint& point, uint32_t& cell) const;
+    size_t threadCount(size_t items, size_t itemsPerThread) const;
+
+    std::shared_ptr<const std::vector<FiberTrack>> m_tracks;
+    std::shared_ptr<const std::vector<FiberTrack>> m_appended;
+    std::vector<uint32_t> m_selection;
+    int m_threadCount;
+    float m_voxelSize;
+
+    // Grid and inverted index (CSR: voxel v lists m_voxelRuns[m_voxelStarts[v], m_voxelStarts[v + 1]))
+    float m_gridOrigin[3];
+    float m_gridVoxelSize;
+    float m_gridInverseSize;
+    int m_gridDims[3];
+    std::vector<size_t> m_voxelStarts;
+    std::vector<VoxelRun> m_voxelRuns;
+
+    std::vector<ROIState> m_rois;
+    std::vector<uint16_t> m_includeHits;    // Per track: include ROIs it passes
+    std::vector<uint16_t> m_excludeHits;
+    std::vector<uint8_t> m_scratch;
+    std::vector<uint8_t> m_result;
+    std::vector<uint32_t> m_changedTracks;
+    size_t m_includeCount;
+    size_t m_selectedCount;
+    bool m_resultDirty;
+    bool m_countersDirty;   // ROIs were added, removed or changed mode
+    double m_buildMs;
+    double m_evaluateMs;
+};
+
+} // namespace DTIFiberLib
+
+#endif // TRACKROIFILTER_H
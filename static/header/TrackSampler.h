@@ -0,0 +1,59 @@
+#ifndef TRACKSAMPLER_H
+#define TRACKSAMPLER_H
+
+#include "TrkFileReader.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace DTIFiberLib {
+
+/**
+ * Track Sampler
+ * Chooses which tracks of a dataset to draw as a list of track indices, so a subset
+ * can be handed to GLFiberRenderer::setTracks() against the shared data instead of
+ * copying tracks. Selections are ascending, which keeps the renderer's vertex order
+ * in file order, and depend only on the seed.
+ *
+ * Stratified selection groups tracks into cells by the grid cells of both endpoints and
+ * the midpoint plus a binned end-to-end orientation, then fills the count with an equal
+ * quota per cell: cells smaller than the quota are kept whole, so thin bundles survive
+ * while dense ones are thinned. Cell keys and per-cell choices are computed in parallel;
+ * each track's rank within its cell is a hash of the seed and its index, so the result
+ * does not depend on the thread count.
+ */
+class TrackSampler {
+public:
+    TrackSampler();
+
+    void setSeed(uint64_t seed) { m_seed = seed; }
+    uint64_t getSeed() const { return m_seed; }
+    void setThreadCount(int threads);           // 0 uses all hardware threads
+    void setCellSize(float size);               // Endpoint/midpoint grid (mm, default 10)
+    void setOrientationBins(int bins);          // Per axis of the end-to-end direction (default 4)
+
+    // Every index of [0, trackCount)
+    static std::vector<uint32_t> selectAll(size_t trackCount);
+
+    // `count` distinct indices drawn uniformly from [0, trackCount); all of them when count >= trackCount
+    std::vector<uint32_t> selectRandom(size_t trackCount, size_t count) const;
+
+    // `count` indices with an equal quota per cell; empty tracks are never chosen
+    std::vector<uint32_t> selectStratified(const std::vector<FiberTrack>& tracks, size_t count);
+    size_t getCellCount() const { return m_cellCount; }    // Of the last stratified selection; 0 when it took every track
+    double getElapsedMs() const { return m_elapsedMs; }    // Of the last stratified selection
+
+private:
+    uint64_t cellKey(const FiberTrack& track) const;
+
+    uint64_t m_seed;
+    int m_threadCount;
+    float m_cellSize;
+    int m_orientationBins;
+    size_t m_cellCount;
+    double m_elapsedMs;
+};
+
+} // namespace DTIFiberLib
+
+#endif // TRACKSAMPLER_H
@@ -0,0 +1,86 @@
+#ifndef TRACKSTATISTICS_H
+#define TRACKSTATISTICS_H
+
+#include "TrkFileReader.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace DTIFiberLib {
+
+/**
+ * Track Statistics
+ * Per-track attributes for filtering and QC, stored as one float column per attribute
+ * and computed in parallel right after loading. Each track's points are gathered into
+ * coordinate arrays once and reduced there by SSE2 kernels where available.
+ *
+ * Every column also keeps its tracks sorted by value, so a range query ("length 40 to
+ * 200 mm") is two binary searches returning a span of that order, and a visibility
+ * mask for GLFiberRenderer::setTrackVisibility() costs one pass over the mask. Tracks
+ * are indexed like the selection passed to build(), i.e. like the renderer's tracks.
+ */
+class TrackStatistics {
+public:
+    // Fixed columns; the mean of per-point scalar s is column SCALAR_MEAN + s
+    enum Column {
+        LENGTH,             // mm along the polyline
+        POINT_COUNT,
+        MEAN_CURVATURE,     // 1/mm: Menger curvature of consecutive point triples, averaged
+        MIN_X, MIN_Y, MIN_Z,
+        MAX_X, MAX_Y, MAX_Z,
+        START_X, START_Y, START_Z,
+        END_X, END_Y, END_Z,
+        SCALAR_MEAN
+    };
+
+    TrackStatistics();
+
+    void setThreadCount(int threads);   // 0 uses all hardware threads
+
+    // Selection entries outside the data (e.g. removed tracks) and empty tracks have 0 length
+    // and points, NaN in the other columns, and are in no sorted order: no range selects them.
+    // The same holds for any other non-finite value, such as the mean of a NaN scalar.
+    // Selection indices past the end of `tracks` address `appended`
+    bool build(const std::vector<FiberTrack>& tracks, const std::vector<uint32_t>& selection,
+               const std::vector<FiberTrack>* appended = nullptr);
+    void clear();
+    bool isBuilt() const { return !m_columns.empty(); }
+    double getBuildMs() const { return m_buildMs; }
+
+    size_t getTrackCount() const { return m_trackCount; }
+    size_t getColumnCount() const { return m_columns.size(); }
+    size_t getScalarCount() const { return m_columns.empty() ? 0 : m_columns.size() - SCALAR_MEAN; }
+    std::string getColumnName(size_t column) const;
+
+    const std::vector<float>& getColumn(size_t column) const { return m_columns[column]; }
+    float getValue(size_t column, size_t track) const { return m_columns[column][track]; }
+    bool getRange(size_t column, float& minValue, float& maxValue) const;   // False without any valid track
+
+    // Tracks with a finite value in the column, ascending by value (ties by track)
+    const std::vector<uint32_t>& getSortedTracks(size_t column) const { return m_sortedTracks[column]; }
+
+    // Span [first, last) of getSortedTracks(column) with minValue <= value <= maxValue
+    std::pair<size_t, size_t> findRange(size_t column, float minValue, float maxValue) const;
+    size_t countRange(size_t column, float minValue, float maxValue) const;
+
+    // mask[t] = 1 for tracks in the range, 0 for the rest; sized to the track count
+    void selectRange(size_t column, float minValue, float maxValue, std::vector<uint8_t>& mask) const;
+    // Clears mask entries of tracks outside the range, so several ranges combine with AND
+    void restrictRange(size_t column, float minValue, float maxValue, std::vector<uint8_t>& mask) const;
+
+private:
+    size_t threadCount(size_t items, size_t itemsPerThread) const;
+
+    int m_threadCount;
+    size_t m_trackCount;
+    std::vector<std::vector<float>> m_columns;
+    std::vector<std::vector<uint32_t>> m_sortedTracks;  // Per column
+    std::vector<std::vector<uint32_t>> m_unsortedTracks;    // Per column: empty or non-finite, ascending
+    double m_buildMs;
+};
+
+} // namespace DTIFiberLib
+
+#endif // TRACKSTATISTICS_H
@@ -5,6 +5,7 @@
 #include <string>
 #include <fstream>
 #include <cstdint>
+#include <memory>
 
 namespace DTIFiberLib {
 
@@ -50,8 +51,10 @@ namespace DTIFiberLib {
         bool IsValidFile() const { return m_isValidFile; }
         
         const TractographyHeader& GetHeader() const { return m_tractographyHeader; }
-        const std::vector<FiberTrack>& GetAllTracks() const { return m_fiberTracks; }
-        size_t GetTrackCount() const { return m_fiberTracks.size(); }
+        const std::vector<FiberTrack>& GetAllTracks() const { return *m_fiberTracks; }
+        // Shared with the caller; the next load allocates a new vector instead of clearing this one
+        std::shared_ptr<const std::vector<FiberTrack>> GetSharedTracks() const { return m_fiberTracks; }
+        size_t GetTrackCount() const { return m_fiberTracks->size(); }
         const FiberTrack& GetTrack(size_t index) const;
         
         void PrintHeaderInfo() const;
@@ -66,7 +69,7 @@ namespace DTIFiberLib {
         
         std::ifstream m_file;
         TractographyHeader m_tractographyHeader;
-        std::vector<FiberTrack> m_fiberTracks;
+        std::shared_ptr<std::vector<FiberTrack>> m_fiberTracks;
         bool m_isValidFile;
         std::string m_lastErrorMessage;
     };
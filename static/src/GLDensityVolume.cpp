@@ -0,0 +1,284 @@
+#include "../header/GLDensityVolume.h"
+#include "../header/TrackDensityImager.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace DTIFiberLib {
+
+// Full-screen triangle; each fragment marches its own ray through the volume box
+static const char* volumeVertexShaderSource = R"(
+#version 460 core
+void main() {
+    vec2 corner = vec2(float((gl_VertexID & 1) * 4 - 1), float((gl_VertexID & 2) * 2 - 1));
+    gl_Position = vec4(corner, 0.0, 1.0);
+}
+)";
+
+static const char* volumeFragmentShaderSource = R"(
+#version 460 core
+layout(binding = 2) uniform sampler1D uColormap;
+layout(binding = 3) uniform sampler3D uDensity;
+out vec4 FragmentColor;
+
+uniform mat4 uInverseMVP;
+uniform vec4 uViewport;         // x, y, width, height
+uniform vec3 uVolumeOrigin;
+uniform vec3 uVolumeExtent;
+uniform vec3 uVolumeDim;
+uniform float uOpacityScale;
+uniform int uColorByDirection;
+
+const int kMaxSteps = 512;
+
+void main() {
+    vec2 ndc = (gl_FragCoord.xy - uViewport.xy) / uViewport.zw * 2.0 - 1.0;
+    vec4 nearPoint = uInverseMVP * vec4(ndc, -1.0, 1.0);
+    vec4 farPoint = uInverseMVP * vec4(ndc, 1.0, 1.0);
+
+    // Ray from the near to the far plane, in texture coordinates
+    vec3 origin = (nearPoint.xyz / nearPoint.w - uVolumeOrigin) / uVolumeExtent;
+    vec3 direction = (farPoint.xyz / farPoint.w - uVolumeOrigin) / uVolumeExtent - origin;
+    direction = mix(direction, vec3(1e-7), lessThan(abs(direction), vec3(1e-7)));
+
+    vec3 t0 = -origin / direction;
+    vec3 t1 = (1.0 - origin) / direction;
+    vec3 tEnter = min(t0, t1);
+    vec3 tExit = max(t0, t1);
+    float tNear = max(max(tEnter.x, tEnter.y), max(tEnter.z, 0.0));
+    float tFar = min(min(tExit.x, tExit.y), min(tExit.z, 1.0));
+    if (tNear >= tFar) {
+        discard;
+    }
+
+    // About two samples per voxel crossed
+    float voxelsCrossed = length(direction * (tFar - tNear) * uVolumeDim);
+    int steps = clamp(int(ceil(voxelsCrossed * 2.0)), 1, kMaxSteps);
+    float dt = (tFar - tNear) / float(steps);
+    float stepVoxels = voxelsCrossed / float(steps);
+
+    // Front-to-back compositing with early termination
+    vec4 accumulated = vec4(0.0);
+    for (int i = 0; i < steps; ++i) {
+        vec4 density = texture(uDensity, origin + direction * (tNear + (float(i) + 0.5) * dt));
+        if (density.a <= 0.0) {
+            continue;
+        }
+        float alpha = 1.0 - exp(-uOpacityScale * density.a * stepVoxels);
+        vec3 color = uColorByDirection != 0 ? density.rgb / max(max(density.r, density.g), max(density.b, 1e-6))
+                                            : texture(uColormap, clamp(density.a, 0.0, 1.0)).rgb;
+        accumulated += (1.0 - accumulated.a) * vec4(color * alpha, alpha);
+        if (accumulated.a > 0.99) {
+            break;
+        }
+    }
+    if (accumulated.a <= 0.0) {
+        discard;
+    }
+    FragmentColor = accumulated;    // Premultiplied
+}
+)";
+
+namespace {
+
+// Column-major 4x4 inverse; false if singular
+bool invertMatrix(const float* m, float* out)
+{
+    float inv[16];
+    inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+    inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+    inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+    inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+    inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+    inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+    inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+    inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+    float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+    if (det == 0.0f) {
+        return false;
+    }
+    det = 1.0f / det;
+    for (int i = 0; i < 16; ++i) {
+        out[i] = inv[i] * det;
+    }
+    return true;
+}
+
+} // namespace
+
+GLDensityVolume::GLDensityVolume()
+    : m_texture(0)
+    , m_VAO(0)
+    , m_built(false)
+    , m_opacityScale(0.5f)
+    , m_buildMs(0.0)
+{
+    std::memset(m_dim, 0, sizeof(m_dim));
+    std::memset(m_origin, 0, sizeof(m_origin));
+    std::memset(m_extent, 0, sizeof(m_extent));
+}
+
+GLDensityVolume::~GLDensityVolume()
+{
+    cleanup();
+}
+
+bool GLDensityVolume::initialize()
+{
+    m_shader = std::make_unique<GLShaderProgram>();
+    if (!m_shader->loadFromString(volumeVertexShaderSource, volumeFragmentShaderSource)) {
+        std::cerr << "Density volume shader unavailable" << std::endl;
+        m_shader.reset();
+        return false;
+    }
+    glGenTextures(1, &m_texture);
+    glGenVertexArrays(1, &m_VAO);
+    return true;
+}
+
+void GLDensityVolume::cleanup()
+{
+    if (m_texture != 0) {
+        glDeleteTextures(1, &m_texture);
+        m_texture = 0;
+    }
+    if (m_VAO != 0) {
+        glDeleteVertexArrays(1, &m_VAO);
+        m_VAO = 0;
+    }
+    m_shader.reset();
+    m_built = false;
+}
+
+bool GLDensityVolume::build(const std::vector<FiberTrack>& tracks, const std::vector<uint32_t>& selection,
+                            const float* boundsMin, const float* boundsMax, int resolution,
+                            const std::vector<FiberTrack>* appended)
+{
+    m_built = false;
+    if (!m_shader || selection.empty() || resolution < 2) {
+        return false;
+    }
+    const auto start = std::chrono::steady_clock::now();
+
+    // Isotropic voxels with a one-voxel margin, so trilinear samples fade out at the box faces
+    float longest = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+        longest = std::max(longest, boundsMax[i] - boundsMin[i]);
+    }
+    const float voxelSize = std::max(longest, 1e-3f) / static_cast<float>(resolution);
+
+    DensityGrid grid;
+    std::memset(&grid, 0, sizeof(grid));
+    for (int i = 0; i < 3; ++i) {
+        grid.dim[i] = static_cast<int>(std::ceil((boundsMax[i] - boundsMin[i]) / voxelSize)) + 2;
+        grid.voxelSize[i] = voxelSize;
+        grid.origin[i] = boundsMin[i] - voxelSize;
+        grid.voxToRas[i][i] = voxelSize;
+        grid.voxToRas[i][3] = grid.origin[i] + 0.5f * voxelSize;
+        m_dim[i] = grid.dim[i];
+        m_origin[i] = grid.origin[i];
+        m_extent[i] = grid.dim[i] * voxelSize;
+    }
+    grid.voxToRas[3][3] = 1.0f;
+
+    TrackDensityImager imager;
+    imager.setGrid(grid);
+    imager.setDirectionWeighted(true);
+    if (!imager.compute(tracks, selection, appended)) {
+        return false;
+    }
+    const std::vector<float>& density = imager.getDensity();
+
+    // Normalize by a high percentile rather than the maximum, which a few crossing hubs dominate
+    std::vector<float> lengths;
+    lengths.reserve(density.size() / 4);
+    for (size_t i = 3; i < density.size(); i += 4) {
+        if (density[i] > 0.0f) {
+            lengths.push_back(density[i]);
+        }
+    }
+    if (lengths.empty()) {
+        return false;
+    }
+    auto percentile = lengths.begin() + static_cast<std::ptrdiff_t>((lengths.size() - 1) * 99 / 100);
+    std::nth_element(lengths.begin(), percentile, lengths.end());
+    const float scale = 1.0f / *percentile;
+
+    std::vector<float> texels(density.size());
+    for (size_t i = 0; i < density.size(); ++i) {
+        texels[i] = density[i] * scale;
+    }
+
+    glBindTexture(GL_TEXTURE_3D, m_texture);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, m_dim[0], m_dim[1], m_dim[2], 0, GL_RGBA, GL_FLOAT, texels.data());
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    m_built = true;
+    m_buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+void GLDensityVolume::draw(const float* mvpMatrix, const GLint* viewport, bool colorByDirection)
+{
+    float inverseMVP[16];
+    if (!m_built || !invertMatrix(mvpMatrix, inverseMVP)) {
+        return;
+    }
+
+    // Nothing is opaque, so the volume neither tests nor writes depth
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    GLboolean depthMask = GL_TRUE;
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+    glDisable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+    m_shader->use();
+    m_shader->setUniformMatrix4fv("uInverseMVP", inverseMVP);
+    const float viewportValues[4] = { static_cast<float>(viewport[0]), static_cast<float>(viewport[1]),
+                                      static_cast<float>(viewport[2]), static_cast<float>(viewport[3]) };
+    m_shader->setUniform4fv("uViewport", 1, viewportValues);
+    m_shader->setUniform3f("uVolumeOrigin", m_origin[0], m_origin[1], m_origin[2]);
+    m_shader->setUniform3f("uVolumeExtent", m_extent[0], m_extent[1], m_extent[2]);
+    m_shader->setUniform3f("uVolumeDim", static_cast<float>(m_dim[0]), static_cast<float>(m_dim[1]), static_cast<float>(m_dim[2]));
+    m_shader->setUniform1f("uOpacityScale", m_opacityScale);
+    m_shader->setUniform1i("uColorByDirection", colorByDirection ? 1 : 0);
+
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_3D, m_texture);
+    glBindVertexArray(m_VAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(depthMask);
+    if (depthTest) {
+        glEnable(GL_DEPTH_TEST);
+    }
+}
+
+size_t GLDensityVolume::getTextureBytes() const
+{
+    return m_built ? static_cast<size_t>(m_dim[0]) * m_dim[1] * m_dim[2] * 4 * sizeof(uint16_t) : 0;
+}
+
+} // namespace DTIFiberLib
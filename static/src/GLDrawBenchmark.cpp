@@ -0,0 +1,255 @@
+#include "../header/GLDrawBenchmark.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <random>
+
+namespace DTIFiberLib {
+
+static const char* benchmarkVertexShaderSource = R"(
+#version 460 core
+layout(location = 0) in vec3 aPosition;
+
+void main() {
+    gl_Position = vec4(aPosition, 1.0);
+}
+)";
+
+static const char* benchmarkFragmentShaderSource = R"(
+#version 460 core
+out vec4 FragmentColor;
+
+void main() {
+    FragmentColor = vec4(1.0);
+}
+)";
+
+static const GLsizei kTargetWidth = 1024;
+static const GLsizei kTargetHeight = 768;
+
+GLDrawBenchmark::GLDrawBenchmark()
+    : m_trackCounts({ 10000, 100000, 1000000, 10000000 })
+    , m_pointsPerTrack(8)
+    , m_frameCount(20)
+    , m_FBO(0)
+    , m_colorRBO(0)
+    , m_depthRBO(0)
+    , m_query(0)
+{
+}
+
+GLDrawBenchmark::~GLDrawBenchmark()
+{
+    destroyTarget();
+}
+
+void GLDrawBenchmark::setTrackCounts(const std::vector<size_t>& counts)
+{
+    m_trackCounts = counts;
+}
+
+void GLDrawBenchmark::setPointsPerTrack(size_t points)
+{
+    m_pointsPerTrack = points < 2 ? 2 : points;
+}
+
+void GLDrawBenchmark::setFrameCount(int frames)
+{
+    m_frameCount = frames < 1 ? 1 : frames;
+}
+
+bool GLDrawBenchmark::createTarget()
+{
+    if (!m_shader.isValid() &&
+        !m_shader.loadFromString(benchmarkVertexShaderSource, benchmarkFragmentShaderSource)) {
+        std::cerr << "Failed to create benchmark shader" << std::endl;
+        return false;
+    }
+
+    // Offscreen target so the benchmark never disturbs the visible framebuffer
+    glGenFramebuffers(1, &m_FBO);
+    glGenRenderbuffers(1, &m_colorRBO);
+    glGenRenderbuffers(1, &m_depthRBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_colorRBO);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, kTargetWidth, kTargetHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depthRBO);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, kTargetWidth, kTargetHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorRBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthRBO);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    glGenQueries(1, &m_query);
+
+    if (!complete) {
+        std::cerr << "Benchmark framebuffer incomplete" << std::endl;
+    }
+    return complete;
+}
+
+void GLDrawBenchmark::destroyTarget()
+{
+    if (m_query != 0) {
+        glDeleteQueries(1, &m_query);
+        m_query = 0;
+    }
+    if (m_FBO != 0) {
+        glDeleteFramebuffers(1, &m_FBO);
+        m_FBO = 0;
+    }
+    if (m_colorRBO != 0) {
+        glDeleteRenderbuffers(1, &m_colorRBO);
+        m_colorRBO = 0;
+    }
+    if (m_depthRBO != 0) {
+        glDeleteRenderbuffers(1, &m_depthRBO);
+        m_depthRBO = 0;
+    }
+}
+
+std::vector<DrawBenchmarkResult> GLDrawBenchmark::run()
+{
+    std::vector<DrawBenchmarkResult> results;
+
+    GLint previousFBO = 0;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFBO);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+    if (createTarget()) {
+        glViewport(0, 0, kTargetWidth, kTargetHeight);
+        glEnable(GL_DEPTH_TEST);
+
+        for (size_t trackCount : m_trackCounts) {
+            results.push_back(runSize(trackCount));
+        }
+    }
+
+    destroyTarget();
+    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(previousFBO));
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+
+    return results;
+}
+
+DrawBenchmarkResult GLDrawBenchmark::runSize(size_t trackCount)
+{
+    DrawBenchmarkResult result = {};
+    result.trackCount = trackCount;
+    result.vertexCount = trackCount * m_pointsPerTrack;
+
+    // Synthetic random walks inside clip space
+    std::mt19937 gen(12345);
+    std::uniform_real_distribution<float> startDist(-0.9f, 0.9f);
+    std::uniform_real_distribution<float> stepDist(-0.02f, 0.02f);
+
+    // The largest default size needs over 1 GB of host memory; a size that does not fit is skipped
+    std::vector<float> positions;
+    std::vector<GLint> starts;
+    std::vector<GLsizei> counts;
+    std::vector<GLuint> indices;
+    try {
+        positions.resize(result.vertexCount * 3);
+        starts.resize(trackCount);
+        counts.assign(trackCount, static_cast<GLsizei>(m_pointsPerTrack));
+        indices.reserve(trackCount * (m_pointsPerTrack + 1));
+    } catch (const std::bad_alloc&) {
+        return result;
+    }
+
+    float* out = positions.data();
+    for (size_t t = 0; t < trackCount; ++t) {
+        starts[t] = static_cast<GLint>(t * m_pointsPerTrack);
+        float x = startDist(gen), y = startDist(gen), z = startDist(gen);
+        for (size_t p = 0; p < m_pointsPerTrack; ++p) {
+            *out++ = x; *out++ = y; *out++ = z;
+            x += stepDist(gen); y += stepDist(gen); z += stepDist(gen);
+            indices.push_back(static_cast<GLuint>(t * m_pointsPerTrack + p));
+        }
+        indices.push_back(0xFFFFFFFFu);
+    }
+
+    GLuint vao = 0, vbo = 0, ibo = 0;
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ibo);
+    glBindVertexArray(vao);
+
+    while (glGetError() != GL_NO_ERROR) {}
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(float), positions.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    result.completed = (glGetError() == GL_NO_ERROR);
+    if (result.completed) {
+        m_shader.use();
+        const GLsizei indexCount = static_cast<GLsizei>(indices.size());
+        const GLsizei drawCount = static_cast<GLsizei>(trackCount);
+
+        for (int path = 0; path < 2; ++path) {
+            double cpuMs = 0.0;
+            double gpuMs = 0.0;
+
+            // One warm-up frame, then timed frames
+            for (int frame = -1; frame < m_frameCount; ++frame) {
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                glFinish();
+
+                glBeginQuery(GL_TIME_ELAPSED, m_query);
+                auto cpuStart = std::chrono::high_resolution_clock::now();
+                if (path == 0) {
+                    glMultiDrawArrays(GL_LINE_STRIP, starts.data(), counts.data(), drawCount);
+                } else {
+                    glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+                    glDrawElements(GL_LINE_STRIP, indexCount, GL_UNSIGNED_INT, nullptr);
+                    glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+                }
+                auto cpuEnd = std::chrono::high_resolution_clock::now();
+                glEndQuery(GL_TIME_ELAPSED);
+
+                GLuint64 elapsedNs = 0;
+                glGetQueryObjectui64v(m_query, GL_QUERY_RESULT, &elapsedNs);
+
+                if (frame >= 0) {
+                    cpuMs += std::chrono::duration<double, std::milli>(cpuEnd - cpuStart).count();
+                    gpuMs += static_cast<double>(elapsedNs) / 1.0e6;
+                }
+            }
+
+            if (path == 0) {
+                result.multiDrawCpuMs = cpuMs / m_frameCount;
+                result.multiDrawGpuMs = gpuMs / m_frameCount;
+            } else {
+                result.restartCpuMs = cpuMs / m_frameCount;
+                result.restartGpuMs = gpuMs / m_frameCount;
+            }
+        }
+    }
+
+    glBindVertexArray(0);
+    glDeleteBuffers(1, &ibo);
+    glDeleteBuffers(1, &vbo);
+    glDeleteVertexArrays(1, &vao);
+
+    return result;
+}
+
+FiberDrawPath GLDrawBenchmark::recommendedPath(const std::vector<DrawBenchmarkResult>& results)
+{
+    double multiDrawTotal = 0.0;
+    double restartTotal = 0.0;
+    for (const auto& result : results) {
+        if (!result.completed) continue;
+        multiDrawTotal += std::max(result.multiDrawGpuMs, result.multiDrawCpuMs);
+        restartTotal += std::max(result.restartGpuMs, result.restartCpuMs);
+    }
+    return restartTotal < multiDrawTotal ? FiberDrawPath::PRIMITIVE_RESTART : FiberDrawPath::MULTI_DRAW_ARRAYS;
+}
+
+} // namespace DTIFiberLib
@@ -1,10 +1,104 @@
 #include "../header/GLFiberRenderer.h"
 #include <iostream>
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstring>
+#include <string>
 
 namespace DTIFiberLib {
 
-// Embedded shaders
+// Per-frame parameters, written once per render() into a uniform buffer that every track
+// program and the cull pass read. Layout must match FrameParameters below (std140).
+static const char* frameParameterShaderSource = R"(
+layout(std140, binding = 0) uniform FrameParameters {
+    mat4 uMVPMatrix;
+    vec4 uFrustumPlanes[6];
+    vec4 uEye;                  // w = 1: eye position, w = 0: direction towards the eye
+    vec2 uScalarWindow;         // (level, window)
+    vec2 uViewportSize;
+    float uOpacity;
+    float uTubeRadius;
+    float uMinScreenSize;
+    float uPixelsPerVertex;     // 0 disables LOD
+    int uTrackCount;
+    int uMaxPointsPerTrack;     // 0 means unlimited
+    int uClipPlaneCount;
+    vec4 uClipPlanes[6];        // World space, kept where dot(plane, vec4(p, 1)) >= 0
+};
+)";
+
+struct FrameParameters {
+    float mvpMatrix[16];
+    float frustumPlanes[6][4];
+    float eye[4];
+    float scalarWindow[2];
+    float viewportSize[2];
+    float opacity;
+    float tubeRadius;
+    float minScreenSize;
+    float pixelsPerVertex;
+    int32_t trackCount;
+    int32_t maxPointsPerTrack;
+    int32_t clipPlaneCount;
+    int32_t padding;
+    float clipPlanes[6][4];
+};
+
+// Per-track attributes shared by every vertex stage. COLOR_MODE selects the coloring at
+// compile time (values of FiberColoringMode). trackAttributes[id] = (RGBA8 color,
+// flags | bundleId << 8); vertexScalars holds one float per point for the colormap mode.
+static const char* trackAttributeShaderSource = R"(
+layout(std430, binding = 5) readonly buffer TrackAttributeBuffer { uvec2 trackAttributes[]; };
+layout(std430, binding = 6) readonly buffer SlotTrackBuffer { uint slotTracks[]; };
+layout(std430, binding = 7) readonly buffer ScalarBuffer { float vertexScalars[]; };
+layout(binding = 2) uniform sampler1D uColormap;
+
+const uint kTrackVisible = 1u;
+const uint kTrackHighlighted = 2u;
+
+vec3 hashColor(uint id) {
+    id = id * 747796405u + 2891336453u;
+    id = ((id >> ((id >> 28u) + 4u)) ^ id) * 277803737u;
+    id = (id >> 22u) ^ id;
+    return 0.25 + 0.75 * vec3(uvec3(id, id >> 8u, id >> 16u) & 255u) / 255.0;
+}
+
+// Color of a track vertex; returns false for hidden tracks
+bool shadeTrack(uint trackId, uint vertexIndex, vec3 direction, out vec3 color) {
+    uvec2 attributes = trackAttributes[trackId];
+#if COLOR_MODE == 1
+    color = abs(normalize(direction));
+#elif COLOR_MODE == 2
+    color = hashColor(trackId);
+#elif COLOR_MODE == 3
+    color = hashColor((attributes.y >> 8u) ^ 0x5bd1e995u);
+#elif COLOR_MODE == 4
+    color = unpackUnorm4x8(attributes.x).rgb;
+#elif COLOR_MODE == 5
+    float t = (vertexScalars[vertexIndex] - uScalarWindow.x) / max(uScalarWindow.y, 1e-20) + 0.5;
+    color = textureLod(uColormap, clamp(t, 0.0, 1.0), 0.0).rgb;
+#else
+    color = vec3(1.0, 0.0, 0.0);
+#endif
+    if ((attributes.y & kTrackHighlighted) != 0u) {
+        color = mix(color, vec3(1.0, 1.0, 0.6), 0.6);
+    }
+    return (attributes.y & kTrackVisible) != 0u;
+}
+)";
+
+// Clip plane distances for every vertex stage; planes past uClipPlaneCount are not enabled
+static const char* clipDistanceShaderSource = R"(
+out float gl_ClipDistance[6];
+
+void writeClipDistances(vec3 position) {
+    for (int i = 0; i < 6; ++i) {
+        gl_ClipDistance[i] = i < uClipPlaneCount ? dot(uClipPlanes[i], vec4(position, 1.0)) : 1.0;
+    }
+}
+)";
+
 static const char* vertexShaderSource = R"(
 #version 460 core
 layout(location = 0) in vec3 aPosition;
@@ -12,48 +106,509 @@ layout(location = 1) in vec3 aDirection;
 
 out vec3 FragColor;
 
-uniform mat4 uMVPMatrix;
-uniform int uColorMode;
+#ifdef TRACK_ID_ATTRIBUTE
+// Indexed draws have no per-track gl_DrawID
+layout(location = 2) in uint aTrackId;
+#else
+uniform int uSlotBase;          // First draw slot of the current multi-draw
+#endif
 
 void main() {
+#ifdef TRACK_ID_ATTRIBUTE
+    uint trackId = aTrackId;
+#else
+    uint trackId = slotTracks[uint(uSlotBase + gl_DrawID)];
+#endif
+    writeClipDistances(aPosition);
+    if (!shadeTrack(trackId, uint(gl_VertexID), aDirection, FragColor)) {
+        // Hidden tracks are pushed beyond the far plane so every segment is clipped
+        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
+        return;
+    }
     gl_Position = uMVPMatrix * vec4(aPosition, 1.0);
+}
+)";
 
-    if (uColorMode == 1) {
-        // Direction-based RGB coloring
-        FragColor = abs(normalize(aDirection));
-    } else {
-        // Default solid color (red)
-        FragColor = vec3(1.0, 0.0, 0.0);
+// Shared by every track program: TUBE_IMPOSTOR reconstructs the cylinder normal from the
+// across-tube coordinate, lights it with a headlight and uses the depth of the tube surface
+// rather than the flat quad. OIT_OUTPUT writes weighted blended OIT targets (McGuire &
+// Bavoil 2013), accumulated with additive / multiplicative blending so order does not matter.
+static const char* trackFragmentShaderSource = R"(
+#version 460 core
+in vec3 FragColor;
+#ifdef TUBE_IMPOSTOR
+in vec3 vAxisPosition;
+in vec3 vSide;
+in vec3 vView;
+in float vAcross;
+#endif
+
+#ifdef OIT_OUTPUT
+layout(location = 0) out vec4 AccumColor;
+layout(location = 1) out float Revealage;
+#else
+out vec4 FragmentColor;
+#endif
+
+void main() {
+    vec3 color = FragColor;
+    float depth = gl_FragCoord.z;
+
+#ifdef TUBE_IMPOSTOR
+    float t = clamp(vAcross, -1.0, 1.0);
+    float bulge = sqrt(max(1.0 - t * t, 0.0));
+    vec3 view = normalize(vView);
+    vec3 normal = normalize(normalize(vSide) * t + view * bulge);
+
+    float diffuse = max(dot(normal, view), 0.0);
+    float specular = pow(diffuse, 32.0);
+    color = FragColor * (0.25 + 0.75 * diffuse) + vec3(0.3 * specular);
+
+    vec4 surface = uMVPMatrix * vec4(vAxisPosition + view * (bulge * uTubeRadius), 1.0);
+    depth = clamp((surface.z / surface.w) * 0.5 + 0.5, 0.0, 1.0);
+#ifndef OIT_OUTPUT
+    gl_FragDepth = depth;
+#endif
+#endif
+
+#ifdef OIT_OUTPUT
+    float alpha = uOpacity;
+    float weight = clamp(pow(min(1.0, alpha * 10.0) + 0.01, 3.0) * 1e8 *
+                         pow(1.0 - depth * 0.9, 3.0), 1e-2, 3e3);
+    AccumColor = vec4(color * alpha, alpha) * weight;
+    Revealage = alpha;
+#else
+    FragmentColor = vec4(color, uOpacity);
+#endif
+}
+)";
+
+// GPU-driven culling: one invocation per track writes a DrawArraysIndirectCommand
+// for each surviving track and picks a vertex stride from its projected size
+static const char* cullComputeShaderSource = R"(
+#version 460 core
+layout(local_size_x = 256) in;
+
+struct DrawArraysIndirectCommand {
+    uint count;
+    uint instanceCount;
+    uint first;
+    uint baseInstance;
+};
+
+layout(std430, binding = 1) readonly buffer TrackInfoBuffer { vec4 trackInfo[]; };
+layout(std430, binding = 2) writeonly buffer TrackLodBuffer { uint trackStride[]; };
+layout(std430, binding = 3) writeonly buffer CommandBuffer { DrawArraysIndirectCommand commands[]; };
+layout(std430, binding = 4) buffer DrawCountBuffer { uint drawCount; };
+layout(std430, binding = 5) readonly buffer TrackAttributeBuffer { uvec2 trackAttributes[]; };
+
+void main() {
+    uint trackId = gl_GlobalInvocationID.x;
+    if (trackId >= uint(uTrackCount)) {
+        return;
+    }
+
+    vec4 boundsMin = trackInfo[trackId * 2u];
+    vec4 boundsMax = trackInfo[trackId * 2u + 1u];
+    uint start = floatBitsToUint(boundsMin.w);
+    uint count = floatBitsToUint(boundsMax.w);
+    if (count == 0u || (trackAttributes[trackId].y & 1u) == 0u) {
+        return;
+    }
+
+    // Frustum and clip plane tests against the box corner furthest along each plane normal
+    for (int p = 0; p < 6 + uClipPlaneCount; ++p) {
+        vec4 plane = p < 6 ? uFrustumPlanes[p] : uClipPlanes[p - 6];
+        vec3 corner = mix(boundsMin.xyz, boundsMax.xyz, greaterThanEqual(plane.xyz, vec3(0.0)));
+        if (dot(plane.xyz, corner) + plane.w < 0.0) {
+            return;
+        }
+    }
+
+    // Projected extent in pixels; boxes crossing the eye plane count as full screen
+    vec2 screenMin = vec2(1e30);
+    vec2 screenMax = vec2(-1e30);
+    bool crossesEye = false;
+    for (int c = 0; c < 8; ++c) {
+        vec3 corner = vec3((c & 1) != 0 ? boundsMax.x : boundsMin.x,
+                           (c & 2) != 0 ? boundsMax.y : boundsMin.y,
+                           (c & 4) != 0 ? boundsMax.z : boundsMin.z);
+        vec4 clip = uMVPMatrix * vec4(corner, 1.0);
+        if (clip.w <= 1e-6) {
+            crossesEye = true;
+            break;
+        }
+        screenMin = min(screenMin, clip.xy / clip.w);
+        screenMax = max(screenMax, clip.xy / clip.w);
+    }
+    vec2 extent = (screenMax - screenMin) * 0.5 * uViewportSize;
+    float screenSize = crossesEye ? 1e30 : max(extent.x, extent.y);
+    if (screenSize < uMinScreenSize) {
+        return;
+    }
+
+    // LOD: skip vertices so consecutive drawn points are roughly uPixelsPerVertex apart
+    uint stride = 1u;
+    if (uPixelsPerVertex > 0.0) {
+        float targetPoints = max(screenSize / uPixelsPerVertex, 2.0);
+        stride = uint(ceil(float(count) / targetPoints));
+    }
+    if (uMaxPointsPerTrack > 1) {
+        stride = max(stride, (count + uint(uMaxPointsPerTrack) - 1u) / uint(uMaxPointsPerTrack));
     }
+    stride = clamp(stride, 1u, 64u);
+
+    trackStride[trackId] = stride;
+    uint slot = atomicAdd(drawCount, 1u);
+    commands[slot] = DrawArraysIndirectCommand((count - 1u + stride - 1u) / stride + 1u, 1u, start, trackId);
 }
 )";
 
-static const char* fragmentShaderSource = R"(
+// Vertex pulling for indirect draws: the track is identified by gl_BaseInstance and
+// every drawn vertex maps to a strided source point (always ending on the last one)
+static const char* pullVertexShaderSource = R"(
 #version 460 core
-in vec3 FragColor;
+layout(std430, binding = 0) readonly buffer VertexBuffer { float vertices[]; };
+layout(std430, binding = 1) readonly buffer TrackInfoBuffer { vec4 trackInfo[]; };
+layout(std430, binding = 2) readonly buffer TrackLodBuffer { uint trackStride[]; };
+
+out vec3 FragColor;
+
+void main() {
+    uint trackId = uint(gl_BaseInstance);
+    uint start = floatBitsToUint(trackInfo[trackId * 2u].w);
+    uint count = floatBitsToUint(trackInfo[trackId * 2u + 1u].w);
+    uint local = uint(gl_VertexID) - start;
+    uint index = (start + min(local * trackStride[trackId], count - 1u)) * 6u;
+
+    vec3 position = vec3(vertices[index], vertices[index + 1u], vertices[index + 2u]);
+    vec3 direction = vec3(vertices[index + 3u], vertices[index + 4u], vertices[index + 5u]);
+
+    shadeTrack(trackId, index / 6u, direction, FragColor);
+    writeClipDistances(position);
+    gl_Position = uMVPMatrix * vec4(position, 1.0);
+}
+)";
+
+// Tube impostors: each segment becomes a camera-facing quad pulled straight from the
+// vertex buffer (6 vertices per segment, gl_VertexID / 6 is the segment's first point).
+// Side vectors come from the per-point direction so neighboring quads share edges.
+static const char* tubeVertexShaderSource = R"(
+#version 460 core
+layout(std430, binding = 0) readonly buffer VertexBuffer { float vertices[]; };
+
+out vec3 FragColor;
+out vec3 vAxisPosition;
+out vec3 vSide;
+out vec3 vView;
+out float vAcross;
+
+uniform int uSlotBase;
+
+const int kEnd[6] = int[6](0, 0, 1, 1, 0, 1);
+const float kSide[6] = float[6](-1.0, 1.0, -1.0, -1.0, 1.0, 1.0);
+
+void main() {
+    int corner = gl_VertexID % 6;
+    uint segment = uint(gl_VertexID / 6);
+    uint index = (segment + uint(kEnd[corner])) * 6u;
+
+    vec3 position = vec3(vertices[index], vertices[index + 1u], vertices[index + 2u]);
+    vec3 tangent = vec3(vertices[index + 3u], vertices[index + 4u], vertices[index + 5u]);
+
+    uint first = segment * 6u;
+    vec3 segmentDir = vec3(vertices[first + 6u], vertices[first + 7u], vertices[first + 8u]) -
+                      vec3(vertices[first], vertices[first + 1u], vertices[first + 2u]);
+
+    vec3 view = uEye.w > 0.5 ? normalize(uEye.xyz - position) : normalize(uEye.xyz);
+    vec3 side = cross(tangent, view);
+    if (dot(side, side) < 1e-8) {
+        side = cross(segmentDir, view);
+    }
+    side = normalize(side);
+
+    vAxisPosition = position + side * (kSide[corner] * uTubeRadius);
+    vSide = side;
+    vView = view;
+    vAcross = kSide[corner];
+    writeClipDistances(vAxisPosition);
+    gl_Position = uMVPMatrix * vec4(vAxisPosition, 1.0);
+
+    if (!shadeTrack(slotTracks[uint(uSlotBase + gl_DrawID)], index / 6u, segmentDir, FragColor)) {
+        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
+    }
+}
+)";
+
+// Full-screen triangle resolving the OIT targets over the current framebuffer
+static const char* compositeVertexShaderSource = R"(
+#version 460 core
+void main() {
+    vec2 corner = vec2(float((gl_VertexID & 1) * 4 - 1), float((gl_VertexID & 2) * 2 - 1));
+    gl_Position = vec4(corner, 0.0, 1.0);
+}
+)";
+
+static const char* compositeFragmentShaderSource = R"(
+#version 460 core
+layout(binding = 0) uniform sampler2D uAccumTexture;
+layout(binding = 1) uniform sampler2D uRevealTexture;
 out vec4 FragmentColor;
 
-uniform float uOpacity;
+uniform vec2 uViewportOrigin;
 
 void main() {
-    FragmentColor = vec4(FragColor, uOpacity);
+    ivec2 texel = ivec2(gl_FragCoord.xy - uViewportOrigin);
+    float revealage = texelFetch(uRevealTexture, texel, 0).r;
+    if (revealage >= 1.0) {
+        discard;
+    }
+    vec4 accum = texelFetch(uAccumTexture, texel, 0);
+    FragmentColor = vec4(accum.rgb / max(accum.a, 1e-5), 1.0 - revealage);
 }
 )";
 
+// Grows a buffer to at least requiredBytes (doubling) and keeps its contents. The name is
+// unchanged, so VAO attribute bindings and indexed binding points stay valid.
+static void reserveBuffer(GLuint buffer, GLsizeiptr& capacity, GLsizeiptr requiredBytes, GLenum usage)
+{
+    if (requiredBytes <= capacity) {
+        return;
+    }
+    GLsizeiptr newCapacity = std::max(requiredBytes, capacity * 2);
+
+    GLuint staging = 0;
+    if (capacity > 0) {
+        glGenBuffers(1, &staging);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, staging);
+        glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_STREAM_COPY);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, capacity);
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, newCapacity, nullptr, usage);
+
+    if (staging != 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, staging);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, capacity);
+        glDeleteBuffers(1, &staging);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    capacity = newCapacity;
+}
+
+// Two vec4 per track; start and count ride in the w components as raw uint bits
+static void packTrackInfo(const BoundingBox& box, GLint first, GLsizei count, float* info)
+{
+    uint32_t start = static_cast<uint32_t>(first);
+    uint32_t points = static_cast<uint32_t>(count);
+    info[0] = box.min[0]; info[1] = box.min[1]; info[2] = box.min[2];
+    std::memcpy(&info[3], &start, sizeof(uint32_t));
+    info[4] = box.max[0]; info[5] = box.max[1]; info[6] = box.max[2];
+    std::memcpy(&info[7], &points, sizeof(uint32_t));
+}
+
+static const uint32_t kTrackVisible = 1u;
+static const uint32_t kTrackHighlighted = 2u;
+static const uint32_t kDefaultTrackColor = 0xFF0000FFu;  // Opaque red, packed as unpackUnorm4x8 expects
+static const int kColormapSize = 256;
+static const uint32_t kRemovedTrack = 0xFFFFFFFFu;     // m_trackSelection entry of a removed track
+static const GLuint kRestartIndex = 0xFFFFFFFFu;       // GL_PRIMITIVE_RESTART_FIXED_INDEX for GL_UNSIGNED_INT
+static const FiberTrack kEmptyTrack;
+static const int kDensityVolumeSettleMs = 200;          // Pause in visibility edits before the volume follows
+
+// Eye position (w = 1) or direction towards the eye (w = 0) in model space, from the MVP alone
+static void computeEye(const float* m, float eye[4])
+{
+    // Cofactor inverse of a column-major 4x4 matrix
+    float inv[16];
+    inv[0] = m[5]*m[10]*m[15] - m[5]*m[11]*m[14] - m[9]*m[6]*m[15] + m[9]*m[7]*m[14] + m[13]*m[6]*m[11] - m[13]*m[7]*m[10];
+    inv[4] = -m[4]*m[10]*m[15] + m[4]*m[11]*m[14] + m[8]*m[6]*m[15] - m[8]*m[7]*m[14] - m[12]*m[6]*m[11] + m[12]*m[7]*m[10];
+    inv[8] = m[4]*m[9]*m[15] - m[4]*m[11]*m[13] - m[8]*m[5]*m[15] + m[8]*m[7]*m[13] + m[12]*m[5]*m[11] - m[12]*m[7]*m[9];
+    inv[12] = -m[4]*m[9]*m[14] + m[4]*m[10]*m[13] + m[8]*m[5]*m[14] - m[8]*m[6]*m[13] - m[12]*m[5]*m[10] + m[12]*m[6]*m[9];
+    inv[1] = -m[1]*m[10]*m[15] + m[1]*m[11]*m[14] + m[9]*m[2]*m[15] - m[9]*m[3]*m[14] - m[13]*m[2]*m[11] + m[13]*m[3]*m[10];
+    inv[5] = m[0]*m[10]*m[15] - m[0]*m[11]*m[14] - m[8]*m[2]*m[15] + m[8]*m[3]*m[14] + m[12]*m[2]*m[11] - m[12]*m[3]*m[10];
+    inv[9] = -m[0]*m[9]*m[15] + m[0]*m[11]*m[13] + m[8]*m[1]*m[15] - m[8]*m[3]*m[13] - m[12]*m[1]*m[11] + m[12]*m[3]*m[9];
+    inv[13] = m[0]*m[9]*m[14] - m[0]*m[10]*m[13] - m[8]*m[1]*m[14] + m[8]*m[2]*m[13] + m[12]*m[1]*m[10] - m[12]*m[2]*m[9];
+    inv[2] = m[1]*m[6]*m[15] - m[1]*m[7]*m[14] - m[5]*m[2]*m[15] + m[5]*m[3]*m[14] + m[13]*m[2]*m[7] - m[13]*m[3]*m[6];
+    inv[6] = -m[0]*m[6]*m[15] + m[0]*m[7]*m[14] + m[4]*m[2]*m[15] - m[4]*m[3]*m[14] - m[12]*m[2]*m[7] + m[12]*m[3]*m[6];
+    inv[10] = m[0]*m[5]*m[15] - m[0]*m[7]*m[13] - m[4]*m[1]*m[15] + m[4]*m[3]*m[13] + m[12]*m[1]*m[7] - m[12]*m[3]*m[5];
+    inv[14] = -m[0]*m[5]*m[14] + m[0]*m[6]*m[13] + m[4]*m[1]*m[14] - m[4]*m[2]*m[13] - m[12]*m[1]*m[6] + m[12]*m[2]*m[5];
+    inv[3] = -m[1]*m[6]*m[11] + m[1]*m[7]*m[10] + m[5]*m[2]*m[11] - m[5]*m[3]*m[10] - m[9]*m[2]*m[7] + m[9]*m[3]*m[6];
+    inv[7] = m[0]*m[6]*m[11] - m[0]*m[7]*m[10] - m[4]*m[2]*m[11] + m[4]*m[3]*m[10] + m[8]*m[2]*m[7] - m[8]*m[3]*m[6];
+    inv[11] = -m[0]*m[5]*m[11] + m[0]*m[7]*m[9] + m[4]*m[1]*m[11] - m[4]*m[3]*m[9] - m[8]*m[1]*m[7] + m[8]*m[3]*m[5];
+    inv[15] = m[0]*m[5]*m[10] - m[0]*m[6]*m[9] - m[4]*m[1]*m[10] + m[4]*m[2]*m[9] + m[8]*m[1]*m[6] - m[8]*m[2]*m[5];
+
+    // The eye maps to clip (0, 0, z, 0): it is column 2 of the inverse, up to scale
+    float h[4] = { inv[8], inv[9], inv[10], inv[11] };
+    float scale = std::fabs(h[0]) + std::fabs(h[1]) + std::fabs(h[2]);
+    if (std::fabs(h[3]) > 1e-6f * scale) {
+        eye[0] = h[0] / h[3];
+        eye[1] = h[1] / h[3];
+        eye[2] = h[2] / h[3];
+        eye[3] = 1.0f;
+    } else {
+        // Orthographic: pick the sign that decreases clip depth (towards the viewer)
+        float clipZ = m[2] * h[0] + m[6] * h[1] + m[10] * h[2];
+        float sign = clipZ > 0.0f ? -1.0f : 1.0f;
+        eye[0] = sign * h[0];
+        eye[1] = sign * h[1];
+        eye[2] = sign * h[2];
+        eye[3] = 0.0f;
+    }
+}
+
+// Interleaved position + direction for one track; out must hold 6 floats per point
+static void writeTrackVertices(const FiberTrack& track, float* out, BoundingBox& trackBox)
+{
+    for (size_t i = 0; i < track.size(); ++i) {
+        const auto& point = track[i];
+
+        // Calculate direction vector
+        float dirX = 0.0f, dirY = 0.0f, dirZ = 0.0f;
+
+        if (track.size() == 1) {
+            dirX = dirY = dirZ = 0.5f;
+        } else if (i == 0) {
+            dirX = track[1].x - track[0].x;
+            dirY = track[1].y - track[0].y;
+            dirZ = track[1].z - track[0].z;
+        } else if (i == track.size() - 1) {
+            dirX = track[i].x - track[i-1].x;
+            dirY = track[i].y - track[i-1].y;
+            dirZ = track[i].z - track[i-1].z;
+        } else {
+            // Central difference
+            dirX = track[i+1].x - track[i-1].x;
+            dirY = track[i+1].y - track[i-1].y;
+            dirZ = track[i+1].z - track[i-1].z;
+        }
+
+        // Normalize direction
+        float length = std::sqrt(dirX*dirX + dirY*dirY + dirZ*dirZ);
+        if (length > 0.0001f) {
+            dirX /= length;
+            dirY /= length;
+            dirZ /= length;
+        }
+
+        // Add vertex data (position + direction)
+        *out++ = point.x;
+        *out++ = point.y;
+        *out++ = point.z;
+        *out++ = dirX;
+        *out++ = dirY;
+        *out++ = dirZ;
+
+        trackBox.expand(point.x, point.y, point.z);
+    }
+}
+
+static double polylineLength(const FiberTrack& track)
+{
+    double length = 0.0;
+    for (size_t i = 1; i < track.size(); ++i) {
+        const float dx = track[i].x - track[i - 1].x;
+        const float dy = track[i].y - track[i - 1].y;
+        const float dz = track[i].z - track[i - 1].z;
+        length += std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+    return length;
+}
+
+const FiberTrack& GLFiberRenderer::trackAt(size_t trackIndex) const
+{
+    const uint32_t sourceIndex = m_trackSelection[trackIndex];
+    if (sourceIndex < m_trackSource->size()) {
+        return (*m_trackSource)[sourceIndex];
+    }
+    return sourceIndex == kRemovedTrack ? kEmptyTrack : (*m_appendedTracks)[sourceIndex - m_trackSource->size()];
+}
+
 GLFiberRenderer::GLFiberRenderer()
     : m_VAO(0)
     , m_VBO(0)
+    , m_IBO(0)
+    , m_trackIdVBO(0)
+    , m_trackAttributeSSBO(0)
+    , m_slotTrackSSBO(0)
+    , m_scalarSSBO(0)
+    , m_colormapTexture(0)
+    , m_frameUBO(0)
+    , m_tubeImpostorsSupported(false)
+    , m_trackInfoSSBO(0)
+    , m_trackLodSSBO(0)
+    , m_indirectBuffer(0)
+    , m_drawCountBuffer(0)
+    , m_oitFBO(0)
+    , m_oitAccumTexture(0)
+    , m_oitRevealTexture(0)
+    , m_oitWidth(0)
+    , m_oitHeight(0)
+    , m_oitPassActive(false)
+    , m_renderMode(FiberRenderMode::LINES)
+    , m_densityVolumeActive(false)
+    , m_densityVolumeDirty(true)
+    , m_densityVolumeVisibilityDirty(false)
+    , m_densityVolumeResolution(128)
+    , m_densityVolumeThreshold(16.0f)
+    , m_totalTrackLength(0.0)
+    , m_attributesDirtyBegin(0)
+    , m_attributesDirtyEnd(0)
+    , m_vertexBufferBytes(0)
+    , m_trackInfoBytes(0)
+    , m_trackLodBytes(0)
+    , m_indirectBytes(0)
+    , m_attributeBufferBytes(0)
+    , m_slotTrackBytes(0)
+    , m_scalarBufferBytes(0)
+    , m_elementBufferBytes(0)
+    , m_trackIdBufferBytes(0)
+    , m_uploadedSlotCount(0)
+    , m_uploadedIndexSlots(0)
+    , m_deadIndexCount(0)
+    , m_clipPlaneCount(0)
+    , m_clipRangesDirty(true)
     , m_colorMode(FiberColoringMode::DIRECTION_RGB)
     , m_lineWidth(1.0f)
     , m_opacity(1.0f)
+    , m_transparencyMode(TransparencyMode::ALPHA_BLEND)
+    , m_tubeImpostorsEnabled(false)
+    , m_tubeRadius(0.3f)
+    , m_scalarIndex(-1)
+    , m_hasScalarStream(false)
+    , m_scalarMin(0.0f), m_scalarMax(0.0f)
+    , m_scalarWindow(1.0f), m_scalarLevel(0.5f)
+    , m_needsScalarUpload(false)
+    , m_needsColormapUpload(true)
     , m_renderedTrackCount(0)
     , m_totalPointCount(0)
+    , m_visibleTrackCount(0)
     , m_minX(0), m_maxX(0), m_minY(0), m_maxY(0), m_minZ(0), m_maxZ(0)
     , m_lodEnabled(false)
     , m_maxPointsPerTrack(0)
+    , m_frustumCullingEnabled(true)
+    , m_drawPath(FiberDrawPath::MULTI_DRAW_ARRAYS)
+    , m_needsIndexUpload(false)
+    , m_gpuCullingEnabled(false)
+    , m_gpuCullingSupported(false)
+    , m_minScreenSize(1.0f)
+    , m_lodPixelsPerVertex(4.0f)
     , m_initialized(false)
     , m_needsUpload(false)
+    , m_sceneRevision(0)
 {
+    m_trackSource = std::make_shared<std::vector<FiberTrack>>();
+    std::memset(m_clipPlanes, 0, sizeof(m_clipPlanes));
+
+    // Viridis control points
+    setColormap({ 0.267f, 0.005f, 0.329f,
+                  0.229f, 0.322f, 0.546f,
+                  0.128f, 0.567f, 0.551f,
+                  0.369f, 0.789f, 0.383f,
+                  0.993f, 0.906f, 0.144f });
 }
 
 GLFiberRenderer::~GLFiberRenderer()
@@ -66,21 +621,60 @@ void GLFiberRenderer::initialize()
     if (m_initialized) {
         return;
     }
+    m_sceneRevision++;
 
-    // Create and compile shader program
-    m_shader = std::make_unique<GLShaderProgram>();
-    if (!m_shader->loadFromString(vertexShaderSource, fragmentShaderSource)) {
+    // Track programs are permutations built on first use; probe the ones that decide fallbacks
+    if (!getTrackProgram(TrackVertexFormat::LINES, FiberColoringMode::DIRECTION_RGB, false)) {
         std::cerr << "Failed to create shader program" << std::endl;
         return;
     }
 
+    m_tubeImpostorsSupported = getTrackProgram(TrackVertexFormat::TUBES, FiberColoringMode::DIRECTION_RGB, false) != nullptr;
+    if (!m_tubeImpostorsSupported) {
+        std::cerr << "Tube impostor shaders unavailable, falling back to lines" << std::endl;
+    }
+
+    // Order-independent transparency programs; without them opacity falls back to alpha blending
+    m_compositeShader = std::make_unique<GLShaderProgram>();
+    if (!getTrackProgram(TrackVertexFormat::LINES, FiberColoringMode::DIRECTION_RGB, true) ||
+        !m_compositeShader->loadFromString(compositeVertexShaderSource, compositeFragmentShaderSource)) {
+        std::cerr << "OIT shaders unavailable, using ordered alpha blending" << std::endl;
+        m_compositeShader.reset();
+    }
+
+    // Density volume mode; without it every mode draws lines
+    if (!m_densityVolume.initialize()) {
+        std::cerr << "Density volume unavailable, always drawing lines" << std::endl;
+    }
+    m_densityVolumeDirty = true;
+
+    if (!m_picker.initialize()) {
+        std::cerr << "Track picking unavailable" << std::endl;
+    }
+
+    m_profiler.initialize();
+
+    // Per-frame parameters shared by all programs
+    glGenBuffers(1, &m_frameUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_frameUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameParameters), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
     // Generate VAO and VBO
     glGenVertexArrays(1, &m_VAO);
     glGenBuffers(1, &m_VBO);
+    glGenBuffers(1, &m_IBO);
+    glGenBuffers(1, &m_trackIdVBO);
+    glGenBuffers(1, &m_trackAttributeSSBO);
+    glGenBuffers(1, &m_slotTrackSSBO);
+    glGenBuffers(1, &m_scalarSSBO);
+    glGenTextures(1, &m_colormapTexture);
+    m_needsColormapUpload = true;
 
     // Setup VAO
     glBindVertexArray(m_VAO);
     glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IBO);
 
     // Position attribute (location = 0)
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
@@ -90,14 +684,34 @@ void GLFiberRenderer::initialize()
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(1);
 
+    // Track index attribute (location = 2), enabled once the primitive-restart path fills it
+    glBindBuffer(GL_ARRAY_BUFFER, m_trackIdVBO);
+    glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+
     glBindVertexArray(0);
 
+    // GPU-driven culling is optional; fall back to CPU culling if the shaders fail
+    m_cullShader = std::make_unique<GLShaderProgram>();
+    const std::string cullSource = GLShaderProgram::insertPreamble(cullComputeShaderSource, frameParameterShaderSource);
+    m_gpuCullingSupported = glMultiDrawArraysIndirectCount != nullptr &&
+                            m_cullShader->loadComputeFromString(cullSource.c_str()) &&
+                            getTrackProgram(TrackVertexFormat::PULL, FiberColoringMode::DIRECTION_RGB, false);
+    if (m_gpuCullingSupported) {
+        glGenBuffers(1, &m_trackInfoSSBO);
+        glGenBuffers(1, &m_trackLodSSBO);
+        glGenBuffers(1, &m_indirectBuffer);
+        glGenBuffers(1, &m_drawCountBuffer);
+    } else {
+        std::cerr << "GPU culling shaders unavailable, using CPU culling only" << std::endl;
+    }
+
     m_initialized = true;
     std::cout << "GLFiberRenderer initialized successfully" << std::endl;
 }
 
 void GLFiberRenderer::cleanup()
 {
+    m_sceneRevision++;
     if (m_VAO != 0) {
         glDeleteVertexArrays(1, &m_VAO);
         m_VAO = 0;
@@ -106,219 +720,1774 @@ void GLFiberRenderer::cleanup()
         glDeleteBuffers(1, &m_VBO);
         m_VBO = 0;
     }
-    m_shader.reset();
+    if (m_IBO != 0) {
+        glDeleteBuffers(1, &m_IBO);
+        m_IBO = 0;
+    }
+    GLuint gpuBuffers[] = { m_trackInfoSSBO, m_trackLodSSBO, m_indirectBuffer, m_drawCountBuffer,
+                            m_trackIdVBO, m_trackAttributeSSBO, m_slotTrackSSBO, m_scalarSSBO };
+    for (GLuint buffer : gpuBuffers) {
+        if (buffer != 0) {
+            glDeleteBuffers(1, &buffer);
+        }
+    }
+    m_trackInfoSSBO = m_trackLodSSBO = m_indirectBuffer = m_drawCountBuffer = 0;
+    m_trackIdVBO = m_trackAttributeSSBO = m_slotTrackSSBO = m_scalarSSBO = 0;
+    m_vertexBufferBytes = m_trackInfoBytes = m_trackLodBytes = m_indirectBytes = 0;
+    m_attributeBufferBytes = m_slotTrackBytes = m_scalarBufferBytes = m_elementBufferBytes = m_trackIdBufferBytes = 0;
+    m_uploadedIndexSlots = 0;
+    if (m_colormapTexture != 0) {
+        glDeleteTextures(1, &m_colormapTexture);
+        m_colormapTexture = 0;
+    }
+    releaseOITTargets();
+    if (m_frameUBO != 0) {
+        glDeleteBuffers(1, &m_frameUBO);
+        m_frameUBO = 0;
+    }
+    m_trackPrograms.clear();
+    m_profiler.cleanup();
+    m_compositeShader.reset();
+    m_cullShader.reset();
+    m_densityVolume.cleanup();
+    m_densityVolumeActive = false;
+    m_streamer.cleanup();
+    m_picker.cleanup();
+    m_tubeImpostorsSupported = false;
+    m_gpuCullingSupported = false;
     m_initialized = false;
 }
 
 void GLFiberRenderer::setTracks(const std::vector<FiberTrack>& tracks)
 {
-    m_tracks = tracks;
-    m_needsUpload = true;
-
-    // Build vertex data immediately to calculate bounding box
-    // (GPU upload will happen later in render())
-    buildVertexData();
+    m_ownedTracks = std::make_shared<std::vector<FiberTrack>>(tracks);
+    std::vector<uint32_t> selection(tracks.size());
+    for (size_t i = 0; i < selection.size(); ++i) {
+        selection[i] = static_cast<uint32_t>(i);
+    }
+    setTrackSource(m_ownedTracks, std::move(selection));
 }
 
-void GLFiberRenderer::setColorMode(FiberColoringMode mode)
+void GLFiberRenderer::setTracks(std::shared_ptr<const std::vector<FiberTrack>> tracks, std::vector<uint32_t> selection)
 {
-    m_colorMode = mode;
+    m_ownedTracks.reset();
+    if (!tracks) {
+        tracks = std::make_shared<std::vector<FiberTrack>>();
+        selection.clear();
+    }
+    const size_t sourceSize = tracks->size();
+    const auto invalid = std::remove_if(selection.begin(), selection.end(),
+                                        [sourceSize](uint32_t index) { return index >= sourceSize; });
+    if (invalid != selection.end()) {
+        std::cerr << "Ignoring " << (selection.end() - invalid) << " track indices outside the data" << std::endl;
+        selection.erase(invalid, selection.end());
+    }
+    setTrackSource(std::move(tracks), std::move(selection));
 }
 
-void GLFiberRenderer::setLineWidth(float width)
+void GLFiberRenderer::setTrackSource(std::shared_ptr<const std::vector<FiberTrack>> tracks, std::vector<uint32_t> selection)
 {
-    m_lineWidth = width;
-}
+    m_sceneRevision++;
+    m_streamer.close();
+    m_trackSource = std::move(tracks);
+    m_appendedTracks.reset();
+    m_trackSelection = std::move(selection);
+    m_needsUpload = true;
 
-void GLFiberRenderer::setOpacity(float opacity)
-{
-    m_opacity = opacity;
+    // Build vertex data immediately to calculate bounding box
+    // (GPU upload will happen later in render())
+    buildVertexData();
 }
 
-void GLFiberRenderer::setLODEnabled(bool enable)
+void GLFiberRenderer::appendTracks(const std::vector<FiberTrack>& tracks)
 {
-    m_lodEnabled = enable;
-}
+    if (m_trackSelection.empty()) {
+        setTracks(tracks);
+        return;
+    }
 
-void GLFiberRenderer::setMaxPointsPerTrack(size_t maxPoints)
-{
-    m_maxPointsPerTrack = maxPoints;
-}
+    // The source stays as it is; new tracks go to a tail the renderer owns, indexed after it
+    m_profiler.beginSection(ProfilerSection::BUILD);
+    const size_t firstTrack = m_trackSelection.size();
+    std::vector<FiberTrack>& appended = editAppendedTracks(tracks.size());
+    const size_t firstAppended = m_trackSource->size() + appended.size();
+    appended.insert(appended.end(), tracks.begin(), tracks.end());
+    for (size_t i = 0; i < tracks.size(); ++i) {
+        m_trackSelection.push_back(static_cast<uint32_t>(firstAppended + i));
+    }
 
-void GLFiberRenderer::buildVertexData()
-{
-    m_vertexData.clear();
-    m_trackStarts.clear();
-    m_trackCounts.clear();
-    m_totalPointCount = 0;
-    m_renderedTrackCount = 0;
+    for (size_t t = firstTrack; t < m_trackSelection.size(); ++t) {
+        const FiberTrack& track = trackAt(t);
+        size_t start = track.empty() ? 0 : allocatePoints(track.size());
 
-    for (const auto& track : m_tracks) {
-        if (track.empty()) continue;
+        BoundingBox trackBox;
+        writeTrackVertices(track, m_vertexData.data() + start * 6, trackBox);
 
-        // Record track start and count for multi-draw
-        m_trackStarts.push_back(static_cast<GLint>(m_totalPointCount));
+        m_trackStarts.push_back(static_cast<GLint>(start));
         m_trackCounts.push_back(static_cast<GLsizei>(track.size()));
-        m_renderedTrackCount++;
-
-        // Build vertex data with direction calculation
-        for (size_t i = 0; i < track.size(); ++i) {
-            const auto& point = track[i];
-
-            // Calculate direction vector
-            float dirX = 0.0f, dirY = 0.0f, dirZ = 0.0f;
-
-            if (track.size() == 1) {
-                dirX = dirY = dirZ = 0.5f;
-            } else if (i == 0) {
-                dirX = track[1].x - track[0].x;
-                dirY = track[1].y - track[0].y;
-                dirZ = track[1].z - track[0].z;
-            } else if (i == track.size() - 1) {
-                dirX = track[i].x - track[i-1].x;
-                dirY = track[i].y - track[i-1].y;
-                dirZ = track[i].z - track[i-1].z;
-            } else {
-                // Central difference
-                dirX = track[i+1].x - track[i-1].x;
-                dirY = track[i+1].y - track[i-1].y;
-                dirZ = track[i+1].z - track[i-1].z;
-            }
+        m_trackBounds.push_back(trackBox);
+        m_trackAttributes.push_back(kDefaultTrackColor);
+        m_trackAttributes.push_back(kTrackVisible);
+        m_pendingTracks.push_back(static_cast<uint32_t>(t));
 
-            // Normalize direction
-            float length = std::sqrt(dirX*dirX + dirY*dirY + dirZ*dirZ);
-            if (length > 0.0001f) {
-                dirX /= length;
-                dirY /= length;
-                dirZ /= length;
-            }
+        if (!track.empty()) {
+            m_renderedTrackCount++;
+            m_totalPointCount += track.size();
+            m_totalTrackLength += polylineLength(track);
 
-            // Add vertex data (position + direction)
-            m_vertexData.push_back(point.x);
-            m_vertexData.push_back(point.y);
-            m_vertexData.push_back(point.z);
-            m_vertexData.push_back(dirX);
-            m_vertexData.push_back(dirY);
-            m_vertexData.push_back(dirZ);
+            m_minX = std::min(m_minX, trackBox.min[0]); m_maxX = std::max(m_maxX, trackBox.max[0]);
+            m_minY = std::min(m_minY, trackBox.min[1]); m_maxY = std::max(m_maxY, trackBox.max[1]);
+            m_minZ = std::min(m_minZ, trackBox.min[2]); m_maxZ = std::max(m_maxZ, trackBox.max[2]);
 
-            m_totalPointCount++;
+            if (m_hasScalarStream) {
+                // A stream still waiting for its upload goes up whole, so it has to cover the new points;
+                // otherwise uploadPendingTracks() sends just these ranges
+                float* out = nullptr;
+                if (m_needsScalarUpload) {
+                    m_scalarData.resize(m_vertexData.size() / 6, 0.0f);
+                    out = m_scalarData.data() + start;
+                }
+                for (const auto& point : track) {
+                    float value = static_cast<size_t>(m_scalarIndex) < point.scalars.size() ? point.scalars[m_scalarIndex] : 0.0f;
+                    if (out) *out++ = value;
+                    m_scalarMin = std::min(m_scalarMin, value);
+                    m_scalarMax = std::max(m_scalarMax, value);
+                }
+            }
         }
     }
+    markAttributesDirty(firstTrack, m_trackSelection.size());
+    m_densityVolumeDirty = true;
 
-    // Calculate bounding box
-    m_minX = 1e10; m_minY = 1e10; m_minZ = 1e10;
-    m_maxX = -1e10; m_maxY = -1e10; m_maxZ = -1e10;
-    for (size_t i = 0; i < m_vertexData.size(); i += 6) {
-        float x = m_vertexData[i];
-        float y = m_vertexData[i + 1];
-        float z = m_vertexData[i + 2];
-        m_minX = std::min(m_minX, x); m_maxX = std::max(m_maxX, x);
-        m_minY = std::min(m_minY, y); m_maxY = std::max(m_maxY, y);
-        m_minZ = std::min(m_minZ, z); m_maxZ = std::max(m_maxZ, z);
-    }
+    // New tracks get their own chunks at the end of the slot order
+    m_chunkBVH.append(m_trackBounds, firstTrack);
+    refreshDrawSlots();
+    m_profiler.endSection();
+}
 
-    std::cout << "Built vertex data: " << m_renderedTrackCount << " tracks, "
-              << m_totalPointCount << " points" << std::endl;
-    std::cout << "Bounding box: X[" << m_minX << ", " << m_maxX << "] "
-              << "Y[" << m_minY << ", " << m_maxY << "] "
-              << "Z[" << m_minZ << ", " << m_maxZ << "]" << std::endl;
+bool GLFiberRenderer::isTrackSourceShared() const
+{
+    // m_trackSource is the second owner of m_ownedTracks
+    return m_ownedTracks.use_count() > 2;
 }
 
-void GLFiberRenderer::uploadToGPU()
+std::vector<FiberTrack>& GLFiberRenderer::editAppendedTracks(size_t extraCapacity)
 {
-    if (!m_initialized) {
-        std::cerr << "GLFiberRenderer not initialized" << std::endl;
-        return;
+    // getAppendedTracks() hands the tail out as const, so a held tail is replaced rather than edited
+    if (!m_appendedTracks) {
+        m_appendedTracks = std::make_shared<std::vector<FiberTrack>>();
+    } else if (m_appendedTracks.use_count() > 1) {
+        auto copy = std::make_shared<std::vector<FiberTrack>>();
+        copy->reserve(m_appendedTracks->size() + extraCapacity);
+        copy->insert(copy->end(), m_appendedTracks->begin(), m_appendedTracks->end());
+        m_appendedTracks = copy;
     }
+    return *m_appendedTracks;
+}
 
-    if (m_tracks.empty()) {
-        std::cout << "No tracks to upload" << std::endl;
-        return;
-    }
+void GLFiberRenderer::removeTracks(const std::vector<uint32_t>& trackIndices)
+{
+    m_sceneRevision++;
+    size_t removed = 0;
+    for (uint32_t trackIndex : trackIndices) {
+        if (trackIndex >= m_trackCounts.size() || m_trackCounts[trackIndex] == 0) continue;
 
-    // Build vertex data if not already built
-    if (m_vertexData.empty()) {
-        buildVertexData();
-    }
+        // The vertex range goes back to the free list for later appends
+        releasePoints(static_cast<size_t>(m_trackStarts[trackIndex]), static_cast<size_t>(m_trackCounts[trackIndex]));
+        m_totalPointCount -= static_cast<size_t>(m_trackCounts[trackIndex]);
+        m_totalTrackLength = std::max(0.0, m_totalTrackLength - polylineLength(trackAt(trackIndex)));
+        m_renderedTrackCount--;
 
-    if (m_vertexData.empty()) {
-        std::cout << "No vertex data to upload" << std::endl;
-        return;
+        m_trackStarts[trackIndex] = 0;
+        m_trackCounts[trackIndex] = 0;
+        m_trackBounds[trackIndex].reset();
+        // Points are released only while nobody else holds the data; copying it all to free one track would cost more
+        const uint32_t sourceIndex = m_trackSelection[trackIndex];
+        if (sourceIndex < m_trackSource->size()) {
+            if (m_ownedTracks && !isTrackSourceShared()) {
+                FiberTrack().swap((*m_ownedTracks)[sourceIndex]);
+            }
+        } else if (m_appendedTracks.use_count() == 1) {
+            FiberTrack().swap((*m_appendedTracks)[sourceIndex - m_trackSource->size()]);
+        }
+        m_trackSelection[trackIndex] = kRemovedTrack;
+        m_pendingTracks.push_back(trackIndex);
+        removed++;
     }
 
-    // Upload to GPU
-    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
-    glBufferData(GL_ARRAY_BUFFER,
-                 m_vertexData.size() * sizeof(float),
-                 m_vertexData.data(),
-                 GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // Chunk bounds stay conservative; the slots simply draw nothing
+    refreshDrawSlots();
+    if (removed > 0) {
+        m_densityVolumeDirty = true;
+    }
+}
 
-    m_needsUpload = false;
+size_t GLFiberRenderer::allocatePoints(size_t count)
+{
+    // First fit in the released ranges, otherwise grow at the end
+    for (size_t i = 0; i < m_freeRanges.size(); ++i) {
+        auto& range = m_freeRanges[i];
+        if (range.second >= count) {
+            size_t first = range.first;
+            range.first += count;
+            range.second -= count;
+            if (range.second == 0) {
+                m_freeRanges.erase(m_freeRanges.begin() + i);
+            }
+            return first;
+        }
+    }
 
-    std::cout << "Uploaded " << m_vertexData.size() * sizeof(float) / 1024 / 1024
-              << " MB to GPU" << std::endl;
+    size_t first = m_vertexData.size() / 6;
+    m_vertexData.resize((first + count) * 6);
+    return first;
 }
 
-void GLFiberRenderer::render(const float* mvpMatrix)
+void GLFiberRenderer::releasePoints(size_t first, size_t count)
 {
-    if (!m_initialized) {
-        std::cerr << "GLFiberRenderer not initialized" << std::endl;
-        return;
-    }
+    auto it = std::lower_bound(m_freeRanges.begin(), m_freeRanges.end(), std::make_pair(first, count));
+    it = m_freeRanges.insert(it, std::make_pair(first, count));
 
-    if (m_needsUpload) {
-        uploadToGPU();
+    // Merge with the following and preceding neighbors
+    auto next = it + 1;
+    if (next != m_freeRanges.end() && it->first + it->second == next->first) {
+        it->second += next->second;
+        m_freeRanges.erase(next);
     }
-
-    if (m_vertexData.empty()) {
-        return;
+    if (it != m_freeRanges.begin()) {
+        auto previous = it - 1;
+        if (previous->first + previous->second == it->first) {
+            previous->second += it->second;
+            it = m_freeRanges.erase(it) - 1;
+        }
     }
 
-    // Use shader program
-    m_shader->use();
-
-    // Debug: Print MVP matrix first time
-    static bool firstRender = true;
-    if (firstRender) {
-        std::cout << "MVP Matrix (first 4 values): "
-                  << mvpMatrix[0] << ", " << mvpMatrix[1] << ", "
-                  << mvpMatrix[2] << ", " << mvpMatrix[3] << std::endl;
-        firstRender = false;
+    // A free range at the end just shrinks the vertex array
+    if (it->first + it->second == m_vertexData.size() / 6) {
+        m_vertexData.resize(it->first * 6);
+        m_freeRanges.erase(it);
     }
+}
 
-    // Set uniforms
-    m_shader->setUniformMatrix4fv("uMVPMatrix", mvpMatrix);
-    m_shader->setUniform1i("uColorMode", m_colorMode == FiberColoringMode::DIRECTION_RGB ? 1 : 0);
-    m_shader->setUniform1f("uOpacity", m_opacity);
-
-    // Set line width
-    glLineWidth(m_lineWidth);
+void GLFiberRenderer::setColorMode(FiberColoringMode mode)
+{
+    m_sceneRevision++;
+    m_colorMode = mode;
+}
+
+void GLFiberRenderer::setLineWidth(float width)
+{
+    m_sceneRevision++;
+    m_lineWidth = width;
+}
+
+void GLFiberRenderer::setOpacity(float opacity)
+{
+    m_sceneRevision++;
+    m_opacity = opacity;
+}
+
+void GLFiberRenderer::setTransparencyMode(TransparencyMode mode)
+{
+    m_sceneRevision++;
+    m_transparencyMode = mode;
+}
+
+void GLFiberRenderer::setTubeImpostorsEnabled(bool enable)
+{
+    m_sceneRevision++;
+    m_tubeImpostorsEnabled = enable;
+}
+
+void GLFiberRenderer::setTubeRadius(float radius)
+{
+    m_sceneRevision++;
+    m_tubeRadius = radius;
+}
+
+void GLFiberRenderer::setTrackColor(size_t trackIndex, float r, float g, float b)
+{
+    if (trackIndex * 2 >= m_trackAttributes.size()) return;
+
+    auto pack = [](float v) {
+        return static_cast<uint32_t>(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+    };
+    m_trackAttributes[trackIndex * 2] = pack(r) | (pack(g) << 8) | (pack(b) << 16) | 0xFF000000u;
+    markAttributesDirty(trackIndex, trackIndex + 1);
+}
+
+bool GLFiberRenderer::setTrackBundle(size_t trackIndex, uint32_t bundleId)
+{
+    if (trackIndex * 2 >= m_trackAttributes.size()) return false;
+    if (bundleId > kMaxBundleId) {
+        // Shifting the id into the flag word would drop its top bits and alias a smaller id
+        std::cerr << "Bundle id " << bundleId << " exceeds " << kMaxBundleId << ", track " << trackIndex << " left unchanged" << std::endl;
+        return false;
+    }
+
+    uint32_t& flags = m_trackAttributes[trackIndex * 2 + 1];
+    flags = (flags & 0xFFu) | (bundleId << 8);
+    markAttributesDirty(trackIndex, trackIndex + 1);
+    return true;
+}
+
+void GLFiberRenderer::setTrackVisible(size_t trackIndex, bool visible)
+{
+    if (trackIndex * 2 >= m_trackAttributes.size()) return;
+
+    uint32_t& flags = m_trackAttributes[trackIndex * 2 + 1];
+    const uint32_t updated = visible ? (flags | kTrackVisible) : (flags & ~kTrackVisible);
+    if (updated != flags) {
+        flags = updated;
+        markAttributesDirty(trackIndex, trackIndex + 1);
+        markVisibilityChanged();
+    }
+}
+
+void GLFiberRenderer::setTrackHighlighted(size_t trackIndex, bool highlighted)
+{
+    if (trackIndex * 2 >= m_trackAttributes.size()) return;
+
+    uint32_t& flags = m_trackAttributes[trackIndex * 2 + 1];
+    flags = highlighted ? (flags | kTrackHighlighted) : (flags & ~kTrackHighlighted);
+    markAttributesDirty(trackIndex, trackIndex + 1);
+}
+
+void GLFiberRenderer::setTracksVisible(const std::vector<uint32_t>& trackIndices, bool visible)
+{
+    for (uint32_t trackIndex : trackIndices) {
+        setTrackVisible(trackIndex, visible);
+    }
+}
+
+void GLFiberRenderer::setAllTracksVisible(bool visible)
+{
+    for (size_t i = 1; i < m_trackAttributes.size(); i += 2) {
+        m_trackAttributes[i] = visible ? (m_trackAttributes[i] | kTrackVisible) : (m_trackAttributes[i] & ~kTrackVisible);
+    }
+    markAttributesDirty(0, m_trackAttributes.size() / 2);
+    markVisibilityChanged();
+}
+
+void GLFiberRenderer::setTrackVisibility(const std::vector<uint8_t>& visible)
+{
+    // Only the span of changed flags is re-uploaded
+    const size_t count = std::min(visible.size(), m_trackAttributes.size() / 2);
+    size_t first = count;
+    size_t last = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t& flags = m_trackAttributes[i * 2 + 1];
+        const uint32_t updated = visible[i] ? (flags | kTrackVisible) : (flags & ~kTrackVisible);
+        if (updated != flags) {
+            flags = updated;
+            first = std::min(first, i);
+            last = i + 1;
+        }
+    }
+    if (first < last) {
+        markAttributesDirty(first, last);
+        markVisibilityChanged();
+    }
+}
+
+void GLFiberRenderer::markVisibilityChanged()
+{
+    // Filters change visibility on every drag step; the volume follows once they pause
+    m_densityVolumeVisibilityDirty = true;
+    m_densityVolumeSettleTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(kDensityVolumeSettleMs);
+}
+
+void GLFiberRenderer::clearHighlights()
+{
+    for (size_t i = 1; i < m_trackAttributes.size(); i += 2) {
+        m_trackAttributes[i] &= ~kTrackHighlighted;
+    }
+    markAttributesDirty(0, m_trackAttributes.size() / 2);
+}
+
+bool GLFiberRenderer::isTrackVisible(size_t trackIndex) const
+{
+    return trackIndex * 2 < m_trackAttributes.size() && (m_trackAttributes[trackIndex * 2 + 1] & kTrackVisible) != 0;
+}
+
+void GLFiberRenderer::setScalarIndex(int index)
+{
+    if (index == m_scalarIndex) return;
+
+    m_scalarIndex = index;
+    m_sceneRevision++;
+    buildScalarData();
+}
+
+size_t GLFiberRenderer::getScalarCount() const
+{
+    for (size_t t = 0; t < m_trackSelection.size(); ++t) {
+        const FiberTrack& track = trackAt(t);
+        if (!track.empty()) {
+            return track[0].scalars.size();
+        }
+    }
+    return 0;
+}
+
+void GLFiberRenderer::setScalarWindow(float window, float level)
+{
+    m_sceneRevision++;
+    m_scalarWindow = window;
+    m_scalarLevel = level;
+}
+
+bool GLFiberRenderer::getScalarRange(float& minValue, float& maxValue) const
+{
+    minValue = m_scalarMin;
+    maxValue = m_scalarMax;
+    return m_hasScalarStream;
+}
+
+void GLFiberRenderer::setColormap(const std::vector<float>& rgb)
+{
+    const size_t stops = rgb.size() / 3;
+    if (stops < 2) {
+        std::cerr << "Colormap needs at least two RGB entries" << std::endl;
+        return;
+    }
+
+    // Resample the control points into a fixed-size table
+    m_colormap.resize(kColormapSize * 4);
+    for (int i = 0; i < kColormapSize; ++i) {
+        float x = static_cast<float>(i) / (kColormapSize - 1) * (stops - 1);
+        size_t j = std::min(static_cast<size_t>(x), stops - 2);
+        float f = x - static_cast<float>(j);
+        for (int c = 0; c < 3; ++c) {
+            float v = rgb[j * 3 + c] * (1.0f - f) + rgb[(j + 1) * 3 + c] * f;
+            m_colormap[i * 4 + c] = static_cast<unsigned char>(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+        }
+        m_colormap[i * 4 + 3] = 255;
+    }
+    m_needsColormapUpload = true;
+    m_sceneRevision++;
+}
+
+void GLFiberRenderer::buildScalarData()
+{
+    m_scalarData.clear();
+    m_hasScalarStream = m_scalarIndex >= 0 && static_cast<size_t>(m_scalarIndex) < getScalarCount();
+    m_needsScalarUpload = m_hasScalarStream;
+    if (!m_hasScalarStream) {
+        return;
+    }
+
+    // Same layout as m_vertexData; points missing the scalar read as 0
+    const size_t index = static_cast<size_t>(m_scalarIndex);
+    m_scalarData.assign(m_vertexData.size() / 6, 0.0f);
+    m_scalarMin = 1e30f;
+    m_scalarMax = -1e30f;
+    for (size_t t = 0; t < m_trackSelection.size(); ++t) {
+        float* out = m_scalarData.data() + m_trackStarts[t];
+        for (const auto& point : trackAt(t)) {
+            float value = index < point.scalars.size() ? point.scalars[index] : 0.0f;
+            *out++ = value;
+            m_scalarMin = std::min(m_scalarMin, value);
+            m_scalarMax = std::max(m_scalarMax, value);
+        }
+    }
+
+    m_scalarWindow = std::max(m_scalarMax - m_scalarMin, 1e-6f);
+    m_scalarLevel = (m_scalarMin + m_scalarMax) * 0.5f;
+}
+
+void GLFiberRenderer::uploadScalarData()
+{
+    m_scalarBufferBytes = static_cast<GLsizeiptr>(m_scalarData.size() * sizeof(float));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_scalarSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, m_scalarBufferBytes, m_scalarData.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    m_profiler.addUploadedBytes(static_cast<size_t>(m_scalarBufferBytes));
+
+    std::vector<float>().swap(m_scalarData);
+    m_needsScalarUpload = false;
+}
+
+void GLFiberRenderer::uploadColormap()
+{
+    glBindTexture(GL_TEXTURE_1D, m_colormapTexture);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, kColormapSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, m_colormap.data());
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    m_profiler.addUploadedBytes(m_colormap.size());
+    glBindTexture(GL_TEXTURE_1D, 0);
+
+    m_needsColormapUpload = false;
+}
+
+FiberColoringMode GLFiberRenderer::effectiveColorMode() const
+{
+    // Without a scalar stream the colormap mode falls back to solid color
+    if (m_colorMode == FiberColoringMode::SCALAR_COLORMAP && !m_hasScalarStream) {
+        return FiberColoringMode::SOLID_COLOR;
+    }
+    return m_colorMode;
+}
+
+GLShaderProgram* GLFiberRenderer::getTrackProgram(TrackVertexFormat format, FiberColoringMode mode, bool oitOutput)
+{
+    const uint32_t key = static_cast<uint32_t>(format) | (static_cast<uint32_t>(mode) << 4) | (oitOutput ? 0x100u : 0u);
+    auto it = m_trackPrograms.find(key);
+    if (it != m_trackPrograms.end()) {
+        return it->second.get();
+    }
+
+    // Per-vertex branching is resolved by the preprocessor instead
+    std::vector<std::string> defines;
+    defines.push_back("COLOR_MODE " + std::to_string(static_cast<int>(mode)));
+    if (oitOutput) {
+        defines.push_back("OIT_OUTPUT");
+    }
+    const char* vertexSource = vertexShaderSource;
+    if (format == TrackVertexFormat::TUBES) {
+        vertexSource = tubeVertexShaderSource;
+        defines.push_back("TUBE_IMPOSTOR");
+    } else if (format == TrackVertexFormat::PULL) {
+        vertexSource = pullVertexShaderSource;
+    } else if (format == TrackVertexFormat::LINES_TRACK_ID) {
+        defines.push_back("TRACK_ID_ATTRIBUTE");
+    }
+
+    const std::string vertex = GLShaderProgram::insertPreamble(
+        vertexSource, std::string(frameParameterShaderSource) + trackAttributeShaderSource + clipDistanceShaderSource);
+    const std::string fragment = GLShaderProgram::insertPreamble(trackFragmentShaderSource, frameParameterShaderSource);
+
+    // Failed variants are remembered as nullptr so they are not recompiled every frame
+    auto program = std::make_unique<GLShaderProgram>();
+    if (!program->loadFromString(vertex.c_str(), fragment.c_str(), defines)) {
+        std::cerr << "Track shader variant unavailable:";
+        for (const auto& define : defines) {
+            std::cerr << " " << define;
+        }
+        std::cerr << std::endl;
+        program.reset();
+    }
+
+    GLShaderProgram* result = program.get();
+    m_trackPrograms[key] = std::move(program);
+    return result;
+}
+
+void GLFiberRenderer::updateFrameParameters(const float* mvpMatrix, const GLint* viewport, bool drawTubes)
+{
+    FrameParameters frame = {};
+    std::memcpy(frame.mvpMatrix, mvpMatrix, sizeof(frame.mvpMatrix));
+
+    Frustum frustum;
+    frustum.extract(mvpMatrix);
+    std::memcpy(frame.frustumPlanes, frustum.planes, sizeof(frame.frustumPlanes));
+
+    if (drawTubes) {
+        computeEye(mvpMatrix, frame.eye);
+    }
+    frame.scalarWindow[0] = m_scalarLevel;
+    frame.scalarWindow[1] = m_scalarWindow;
+    frame.viewportSize[0] = static_cast<float>(viewport[2]);
+    frame.viewportSize[1] = static_cast<float>(viewport[3]);
+    frame.opacity = m_opacity;
+    frame.tubeRadius = m_tubeRadius;
+    frame.minScreenSize = m_minScreenSize;
+    frame.pixelsPerVertex = m_lodEnabled ? m_lodPixelsPerVertex : 0.0f;
+    frame.trackCount = static_cast<int32_t>(m_trackStarts.size());
+    frame.maxPointsPerTrack = static_cast<int32_t>(m_maxPointsPerTrack);
+    frame.clipPlaneCount = m_clipPlaneCount;
+    std::memcpy(frame.clipPlanes, m_clipPlanes, sizeof(frame.clipPlanes));
+
+    glBindBuffer(GL_UNIFORM_BUFFER, m_frameUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameParameters), &frame);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    m_profiler.addUploadedBytes(sizeof(FrameParameters));
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, m_frameUBO);
+}
+
+void GLFiberRenderer::markAttributesDirty(size_t first, size_t last)
+{
+    m_sceneRevision++;
+    if (first >= last) return;
+
+    if (m_attributesDirtyBegin >= m_attributesDirtyEnd) {
+        m_attributesDirtyBegin = first;
+        m_attributesDirtyEnd = last;
+    } else {
+        m_attributesDirtyBegin = std::min(m_attributesDirtyBegin, first);
+        m_attributesDirtyEnd = std::max(m_attributesDirtyEnd, last);
+    }
+}
+
+void GLFiberRenderer::setLODEnabled(bool enable)
+{
+    m_sceneRevision++;
+    m_lodEnabled = enable;
+}
+
+void GLFiberRenderer::setMaxPointsPerTrack(size_t maxPoints)
+{
+    m_sceneRevision++;
+    m_maxPointsPerTrack = maxPoints;
+}
+
+void GLFiberRenderer::setFrustumCullingEnabled(bool enable)
+{
+    m_sceneRevision++;
+    m_frustumCullingEnabled = enable;
+}
+
+void GLFiberRenderer::setClipPlanes(const float* planes, int count)
+{
+    // Sliders resend the same planes; only a real change re-culls the tracks
+    count = std::min(std::max(count, 0), static_cast<int>(kMaxClipPlanes));
+    if (count == m_clipPlaneCount &&
+        (count == 0 || std::equal(planes, planes + count * 4, &m_clipPlanes[0][0]))) {
+        return;
+    }
+
+    m_sceneRevision++;
+    m_clipPlaneCount = count;
+    for (int p = 0; p < m_clipPlaneCount; ++p) {
+        std::copy(planes + p * 4, planes + p * 4 + 4, m_clipPlanes[p]);
+    }
+    m_clipRangesDirty = true;
+}
+
+bool GLFiberRenderer::getClipPlane(int index, float plane[4]) const
+{
+    if (index < 0 || index >= m_clipPlaneCount) {
+        return false;
+    }
+    std::copy(m_clipPlanes[index], m_clipPlanes[index] + 4, plane);
+    return true;
+}
+
+void GLFiberRenderer::setSlab(const float* normal, float center, float thickness)
+{
+    const float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    if (length <= 0.0f) {
+        clearClipPlanes();
+        return;
+    }
+    const float n[3] = { normal[0] / length, normal[1] / length, normal[2] / length };
+    const float halfThickness = std::max(thickness, 0.0f) * 0.5f;
+    const float planes[8] = { n[0], n[1], n[2], halfThickness - center,
+                              -n[0], -n[1], -n[2], halfThickness + center };
+    setClipPlanes(planes, 2);
+}
+
+void GLFiberRenderer::addClipPlanes(Frustum& frustum) const
+{
+    for (int p = 0; p < m_clipPlaneCount; ++p) {
+        frustum.addPlane(m_clipPlanes[p]);
+    }
+}
+
+void GLFiberRenderer::setClipDistancesEnabled(bool enable)
+{
+    for (int p = 0; p < m_clipPlaneCount; ++p) {
+        if (enable) {
+            glEnable(GL_CLIP_DISTANCE0 + p);
+        } else {
+            glDisable(GL_CLIP_DISTANCE0 + p);
+        }
+    }
+}
+
+void GLFiberRenderer::setDrawPath(FiberDrawPath path)
+{
+    m_sceneRevision++;
+    if (path == FiberDrawPath::PRIMITIVE_RESTART && m_drawPath != path) {
+        m_needsIndexUpload = true;
+    }
+    m_drawPath = path;
+}
+
+void GLFiberRenderer::setGPUCullingEnabled(bool enable)
+{
+    m_sceneRevision++;
+    m_gpuCullingEnabled = enable;
+}
+
+bool GLFiberRenderer::openOutOfCore(const std::string& octreePath)
+{
+    // In-memory tracks are released; the octree replaces them
+    setTracks(std::vector<FiberTrack>());
+    if (!m_streamer.open(octreePath)) {
+        return false;
+    }
+
+    float boundsMin[3], boundsMax[3];
+    m_streamer.getBoundingBox(boundsMin, boundsMax);
+    m_minX = boundsMin[0]; m_maxX = boundsMax[0];
+    m_minY = boundsMin[1]; m_maxY = boundsMax[1];
+    m_minZ = boundsMin[2]; m_maxZ = boundsMax[2];
+    m_renderedTrackCount = static_cast<size_t>(m_streamer.getFileHeader().trackCount);
+    m_totalPointCount = static_cast<size_t>(m_streamer.getFileHeader().pointCount);
+    return true;
+}
+
+void GLFiberRenderer::closeOutOfCore()
+{
+    if (m_streamer.isOpen()) {
+        setTracks(std::vector<FiberTrack>());
+    }
+}
+
+void GLFiberRenderer::setOutOfCoreBudget(size_t cacheBytes, size_t pointsPerFrame)
+{
+    m_sceneRevision++;
+    m_streamer.setCacheBytes(cacheBytes);
+    m_streamer.setPointBudget(pointsPerFrame);
+}
+
+void GLFiberRenderer::setRenderMode(FiberRenderMode mode)
+{
+    m_sceneRevision++;
+    m_renderMode = mode;
+}
+
+void GLFiberRenderer::setDensityVolumeResolution(int voxels)
+{
+    m_sceneRevision++;
+    m_densityVolumeResolution = std::max(voxels, 8);
+    m_densityVolumeDirty = true;
+}
+
+void GLFiberRenderer::setDensityVolumeThreshold(float overdraw)
+{
+    m_sceneRevision++;
+    m_densityVolumeThreshold = std::max(overdraw, 0.0f);
+}
+
+void GLFiberRenderer::setDensityVolumeOpacity(float scale)
+{
+    m_sceneRevision++;
+    m_densityVolume.setOpacityScale(std::max(scale, 0.0f));
+}
+
+void GLFiberRenderer::buildVertexData()
+{
+    m_profiler.beginSection(ProfilerSection::BUILD);
+    m_vertexData.clear();
+    m_trackStarts.clear();
+    m_trackCounts.clear();
+    m_trackBounds.clear();
+    m_freeRanges.clear();
+    m_pendingTracks.clear();
+    m_totalPointCount = 0;
+    m_renderedTrackCount = 0;
+    m_totalTrackLength = 0.0;
+    m_densityVolumeDirty = true;
+
+    for (size_t t = 0; t < m_trackSelection.size(); ++t) {
+        const FiberTrack& track = trackAt(t);
+        m_totalPointCount += track.size();
+        m_totalTrackLength += polylineLength(track);
+    }
+    m_vertexData.resize(m_totalPointCount * 6);
+
+    size_t nextPoint = 0;
+    for (size_t t = 0; t < m_trackSelection.size(); ++t) {
+        const FiberTrack& track = trackAt(t);
+        // Empty tracks keep a zero-length entry so renderer indices match setTracks() indices
+        m_trackStarts.push_back(static_cast<GLint>(nextPoint));
+        m_trackCounts.push_back(static_cast<GLsizei>(track.size()));
+        if (!track.empty()) {
+            m_renderedTrackCount++;
+        }
+
+        BoundingBox trackBox;
+        writeTrackVertices(track, m_vertexData.data() + nextPoint * 6, trackBox);
+        nextPoint += track.size();
+
+        m_trackBounds.push_back(trackBox);
+    }
+
+    // New data starts visible, unhighlighted, bundle 0, red custom color
+    m_trackAttributes.resize(m_trackSelection.size() * 2);
+    for (size_t i = 0; i < m_trackSelection.size(); ++i) {
+        m_trackAttributes[i * 2] = kDefaultTrackColor;
+        m_trackAttributes[i * 2 + 1] = kTrackVisible;
+    }
+    m_attributesDirtyBegin = m_attributesDirtyEnd = 0;
+
+    buildScalarData();
+    buildDrawChunks();
+
+    // Calculate bounding box
+    m_minX = 1e10; m_minY = 1e10; m_minZ = 1e10;
+    m_maxX = -1e10; m_maxY = -1e10; m_maxZ = -1e10;
+    for (size_t i = 0; i < m_vertexData.size(); i += 6) {
+        float x = m_vertexData[i];
+        float y = m_vertexData[i + 1];
+        float z = m_vertexData[i + 2];
+        m_minX = std::min(m_minX, x); m_maxX = std::max(m_maxX, x);
+        m_minY = std::min(m_minY, y); m_maxY = std::max(m_maxY, y);
+        m_minZ = std::min(m_minZ, z); m_maxZ = std::max(m_maxZ, z);
+    }
+    m_profiler.endSection();
+
+    std::cout << "Built vertex data: " << m_renderedTrackCount << " tracks, "
+              << m_totalPointCount << " points" << std::endl;
+    std::cout << "Bounding box: X[" << m_minX << ", " << m_maxX << "] "
+              << "Y[" << m_minY << ", " << m_maxY << "] "
+              << "Z[" << m_minZ << ", " << m_maxZ << "]" << std::endl;
+}
+
+void GLFiberRenderer::buildDrawChunks()
+{
+    // A new slot order invalidates every uploaded index range
+    m_uploadedIndexSlots = 0;
+    m_chunkBVH.build(m_trackBounds);
+    refreshDrawSlots();
+}
+
+void GLFiberRenderer::refreshDrawSlots()
+{
+    // Permute starts/counts into chunk order so each BVH subtree maps to one contiguous range
+    const auto& slotOrder = m_chunkBVH.getSlotOrder();
+    const size_t slotCount = slotOrder.size();
+    bool repackIndices = m_uploadedIndexSlots == 0 || m_uploadedIndexSlots > slotCount;
+    m_drawStarts.resize(slotCount);
+    m_drawCounts.resize(slotCount);
+    m_tubeStarts.resize(slotCount);
+    m_tubeCounts.resize(slotCount);
+    for (size_t slot = 0; slot < slotCount; ++slot) {
+        const GLsizei count = m_trackCounts[slotOrder[slot]];
+        if (!repackIndices && slot < m_uploadedIndexSlots && count != m_drawCounts[slot]) {
+            // Removal only shrinks a track; anything longer no longer fits its range
+            repackIndices = count > m_drawCounts[slot];
+            m_deadIndexCount += static_cast<size_t>(m_drawCounts[slot] - count);
+            m_staleIndexSlots.push_back(static_cast<uint32_t>(slot));
+        }
+        m_drawStarts[slot] = m_trackStarts[slotOrder[slot]];
+        m_drawCounts[slot] = count;
+        m_tubeStarts[slot] = m_drawStarts[slot] * 6;
+        m_tubeCounts[slot] = std::max<GLsizei>(m_drawCounts[slot] - 1, 0) * 6;
+    }
+
+    // Each slot owns its indices plus one restart index, so slot ranges stay contiguous. Uploaded
+    // slots keep their range when their track shrinks or goes and new slots extend the end, so
+    // edits patch m_IBO in place; the ranges are repacked once removed points fill half of it
+    if (!m_slotIndexOffsets.empty() && m_deadIndexCount * 2 > m_slotIndexOffsets.back()) {
+        repackIndices = true;
+    }
+    size_t firstSlot = m_uploadedIndexSlots;
+    if (repackIndices) {
+        firstSlot = 0;
+        m_uploadedIndexSlots = 0;
+        m_deadIndexCount = 0;
+        m_staleIndexSlots.clear();
+    }
+    m_slotIndexOffsets.resize(slotCount + 1);
+    size_t indexCount = m_slotIndexOffsets[firstSlot];
+    for (size_t slot = firstSlot; slot < slotCount; ++slot) {
+        m_slotIndexOffsets[slot] = indexCount;
+        indexCount += static_cast<size_t>(m_drawCounts[slot]) + 1;
+    }
+    m_slotIndexOffsets[slotCount] = indexCount;
+    m_needsIndexUpload = (m_drawPath == FiberDrawPath::PRIMITIVE_RESTART);
+    m_clipRangesDirty = true;
+}
+
+void GLFiberRenderer::uploadToGPU()
+{
+    if (!m_initialized) {
+        std::cerr << "GLFiberRenderer not initialized" << std::endl;
+        return;
+    }
+
+    if (m_trackSelection.empty()) {
+        std::cout << "No tracks to upload" << std::endl;
+        m_needsUpload = false;
+        return;
+    }
+
+    // Build vertex data if not already built
+    if (m_vertexData.empty()) {
+        buildVertexData();
+    }
+
+    if (m_vertexData.empty()) {
+        std::cout << "No vertex data to upload" << std::endl;
+        m_needsUpload = false;
+        return;
+    }
+
+    // Upload to GPU
+    m_vertexBufferBytes = static_cast<GLsizeiptr>(m_vertexData.size() * sizeof(float));
+    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+    glBufferData(GL_ARRAY_BUFFER,
+                 m_vertexBufferBytes,
+                 m_vertexData.data(),
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_profiler.addUploadedBytes(static_cast<size_t>(m_vertexBufferBytes));
+
+    if (m_gpuCullingSupported) {
+        uploadTrackInfo();
+    }
 
-    // Enable blending for transparency
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    uploadTrackAttributes();
+
+    // The index buffer is rebuilt whole on its next upload
+    m_uploadedIndexSlots = 0;
+    if (m_drawPath == FiberDrawPath::PRIMITIVE_RESTART) {
+        m_needsIndexUpload = true;
+    }
+
+    m_pendingTracks.clear();
+    m_needsUpload = false;
+
+    std::cout << "Uploaded " << m_vertexData.size() * sizeof(float) / 1024 / 1024
+              << " MB to GPU" << std::endl;
+}
+
+void GLFiberRenderer::uploadIndexBuffer()
+{
+    // Built only when the primitive-restart path is in use; the CPU copy is not kept. Slots past
+    // m_uploadedIndexSlots are new and written at the end, stale slots are rewritten in place, and
+    // no uploaded slot (new data or repacked ranges) rebuilds both buffers
+    const size_t slotCount = m_drawStarts.size();
+    const size_t firstSlot = m_uploadedIndexSlots;
+    const size_t firstIndex = m_slotIndexOffsets[firstSlot];
+    const bool rebuild = firstSlot == 0;
+    if (rebuild) {
+        m_elementBufferBytes = m_trackIdBufferBytes = 0;
+    }
+    size_t uploadedBytes = 0;
+
+    // Ranges of removed points stay filled with restart indices
+    std::vector<GLuint> indices(m_slotIndexOffsets[slotCount] - firstIndex, kRestartIndex);
+    for (size_t slot = firstSlot; slot < slotCount; ++slot) {
+        GLuint* out = indices.data() + (m_slotIndexOffsets[slot] - firstIndex);
+        GLuint first = static_cast<GLuint>(m_drawStarts[slot]);
+        for (GLsizei i = 0; i < m_drawCounts[slot]; ++i) {
+            *out++ = first + static_cast<GLuint>(i);
+        }
+    }
+    reserveBuffer(m_IBO, m_elementBufferBytes, static_cast<GLsizeiptr>(m_slotIndexOffsets[slotCount] * sizeof(GLuint)), GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_IBO);
+    if (!indices.empty()) {
+        glBufferSubData(GL_COPY_WRITE_BUFFER, firstIndex * sizeof(GLuint), indices.size() * sizeof(GLuint), indices.data());
+        uploadedBytes += indices.size() * sizeof(GLuint);
+    }
+    for (uint32_t slot : m_staleIndexSlots) {
+        const size_t rangeFirst = m_slotIndexOffsets[slot];
+        indices.assign(m_slotIndexOffsets[slot + 1] - rangeFirst, kRestartIndex);
+        for (GLsizei i = 0; i < m_drawCounts[slot]; ++i) {
+            indices[i] = static_cast<GLuint>(m_drawStarts[slot] + i);
+        }
+        glBufferSubData(GL_COPY_WRITE_BUFFER, rangeFirst * sizeof(GLuint), indices.size() * sizeof(GLuint), indices.data());
+        uploadedBytes += indices.size() * sizeof(GLuint);
+    }
+
+    // Indexed draws have no gl_DrawID per track, so the track index rides along per vertex.
+    // Only the new slots' tracks are written, in runs of adjacent vertex ranges
+    const auto& slotOrder = m_chunkBVH.getSlotOrder();
+    std::vector<uint32_t> newTracks(slotOrder.begin() + firstSlot, slotOrder.begin() + slotCount);
+    std::sort(newTracks.begin(), newTracks.end(),
+              [this](uint32_t a, uint32_t b) { return m_trackStarts[a] < m_trackStarts[b]; });
+    reserveBuffer(m_trackIdVBO, m_trackIdBufferBytes, static_cast<GLsizeiptr>(m_vertexData.size() / 6 * sizeof(GLuint)), GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_trackIdVBO);
+    std::vector<GLuint> trackIds;
+    for (size_t i = 0; i < newTracks.size();) {
+        const size_t runStart = static_cast<size_t>(m_trackStarts[newTracks[i]]);
+        trackIds.clear();
+        do {
+            trackIds.insert(trackIds.end(), static_cast<size_t>(m_trackCounts[newTracks[i]]), newTracks[i]);
+            ++i;
+        } while (i < newTracks.size() && static_cast<size_t>(m_trackStarts[newTracks[i]]) == runStart + trackIds.size());
+        if (!trackIds.empty()) {
+            glBufferSubData(GL_COPY_WRITE_BUFFER, runStart * sizeof(GLuint), trackIds.size() * sizeof(GLuint), trackIds.data());
+            uploadedBytes += trackIds.size() * sizeof(GLuint);
+        }
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (rebuild) {
+        glBindVertexArray(m_VAO);
+        glEnableVertexAttribArray(2);
+        glBindVertexArray(0);
+    }
+    m_profiler.addUploadedBytes(uploadedBytes);
+    m_uploadedIndexSlots = slotCount;
+    m_staleIndexSlots.clear();
+    m_needsIndexUpload = false;
+}
+
+void GLFiberRenderer::uploadTrackAttributes()
+{
+    m_attributeBufferBytes = static_cast<GLsizeiptr>(m_trackAttributes.size() * sizeof(uint32_t));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_trackAttributeSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, m_attributeBufferBytes, m_trackAttributes.data(), GL_DYNAMIC_DRAW);
+
+    const auto& slotOrder = m_chunkBVH.getSlotOrder();
+    m_slotTrackBytes = static_cast<GLsizeiptr>(slotOrder.size() * sizeof(uint32_t));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_slotTrackSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, m_slotTrackBytes, slotOrder.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    m_profiler.addUploadedBytes(static_cast<size_t>(m_attributeBufferBytes + m_slotTrackBytes));
+
+    m_uploadedSlotCount = slotOrder.size();
+    m_attributesDirtyBegin = m_attributesDirtyEnd = 0;
+}
+
+void GLFiberRenderer::uploadPendingTracks()
+{
+    // Appended and removed tracks since the last frame; runs of neighbors go up together
+    std::sort(m_pendingTracks.begin(), m_pendingTracks.end());
+    m_pendingTracks.erase(std::unique(m_pendingTracks.begin(), m_pendingTracks.end()), m_pendingTracks.end());
+    const size_t trackCount = m_trackStarts.size();
+
+    reserveBuffer(m_VBO, m_vertexBufferBytes, static_cast<GLsizeiptr>(m_vertexData.size() * sizeof(float)), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+    size_t runStart = 0, runEnd = 0;
+    for (size_t i = 0; i <= m_pendingTracks.size(); ++i) {
+        size_t start = 0, end = 0;
+        if (i < m_pendingTracks.size()) {
+            start = static_cast<size_t>(m_trackStarts[m_pendingTracks[i]]);
+            end = start + static_cast<size_t>(m_trackCounts[m_pendingTracks[i]]);
+            if (start == end) continue;
+            if (start == runEnd) {
+                runEnd = end;
+                continue;
+            }
+        }
+        if (runEnd > runStart) {
+            glBufferSubData(GL_ARRAY_BUFFER, runStart * 6 * sizeof(float), (runEnd - runStart) * 6 * sizeof(float),
+                            m_vertexData.data() + runStart * 6);
+            m_profiler.addUploadedBytes((runEnd - runStart) * 6 * sizeof(float));
+        }
+        runStart = start;
+        runEnd = end;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (m_gpuCullingSupported) {
+        reserveBuffer(m_trackInfoSSBO, m_trackInfoBytes, static_cast<GLsizeiptr>(trackCount * 8 * sizeof(float)), GL_STATIC_DRAW);
+        reserveBuffer(m_trackLodSSBO, m_trackLodBytes, static_cast<GLsizeiptr>(trackCount * sizeof(GLuint)), GL_DYNAMIC_DRAW);
+        reserveBuffer(m_indirectBuffer, m_indirectBytes, static_cast<GLsizeiptr>(trackCount * 4 * sizeof(GLuint)), GL_DYNAMIC_DRAW);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_trackInfoSSBO);
+        std::vector<float> info;
+        for (size_t i = 0; i < m_pendingTracks.size(); ) {
+            size_t first = m_pendingTracks[i];
+            size_t last = first;
+            info.clear();
+            while (i < m_pendingTracks.size() && m_pendingTracks[i] == last) {
+                info.resize(info.size() + 8);
+                packTrackInfo(m_trackBounds[last], m_trackStarts[last], m_trackCounts[last], &info[info.size() - 8]);
+                ++last;
+                ++i;
+            }
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * 8 * sizeof(float), info.size() * sizeof(float), info.data());
+            m_profiler.addUploadedBytes(info.size() * sizeof(float));
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    // The attribute range itself is flagged dirty and sent by bindColoringResources()
+    reserveBuffer(m_trackAttributeSSBO, m_attributeBufferBytes,
+                  static_cast<GLsizeiptr>(m_trackAttributes.size() * sizeof(uint32_t)), GL_DYNAMIC_DRAW);
+
+    // New slots are appended to the slot order, existing ones never move
+    const auto& slotOrder = m_chunkBVH.getSlotOrder();
+    if (slotOrder.size() > m_uploadedSlotCount) {
+        reserveBuffer(m_slotTrackSSBO, m_slotTrackBytes, static_cast<GLsizeiptr>(slotOrder.size() * sizeof(uint32_t)), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_slotTrackSSBO);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, m_uploadedSlotCount * sizeof(uint32_t),
+                        (slotOrder.size() - m_uploadedSlotCount) * sizeof(uint32_t), slotOrder.data() + m_uploadedSlotCount);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        m_profiler.addUploadedBytes((slotOrder.size() - m_uploadedSlotCount) * sizeof(uint32_t));
+        m_uploadedSlotCount = slotOrder.size();
+    }
+
+    if (m_hasScalarStream && !m_needsScalarUpload) {
+        reserveBuffer(m_scalarSSBO, m_scalarBufferBytes, static_cast<GLsizeiptr>(m_vertexData.size() / 6 * sizeof(float)), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_scalarSSBO);
+        std::vector<float> values;
+        for (uint32_t trackIndex : m_pendingTracks) {
+            const FiberTrack& track = trackAt(trackIndex);
+            if (track.empty()) continue;
+            values.clear();
+            for (const auto& point : track) {
+                values.push_back(static_cast<size_t>(m_scalarIndex) < point.scalars.size() ? point.scalars[m_scalarIndex] : 0.0f);
+            }
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, m_trackStarts[trackIndex] * sizeof(float),
+                            values.size() * sizeof(float), values.data());
+            m_profiler.addUploadedBytes(values.size() * sizeof(float));
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    m_pendingTracks.clear();
+}
+
+void GLFiberRenderer::bindColoringResources()
+{
+    // Recolor/hide/highlight edits since the last frame go up as one sub-range
+    if (m_attributesDirtyBegin < m_attributesDirtyEnd) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_trackAttributeSSBO);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                        m_attributesDirtyBegin * 2 * sizeof(uint32_t),
+                        (m_attributesDirtyEnd - m_attributesDirtyBegin) * 2 * sizeof(uint32_t),
+                        m_trackAttributes.data() + m_attributesDirtyBegin * 2);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        m_profiler.addUploadedBytes((m_attributesDirtyEnd - m_attributesDirtyBegin) * 2 * sizeof(uint32_t));
+        m_attributesDirtyBegin = m_attributesDirtyEnd = 0;
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, m_trackAttributeSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, m_slotTrackSSBO);
+
+    // Scalar selection and colormap edits upload only their own resource
+    if (m_needsScalarUpload) {
+        uploadScalarData();
+    }
+    if (m_needsColormapUpload) {
+        uploadColormap();
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, m_scalarSSBO);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_1D, m_colormapTexture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void GLFiberRenderer::uploadTrackInfo()
+{
+    const size_t trackCount = m_trackStarts.size();
+    std::vector<float> trackInfo(trackCount * 8);
+    for (size_t i = 0; i < trackCount; ++i) {
+        packTrackInfo(m_trackBounds[i], m_trackStarts[i], m_trackCounts[i], &trackInfo[i * 8]);
+    }
+    m_trackInfoBytes = static_cast<GLsizeiptr>(trackInfo.size() * sizeof(float));
+    m_trackLodBytes = static_cast<GLsizeiptr>(trackCount * sizeof(GLuint));
+    m_indirectBytes = static_cast<GLsizeiptr>(trackCount * 4 * sizeof(GLuint));
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_trackInfoSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, trackInfo.size() * sizeof(float), trackInfo.data(), GL_STATIC_DRAW);
+    m_profiler.addUploadedBytes(trackInfo.size() * sizeof(float));
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_trackLodSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, trackCount * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_indirectBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, trackCount * 4 * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawCountBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GLFiberRenderer::render(const float* mvpMatrix)
+{
+    if (!m_initialized) {
+        std::cerr << "GLFiberRenderer not initialized" << std::endl;
+        return;
+    }
+
+    m_profiler.beginFrame();
+    if (m_streamer.isOpen()) {
+        renderOutOfCore(mvpMatrix);
+        m_profiler.endFrame();
+        return;
+    }
+
+    m_profiler.beginSection(ProfilerSection::UPLOAD);
+    if (m_needsUpload) {
+        uploadToGPU();
+    } else if (!m_pendingTracks.empty()) {
+        uploadPendingTracks();
+    }
+
+    if (m_vertexData.empty()) {
+        m_profiler.endFrame();
+        return;
+    }
+
+    GLint targetFBO = 0;
+    GLint viewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &targetFBO);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    m_densityVolumeActive = shouldUseDensityVolume(mvpMatrix, viewport);
+    if (m_densityVolumeActive) {
+        m_profiler.endSection();
+        renderDensityVolume(mvpMatrix, viewport);
+        m_profiler.endFrame();
+        return;
+    }
+
+    if (m_needsIndexUpload && m_drawPath == FiberDrawPath::PRIMITIVE_RESTART) {
+        uploadIndexBuffer();
+    }
+
+    // Set line width
+    glLineWidth(m_lineWidth);
+
+    // Translucent fibers go through the OIT targets instead of ordered blending
+    bool useOIT = m_transparencyMode == TransparencyMode::WEIGHTED_BLENDED && m_opacity < 1.0f &&
+                  m_compositeShader && ensureOITTargets(viewport[2], viewport[3]);
+    GLboolean depthTestEnabled = glIsEnabled(GL_DEPTH_TEST);
+
+    if (useOIT) {
+        beginOITPass(viewport);
+    } else {
+        // Enable blending for transparency
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
 
     // Bind VAO and render
     glBindVertexArray(m_VAO);
+    bindColoringResources();
+
+    // Tubes need the quad expansion pass, which runs on the CPU-culled path
+    bool drawTubes = m_tubeImpostorsEnabled && m_tubeImpostorsSupported;
+    bool gpuPath = m_gpuCullingEnabled && m_gpuCullingSupported && !drawTubes &&
+                   getTrackProgram(TrackVertexFormat::PULL, effectiveColorMode(), useOIT);
+    updateFrameParameters(mvpMatrix, viewport, drawTubes);
+    m_profiler.endSection();
+    setClipDistancesEnabled(true);
+    if (gpuPath) {
+        drawTracksGPU();
+    } else {
+        drawTracksCPU(mvpMatrix);
+    }
+    setClipDistancesEnabled(false);
+
+    if (useOIT) {
+        m_profiler.beginSection(ProfilerSection::COMPOSITE);
+        compositeOIT(targetFBO, viewport);
+        m_profiler.endSection();
+    }
+
+    glBindVertexArray(0);
+    glDisable(GL_BLEND);
+    if (depthTestEnabled) {
+        glEnable(GL_DEPTH_TEST);
+    }
+    m_profiler.endFrame();
+}
+
+void GLFiberRenderer::renderOutOfCore(const float* mvpMatrix)
+{
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glLineWidth(m_lineWidth);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // Node uploads, traversal and the draw happen in one pass, so they are all counted as DRAW
+    m_profiler.beginSection(ProfilerSection::DRAW);
+    m_streamer.setOpacity(m_opacity);
+    m_streamer.render(mvpMatrix, viewport);
+    m_profiler.endSection();
+    glDisable(GL_BLEND);
+
+    const StreamingStatistics& statistics = m_streamer.getStatistics();
+    m_profiler.addUploadedBytes(statistics.uploadedBytes);
+    m_profiler.addDraw(statistics.drawnPieces, statistics.drawnPoints, statistics.drawnPieces > 0 ? 1 : 0);
+    m_visibleTrackCount = statistics.drawnPieces;
+    if (statistics.uploadedBytes > 0) {
+        m_sceneRevision++;
+    }
+}
+
+bool GLFiberRenderer::shouldUseDensityVolume(const float* mvpMatrix, const GLint* viewport)
+{
+    if (m_renderMode == FiberRenderMode::LINES || !m_densityVolume.isAvailable()) {
+        return false;
+    }
+    if (m_renderMode == FiberRenderMode::DENSITY_VOLUME) {
+        return true;
+    }
+    // The volume cannot be clipped, and clipped views only draw the tracks they touch
+    if (m_clipPlaneCount > 0) {
+        return false;
+    }
+
+    // Screen rectangle of the projected bounding box; lines while the camera is inside it
+    const float corners[2][3] = { { m_minX, m_minY, m_minZ }, { m_maxX, m_maxY, m_maxZ } };
+    float screenMin[2] = { 1e30f, 1e30f };
+    float screenMax[2] = { -1e30f, -1e30f };
+    for (int corner = 0; corner < 8; ++corner) {
+        const float x = corners[corner & 1][0];
+        const float y = corners[(corner >> 1) & 1][1];
+        const float z = corners[(corner >> 2) & 1][2];
+        const float clipX = mvpMatrix[0] * x + mvpMatrix[4] * y + mvpMatrix[8] * z + mvpMatrix[12];
+        const float clipY = mvpMatrix[1] * x + mvpMatrix[5] * y + mvpMatrix[9] * z + mvpMatrix[13];
+        const float clipW = mvpMatrix[3] * x + mvpMatrix[7] * y + mvpMatrix[11] * z + mvpMatrix[15];
+        if (clipW <= 1e-6f) {
+            return false;
+        }
+        const float pixelX = (clipX / clipW * 0.5f + 0.5f) * viewport[2];
+        const float pixelY = (clipY / clipW * 0.5f + 0.5f) * viewport[3];
+        screenMin[0] = std::min(screenMin[0], pixelX); screenMax[0] = std::max(screenMax[0], pixelX);
+        screenMin[1] = std::min(screenMin[1], pixelY); screenMax[1] = std::max(screenMax[1], pixelY);
+    }
+
+    // Covered pixels of all lines over the visible part of the rectangle
+    const float width = screenMax[0] - screenMin[0];
+    const float height = screenMax[1] - screenMin[1];
+    const float visibleWidth = std::min(screenMax[0], static_cast<float>(viewport[2])) - std::max(screenMin[0], 0.0f);
+    const float visibleHeight = std::min(screenMax[1], static_cast<float>(viewport[3])) - std::max(screenMin[1], 0.0f);
+    const float boxDiagonal = std::sqrt((m_maxX - m_minX) * (m_maxX - m_minX) + (m_maxY - m_minY) * (m_maxY - m_minY) +
+                                        (m_maxZ - m_minZ) * (m_maxZ - m_minZ));
+    if (visibleWidth <= 0.0f || visibleHeight <= 0.0f || boxDiagonal <= 0.0f) {
+        return false;
+    }
+    const double pixelsPerUnit = std::sqrt(width * width + height * height) / boxDiagonal;
+    const double overdraw = m_totalTrackLength * pixelsPerUnit * std::max(m_lineWidth, 1.0f) /
+                            (static_cast<double>(width) * height);
+
+    // Hysteresis, so zooming around the threshold does not flicker between modes
+    const float threshold = m_densityVolumeActive ? m_densityVolumeThreshold * 0.75f : m_densityVolumeThreshold;
+    return overdraw > threshold;
+}
+
+void GLFiberRenderer::renderDensityVolume(const float* mvpMatrix, const GLint* viewport)
+{
+    // New data rebuilds at once; visibility edits keep the previous volume until they settle
+    const bool settled = m_densityVolumeVisibilityDirty && std::chrono::steady_clock::now() >= m_densityVolumeSettleTime;
+    if (m_densityVolumeDirty || settled) {
+        m_profiler.beginSection(ProfilerSection::BUILD);
+        // Indices into the source data, which the imager reads in place
+        std::vector<uint32_t> selection;
+        selection.reserve(m_renderedTrackCount);
+        for (size_t i = 0; i < m_trackCounts.size(); ++i) {
+            if (m_trackCounts[i] > 1 && isTrackVisible(i)) {
+                selection.push_back(m_trackSelection[i]);
+            }
+        }
+        const float boundsMin[3] = { m_minX, m_minY, m_minZ };
+        const float boundsMax[3] = { m_maxX, m_maxY, m_maxZ };
+        m_densityVolume.build(*m_trackSource, selection, boundsMin, boundsMax, m_densityVolumeResolution, m_appendedTracks.get());
+        m_densityVolumeDirty = false;
+        m_densityVolumeVisibilityDirty = false;
+        m_profiler.addUploadedBytes(m_densityVolume.getTextureBytes());
+        m_profiler.endSection();
+    }
+
+    m_profiler.beginSection(ProfilerSection::DRAW);
+    bindColoringResources();
+    m_densityVolume.draw(mvpMatrix, viewport, effectiveColorMode() != FiberColoringMode::SCALAR_COLORMAP);
+    m_profiler.addDraw(0, 0, 1);
+    m_profiler.endSection();
+    m_visibleTrackCount = 0;
+    glDisable(GL_BLEND);
+}
+
+bool GLFiberRenderer::pick(const float* mvpMatrix, const GLint* viewport, int x, int y, TrackPickResult& result)
+{
+    std::memset(&result, 0, sizeof(result));
+    return drawPickIds(mvpMatrix, viewport, x, y) && m_picker.poll(result, true);
+}
 
-    // Render all tracks in one call using glMultiDrawArrays
-    if (!m_trackStarts.empty() && !m_trackCounts.empty()) {
-        std::cout << "Rendering " << m_trackStarts.size() << " tracks with glMultiDrawArrays" << std::endl;
-        glMultiDrawArrays(GL_LINE_STRIP, m_trackStarts.data(), m_trackCounts.data(), static_cast<GLsizei>(m_trackStarts.size()));
+bool GLFiberRenderer::requestPick(const float* mvpMatrix, const GLint* viewport, int x, int y)
+{
+    return drawPickIds(mvpMatrix, viewport, x, y);
+}
+
+bool GLFiberRenderer::drawPickIds(const float* mvpMatrix, const GLint* viewport, int x, int y)
+{
+    // Picks read what the last render() uploaded
+    if (!m_initialized || m_streamer.isOpen() || m_needsUpload || !m_pendingTracks.empty() || m_vertexData.empty()) {
+        return false;
+    }
+    float pickMatrix[16];
+    if (!m_picker.begin(mvpMatrix, viewport, x, y, pickMatrix, m_lineWidth)) {
+        return false;
+    }
 
-        // Check for OpenGL errors
-        GLenum err = glGetError();
-        if (err != GL_NO_ERROR) {
-            std::cerr << "OpenGL error after glMultiDrawArrays: 0x" << std::hex << err << std::dec << std::endl;
+    // The pick frustum spans a few pixels, so chunk and track bounds leave only tracks near the cursor
+    Frustum frustum;
+    frustum.extract(pickMatrix);
+    addClipPlanes(frustum);
+    m_pickFirsts.clear();
+    m_pickCounts.clear();
+    m_pickTracks.clear();
+    auto addTrack = [&](uint32_t track) {
+        if (m_trackCounts[track] < 2 || !isTrackVisible(track) || frustum.classify(m_trackBounds[track]) == Frustum::OUTSIDE) {
+            return;
+        }
+        m_pickFirsts.push_back(m_trackStarts[track]);
+        m_pickCounts.push_back(m_trackCounts[track]);
+        m_pickTracks.push_back(track);
+    };
+    if (m_chunkBVH.isEmpty()) {
+        for (size_t t = 0; t < m_trackCounts.size(); ++t) {
+            addTrack(static_cast<uint32_t>(t));
         }
     } else {
-        std::cerr << "WARNING: No track data to render (starts=" << m_trackStarts.size()
-                  << ", counts=" << m_trackCounts.size() << ")" << std::endl;
+        std::vector<SlotRange> ranges;
+        m_chunkBVH.cullFrustum(frustum, ranges);
+        const std::vector<uint32_t>& slotOrder = m_chunkBVH.getSlotOrder();
+        for (const auto& range : ranges) {
+            for (uint32_t slot = range.firstSlot; slot < range.firstSlot + range.slotCount; ++slot) {
+                addTrack(slotOrder[slot]);
+            }
+        }
     }
 
+    glBindVertexArray(m_VAO);
+    m_picker.setClipPlanes(&m_clipPlanes[0][0], m_clipPlaneCount);
+    setClipDistancesEnabled(true);
+    m_picker.drawStrips(m_pickFirsts.data(), m_pickCounts.data(), m_pickTracks.data(), static_cast<GLsizei>(m_pickTracks.size()));
+    setClipDistancesEnabled(false);
     glBindVertexArray(0);
-    glDisable(GL_BLEND);
+    m_picker.end();
+    return true;
+}
+
+bool GLFiberRenderer::ensureOITTargets(GLsizei width, GLsizei height)
+{
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+    if (m_oitFBO != 0 && width == m_oitWidth && height == m_oitHeight) {
+        return true;
+    }
+
+    releaseOITTargets();
+
+    glGenTextures(1, &m_oitAccumTexture);
+    glBindTexture(GL_TEXTURE_2D, m_oitAccumTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenTextures(1, &m_oitRevealTexture);
+    glBindTexture(GL_TEXTURE_2D, m_oitRevealTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, width, height, 0, GL_RED, GL_HALF_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint previousFBO = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFBO);
+    glGenFramebuffers(1, &m_oitFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_oitFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_oitAccumTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_oitRevealTexture, 0);
+    const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(previousFBO));
+
+    if (!complete) {
+        std::cerr << "OIT framebuffer incomplete, using ordered alpha blending" << std::endl;
+        releaseOITTargets();
+        return false;
+    }
+
+    m_oitWidth = width;
+    m_oitHeight = height;
+    return true;
+}
+
+void GLFiberRenderer::releaseOITTargets()
+{
+    if (m_oitFBO != 0) {
+        glDeleteFramebuffers(1, &m_oitFBO);
+        m_oitFBO = 0;
+    }
+    if (m_oitAccumTexture != 0) {
+        glDeleteTextures(1, &m_oitAccumTexture);
+        m_oitAccumTexture = 0;
+    }
+    if (m_oitRevealTexture != 0) {
+        glDeleteTextures(1, &m_oitRevealTexture);
+        m_oitRevealTexture = 0;
+    }
+    m_oitWidth = m_oitHeight = 0;
+}
+
+void GLFiberRenderer::beginOITPass(const GLint* viewport)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, m_oitFBO);
+    glViewport(0, 0, viewport[2], viewport[3]);
+
+    const GLfloat clearAccum[] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    const GLfloat clearReveal[] = { 1.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 0, clearAccum);
+    glClearBufferfv(GL_COLOR, 1, clearReveal);
+
+    // All fibers are translucent, so nothing occludes and nothing needs sorting
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+
+    m_oitPassActive = true;
+}
+
+void GLFiberRenderer::compositeOIT(GLint targetFBO, const GLint* viewport)
+{
+    m_oitPassActive = false;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(targetFBO));
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    m_compositeShader->use();
+    m_compositeShader->setUniform2f("uViewportOrigin", static_cast<float>(viewport[0]), static_cast<float>(viewport[1]));
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_oitAccumTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, m_oitRevealTexture);
+
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Sum of per-slot vertex counts over a visible slot range
+static size_t countVertices(const std::vector<GLsizei>& counts, const SlotRange& range)
+{
+    size_t total = 0;
+    for (uint32_t slot = range.firstSlot; slot < range.firstSlot + range.slotCount; ++slot) {
+        total += static_cast<size_t>(counts[slot]);
+    }
+    return total;
+}
+
+// The ranges with empty slots (removed tracks) cut out: some drivers lose gl_DrawID
+// order across zero-count draws of a multi-draw
+static void skipEmptySlots(const std::vector<SlotRange>& ranges, const std::vector<GLsizei>& counts, std::vector<SlotRange>& result)
+{
+    result.clear();
+    for (const auto& range : ranges) {
+        const uint32_t end = range.firstSlot + range.slotCount;
+        uint32_t first = range.firstSlot;
+        while (first < end) {
+            if (counts[first] == 0) {
+                ++first;
+                continue;
+            }
+            uint32_t last = first + 1;
+            while (last < end && counts[last] != 0) {
+                ++last;
+            }
+            result.push_back(SlotRange{first, last - first});
+            first = last;
+        }
+    }
+}
+
+// Slots covered by both sorted range lists
+static void intersectRanges(const std::vector<SlotRange>& a, const std::vector<SlotRange>& b, std::vector<SlotRange>& result)
+{
+    result.clear();
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        const uint32_t first = std::max(a[i].firstSlot, b[j].firstSlot);
+        const uint32_t aEnd = a[i].firstSlot + a[i].slotCount;
+        const uint32_t bEnd = b[j].firstSlot + b[j].slotCount;
+        const uint32_t end = std::min(aEnd, bEnd);
+        if (first < end) {
+            result.push_back(SlotRange{first, end - first});
+        }
+        if (aEnd <= bEnd) {
+            ++i;
+        } else {
+            ++j;
+        }
+    }
+}
+
+void GLFiberRenderer::updateClipRanges()
+{
+    if (!m_clipRangesDirty) {
+        return;
+    }
+    m_clipRangesDirty = false;
+
+    // Chunks wholly outside a plane are skipped; tracks of the rest are tested by their own
+    // bounds, so only the tracks a slab touches are submitted and the frustum result just
+    // has to be intersected with these ranges every frame
+    Frustum clip;
+    addClipPlanes(clip);
+    m_chunkBVH.cullFrustum(clip, m_cullRanges);
+    m_clipRanges.clear();
+    const std::vector<uint32_t>& slotOrder = m_chunkBVH.getSlotOrder();
+    for (const auto& range : m_cullRanges) {
+        for (uint32_t slot = range.firstSlot; slot < range.firstSlot + range.slotCount; ++slot) {
+            const BoundingBox& bounds = m_trackBounds[slotOrder[slot]];
+            if (!bounds.isValid() || clip.classify(bounds) == Frustum::OUTSIDE) {
+                continue;
+            }
+            if (!m_clipRanges.empty() && m_clipRanges.back().firstSlot + m_clipRanges.back().slotCount == slot) {
+                m_clipRanges.back().slotCount++;
+            } else {
+                m_clipRanges.push_back(SlotRange{slot, 1});
+            }
+        }
+    }
+}
+
+void GLFiberRenderer::drawTracksCPU(const float* mvpMatrix)
+{
+    const FiberColoringMode colorMode = effectiveColorMode();
+    const TrackVertexFormat lineFormat = m_drawPath == FiberDrawPath::PRIMITIVE_RESTART ?
+                                         TrackVertexFormat::LINES_TRACK_ID : TrackVertexFormat::LINES;
+    bool drawTubes = m_tubeImpostorsEnabled && m_tubeImpostorsSupported;
+    GLShaderProgram* shader = getTrackProgram(drawTubes ? TrackVertexFormat::TUBES : lineFormat, colorMode, m_oitPassActive);
+    if (!shader && drawTubes) {
+        // No tube variant for this combination: draw plain lines instead
+        drawTubes = false;
+        shader = getTrackProgram(lineFormat, colorMode, m_oitPassActive);
+    }
+    if (!shader) {
+        return;
+    }
+
+    // Per-frame parameters already sit in the frame UBO; only the slot base changes per draw
+    shader->use();
+    const GLint slotBaseLocation = shader->getUniformLocation("uSlotBase");
+
+    if (drawTubes) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_VBO);
+    }
+
+    // Render visible chunks with one glMultiDrawArrays per contiguous slot range
+    if (!m_drawStarts.empty() && !m_drawCounts.empty()) {
+        m_profiler.beginSection(ProfilerSection::CULL);
+        if (m_clipPlaneCount > 0) {
+            updateClipRanges();
+        }
+        if (m_frustumCullingEnabled && m_clipPlaneCount > 0) {
+            m_chunkBVH.cullFrustum(mvpMatrix, m_cullRanges);
+            intersectRanges(m_cullRanges, m_clipRanges, m_visibleRanges);
+        } else if (m_frustumCullingEnabled) {
+            m_chunkBVH.cullFrustum(mvpMatrix, m_visibleRanges);
+        } else if (m_clipPlaneCount > 0) {
+            m_visibleRanges = m_clipRanges;
+        } else {
+            m_visibleRanges.assign(1, SlotRange{0, static_cast<uint32_t>(m_drawStarts.size())});
+        }
+
+        m_profiler.beginSection(ProfilerSection::DRAW);
+        m_visibleTrackCount = 0;
+        size_t vertexCount = 0;
+        size_t drawCount = m_visibleRanges.size();
+        if (drawTubes) {
+            skipEmptySlots(m_visibleRanges, m_tubeCounts, m_drawRanges);
+            drawCount = m_drawRanges.size();
+            for (const auto& range : m_drawRanges) {
+                glUniform1i(slotBaseLocation, static_cast<GLint>(range.firstSlot));
+                glMultiDrawArrays(GL_TRIANGLES,
+                                  m_tubeStarts.data() + range.firstSlot,
+                                  m_tubeCounts.data() + range.firstSlot,
+                                  static_cast<GLsizei>(range.slotCount));
+                m_visibleTrackCount += range.slotCount;
+                vertexCount += countVertices(m_tubeCounts, range);
+            }
+        } else if (m_drawPath == FiberDrawPath::PRIMITIVE_RESTART) {
+            // One glDrawElements per visible range; restart indices separate the tracks
+            glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+            for (const auto& range : m_visibleRanges) {
+                size_t firstIndex = m_slotIndexOffsets[range.firstSlot];
+                size_t indexCount = m_slotIndexOffsets[range.firstSlot + range.slotCount] - firstIndex;
+                glDrawElements(GL_LINE_STRIP, static_cast<GLsizei>(indexCount), GL_UNSIGNED_INT,
+                               reinterpret_cast<const void*>(firstIndex * sizeof(GLuint)));
+                m_visibleTrackCount += range.slotCount;
+                vertexCount += countVertices(m_drawCounts, range);
+            }
+            glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+        } else {
+            skipEmptySlots(m_visibleRanges, m_drawCounts, m_drawRanges);
+            drawCount = m_drawRanges.size();
+            for (const auto& range : m_drawRanges) {
+                glUniform1i(slotBaseLocation, static_cast<GLint>(range.firstSlot));
+                glMultiDrawArrays(GL_LINE_STRIP,
+                                  m_drawStarts.data() + range.firstSlot,
+                                  m_drawCounts.data() + range.firstSlot,
+                                  static_cast<GLsizei>(range.slotCount));
+                m_visibleTrackCount += range.slotCount;
+                vertexCount += countVertices(m_drawCounts, range);
+            }
+        }
+        m_profiler.endSection();
+        m_profiler.addDraw(m_visibleTrackCount, vertexCount, drawCount);
+    }
+}
+
+void GLFiberRenderer::drawTracksGPU()
+{
+    // Fixed per-frame CPU work: reset the counter, one dispatch, one indirect draw
+    const GLsizei trackCount = static_cast<GLsizei>(m_trackStarts.size());
+    if (trackCount == 0) {
+        return;
+    }
+
+    m_profiler.beginSection(ProfilerSection::CULL);
+    const GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawCountBuffer);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_VBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_trackInfoSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_trackLodSSBO);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_indirectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_drawCountBuffer);
+
+    // Frustum planes, viewport and LOD settings come from the frame UBO
+    m_cullShader->use();
+    glDispatchCompute((trackCount + 255) / 256, 1, 1);
+
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    m_profiler.beginSection(ProfilerSection::DRAW);
+    getTrackProgram(TrackVertexFormat::PULL, effectiveColorMode(), m_oitPassActive)->use();
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+    glBindBuffer(GL_PARAMETER_BUFFER, m_drawCountBuffer);
+    glMultiDrawArraysIndirectCount(GL_LINE_STRIP, nullptr, 0, trackCount, 0);
+    glBindBuffer(GL_PARAMETER_BUFFER, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    m_profiler.endSection();
+
+    // The surviving count stays on the GPU; report the submitted upper bound
+    m_visibleTrackCount = static_cast<size_t>(trackCount);
+    m_profiler.addDraw(m_visibleTrackCount, m_totalPointCount, 1);
+}
+
+size_t GLFiberRenderer::estimateGPUBytes(size_t trackCount, size_t pointCount) const
+{
+    // Interleaved position + direction, then the per-track attribute and slot tables
+    size_t bytes = pointCount * 6 * sizeof(float) + trackCount * (2 * sizeof(uint32_t) + sizeof(uint32_t));
+    if (m_scalarIndex >= 0) {
+        bytes += pointCount * sizeof(float);
+    }
+    if (m_gpuCullingSupported) {
+        // Track info, LOD stride and one indirect command per track
+        bytes += trackCount * (8 * sizeof(float) + sizeof(GLuint) + 4 * sizeof(GLuint));
+    }
+    if (m_drawPath == FiberDrawPath::PRIMITIVE_RESTART) {
+        // One index per point plus a restart per track, and a track id per point
+        bytes += (pointCount + trackCount) * sizeof(GLuint) + pointCount * sizeof(GLuint);
+    }
+    return bytes;
+}
+
+size_t GLFiberRenderer::getGPUBufferBytes() const
+{
+    const GLsizeiptr sizes[] = { m_vertexBufferBytes, m_trackInfoBytes, m_trackLodBytes, m_indirectBytes,
+                                 m_attributeBufferBytes, m_slotTrackBytes, m_scalarBufferBytes,
+                                 m_elementBufferBytes, m_trackIdBufferBytes };
+    size_t bytes = 0;
+    for (GLsizeiptr size : sizes) {
+        bytes += static_cast<size_t>(size);
+    }
+    return bytes;
 }
 
 void GLFiberRenderer::getBoundingBox(float& minX, float& maxX, float& minY, float& maxY, float& minZ, float& maxZ) const
@@ -0,0 +1,221 @@
+#include "../header/GLFrameCache.h"
+#include <cstring>
+#include <iostream>
+
+namespace DTIFiberLib {
+
+namespace {
+
+GLint attachmentParameter(GLenum attachment, GLenum parameter)
+{
+    GLint value = 0;
+    glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, attachment, parameter, &value);
+    return value;
+}
+
+// Internal format of the bound read framebuffer's color buffer, from its component sizes
+GLenum queryColorFormat(GLenum attachment)
+{
+    const GLint red = attachmentParameter(attachment, GL_FRAMEBUFFER_ATTACHMENT_RED_SIZE);
+    const GLint alpha = attachmentParameter(attachment, GL_FRAMEBUFFER_ATTACHMENT_ALPHA_SIZE);
+    const GLint type = attachmentParameter(attachment, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE);
+    const GLint encoding = attachmentParameter(attachment, GL_FRAMEBUFFER_ATTACHMENT_COLOR_ENCODING);
+
+    if (type == GL_FLOAT) {
+        if (red == 11) return GL_R11F_G11F_B10F;
+        if (red == 32) return alpha > 0 ? GL_RGBA32F : GL_RGB32F;
+        return alpha > 0 ? GL_RGBA16F : GL_RGB16F;
+    }
+    if (encoding == GL_SRGB) return alpha > 0 ? GL_SRGB8_ALPHA8 : GL_SRGB8;
+    if (red == 10) return GL_RGB10_A2;
+    if (red == 16) return GL_RGBA16;
+    return alpha > 0 ? GL_RGBA8 : GL_RGB8;
+}
+
+// Depth blits require identical depth/stencil formats, so this must reproduce the source exactly
+GLenum queryDepthFormat(GLenum depthAttachment, GLenum stencilAttachment)
+{
+    if (attachmentParameter(depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE) == GL_NONE) {
+        return GL_NONE;
+    }
+    const GLint depth = attachmentParameter(depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE);
+    const GLint type = attachmentParameter(depthAttachment, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE);
+    const bool hasStencil = attachmentParameter(stencilAttachment, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE) != GL_NONE &&
+                            attachmentParameter(stencilAttachment, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE) > 0;
+
+    if (type == GL_FLOAT) return hasStencil ? GL_DEPTH32F_STENCIL8 : GL_DEPTH_COMPONENT32F;
+    if (depth == 24) return hasStencil ? GL_DEPTH24_STENCIL8 : GL_DEPTH_COMPONENT24;
+    if (depth == 16) return GL_DEPTH_COMPONENT16;
+    if (depth == 32) return GL_DEPTH_COMPONENT32;
+    return GL_NONE;
+}
+
+// Saves and restores the framebuffer bindings and scissor test around a blit
+class BlitState {
+public:
+    BlitState()
+    {
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_drawFBO);
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &m_readFBO);
+        m_scissor = glIsEnabled(GL_SCISSOR_TEST);
+        if (m_scissor) {
+            glDisable(GL_SCISSOR_TEST);
+        }
+    }
+
+    ~BlitState()
+    {
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, static_cast<GLuint>(m_drawFBO));
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(m_readFBO));
+        if (m_scissor) {
+            glEnable(GL_SCISSOR_TEST);
+        }
+    }
+
+private:
+    GLint m_drawFBO = 0;
+    GLint m_readFBO = 0;
+    GLboolean m_scissor = GL_FALSE;
+};
+
+} // namespace
+
+GLFrameCache::GLFrameCache()
+    : m_FBO(0)
+    , m_colorRBO(0)
+    , m_depthRBO(0)
+    , m_width(0)
+    , m_height(0)
+    , m_samples(0)
+    , m_colorFormat(GL_NONE)
+    , m_depthFormat(GL_NONE)
+    , m_blitMask(0)
+    , m_valid(false)
+    , m_sceneRevision(0)
+    , m_hitCount(0)
+    , m_missCount(0)
+{
+    std::memset(m_mvpMatrix, 0, sizeof(m_mvpMatrix));
+    std::memset(m_viewport, 0, sizeof(m_viewport));
+}
+
+GLFrameCache::~GLFrameCache()
+{
+    cleanup();
+}
+
+void GLFrameCache::cleanup()
+{
+    if (m_FBO != 0) {
+        glDeleteFramebuffers(1, &m_FBO);
+    }
+    GLuint renderbuffers[] = { m_colorRBO, m_depthRBO };
+    if (m_colorRBO != 0 || m_depthRBO != 0) {
+        glDeleteRenderbuffers(2, renderbuffers);
+    }
+    m_FBO = m_colorRBO = m_depthRBO = 0;
+    m_width = m_height = 0;
+    m_valid = false;
+}
+
+bool GLFrameCache::matches(uint64_t sceneRevision, const float* mvpMatrix, const GLint* viewport) const
+{
+    // Exact comparison: a stale frame must never be shown
+    return m_valid && sceneRevision == m_sceneRevision &&
+           std::memcmp(mvpMatrix, m_mvpMatrix, sizeof(m_mvpMatrix)) == 0 &&
+           std::memcmp(viewport, m_viewport, sizeof(m_viewport)) == 0;
+}
+
+bool GLFrameCache::restore(GLuint targetFBO, uint64_t sceneRevision, const float* mvpMatrix, const GLint* viewport)
+{
+    if (!matches(sceneRevision, mvpMatrix, viewport)) {
+        m_missCount++;
+        return false;
+    }
+
+    BlitState state;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_FBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFBO);
+    glBlitFramebuffer(0, 0, m_width, m_height,
+                      viewport[0], viewport[1], viewport[0] + m_width, viewport[1] + m_height,
+                      m_blitMask, GL_NEAREST);
+    m_hitCount++;
+    return true;
+}
+
+bool GLFrameCache::store(GLuint sourceFBO, uint64_t sceneRevision, const float* mvpMatrix, const GLint* viewport)
+{
+    m_valid = false;
+    if (viewport[2] <= 0 || viewport[3] <= 0) {
+        return false;
+    }
+
+    BlitState state;
+    if (!ensureStorage(sourceFBO, viewport[2], viewport[3])) {
+        return false;
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, sourceFBO);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_FBO);
+    glBlitFramebuffer(viewport[0], viewport[1], viewport[0] + m_width, viewport[1] + m_height,
+                      0, 0, m_width, m_height,
+                      m_blitMask, GL_NEAREST);
+
+    m_sceneRevision = sceneRevision;
+    std::memcpy(m_mvpMatrix, mvpMatrix, sizeof(m_mvpMatrix));
+    std::memcpy(m_viewport, viewport, sizeof(m_viewport));
+    m_valid = true;
+    return true;
+}
+
+bool GLFrameCache::ensureStorage(GLuint sourceFBO, GLsizei width, GLsizei height)
+{
+    // Multisampled blits need equal sample counts, so mirror the source framebuffer
+    glBindFramebuffer(GL_FRAMEBUFFER, sourceFBO);
+    GLint samples = 0;
+    glGetIntegerv(GL_SAMPLES, &samples);
+    const bool isDefault = sourceFBO == 0;
+    const GLenum colorFormat = queryColorFormat(isDefault ? GL_BACK_LEFT : GL_COLOR_ATTACHMENT0);
+    const GLenum depthFormat = queryDepthFormat(isDefault ? GL_DEPTH : GL_DEPTH_ATTACHMENT,
+                                                isDefault ? GL_STENCIL : GL_STENCIL_ATTACHMENT);
+
+    if (m_FBO != 0 && width == m_width && height == m_height && samples == m_samples &&
+        colorFormat == m_colorFormat && depthFormat == m_depthFormat) {
+        return true;
+    }
+
+    cleanup();
+    m_width = width;
+    m_height = height;
+    m_samples = samples;
+    m_colorFormat = colorFormat;
+    m_depthFormat = depthFormat;
+    m_blitMask = GL_COLOR_BUFFER_BIT | (depthFormat != GL_NONE ? GL_DEPTH_BUFFER_BIT : 0);
+
+    glGenRenderbuffers(1, &m_colorRBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_colorRBO);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, colorFormat, width, height);
+
+    glGenFramebuffers(1, &m_FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorRBO);
+
+    if (depthFormat != GL_NONE) {
+        const bool packed = depthFormat == GL_DEPTH24_STENCIL8 || depthFormat == GL_DEPTH32F_STENCIL8;
+        glGenRenderbuffers(1, &m_depthRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_depthRBO);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, depthFormat, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, packed ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT,
+                                  GL_RENDERBUFFER, m_depthRBO);
+    }
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Frame cache framebuffer incomplete" << std::endl;
+        cleanup();
+        return false;
+    }
+    return true;
+}
+
+} // namespace DTIFiberLib
@@ -0,0 +1,182 @@
+#include "../header/GLFrameProfiler.h"
+
+namespace DTIFiberLib {
+
+GLFrameProfiler::GLFrameProfiler()
+    : m_enabled(false)
+    , m_inFrame(false)
+    , m_queryBuffer(0)
+    , m_openSection(-1)
+    , m_openSectionTimed(false)
+{
+    for (int buffer = 0; buffer < 2; ++buffer) {
+        for (int section = 0; section < kSectionCount; ++section) {
+            m_queries[buffer][section] = 0;
+            m_queryIssued[buffer][section] = false;
+        }
+    }
+    resetCurrent();
+    m_current.frameIndex = 0;
+    m_lastFrame = m_current;
+}
+
+GLFrameProfiler::~GLFrameProfiler()
+{
+}
+
+void GLFrameProfiler::initialize()
+{
+    if (m_queries[0][0] == 0) {
+        glGenQueries(2 * kSectionCount, &m_queries[0][0]);
+    }
+}
+
+void GLFrameProfiler::cleanup()
+{
+    if (m_queries[0][0] != 0) {
+        glDeleteQueries(2 * kSectionCount, &m_queries[0][0]);
+    }
+    for (int buffer = 0; buffer < 2; ++buffer) {
+        for (int section = 0; section < kSectionCount; ++section) {
+            m_queries[buffer][section] = 0;
+            m_queryIssued[buffer][section] = false;
+        }
+    }
+    m_inFrame = false;
+    m_openSection = -1;
+    m_openSectionTimed = false;
+}
+
+void GLFrameProfiler::setEnabled(bool enable)
+{
+    if (!enable && m_inFrame) {
+        endFrame();
+    }
+    m_enabled = enable;
+}
+
+void GLFrameProfiler::resetCurrent()
+{
+    for (int section = 0; section < kSectionCount; ++section) {
+        m_current.cpuMs[section] = 0.0;
+        m_current.gpuMs[section] = -1.0;
+    }
+    m_current.frameCpuMs = 0.0;
+    m_current.frameGpuMs = 0.0;
+    m_current.submittedTracks = 0;
+    m_current.submittedVertices = 0;
+    m_current.drawCalls = 0;
+    m_current.uploadedBytes = 0;
+}
+
+void GLFrameProfiler::beginFrame()
+{
+    if (!m_enabled || m_inFrame) {
+        return;
+    }
+    m_inFrame = true;
+    m_frameStart = Clock::now();
+}
+
+void GLFrameProfiler::endFrame()
+{
+    if (!m_inFrame) {
+        return;
+    }
+    endSection();
+    m_inFrame = false;
+    m_current.frameCpuMs = std::chrono::duration<double, std::milli>(Clock::now() - m_frameStart).count();
+
+    // The other query set was written last frame and is usually complete by now
+    const int previousBuffer = 1 - m_queryBuffer;
+    collectGPUResults(previousBuffer);
+
+    m_current.frameIndex = m_lastFrame.frameIndex + 1;
+    m_lastFrame = m_current;
+    resetCurrent();
+    m_queryBuffer = previousBuffer;
+}
+
+void GLFrameProfiler::collectGPUResults(int queryBuffer)
+{
+    for (int section = 0; section < kSectionCount; ++section) {
+        if (!m_queryIssued[queryBuffer][section]) {
+            continue;
+        }
+        m_queryIssued[queryBuffer][section] = false;
+
+        // Never stall the pipeline: a result that is not ready is dropped
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(m_queries[queryBuffer][section], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+        GLuint64 elapsedNs = 0;
+        glGetQueryObjectui64v(m_queries[queryBuffer][section], GL_QUERY_RESULT, &elapsedNs);
+        m_current.gpuMs[section] = static_cast<double>(elapsedNs) / 1.0e6;
+        m_current.frameGpuMs += m_current.gpuMs[section];
+    }
+}
+
+void GLFrameProfiler::beginSection(ProfilerSection section)
+{
+    if (!m_enabled) {
+        return;
+    }
+    endSection();
+
+    const int index = static_cast<int>(section);
+    m_openSection = index;
+    m_sectionStart = Clock::now();
+
+    // A query can be begun once per frame; repeated sections only add CPU time
+    m_openSectionTimed = m_inFrame && section != ProfilerSection::BUILD &&
+                         m_queries[0][0] != 0 && !m_queryIssued[m_queryBuffer][index];
+    if (m_openSectionTimed) {
+        glBeginQuery(GL_TIME_ELAPSED, m_queries[m_queryBuffer][index]);
+        m_queryIssued[m_queryBuffer][index] = true;
+    }
+}
+
+void GLFrameProfiler::endSection()
+{
+    if (m_openSection < 0) {
+        return;
+    }
+    if (m_openSectionTimed) {
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+    m_current.cpuMs[m_openSection] += std::chrono::duration<double, std::milli>(Clock::now() - m_sectionStart).count();
+    m_openSection = -1;
+    m_openSectionTimed = false;
+}
+
+void GLFrameProfiler::addUploadedBytes(size_t bytes)
+{
+    if (m_enabled) {
+        m_current.uploadedBytes += bytes;
+    }
+}
+
+void GLFrameProfiler::addDraw(size_t tracks, size_t vertices, size_t drawCalls)
+{
+    if (m_enabled) {
+        m_current.submittedTracks += tracks;
+        m_current.submittedVertices += vertices;
+        m_current.drawCalls += drawCalls;
+    }
+}
+
+const char* GLFrameProfiler::sectionName(ProfilerSection section)
+{
+    switch (section) {
+    case ProfilerSection::BUILD:     return "build";
+    case ProfilerSection::UPLOAD:    return "upload";
+    case ProfilerSection::CULL:      return "cull";
+    case ProfilerSection::DRAW:      return "draw";
+    case ProfilerSection::COMPOSITE: return "composite";
+    default:                         return "";
+    }
+}
+
+} // namespace DTIFiberLib
@@ -0,0 +1,161 @@
+#include "../header/GLHeadlessContext.h"
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstring>
+#include <iostream>
+
+namespace DTIFiberLib {
+
+namespace {
+
+bool hasExtension(const char* extensions, const char* name)
+{
+    if (!extensions) {
+        return false;
+    }
+    const size_t length = std::strlen(name);
+    for (const char* pos = std::strstr(extensions, name); pos; pos = std::strstr(pos + length, name)) {
+        const bool startOk = pos == extensions || pos[-1] == ' ';
+        const bool endOk = pos[length] == ' ' || pos[length] == '\0';
+        if (startOk && endOk) {
+            return true;
+        }
+    }
+    return false;
+}
+
+EGLDisplay openDisplay()
+{
+    // Surfaceless platform: no X11/Wayland connection, works on display-less servers
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+            eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (getPlatformDisplay) {
+            EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if (display != EGL_NO_DISPLAY) {
+                return display;
+            }
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+} // namespace
+
+GLHeadlessContext::GLHeadlessContext()
+    : m_display(nullptr)
+    , m_context(nullptr)
+{
+}
+
+GLHeadlessContext::~GLHeadlessContext()
+{
+    destroy();
+}
+
+bool GLHeadlessContext::create()
+{
+    destroy();
+
+    EGLDisplay display = openDisplay();
+    EGLint major = 0, minor = 0;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        std::cerr << "Failed to initialize EGL display" << std::endl;
+        return false;
+    }
+    m_display = display;
+
+    if (!hasExtension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context")) {
+        std::cerr << "EGL_KHR_surfaceless_context not supported" << std::endl;
+        destroy();
+        return false;
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cerr << "EGL has no desktop OpenGL support" << std::endl;
+        destroy();
+        return false;
+    }
+
+    const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config = nullptr;
+    EGLint configCount = 0;
+    eglChooseConfig(display, configAttributes, &config, 1, &configCount);
+
+    // 4.6 first; llvmpipe and older drivers stop at 4.5
+    const EGLint versions[][2] = { { 4, 6 }, { 4, 5 } };
+    EGLContext context = EGL_NO_CONTEXT;
+    for (const auto& version : versions) {
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, version[0],
+            EGL_CONTEXT_MINOR_VERSION, version[1],
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, configCount > 0 ? config : nullptr, EGL_NO_CONTEXT, contextAttributes);
+        if (context != EGL_NO_CONTEXT) {
+            break;
+        }
+    }
+    if (context == EGL_NO_CONTEXT) {
+        std::cerr << "Failed to create an OpenGL 4.5 core context (EGL error 0x"
+                  << std::hex << eglGetError() << std::dec << ")" << std::endl;
+        destroy();
+        return false;
+    }
+    m_context = context;
+
+    if (!makeCurrent()) {
+        destroy();
+        return false;
+    }
+
+    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress))) {
+        std::cerr << "Failed to initialize GLAD" << std::endl;
+        destroy();
+        return false;
+    }
+
+    // GL_ARB_indirect_parameters provides the indirect-count draw on 4.5 contexts
+    if (!glad_glMultiDrawArraysIndirectCount) {
+        glad_glMultiDrawArraysIndirectCount = reinterpret_cast<PFNGLMULTIDRAWARRAYSINDIRECTCOUNTPROC>(
+            eglGetProcAddress("glMultiDrawArraysIndirectCountARB"));
+    }
+
+    std::cout << "Headless OpenGL: " << glGetString(GL_VERSION) << " (" << glGetString(GL_RENDERER) << ")" << std::endl;
+    return true;
+}
+
+void GLHeadlessContext::destroy()
+{
+    EGLDisplay display = static_cast<EGLDisplay>(m_display);
+    if (m_context) {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display, static_cast<EGLContext>(m_context));
+        m_context = nullptr;
+    }
+    if (m_display) {
+        eglTerminate(display);
+        m_display = nullptr;
+    }
+}
+
+bool GLHeadlessContext::makeCurrent()
+{
+    if (!m_context) {
+        return false;
+    }
+    if (!eglMakeCurrent(static_cast<EGLDisplay>(m_display), EGL_NO_SURFACE, EGL_NO_SURFACE,
+                        static_cast<EGLContext>(m_context))) {
+        std::cerr << "eglMakeCurrent failed (EGL error 0x" << std::hex << eglGetError() << std::dec << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace DTIFiberLib
@@ -0,0 +1,168 @@
+#include "../header/GLMemoryBudget.h"
+#include "../header/GLFiberRenderer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifndef GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX
+#define GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX 0x9049
+#endif
+#ifndef GL_VBO_FREE_MEMORY_ATI
+#define GL_VBO_FREE_MEMORY_ATI 0x87FB
+#endif
+
+namespace DTIFiberLib {
+
+namespace {
+
+const size_t kMinimumBudgetBytes = 64u << 20;
+const size_t kSpacingSampleTracks = 10000;
+
+bool hasExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i) {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+        if (extension && std::strcmp(extension, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t decimatedPointCount(size_t points, int stride)
+{
+    return points < 2 ? points : (points - 2) / static_cast<size_t>(stride) + 2;
+}
+
+} // namespace
+
+GLMemoryBudget::GLMemoryBudget()
+    : m_fallbackBytes(1024u << 20)
+    , m_usableFraction(0.75f)
+    , m_reserveBytes(256u << 20)
+    , m_maxPointStride(4)
+    , m_maxPointSpacing(2.0f)
+    , m_availableBytes(0)
+    , m_source(MemoryInfoSource::FALLBACK)
+{
+}
+
+void GLMemoryBudget::setUsableFraction(float fraction)
+{
+    m_usableFraction = std::min(std::max(fraction, 0.05f), 1.0f);
+}
+
+void GLMemoryBudget::setMaxPointStride(int stride)
+{
+    m_maxPointStride = std::max(stride, 1);
+}
+
+void GLMemoryBudget::setMaxPointSpacing(float spacing)
+{
+    m_maxPointSpacing = std::max(spacing, 0.0f);
+}
+
+size_t GLMemoryBudget::queryAvailableBytes()
+{
+    m_source = MemoryInfoSource::FALLBACK;
+    m_availableBytes = m_fallbackBytes;
+    if (!glGetStringi) {
+        return m_availableBytes;    // No loaded context
+    }
+
+    // Both report kilobytes
+    GLint values[4] = { 0, 0, 0, 0 };
+    if (hasExtension("GL_NVX_gpu_memory_info")) {
+        glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, values);
+        m_source = MemoryInfoSource::NVX_GPU_MEMORY_INFO;
+    } else if (hasExtension("GL_ATI_meminfo")) {
+        glGetIntegerv(GL_VBO_FREE_MEMORY_ATI, values);     // Total free, largest block, ...
+        m_source = MemoryInfoSource::ATI_MEMINFO;
+    }
+    if (m_source != MemoryInfoSource::FALLBACK && values[0] > 0) {
+        m_availableBytes = static_cast<size_t>(values[0]) * 1024;
+    } else {
+        m_source = MemoryInfoSource::FALLBACK;
+    }
+    return m_availableBytes;
+}
+
+MemoryBudgetPlan GLMemoryBudget::plan(const std::vector<FiberTrack>& tracks, const GLFiberRenderer& renderer) const
+{
+    MemoryBudgetPlan result;
+    std::memset(&result, 0, sizeof(result));
+    result.source = m_source;
+    result.totalTrackCount = tracks.size();
+
+    // Buffers of the current scene are released when the new one replaces it
+    result.availableBytes = (m_availableBytes > 0 ? m_availableBytes : m_fallbackBytes) + renderer.getGPUBufferBytes();
+    const double usable = static_cast<double>(result.availableBytes) * m_usableFraction - static_cast<double>(m_reserveBytes);
+    result.budgetBytes = std::max(kMinimumBudgetBytes, static_cast<size_t>(std::max(usable, 0.0)));
+
+    // Point spacing from an evenly spread sample of the tracks
+    const size_t sampleStep = std::max<size_t>(tracks.size() / kSpacingSampleTracks, 1);
+    double sampledLength = 0.0;
+    size_t sampledSegments = 0;
+    for (size_t t = 0; t < tracks.size(); t += sampleStep) {
+        const FiberTrack& track = tracks[t];
+        for (size_t i = 1; i < track.size(); ++i) {
+            const float dx = track[i].x - track[i - 1].x;
+            const float dy = track[i].y - track[i - 1].y;
+            const float dz = track[i].z - track[i - 1].z;
+            sampledLength += std::sqrt(dx * dx + dy * dy + dz * dz);
+        }
+        sampledSegments += track.empty() ? 0 : track.size() - 1;
+    }
+    result.meanPointSpacing = sampledSegments > 0 ? static_cast<float>(sampledLength / sampledSegments) : 0.0f;
+
+    // Points at each power-of-two stride the spacing limit allows
+    std::vector<int> strides(1, 1);
+    while (strides.back() * 2 <= m_maxPointStride && result.meanPointSpacing * strides.back() * 2 <= m_maxPointSpacing) {
+        strides.push_back(strides.back() * 2);
+    }
+    std::vector<size_t> points(strides.size(), 0);
+    for (const FiberTrack& track : tracks) {
+        for (size_t s = 0; s < strides.size(); ++s) {
+            points[s] += decimatedPointCount(track.size(), strides[s]);
+        }
+    }
+    result.requiredBytes = renderer.estimateGPUBytes(tracks.size(), points[0]);
+
+    // Full tracks at the finest stride that fits, else subsample at the coarsest
+    result.trackCount = tracks.size();
+    result.pointStride = strides.back();
+    result.plannedBytes = renderer.estimateGPUBytes(tracks.size(), points.back());
+    for (size_t s = 0; s < strides.size(); ++s) {
+        const size_t bytes = renderer.estimateGPUBytes(tracks.size(), points[s]);
+        if (bytes <= result.budgetBytes) {
+            result.pointStride = strides[s];
+            result.plannedBytes = bytes;
+            break;
+        }
+    }
+    if (result.plannedBytes > result.budgetBytes) {
+        const double keep = static_cast<double>(result.budgetBytes) / static_cast<double>(result.plannedBytes);
+        result.trackCount = static_cast<size_t>(static_cast<double>(tracks.size()) * keep);
+        result.plannedBytes = static_cast<size_t>(static_cast<double>(result.plannedBytes) * keep);
+    }
+    result.fraction = tracks.empty() ? 1.0 : static_cast<double>(result.trackCount) / static_cast<double>(tracks.size());
+    return result;
+}
+
+FiberTrack GLMemoryBudget::decimate(const FiberTrack& track, int stride)
+{
+    if (stride <= 1 || track.size() <= 2) {
+        return track;
+    }
+    FiberTrack result;
+    result.reserve(decimatedPointCount(track.size(), stride));
+    for (size_t i = 0; i + 1 < track.size(); i += static_cast<size_t>(stride)) {
+        result.push_back(track[i]);
+    }
+    result.push_back(track.back());
+    return result;
+}
+
+} // namespace DTIFiberLib
@@ -1,9 +1,70 @@
 #include "../header/GLShaderProgram.h"
 #include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <iterator>
 #include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <cctype>
 
 namespace DTIFiberLib {
 
+std::string GLShaderProgram::s_binaryCacheDirectory;
+
+namespace {
+
+const uint32_t kBinaryCacheMagic = 0x50495444u;  // "DTIP"
+
+// 64-bit FNV-1a, continued across calls through hash
+void hashBytes(uint64_t& hash, const char* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 0x100000001B3ull;
+    }
+}
+
+// Replace whole-word occurrences of an identifier
+void replaceIdentifier(std::string& text, const std::string& from, const std::string& to)
+{
+    auto isIdentifierChar = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+    for (size_t pos = text.find(from); pos != std::string::npos; pos = text.find(from, pos)) {
+        size_t end = pos + from.size();
+        if ((pos > 0 && isIdentifierChar(text[pos - 1])) || (end < text.size() && isIdentifierChar(text[end]))) {
+            pos = end;
+            continue;
+        }
+        text.replace(pos, from.size(), to);
+        pos += to.size();
+    }
+}
+
+// GLSL 4.60 sources on a 4.5 context (e.g. Mesa llvmpipe): the draw parameters come from
+// GL_ARB_shader_draw_parameters instead. Variants that need them fail to compile without it.
+std::string adaptToContextVersion(const char* source)
+{
+    std::string text(source);
+    const std::string version = "#version 460 core";
+    size_t pos = text.find(version);
+    if (GLAD_GL_VERSION_4_6 || pos == std::string::npos) {
+        return text;
+    }
+    text.replace(pos, version.size(), "#version 450 core\n#extension GL_ARB_shader_draw_parameters : enable");
+    replaceIdentifier(text, "gl_DrawID", "gl_DrawIDARB");
+    replaceIdentifier(text, "gl_BaseInstance", "gl_BaseInstanceARB");
+    return text;
+}
+
+void hashString(uint64_t& hash, const char* text)
+{
+    // The terminator is hashed too so that ("ab", "c") and ("a", "bc") differ
+    hashBytes(hash, text ? text : "", text ? std::strlen(text) + 1 : 1);
+}
+
+} // namespace
+
 GLShaderProgram::GLShaderProgram()
     : m_programID(0)
 {
@@ -19,6 +80,11 @@ GLShaderProgram::~GLShaderProgram()
 
 bool GLShaderProgram::loadFromString(const char* vertexSource, const char* fragmentSource)
 {
+    const std::string cacheKey = binaryCacheKey("VF", vertexSource, fragmentSource);
+    if (loadCachedBinary(cacheKey)) {
+        return true;
+    }
+
     // Compile vertex shader
     GLuint vertexShader = compileShader(vertexSource, GL_VERTEX_SHADER);
     if (vertexShader == 0) {
@@ -45,6 +111,57 @@ bool GLShaderProgram::loadFromString(const char* vertexSource, const char* fragm
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
 
+    saveCachedBinary(cacheKey);
+    return true;
+}
+
+bool GLShaderProgram::loadFromString(const char* vertexSource, const char* fragmentSource,
+                                     const std::vector<std::string>& defines)
+{
+    std::string preamble;
+    for (const auto& define : defines) {
+        preamble += "#define " + define + "\n";
+    }
+    return loadFromString(insertPreamble(vertexSource, preamble).c_str(),
+                          insertPreamble(fragmentSource, preamble).c_str());
+}
+
+std::string GLShaderProgram::insertPreamble(const char* source, const std::string& preamble)
+{
+    std::string text(source);
+    size_t insertAt = 0;
+    while (insertAt < text.size()) {
+        size_t lineEnd = text.find('\n', insertAt);
+        if (lineEnd == std::string::npos) break;
+        size_t first = text.find_first_not_of(" \t", insertAt);
+        if (first < lineEnd && text.compare(first, 8, "#version") != 0 && text.compare(first, 10, "#extension") != 0) break;
+        insertAt = lineEnd + 1;
+    }
+    text.insert(insertAt, preamble);
+    return text;
+}
+
+bool GLShaderProgram::loadComputeFromString(const char* computeSource)
+{
+    const std::string cacheKey = binaryCacheKey("C", computeSource, nullptr);
+    if (loadCachedBinary(cacheKey)) {
+        return true;
+    }
+
+    GLuint computeShader = compileShader(computeSource, GL_COMPUTE_SHADER);
+    if (computeShader == 0) {
+        std::cerr << "Failed to compile compute shader" << std::endl;
+        return false;
+    }
+
+    if (!linkProgram(computeShader)) {
+        glDeleteShader(computeShader);
+        return false;
+    }
+
+    glDeleteShader(computeShader);
+
+    saveCachedBinary(cacheKey);
     return true;
 }
 
@@ -57,7 +174,7 @@ void GLShaderProgram::use()
 
 void GLShaderProgram::setUniformMatrix4fv(const char* name, const float* value)
 {
-    GLint location = glGetUniformLocation(m_programID, name);
+    GLint location = getUniformLocation(name);
     if (location != -1) {
         glUniformMatrix4fv(location, 1, GL_FALSE, value);
     }
@@ -65,7 +182,7 @@ void GLShaderProgram::setUniformMatrix4fv(const char* name, const float* value)
 
 void GLShaderProgram::setUniform1i(const char* name, int value)
 {
-    GLint location = glGetUniformLocation(m_programID, name);
+    GLint location = getUniformLocation(name);
     if (location != -1) {
         glUniform1i(location, value);
     }
@@ -73,28 +190,197 @@ void GLShaderProgram::setUniform1i(const char* name, int value)
 
 void GLShaderProgram::setUniform1f(const char* name, float value)
 {
-    GLint location = glGetUniformLocation(m_programID, name);
+    GLint location = getUniformLocation(name);
     if (location != -1) {
         glUniform1f(location, value);
     }
 }
 
+void GLShaderProgram::setUniform2f(const char* name, float v0, float v1)
+{
+    GLint location = getUniformLocation(name);
+    if (location != -1) {
+        glUniform2f(location, v0, v1);
+    }
+}
+
 void GLShaderProgram::setUniform3f(const char* name, float v0, float v1, float v2)
 {
-    GLint location = glGetUniformLocation(m_programID, name);
+    GLint location = getUniformLocation(name);
     if (location != -1) {
         glUniform3f(location, v0, v1, v2);
     }
 }
 
+void GLShaderProgram::setUniform4fv(const char* name, int count, const float* value)
+{
+    GLint location = getUniformLocation(name);
+    if (location != -1) {
+        glUniform4fv(location, count, value);
+    }
+}
+
+GLint GLShaderProgram::getUniformLocation(const char* name) const
+{
+    auto it = m_uniformLocations.find(name);
+    return it != m_uniformLocations.end() ? it->second : -1;
+}
+
+void GLShaderProgram::cacheUniformLocations()
+{
+    m_uniformLocations.clear();
+
+    GLint uniformCount = 0;
+    GLint maxNameLength = 0;
+    glGetProgramiv(m_programID, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(m_programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+    std::vector<GLchar> nameBuffer(static_cast<size_t>(maxNameLength) + 1);
+
+    for (GLint i = 0; i < uniformCount; ++i) {
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(m_programID, static_cast<GLuint>(i), static_cast<GLsizei>(nameBuffer.size()),
+                           nullptr, &size, &type, nameBuffer.data());
+
+        // Members of uniform blocks have no location
+        GLint location = glGetUniformLocation(m_programID, nameBuffer.data());
+        if (location == -1) continue;
+
+        // Arrays are reported as "name[0]"; register the plain name as well
+        std::string name(nameBuffer.data());
+        m_uniformLocations[name] = location;
+        size_t bracket = name.find('[');
+        if (bracket != std::string::npos) {
+            m_uniformLocations[name.substr(0, bracket)] = location;
+        }
+    }
+}
+
+void GLShaderProgram::setBinaryCacheDirectory(const std::string& directory)
+{
+    s_binaryCacheDirectory = directory;
+}
+
+std::string GLShaderProgram::binaryCacheKey(const char* stageTag, const char* firstSource, const char* secondSource)
+{
+    if (s_binaryCacheDirectory.empty()) {
+        return std::string();
+    }
+
+    // Drivers only accept binaries they produced, so the driver identity is part of the key
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    if (formatCount <= 0) {
+        return std::string();
+    }
+
+    uint64_t hash = 0xCBF29CE484222325ull;
+    hashString(hash, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+    hashString(hash, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+    hashString(hash, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+    hashString(hash, stageTag);
+    hashString(hash, firstSource);
+    hashString(hash, secondSource);
+
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+    return name;
+}
+
+bool GLShaderProgram::loadCachedBinary(const std::string& key)
+{
+    if (key.empty()) {
+        return false;
+    }
+
+    std::ifstream file(s_binaryCacheDirectory + "/" + key + ".bin", std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    uint32_t header[2] = { 0, 0 };  // Magic, binary format
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != kBinaryCacheMagic) {
+        return false;
+    }
+    std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (binary.empty()) {
+        return false;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, static_cast<GLenum>(header[1]), binary.data(), static_cast<GLsizei>(binary.size()));
+
+    // A driver update invalidates stored binaries; the caller then compiles from source
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(program);
+        return false;
+    }
+
+    m_programID = program;
+    cacheUniformLocations();
+    return true;
+}
+
+void GLShaderProgram::saveCachedBinary(const std::string& key)
+{
+    if (key.empty() || m_programID == 0) {
+        return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(m_programID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    std::vector<char> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    glGetProgramBinary(m_programID, length, &length, &format, binary.data());
+
+    std::error_code error;
+    std::filesystem::create_directories(s_binaryCacheDirectory, error);
+
+    // Write under a temporary name so concurrent processes never read a partial file
+    const std::string path = s_binaryCacheDirectory + "/" + key + ".bin";
+    const std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return;
+        }
+        const uint32_t header[2] = { kBinaryCacheMagic, static_cast<uint32_t>(format) };
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(binary.data(), length);
+        if (!file) {
+            file.close();
+            std::filesystem::remove(tempPath, error);
+            return;
+        }
+    }
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        std::filesystem::remove(tempPath, error);
+    }
+}
+
 GLuint GLShaderProgram::compileShader(const char* source, GLenum shaderType)
 {
+    const std::string adaptedSource = adaptToContextVersion(source);
+    const char* sourceText = adaptedSource.c_str();
     GLuint shader = glCreateShader(shaderType);
-    glShaderSource(shader, 1, &source, nullptr);
+    glShaderSource(shader, 1, &sourceText, nullptr);
     glCompileShader(shader);
 
     // Check compilation errors
-    checkCompileErrors(shader, shaderType == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT");
+    const char* typeName = "FRAGMENT";
+    if (shaderType == GL_VERTEX_SHADER) {
+        typeName = "VERTEX";
+    } else if (shaderType == GL_COMPUTE_SHADER) {
+        typeName = "COMPUTE";
+    }
+    checkCompileErrors(shader, typeName);
 
     GLint success;
     glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
@@ -111,6 +397,33 @@ bool GLShaderProgram::linkProgram(GLuint vertexShader, GLuint fragmentShader)
     m_programID = glCreateProgram();
     glAttachShader(m_programID, vertexShader);
     glAttachShader(m_programID, fragmentShader);
+    if (!s_binaryCacheDirectory.empty()) {
+        glProgramParameteri(m_programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(m_programID);
+
+    // Check linking errors
+    checkCompileErrors(m_programID, "PROGRAM");
+
+    GLint success;
+    glGetProgramiv(m_programID, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(m_programID);
+        m_programID = 0;
+        return false;
+    }
+
+    cacheUniformLocations();
+    return true;
+}
+
+bool GLShaderProgram::linkProgram(GLuint computeShader)
+{
+    m_programID = glCreateProgram();
+    glAttachShader(m_programID, computeShader);
+    if (!s_binaryCacheDirectory.empty()) {
+        glProgramParameteri(m_programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(m_programID);
 
     // Check linking errors
@@ -124,6 +437,7 @@ bool GLShaderProgram::linkProgram(GLuint vertexShader, GLuint fragmentShader)
         return false;
     }
 
+    cacheUniformLocations();
     return true;
 }
 
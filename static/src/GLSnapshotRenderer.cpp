@@ -0,0 +1,279 @@
+#include "../header/GLSnapshotRenderer.h"
+#include "../header/PngWriter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace DTIFiberLib {
+
+namespace {
+
+struct PresetInfo {
+    const char* name;
+    float direction[3];     // From the box center towards the eye
+    float up[3];
+};
+
+const PresetInfo kPresets[] = {
+    { "left",      { -1.0f,  0.0f,  0.0f }, { 0.0f, 0.0f, 1.0f } },
+    { "right",     {  1.0f,  0.0f,  0.0f }, { 0.0f, 0.0f, 1.0f } },
+    { "anterior",  {  0.0f,  1.0f,  0.0f }, { 0.0f, 0.0f, 1.0f } },
+    { "posterior", {  0.0f, -1.0f,  0.0f }, { 0.0f, 0.0f, 1.0f } },
+    { "superior",  {  0.0f,  0.0f,  1.0f }, { 0.0f, 1.0f, 0.0f } },
+    { "inferior",  {  0.0f,  0.0f, -1.0f }, { 0.0f, 1.0f, 0.0f } },
+    { "oblique",   { -0.57735f, 0.57735f, 0.57735f }, { 0.0f, 0.0f, 1.0f } },
+};
+
+void normalize(float* v)
+{
+    float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0.0f) {
+        v[0] /= length; v[1] /= length; v[2] /= length;
+    }
+}
+
+void cross(const float* a, const float* b, float* out)
+{
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+} // namespace
+
+GLSnapshotRenderer::GLSnapshotRenderer()
+    : m_renderFBO(0)
+    , m_colorRBO(0)
+    , m_depthRBO(0)
+    , m_resolveFBO(0)
+    , m_resolveRBO(0)
+    , m_width(0)
+    , m_height(0)
+    , m_samples(0)
+    , m_fieldOfView(30.0f)
+{
+    m_background[0] = 0.0f;
+    m_background[1] = 0.0f;
+    m_background[2] = 0.0f;
+}
+
+GLSnapshotRenderer::~GLSnapshotRenderer()
+{
+    cleanup();
+}
+
+bool GLSnapshotRenderer::initialize(int width, int height, int samples)
+{
+    cleanup();
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+
+    GLint maxSamples = 0;
+    glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+    m_samples = std::min(std::max(samples, 0), static_cast<int>(maxSamples));
+    if (m_samples == 1) {
+        m_samples = 0;
+    }
+    m_width = width;
+    m_height = height;
+
+    GLint previousFBO = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFBO);
+
+    glGenRenderbuffers(1, &m_colorRBO);
+    glGenRenderbuffers(1, &m_depthRBO);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_colorRBO);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, m_samples, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depthRBO);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, m_samples, GL_DEPTH_COMPONENT24, width, height);
+
+    glGenFramebuffers(1, &m_renderFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_renderFBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorRBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthRBO);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+    if (complete && m_samples > 0) {
+        glGenRenderbuffers(1, &m_resolveRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_resolveRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenFramebuffers(1, &m_resolveFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_resolveFBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_resolveRBO);
+        complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(previousFBO));
+
+    if (!complete) {
+        std::cerr << "Snapshot framebuffer incomplete" << std::endl;
+        cleanup();
+    }
+    return complete;
+}
+
+void GLSnapshotRenderer::cleanup()
+{
+    GLuint framebuffers[] = { m_renderFBO, m_resolveFBO };
+    GLuint renderbuffers[] = { m_colorRBO, m_depthRBO, m_resolveRBO };
+    if (m_renderFBO != 0 || m_resolveFBO != 0) {
+        glDeleteFramebuffers(2, framebuffers);
+    }
+    if (m_colorRBO != 0 || m_depthRBO != 0 || m_resolveRBO != 0) {
+        glDeleteRenderbuffers(3, renderbuffers);
+    }
+    m_renderFBO = m_resolveFBO = 0;
+    m_colorRBO = m_depthRBO = m_resolveRBO = 0;
+    m_width = m_height = 0;
+}
+
+void GLSnapshotRenderer::setBackgroundColor(float r, float g, float b)
+{
+    m_background[0] = r;
+    m_background[1] = g;
+    m_background[2] = b;
+}
+
+void GLSnapshotRenderer::setFieldOfView(float degrees)
+{
+    m_fieldOfView = std::min(std::max(degrees, 5.0f), 120.0f);
+}
+
+void GLSnapshotRenderer::computeCameraMatrix(CameraPreset preset, const float* bounds, float* mvpMatrix) const
+{
+    const PresetInfo& info = kPresets[static_cast<int>(preset)];
+    const float center[3] = {
+        (bounds[0] + bounds[1]) * 0.5f, (bounds[2] + bounds[3]) * 0.5f, (bounds[4] + bounds[5]) * 0.5f
+    };
+    const float dx = bounds[1] - bounds[0], dy = bounds[3] - bounds[2], dz = bounds[5] - bounds[4];
+    const float radius = std::max(0.5f * std::sqrt(dx * dx + dy * dy + dz * dz), 1e-3f);
+
+    // Distance at which the bounding sphere fits the narrower field of view
+    const float aspect = m_height > 0 ? static_cast<float>(m_width) / static_cast<float>(m_height) : 1.0f;
+    const float halfFovY = m_fieldOfView * 0.5f * 3.14159265f / 180.0f;
+    const float halfFovX = std::atan(std::tan(halfFovY) * aspect);
+    const float distance = radius / std::sin(std::min(halfFovY, halfFovX)) * 1.05f;
+    const float nearPlane = std::max(distance - radius * 1.1f, distance * 0.01f);
+    const float farPlane = distance + radius * 1.1f;
+
+    float eye[3];
+    for (int i = 0; i < 3; ++i) {
+        eye[i] = center[i] + info.direction[i] * distance;
+    }
+
+    // View matrix (look at the center)
+    float forward[3] = { center[0] - eye[0], center[1] - eye[1], center[2] - eye[2] };
+    normalize(forward);
+    float side[3];
+    cross(forward, info.up, side);
+    normalize(side);
+    float up[3];
+    cross(side, forward, up);
+
+    float view[16] = {};
+    view[0] = side[0];     view[4] = side[1];     view[8] = side[2];
+    view[1] = up[0];       view[5] = up[1];       view[9] = up[2];
+    view[2] = -forward[0]; view[6] = -forward[1]; view[10] = -forward[2];
+    view[12] = -(side[0] * eye[0] + side[1] * eye[1] + side[2] * eye[2]);
+    view[13] = -(up[0] * eye[0] + up[1] * eye[1] + up[2] * eye[2]);
+    view[14] = forward[0] * eye[0] + forward[1] * eye[1] + forward[2] * eye[2];
+    view[15] = 1.0f;
+
+    // Perspective projection
+    const float f = 1.0f / std::tan(halfFovY);
+    float projection[16] = {};
+    projection[0] = f / aspect;
+    projection[5] = f;
+    projection[10] = (farPlane + nearPlane) / (nearPlane - farPlane);
+    projection[11] = -1.0f;
+    projection[14] = 2.0f * farPlane * nearPlane / (nearPlane - farPlane);
+
+    for (int column = 0; column < 4; ++column) {
+        for (int row = 0; row < 4; ++row) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; ++k) {
+                sum += projection[k * 4 + row] * view[column * 4 + k];
+            }
+            mvpMatrix[column * 4 + row] = sum;
+        }
+    }
+}
+
+bool GLSnapshotRenderer::renderSnapshot(GLFiberRenderer& renderer, CameraPreset preset, std::vector<unsigned char>& rgba)
+{
+    if (m_renderFBO == 0 || !renderer.isInitialized()) {
+        return false;
+    }
+
+    float bounds[6];
+    renderer.getBoundingBox(bounds[0], bounds[1], bounds[2], bounds[3], bounds[4], bounds[5]);
+    float mvpMatrix[16];
+    computeCameraMatrix(preset, bounds, mvpMatrix);
+
+    GLint previousFBO = 0;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFBO);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_renderFBO);
+    glViewport(0, 0, m_width, m_height);
+    glClearColor(m_background[0], m_background[1], m_background[2], 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glEnable(GL_DEPTH_TEST);
+
+    renderer.render(mvpMatrix);
+
+    GLuint readFBO = m_renderFBO;
+    if (m_resolveFBO != 0) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_renderFBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_resolveFBO);
+        glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        readFBO = m_resolveFBO;
+    }
+
+    // GL rows start at the bottom; images start at the top
+    const size_t rowBytes = static_cast<size_t>(m_width) * 4;
+    std::vector<unsigned char> pixels(rowBytes * m_height);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFBO);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    rgba.resize(pixels.size());
+    for (int y = 0; y < m_height; ++y) {
+        std::memcpy(rgba.data() + rowBytes * y, pixels.data() + rowBytes * (m_height - 1 - y), rowBytes);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(previousFBO));
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    return true;
+}
+
+bool GLSnapshotRenderer::writeSnapshot(GLFiberRenderer& renderer, CameraPreset preset, const std::string& path)
+{
+    std::vector<unsigned char> rgba;
+    if (!renderSnapshot(renderer, preset, rgba)) {
+        return false;
+    }
+    return PngWriter::write(path, m_width, m_height, rgba.data());
+}
+
+const char* GLSnapshotRenderer::presetName(CameraPreset preset)
+{
+    const int index = static_cast<int>(preset);
+    return index >= 0 && index < static_cast<int>(CameraPreset::COUNT) ? kPresets[index].name : "";
+}
+
+bool GLSnapshotRenderer::presetFromName(const std::string& name, CameraPreset& preset)
+{
+    for (int i = 0; i < static_cast<int>(CameraPreset::COUNT); ++i) {
+        if (name == kPresets[i].name) {
+            preset = static_cast<CameraPreset>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace DTIFiberLib
@@ -0,0 +1,315 @@
+#include "../header/GLTrackPicker.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace DTIFiberLib {
+
+static const char* pickVertexShaderSource = R"(
+#version 460 core
+layout(location = 0) in vec3 aPosition;
+layout(std430, binding = 8) readonly buffer PickDrawBuffer { uvec2 pickDraws[]; };   // (track, first vertex)
+uniform mat4 uPickMatrix;
+uniform vec4 uClipPlanes[6];
+uniform int uClipPlaneCount;
+
+flat out uint vTrack;
+out float vPoint;
+out vec3 vPosition;
+out float gl_ClipDistance[6];
+
+void main() {
+    uvec2 draw = pickDraws[gl_DrawID];
+    vTrack = draw.x;
+    vPoint = float(uint(gl_VertexID) - draw.y);
+    vPosition = aPosition;
+    for (int i = 0; i < 6; ++i) {
+        gl_ClipDistance[i] = i < uClipPlaneCount ? dot(uClipPlanes[i], vec4(aPosition, 1.0)) : 1.0;
+    }
+    gl_Position = uPickMatrix * vec4(aPosition, 1.0);
+}
+)";
+
+static const char* pickFragmentShaderSource = R"(
+#version 460 core
+flat in uint vTrack;
+in float vPoint;
+in vec3 vPosition;
+
+layout(location = 0) out uvec2 PickId;
+layout(location = 1) out vec4 PickPosition;
+
+void main() {
+    PickId = uvec2(vTrack + 1u, uint(vPoint + 0.5));
+    PickPosition = vec4(vPosition, gl_FragCoord.z);
+}
+)";
+
+GLTrackPicker::GLTrackPicker()
+    : m_FBO(0)
+    , m_idTexture(0)
+    , m_positionTexture(0)
+    , m_depthBuffer(0)
+    , m_drawBuffer(0)
+    , m_PBO(0)
+    , m_fence(nullptr)
+    , m_radius(3)
+    , m_targetSize(0)
+    , m_size(0)
+    , m_previousFBO(0)
+    , m_previousDepthTest(GL_FALSE)
+    , m_previousBlend(GL_FALSE)
+    , m_previousLineWidth(1.0f)
+{
+    std::memset(m_previousViewport, 0, sizeof(m_previousViewport));
+}
+
+GLTrackPicker::~GLTrackPicker()
+{
+    cleanup();
+}
+
+bool GLTrackPicker::initialize()
+{
+    m_shader = std::make_unique<GLShaderProgram>();
+    if (!m_shader->loadFromString(pickVertexShaderSource, pickFragmentShaderSource)) {
+        std::cerr << "Track picking shader unavailable" << std::endl;
+        m_shader.reset();
+        return false;
+    }
+    glGenFramebuffers(1, &m_FBO);
+    glGenBuffers(1, &m_drawBuffer);
+    glGenBuffers(1, &m_PBO);
+    return true;
+}
+
+void GLTrackPicker::cleanup()
+{
+    if (m_fence) {
+        glDeleteSync(m_fence);
+        m_fence = nullptr;
+    }
+    if (m_FBO != 0) {
+        glDeleteFramebuffers(1, &m_FBO);
+        m_FBO = 0;
+    }
+    GLuint textures[] = { m_idTexture, m_positionTexture };
+    for (GLuint texture : textures) {
+        if (texture != 0) {
+            glDeleteTextures(1, &texture);
+        }
+    }
+    m_idTexture = m_positionTexture = 0;
+    if (m_depthBuffer != 0) {
+        glDeleteRenderbuffers(1, &m_depthBuffer);
+        m_depthBuffer = 0;
+    }
+    GLuint buffers[] = { m_drawBuffer, m_PBO };
+    for (GLuint buffer : buffers) {
+        if (buffer != 0) {
+            glDeleteBuffers(1, &buffer);
+        }
+    }
+    m_drawBuffer = m_PBO = 0;
+    m_targetSize = 0;
+    m_shader.reset();
+}
+
+void GLTrackPicker::setRadius(int pixels)
+{
+    m_radius = std::min(std::max(pixels, 0), 32);
+}
+
+bool GLTrackPicker::ensureTargets()
+{
+    const int size = 2 * m_radius + 1;
+    if (size == m_targetSize) {
+        return true;
+    }
+
+    if (m_idTexture == 0) {
+        glGenTextures(1, &m_idTexture);
+        glGenTextures(1, &m_positionTexture);
+        glGenRenderbuffers(1, &m_depthBuffer);
+    }
+    glBindTexture(GL_TEXTURE_2D, m_idTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, size, size, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, m_positionTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, size, size, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, size, size);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    GLint previousFBO = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_idTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, m_positionTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+    const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+    const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(previousFBO));
+    if (!complete) {
+        std::cerr << "Track picking framebuffer incomplete" << std::endl;
+        return false;
+    }
+
+    // Both targets are read into one buffer: ids, then positions
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_PBO);
+    glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(size) * size * (2 + 4) * 4, nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_targetSize = size;
+    return true;
+}
+
+bool GLTrackPicker::begin(const float* mvpMatrix, const GLint* viewport, int x, int y, float* pickMatrix, float lineWidth)
+{
+    if (!m_shader || viewport[2] <= 0 || viewport[3] <= 0 || !ensureTargets()) {
+        return false;
+    }
+    const int size = m_targetSize;
+
+    // Scale and shift clip space so the size x size pixels centered on (x, y) fill it (as gluPickMatrix)
+    const float sx = static_cast<float>(viewport[2]) / size;
+    const float sy = static_cast<float>(viewport[3]) / size;
+    const float tx = (viewport[2] - 2.0f * (x + 0.5f - viewport[0])) / size;
+    const float ty = (viewport[3] - 2.0f * (y + 0.5f - viewport[1])) / size;
+    for (int c = 0; c < 4; ++c) {
+        pickMatrix[c * 4 + 0] = sx * mvpMatrix[c * 4 + 0] + tx * mvpMatrix[c * 4 + 3];
+        pickMatrix[c * 4 + 1] = sy * mvpMatrix[c * 4 + 1] + ty * mvpMatrix[c * 4 + 3];
+        pickMatrix[c * 4 + 2] = mvpMatrix[c * 4 + 2];
+        pickMatrix[c * 4 + 3] = mvpMatrix[c * 4 + 3];
+    }
+
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_previousFBO);
+    glGetIntegerv(GL_VIEWPORT, m_previousViewport);
+    glGetFloatv(GL_LINE_WIDTH, &m_previousLineWidth);
+    m_previousDepthTest = glIsEnabled(GL_DEPTH_TEST);
+    m_previousBlend = glIsEnabled(GL_BLEND);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_FBO);
+    glViewport(0, 0, size, size);
+    const GLuint noTrack[4] = { 0, 0, 0, 0 };
+    const GLfloat noPosition[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    glClearBufferuiv(GL_COLOR, 0, noTrack);
+    glClearBufferfv(GL_COLOR, 1, noPosition);
+    const GLfloat farDepth = 1.0f;
+    glClearBufferfv(GL_DEPTH, 0, &farDepth);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glDisable(GL_BLEND);
+    glLineWidth(std::max(lineWidth, 1.0f));
+
+    m_shader->use();
+    m_shader->setUniformMatrix4fv("uPickMatrix", pickMatrix);
+    m_size = size;
+    return true;
+}
+
+void GLTrackPicker::setClipPlanes(const float* planes, int count)
+{
+    count = std::min(std::max(count, 0), 6);
+    if (count > 0) {
+        m_shader->setUniform4fv("uClipPlanes", count, planes);
+    }
+    m_shader->setUniform1i("uClipPlaneCount", count);
+}
+
+void GLTrackPicker::drawStrips(const GLint* firsts, const GLsizei* counts, const uint32_t* trackIds, GLsizei drawCount)
+{
+    if (drawCount <= 0) {
+        return;
+    }
+    m_drawData.resize(static_cast<size_t>(drawCount) * 2);
+    for (GLsizei i = 0; i < drawCount; ++i) {
+        m_drawData[i * 2] = trackIds[i];
+        m_drawData[i * 2 + 1] = static_cast<GLuint>(firsts[i]);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(m_drawData.size() * sizeof(GLuint)),
+                 m_drawData.data(), GL_STREAM_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, m_drawBuffer);
+    glMultiDrawArrays(GL_LINE_STRIP, firsts, counts, drawCount);
+}
+
+void GLTrackPicker::end()
+{
+    const GLsizei size = m_size;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_PBO);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_FBO);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, size, size, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glReadBuffer(GL_COLOR_ATTACHMENT1);
+    glReadPixels(0, 0, size, size, GL_RGBA, GL_FLOAT, reinterpret_cast<void*>(static_cast<size_t>(size) * size * 2 * 4));
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (m_fence) {
+        glDeleteSync(m_fence);
+    }
+    m_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(m_previousFBO));
+    glViewport(m_previousViewport[0], m_previousViewport[1], m_previousViewport[2], m_previousViewport[3]);
+    glLineWidth(m_previousLineWidth);
+    if (m_previousDepthTest) {
+        glEnable(GL_DEPTH_TEST);
+    } else {
+        glDisable(GL_DEPTH_TEST);
+    }
+    if (m_previousBlend) {
+        glEnable(GL_BLEND);
+    }
+}
+
+bool GLTrackPicker::poll(TrackPickResult& result, bool wait)
+{
+    if (!m_fence) {
+        return false;
+    }
+    const GLenum status = glClientWaitSync(m_fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                           wait ? GL_TIMEOUT_IGNORED : 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+        return false;
+    }
+    glDeleteSync(m_fence);
+    m_fence = nullptr;
+
+    const size_t pixels = static_cast<size_t>(m_size) * m_size;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_PBO);
+    const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(pixels * (2 + 4) * 4), GL_MAP_READ_BIT);
+    std::memset(&result, 0, sizeof(result));
+    if (mapped) {
+        const GLuint* ids = static_cast<const GLuint*>(mapped);
+        const float* positions = reinterpret_cast<const float*>(ids + pixels * 2);
+
+        // Nearest covered pixel to the cursor; the front-most on ties
+        const int center = m_size / 2;
+        int bestDistance = -1;
+        for (int j = 0; j < m_size; ++j) {
+            for (int i = 0; i < m_size; ++i) {
+                const size_t p = static_cast<size_t>(j) * m_size + i;
+                if (ids[p * 2] == 0) continue;
+                const int distance = (i - center) * (i - center) + (j - center) * (j - center);
+                const float depth = positions[p * 4 + 3];
+                if (bestDistance < 0 || distance < bestDistance || (distance == bestDistance && depth < result.depth)) {
+                    bestDistance = distance;
+                    result.hit = true;
+                    result.trackIndex = ids[p * 2] - 1;
+                    result.pointIndex = ids[p * 2 + 1];
+                    std::memcpy(result.position, positions + p * 4, sizeof(result.position));
+                    result.depth = depth;
+                }
+            }
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return true;
+}
+
+} // namespace DTIFiberLib
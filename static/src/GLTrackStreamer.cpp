@@ -0,0 +1,596 @@
+#include "../header/GLTrackStreamer.h"
+#include "../header/BoundingVolume.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <queue>
+
+namespace DTIFiberLib {
+
+static const char* streamVertexShaderSource = R"(
+#version 460 core
+layout(location = 0) in vec3 aPosition;
+layout(location = 1) in vec3 aDirection;
+uniform mat4 uMVPMatrix;
+out vec3 FragColor;
+
+void main() {
+    FragColor = abs(aDirection);
+    gl_Position = uMVPMatrix * vec4(aPosition, 1.0);
+}
+)";
+
+static const char* streamFragmentShaderSource = R"(
+#version 460 core
+in vec3 FragColor;
+uniform float uOpacity;
+out vec4 FragmentColor;
+
+void main() {
+    FragmentColor = vec4(FragColor, uOpacity);
+}
+)";
+
+namespace {
+
+const size_t kVertexBytes = 6 * sizeof(float);
+const size_t kMaxLoadedBytes = 256u << 20;          // Parsed nodes waiting for upload
+const size_t kUploadBytesPerFrame = 32u << 20;
+const size_t kMaxQueuedRequests = 64;
+
+// Interleaved position + direction of one piece, directions as in GLFiberRenderer
+void writePieceVertices(const float* xyz, size_t count, float* out)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const float* previous = xyz + (i > 0 ? i - 1 : i) * 3;
+        const float* next = xyz + (i + 1 < count ? i + 1 : i) * 3;
+        float dx = next[0] - previous[0];
+        float dy = next[1] - previous[1];
+        float dz = next[2] - previous[2];
+        const float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+        if (length > 0.0001f) {
+            dx /= length;
+            dy /= length;
+            dz /= length;
+        }
+        *out++ = xyz[i * 3];
+        *out++ = xyz[i * 3 + 1];
+        *out++ = xyz[i * 3 + 2];
+        *out++ = dx;
+        *out++ = dy;
+        *out++ = dz;
+    }
+}
+
+} // namespace
+
+GLTrackStreamer::GLTrackStreamer()
+    : m_loadedBytes(0)
+    , m_loading(0)
+    , m_stopLoader(false)
+    , m_VAO(0)
+    , m_VBO(0)
+    , m_cacheBytes(512u << 20)
+    , m_cacheVertices(0)
+    , m_pointBudget(20000000)
+    , m_errorThreshold(2.0f)
+    , m_opacity(1.0f)
+    , m_frame(0)
+{
+    std::memset(&m_fileHeader, 0, sizeof(m_fileHeader));
+    std::memset(&m_statistics, 0, sizeof(m_statistics));
+}
+
+GLTrackStreamer::~GLTrackStreamer()
+{
+    close();
+    cleanup();
+}
+
+bool GLTrackStreamer::open(const std::string& octreePath)
+{
+    close();
+
+    std::ifstream file(octreePath, std::ios::binary);
+    TrackOctreeFileHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, "TRKOCT1", 8) != 0 || header.version != 1 || header.nodeCount == 0) {
+        std::cerr << "Not a track octree file: " << octreePath << std::endl;
+        return false;
+    }
+    std::vector<TrackOctreeNode> nodes(header.nodeCount);
+    if (!file.read(reinterpret_cast<char*>(nodes.data()), static_cast<std::streamsize>(nodes.size() * sizeof(TrackOctreeNode)))) {
+        std::cerr << "Truncated track octree file: " << octreePath << std::endl;
+        return false;
+    }
+
+    // Every node's data has to lie in the file, or the loader would only notice when a read fails
+    file.seekg(0, std::ios::end);
+    const uint64_t fileBytes = static_cast<uint64_t>(file.tellg());
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        const TrackOctreeNode& node = nodes[i];
+        if (node.dataBytes > fileBytes || node.dataOffset > fileBytes - node.dataBytes) {
+            std::cerr << "Corrupt track octree file: node " << i << " runs past the end of " << octreePath << std::endl;
+            return false;
+        }
+    }
+
+    m_path = octreePath;
+    m_fileHeader = header;
+    m_nodes.swap(nodes);
+    m_nodeStates.assign(m_nodes.size(), NodeState::ABSENT);
+    m_resident.assign(m_nodes.size(), ResidentNode());
+    std::memset(&m_statistics, 0, sizeof(m_statistics));
+    m_freeRanges.clear();
+    if (m_cacheVertices > 0) {
+        m_freeRanges.emplace_back(0, m_cacheVertices);
+    }
+
+    m_stopLoader = false;
+    m_loader = std::thread(&GLTrackStreamer::loaderLoop, this);
+
+    return true;
+}
+
+void GLTrackStreamer::close()
+{
+    if (m_loader.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopLoader = true;
+        }
+        m_wake.notify_all();
+        m_loader.join();
+    }
+    m_requests.clear();
+    m_loaded.clear();
+    m_loadedBytes = 0;
+    m_loading = 0;
+    m_nodes.clear();
+    m_nodeStates.clear();
+    m_resident.clear();
+    m_freeRanges.clear();
+    if (m_cacheVertices > 0) {
+        m_freeRanges.emplace_back(0, m_cacheVertices);
+    }
+}
+
+bool GLTrackStreamer::initialize()
+{
+    m_shader = std::make_unique<GLShaderProgram>();
+    if (!m_shader->loadFromString(streamVertexShaderSource, streamFragmentShaderSource)) {
+        std::cerr << "Streaming shader unavailable" << std::endl;
+        m_shader.reset();
+        return false;
+    }
+    glGenVertexArrays(1, &m_VAO);
+    glGenBuffers(1, &m_VBO);
+    m_cacheVertices = 0;
+    return true;
+}
+
+void GLTrackStreamer::cleanup()
+{
+    if (m_VAO != 0) {
+        glDeleteVertexArrays(1, &m_VAO);
+        m_VAO = 0;
+    }
+    if (m_VBO != 0) {
+        glDeleteBuffers(1, &m_VBO);
+        m_VBO = 0;
+    }
+    m_shader.reset();
+    m_cacheVertices = 0;
+
+    // Cache contents are gone; nodes come back from the loader as needed
+    std::fill(m_nodeStates.begin(), m_nodeStates.end(), NodeState::ABSENT);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_requests.clear();
+    m_loaded.clear();
+    m_loadedBytes = 0;
+}
+
+void GLTrackStreamer::setCacheBytes(size_t bytes)
+{
+    m_cacheBytes = std::max<size_t>(bytes, 16u << 20);
+}
+
+void GLTrackStreamer::setPointBudget(size_t points)
+{
+    m_pointBudget = std::max<size_t>(points, 1);
+}
+
+void GLTrackStreamer::setErrorThreshold(float pixels)
+{
+    m_errorThreshold = std::max(pixels, 0.1f);
+}
+
+void GLTrackStreamer::getBoundingBox(float* boundsMin, float* boundsMax) const
+{
+    for (int i = 0; i < 3; ++i) {
+        boundsMin[i] = m_nodes.empty() ? 0.0f : m_nodes[0].boundsMin[i];
+        boundsMax[i] = m_nodes.empty() ? 0.0f : m_nodes[0].boundsMax[i];
+    }
+}
+
+bool GLTrackStreamer::hasPendingWork() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_requests.empty() || m_loading > 0 || !m_loaded.empty();
+}
+
+void GLTrackStreamer::loaderLoop()
+{
+    std::ifstream file(m_path, std::ios::binary);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [this] { return m_stopLoader || (!m_requests.empty() && m_loadedBytes < kMaxLoadedBytes); });
+        if (m_stopLoader) {
+            return;
+        }
+        LoadedNode loaded;
+        loaded.node = m_requests.back();
+        m_requests.pop_back();
+        m_loading++;
+
+        lock.unlock();
+        if (!readNode(file, loaded.node, loaded)) {
+            std::cerr << "Failed to read track octree node " << loaded.node << std::endl;
+            file.clear();
+            loaded.vertices.clear();
+            loaded.pieceCounts.clear();
+        }
+        lock.lock();
+
+        m_loadedBytes += loaded.vertices.size() * sizeof(float);
+        m_loaded.push_back(std::move(loaded));
+        m_loading--;
+    }
+}
+
+bool GLTrackStreamer::readNode(std::ifstream& file, uint32_t node, LoadedNode& loaded) const
+{
+    const TrackOctreeNode& info = m_nodes[node];
+    std::vector<char> data(static_cast<size_t>(info.dataBytes));
+    file.seekg(static_cast<std::streamoff>(info.dataOffset));
+    if (!file.read(data.data(), static_cast<std::streamsize>(data.size()))) {
+        return false;
+    }
+
+    loaded.vertices.resize(static_cast<size_t>(info.pointCount) * 6);
+    loaded.pieceCounts.reserve(info.pieceCount);
+    size_t offset = 0;
+    size_t vertex = 0;
+    std::vector<float> xyz;
+    for (uint32_t piece = 0; piece < info.pieceCount; ++piece) {
+        uint32_t count = 0;
+        if (offset + sizeof(count) > data.size()) {
+            return false;
+        }
+        std::memcpy(&count, data.data() + offset, sizeof(count));
+        offset += sizeof(count);
+        if (vertex + count > info.pointCount || offset + count * 3 * sizeof(float) > data.size()) {
+            return false;
+        }
+        xyz.resize(count * 3);
+        std::memcpy(xyz.data(), data.data() + offset, count * 3 * sizeof(float));
+        offset += count * 3 * sizeof(float);
+
+        writePieceVertices(xyz.data(), count, &loaded.vertices[vertex * 6]);
+        loaded.pieceCounts.push_back(static_cast<GLsizei>(count));
+        vertex += count;
+    }
+    return vertex == info.pointCount;
+}
+
+void GLTrackStreamer::ensureCache()
+{
+    const size_t vertices = m_cacheBytes / kVertexBytes;
+    if (vertices == m_cacheVertices) {
+        return;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(vertices * kVertexBytes), nullptr, GL_DYNAMIC_DRAW);
+
+    glBindVertexArray(m_VAO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // A new buffer holds nothing; every resident node has to stream in again, and nodes
+    // too large for the old cache get another chance
+    for (NodeState& state : m_nodeStates) {
+        if (state == NodeState::RESIDENT || state == NodeState::UNLOADABLE) {
+            state = NodeState::ABSENT;
+        }
+    }
+    m_cacheVertices = vertices;
+    m_freeRanges.assign(1, std::make_pair(size_t(0), vertices));
+    m_statistics.cacheBytesCapacity = vertices * kVertexBytes;
+    m_statistics.cacheBytesUsed = 0;
+}
+
+bool GLTrackStreamer::allocateVertices(size_t count, size_t& first)
+{
+    for (size_t i = 0; i < m_freeRanges.size(); ++i) {
+        auto& range = m_freeRanges[i];
+        if (range.second >= count) {
+            first = range.first;
+            range.first += count;
+            range.second -= count;
+            if (range.second == 0) {
+                m_freeRanges.erase(m_freeRanges.begin() + i);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void GLTrackStreamer::evictNode(uint32_t node)
+{
+    ResidentNode& resident = m_resident[node];
+    m_nodeStates[node] = NodeState::ABSENT;
+    m_statistics.cacheBytesUsed -= resident.vertexCount * kVertexBytes;
+    m_statistics.evictedNodes++;
+    if (resident.vertexCount == 0) {
+        return;
+    }
+
+    // Release the range, merging with its neighbours
+    auto range = std::make_pair(resident.firstVertex, resident.vertexCount);
+    auto it = m_freeRanges.insert(std::lower_bound(m_freeRanges.begin(), m_freeRanges.end(), range), range);
+    auto next = it + 1;
+    if (next != m_freeRanges.end() && it->first + it->second == next->first) {
+        it->second += next->second;
+        m_freeRanges.erase(next);
+    }
+    if (it != m_freeRanges.begin()) {
+        auto previous = it - 1;
+        if (previous->first + previous->second == it->first) {
+            previous->second += it->second;
+            m_freeRanges.erase(it);
+        }
+    }
+}
+
+void GLTrackStreamer::uploadLoadedNodes()
+{
+    std::deque<LoadedNode> batch;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t bytes = 0;
+        while (!m_loaded.empty() && bytes < kUploadBytesPerFrame) {
+            bytes += m_loaded.front().vertices.size() * sizeof(float);
+            m_loadedBytes -= m_loaded.front().vertices.size() * sizeof(float);
+            batch.push_back(std::move(m_loaded.front()));
+            m_loaded.pop_front();
+        }
+    }
+    m_wake.notify_all();
+    if (batch.empty()) {
+        return;
+    }
+
+    // Least recently drawn first; nodes drawn last frame or uploaded this frame stay
+    std::vector<std::pair<uint64_t, uint32_t>> evictable;
+    bool evictableCollected = false;
+    size_t nextEvictable = 0;
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+    for (LoadedNode& loaded : batch) {
+        if (m_nodeStates[loaded.node] != NodeState::REQUESTED) {
+            continue;
+        }
+        const size_t count = loaded.vertices.size() / 6;
+        if (count > m_cacheVertices) {
+            // No eviction can make room; requesting it again would re-read it every frame
+            std::cerr << "Track octree node " << loaded.node << " (" << ((count * kVertexBytes) >> 20)
+                      << " MB) exceeds the GPU cache, skipped" << std::endl;
+            m_nodeStates[loaded.node] = NodeState::UNLOADABLE;
+            continue;
+        }
+        size_t first = 0;
+        bool allocated = count == 0 || allocateVertices(count, first);
+        while (!allocated) {
+            if (!evictableCollected) {
+                for (uint32_t node = 0; node < m_nodeStates.size(); ++node) {
+                    if (m_nodeStates[node] == NodeState::RESIDENT && m_resident[node].lastDrawnFrame + 1 < m_frame) {
+                        evictable.emplace_back(m_resident[node].lastDrawnFrame, node);
+                    }
+                }
+                std::sort(evictable.begin(), evictable.end());
+                evictableCollected = true;
+            }
+            if (nextEvictable == evictable.size()) {
+                break;
+            }
+            const uint32_t victim = evictable[nextEvictable++].second;
+            if (m_nodeStates[victim] == NodeState::RESIDENT) {
+                evictNode(victim);
+            }
+            allocated = allocateVertices(count, first);
+        }
+        if (!allocated) {
+            // Everything left is in view; the traversal will ask again if it still matters
+            m_nodeStates[loaded.node] = NodeState::ABSENT;
+            continue;
+        }
+
+        if (count > 0) {
+            glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(first * kVertexBytes),
+                            static_cast<GLsizeiptr>(count * kVertexBytes), loaded.vertices.data());
+            m_statistics.uploadedBytes += count * kVertexBytes;
+        }
+        ResidentNode& resident = m_resident[loaded.node];
+        resident.firstVertex = first;
+        resident.vertexCount = count;
+        resident.pieceCounts.swap(loaded.pieceCounts);
+        resident.lastDrawnFrame = m_frame;
+        m_nodeStates[loaded.node] = NodeState::RESIDENT;
+        m_statistics.cacheBytesUsed += count * kVertexBytes;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GLTrackStreamer::traverse(const float* mvpMatrix, const GLint* viewport, std::vector<uint32_t>& drawList)
+{
+    // Requests the loader has not started are re-prioritized from this frame's view
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (uint32_t node : m_requests) {
+            m_nodeStates[node] = NodeState::ABSENT;
+        }
+        m_requests.clear();
+    }
+
+    Frustum frustum;
+    frustum.extract(mvpMatrix);
+
+    // Pixels per world unit at clip depth w, from the y row scale of the MVP
+    const float rowScale = std::sqrt(mvpMatrix[1] * mvpMatrix[1] + mvpMatrix[5] * mvpMatrix[5] + mvpMatrix[9] * mvpMatrix[9]);
+    const float wScale = std::sqrt(mvpMatrix[3] * mvpMatrix[3] + mvpMatrix[7] * mvpMatrix[7] + mvpMatrix[11] * mvpMatrix[11]);
+    auto screenError = [&](const TrackOctreeNode& node) {
+        if (node.spacing <= 0.0f) {
+            return 0.0f;
+        }
+        float center[3];
+        float radius = 0.0f;
+        for (int i = 0; i < 3; ++i) {
+            center[i] = 0.5f * (node.boundsMin[i] + node.boundsMax[i]);
+            const float half = 0.5f * (node.boundsMax[i] - node.boundsMin[i]);
+            radius += half * half;
+        }
+        const float w = mvpMatrix[3] * center[0] + mvpMatrix[7] * center[1] + mvpMatrix[11] * center[2] + mvpMatrix[15];
+        const float nearestW = w - std::sqrt(radius) * wScale;
+        if (nearestW <= 1e-4f) {
+            return 1e30f;   // The camera is inside or next to the node
+        }
+        return node.spacing * 0.5f * static_cast<float>(viewport[3]) * rowScale / nearestW;
+    };
+
+    // Never plan more points than the cache can hold, or the view would evict itself
+    const size_t budget = std::min(m_pointBudget, m_cacheVertices * 3 / 4);
+    size_t drawnPoints = 0;
+    std::vector<std::pair<float, uint32_t>> requests;
+
+    std::priority_queue<std::pair<float, uint32_t>> queue;
+    BoundingBox rootBox;
+    std::memcpy(rootBox.min, m_nodes[0].boundsMin, sizeof(rootBox.min));
+    std::memcpy(rootBox.max, m_nodes[0].boundsMax, sizeof(rootBox.max));
+    if (rootBox.isValid() && frustum.classify(rootBox) != Frustum::OUTSIDE) {
+        queue.emplace(screenError(m_nodes[0]), 0u);
+    }
+
+    while (!queue.empty()) {
+        const float error = queue.top().first;
+        const uint32_t index = queue.top().second;
+        queue.pop();
+        const TrackOctreeNode& node = m_nodes[index];
+
+        if (node.pointCount > 0 && m_nodeStates[index] != NodeState::UNLOADABLE) {
+            if (m_nodeStates[index] != NodeState::RESIDENT) {
+                // Coarse levels first: children wait until their parent is resident
+                if (m_nodeStates[index] == NodeState::ABSENT) {
+                    requests.emplace_back(error, index);
+                }
+                continue;
+            }
+            ResidentNode& resident = m_resident[index];
+            if (drawnPoints + resident.vertexCount > budget) {
+                break;
+            }
+            drawnPoints += resident.vertexCount;
+            resident.lastDrawnFrame = m_frame;
+            drawList.push_back(index);
+        }
+
+        if (error <= m_errorThreshold) {
+            continue;
+        }
+        for (int32_t child : node.children) {
+            if (child < 0) {
+                continue;
+            }
+            BoundingBox box;
+            std::memcpy(box.min, m_nodes[child].boundsMin, sizeof(box.min));
+            std::memcpy(box.max, m_nodes[child].boundsMax, sizeof(box.max));
+            if (box.isValid() && frustum.classify(box) != Frustum::OUTSIDE) {
+                queue.emplace(screenError(m_nodes[child]), static_cast<uint32_t>(child));
+            }
+        }
+    }
+
+    // Highest screen-space error is loaded first; the loader takes from the back
+    std::sort(requests.begin(), requests.end());
+    if (requests.size() > kMaxQueuedRequests) {
+        requests.erase(requests.begin(), requests.end() - kMaxQueuedRequests);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& request : requests) {
+            m_nodeStates[request.second] = NodeState::REQUESTED;
+            m_requests.push_back(request.second);
+        }
+        m_statistics.pendingRequests = m_requests.size() + m_loading;
+    }
+    m_wake.notify_all();
+}
+
+void GLTrackStreamer::render(const float* mvpMatrix, const GLint* viewport)
+{
+    if (!isOpen() || (!m_shader && !initialize())) {
+        return;
+    }
+    ensureCache();
+    m_frame++;
+    m_statistics.uploadedBytes = 0;
+
+    uploadLoadedNodes();
+
+    std::vector<uint32_t> drawList;
+    traverse(mvpMatrix, viewport, drawList);
+
+    m_drawFirsts.clear();
+    m_drawCounts.clear();
+    size_t drawnPoints = 0;
+    for (uint32_t node : drawList) {
+        const ResidentNode& resident = m_resident[node];
+        GLint first = static_cast<GLint>(resident.firstVertex);
+        for (GLsizei count : resident.pieceCounts) {
+            m_drawFirsts.push_back(first);
+            m_drawCounts.push_back(count);
+            first += count;
+        }
+        drawnPoints += resident.vertexCount;
+    }
+
+    size_t residentNodes = 0;
+    size_t unloadableNodes = 0;
+    for (NodeState state : m_nodeStates) {
+        residentNodes += state == NodeState::RESIDENT ? 1 : 0;
+        unloadableNodes += state == NodeState::UNLOADABLE ? 1 : 0;
+    }
+    m_statistics.residentNodes = residentNodes;
+    m_statistics.unloadableNodes = unloadableNodes;
+    m_statistics.drawnNodes = drawList.size();
+    m_statistics.drawnPieces = m_drawCounts.size();
+    m_statistics.drawnPoints = drawnPoints;
+
+    if (m_drawCounts.empty()) {
+        return;
+    }
+    m_shader->use();
+    m_shader->setUniformMatrix4fv("uMVPMatrix", mvpMatrix);
+    m_shader->setUniform1f("uOpacity", m_opacity);
+    glBindVertexArray(m_VAO);
+    glMultiDrawArrays(GL_LINE_STRIP, m_drawFirsts.data(), m_drawCounts.data(), static_cast<GLsizei>(m_drawCounts.size()));
+    glBindVertexArray(0);
+}
+
+} // namespace DTIFiberLib
@@ -0,0 +1,139 @@
+#include "../header/NiftiWriter.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#ifdef DTIFIBERLIB_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+namespace DTIFiberLib {
+
+namespace {
+
+#pragma pack(push, 1)
+struct Nifti1Header {
+    int32_t sizeof_hdr;
+    char data_type[10];
+    char db_name[18];
+    int32_t extents;
+    int16_t session_error;
+    char regular;
+    char dim_info;
+    int16_t dim[8];
+    float intent_p1, intent_p2, intent_p3;
+    int16_t intent_code;
+    int16_t datatype;
+    int16_t bitpix;
+    int16_t slice_start;
+    float pixdim[8];
+    float vox_offset;
+    float scl_slope;
+    float scl_inter;
+    int16_t slice_end;
+    char slice_code;
+    char xyzt_units;
+    float cal_max, cal_min;
+    float slice_duration;
+    float toffset;
+    int32_t glmax, glmin;
+    char descrip[80];
+    char aux_file[24];
+    int16_t qform_code, sform_code;
+    float quatern_b, quatern_c, quatern_d;
+    float qoffset_x, qoffset_y, qoffset_z;
+    float srow_x[4], srow_y[4], srow_z[4];
+    char intent_name[16];
+    char magic[4];
+};
+#pragma pack(pop)
+
+static_assert(sizeof(Nifti1Header) == 348, "NIfTI-1 header must be 348 bytes");
+
+const int16_t kDatatypeFloat32 = 16;
+const int16_t kXformScannerAnat = 1;
+const char kUnitsMillimetre = 2;
+
+bool endsWith(const std::string& text, const std::string& suffix)
+{
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+} // namespace
+
+bool NiftiWriter::write(const std::string& path, const int* dim, const float* voxelSize,
+                        const float voxToRas[4][4], const float* data, const std::string& description)
+{
+    if (dim[0] <= 0 || dim[1] <= 0 || dim[2] <= 0 || dim[0] > 32767 || dim[1] > 32767 || dim[2] > 32767 || !data) {
+        std::cerr << "Invalid NIfTI volume: " << path << std::endl;
+        return false;
+    }
+    const size_t voxelCount = static_cast<size_t>(dim[0]) * dim[1] * dim[2];
+
+    Nifti1Header header;
+    std::memset(&header, 0, sizeof(header));
+    header.sizeof_hdr = 348;
+    header.regular = 'r';
+    header.dim[0] = 3;
+    header.pixdim[0] = 1.0f;    // qfac
+    for (int i = 0; i < 3; ++i) {
+        header.dim[i + 1] = static_cast<int16_t>(dim[i]);
+        header.pixdim[i + 1] = voxelSize[i];
+    }
+    header.dim[4] = header.dim[5] = header.dim[6] = header.dim[7] = 1;
+    header.datatype = kDatatypeFloat32;
+    header.bitpix = 32;
+    header.vox_offset = 352.0f;     // Header plus the empty extension flag
+    header.scl_slope = 1.0f;
+    header.xyzt_units = kUnitsMillimetre;
+    header.cal_max = *std::max_element(data, data + voxelCount);
+    header.sform_code = kXformScannerAnat;
+    for (int c = 0; c < 4; ++c) {
+        header.srow_x[c] = voxToRas[0][c];
+        header.srow_y[c] = voxToRas[1][c];
+        header.srow_z[c] = voxToRas[2][c];
+    }
+    std::strncpy(header.descrip, description.c_str(), sizeof(header.descrip) - 1);
+    std::memcpy(header.magic, "n+1\0", 4);
+
+    const char extension[4] = { 0, 0, 0, 0 };
+    const size_t dataBytes = voxelCount * sizeof(float);
+
+    if (endsWith(path, ".gz")) {
+#ifdef DTIFIBERLIB_HAS_ZLIB
+        gzFile file = gzopen(path.c_str(), "wb6");
+        if (!file) {
+            std::cerr << "Failed to open NIfTI file: " << path << std::endl;
+            return false;
+        }
+        bool ok = gzwrite(file, &header, sizeof(header)) == static_cast<int>(sizeof(header)) &&
+                  gzwrite(file, extension, sizeof(extension)) == static_cast<int>(sizeof(extension));
+        // gzwrite takes an unsigned length, so large volumes go in slices
+        const char* bytes = reinterpret_cast<const char*>(data);
+        for (size_t offset = 0; ok && offset < dataBytes; offset += 1u << 30) {
+            const unsigned chunk = static_cast<unsigned>(std::min<size_t>(dataBytes - offset, 1u << 30));
+            ok = gzwrite(file, bytes + offset, chunk) == static_cast<int>(chunk);
+        }
+        ok = gzclose(file) == Z_OK && ok;
+        if (!ok) {
+            std::cerr << "Failed to write NIfTI file: " << path << std::endl;
+        }
+        return ok;
+#else
+        std::cerr << "Compressed NIfTI needs zlib; write .nii instead: " << path << std::endl;
+        return false;
+#endif
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.write(reinterpret_cast<const char*>(&header), sizeof(header)) ||
+        !file.write(extension, sizeof(extension)) ||
+        !file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(dataBytes))) {
+        std::cerr << "Failed to write NIfTI file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace DTIFiberLib
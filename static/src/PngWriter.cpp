@@ -0,0 +1,146 @@
+#include "../header/PngWriter.h"
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#ifdef DTIFIBERLIB_HAS_ZLIB
+#include <zlib.h>
+#endif
+
+namespace DTIFiberLib {
+
+namespace {
+
+uint32_t crc32Update(uint32_t crc, const unsigned char* data, size_t size)
+{
+    static uint32_t table[256];
+    static bool tableReady = false;
+    if (!tableReady) {
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        tableReady = true;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+void appendBigEndian(std::vector<unsigned char>& out, uint32_t value)
+{
+    out.push_back(static_cast<unsigned char>(value >> 24));
+    out.push_back(static_cast<unsigned char>(value >> 16));
+    out.push_back(static_cast<unsigned char>(value >> 8));
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+void appendChunk(std::vector<unsigned char>& out, const char* type, const std::vector<unsigned char>& data)
+{
+    appendBigEndian(out, static_cast<uint32_t>(data.size()));
+    const size_t typeOffset = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    uint32_t crc = crc32Update(0xFFFFFFFFu, out.data() + typeOffset, 4 + data.size());
+    appendBigEndian(out, crc ^ 0xFFFFFFFFu);
+}
+
+bool deflateRows(const std::vector<unsigned char>& raw, std::vector<unsigned char>& compressed)
+{
+#ifdef DTIFIBERLIB_HAS_ZLIB
+    uLongf size = compressBound(static_cast<uLong>(raw.size()));
+    compressed.resize(size);
+    if (compress2(compressed.data(), &size, raw.data(), static_cast<uLong>(raw.size()), Z_BEST_SPEED) != Z_OK) {
+        return false;
+    }
+    compressed.resize(size);
+    return true;
+#else
+    // zlib stream of stored blocks (at most 65535 bytes each) followed by the Adler-32
+    compressed.clear();
+    compressed.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    compressed.push_back(0x78);
+    compressed.push_back(0x01);
+    size_t offset = 0;
+    do {
+        const size_t blockSize = std::min<size_t>(raw.size() - offset, 65535);
+        const bool last = offset + blockSize == raw.size();
+        compressed.push_back(last ? 1 : 0);
+        compressed.push_back(static_cast<unsigned char>(blockSize & 0xFF));
+        compressed.push_back(static_cast<unsigned char>(blockSize >> 8));
+        compressed.push_back(static_cast<unsigned char>(~blockSize & 0xFF));
+        compressed.push_back(static_cast<unsigned char>((~blockSize >> 8) & 0xFF));
+        compressed.insert(compressed.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+        offset += blockSize;
+    } while (offset < raw.size());
+
+    uint32_t a = 1, b = 0;
+    for (unsigned char byte : raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    appendBigEndian(compressed, (b << 16) | a);
+    return true;
+#endif
+}
+
+} // namespace
+
+bool PngWriter::encode(int width, int height, const unsigned char* rgba, std::vector<unsigned char>& png)
+{
+    if (width <= 0 || height <= 0 || !rgba) {
+        return false;
+    }
+
+    // Each row is prefixed with filter type 0 (none)
+    const size_t rowBytes = static_cast<size_t>(width) * 4;
+    std::vector<unsigned char> raw((rowBytes + 1) * static_cast<size_t>(height));
+    for (int y = 0; y < height; ++y) {
+        unsigned char* row = raw.data() + (rowBytes + 1) * y;
+        row[0] = 0;
+        std::copy(rgba + rowBytes * y, rgba + rowBytes * (y + 1), row + 1);
+    }
+
+    std::vector<unsigned char> compressed;
+    if (!deflateRows(raw, compressed)) {
+        return false;
+    }
+
+    static const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    png.assign(signature, signature + sizeof(signature));
+
+    std::vector<unsigned char> header;
+    appendBigEndian(header, static_cast<uint32_t>(width));
+    appendBigEndian(header, static_cast<uint32_t>(height));
+    header.push_back(8);    // Bit depth
+    header.push_back(6);    // Color type: RGBA
+    header.push_back(0);    // Compression: deflate
+    header.push_back(0);    // Filter method
+    header.push_back(0);    // No interlace
+    appendChunk(png, "IHDR", header);
+    appendChunk(png, "IDAT", compressed);
+    appendChunk(png, "IEND", std::vector<unsigned char>());
+    return true;
+}
+
+bool PngWriter::write(const std::string& path, int width, int height, const unsigned char* rgba)
+{
+    std::vector<unsigned char> png;
+    if (!encode(width, height, rgba, png)) {
+        std::cerr << "Failed to encode PNG: " << path << std::endl;
+        return false;
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.write(reinterpret_cast<const char*>(png.data()), static_cast<std::streamsize>(png.size()))) {
+        std::cerr << "Failed to write PNG: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace DTIFiberLib
@@ -0,0 +1,656 @@
+#include "../header/SegmentBVH.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <thread>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DTIFIBERLIB_BVH_SSE2
+#endif
+
+namespace DTIFiberLib {
+
+namespace {
+
+const size_t kSegmentsPerBlock = 16384;     // Work unit handed to a thread
+const uint32_t kTaskSegments = 32768;       // Subtrees of at most this many segments are built by workers
+const int kStackSize = 64;                  // Traversal entries kept on the call stack
+
+static_assert(sizeof(float) == 4, "Nodes and segments are laid out as 32-byte records");
+
+// Depth-first traversal stack: kStackSize entries in place, deeper trees (long runs of equal
+// codes) spill to the heap, so no node is ever skipped
+template <typename Entry>
+class TraversalStack {
+public:
+    TraversalStack() : m_size(0) {}
+
+    bool empty() const { return m_size == 0; }
+    void push(const Entry& entry)
+    {
+        if (m_size < kStackSize) {
+            m_entries[m_size] = entry;
+        } else {
+            m_overflow.push_back(entry);
+        }
+        m_size++;
+    }
+    Entry pop()
+    {
+        m_size--;
+        if (m_size < kStackSize) {
+            return m_entries[m_size];
+        }
+        const Entry entry = m_overflow.back();
+        m_overflow.pop_back();
+        return entry;
+    }
+
+private:
+    Entry m_entries[kStackSize];
+    size_t m_size;
+    std::vector<Entry> m_overflow;
+};
+
+// Runs body(thread) on `threadCount` threads, the calling thread being thread 0
+template <typename Body>
+void runThreads(size_t threadCount, const Body& body)
+{
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threadCount; ++i) {
+        threads.emplace_back(body, i);
+    }
+    body(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+// 10 bits of v spread to every third bit
+inline uint32_t spreadBits(uint32_t v)
+{
+    v = (v | (v << 16)) & 0x030000FFu;
+    v = (v | (v << 8)) & 0x0300F00Fu;
+    v = (v | (v << 4)) & 0x030C30C3u;
+    v = (v | (v << 2)) & 0x09249249u;
+    return v;
+}
+
+inline float dot3(const float* a, const float* b)
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+inline float clamp01(float v)
+{
+    return std::min(std::max(v, 0.0f), 1.0f);
+}
+
+// Entry parameter of the ray into the node box grown by `radius`, or +inf on a miss
+struct RayBoxTest {
+    float origin[4];
+    float inverse[4];
+    float radius;
+    float maxT;
+
+    float entry(const float* nodeMin, const float* nodeMax) const
+    {
+#if defined(DTIFIBERLIB_BVH_SSE2)
+        // Lane 3 carries the node's index bits; it is replaced by lane 0 before the reductions
+        const __m128 r = _mm_set1_ps(radius);
+        const __m128 o = _mm_loadu_ps(origin);
+        const __m128 inv = _mm_loadu_ps(inverse);
+        const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(nodeMin), r), o), inv);
+        const __m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_loadu_ps(nodeMax), r), o), inv);
+        __m128 nearT = _mm_min_ps(t1, t2);
+        __m128 farT = _mm_max_ps(t1, t2);
+        nearT = _mm_shuffle_ps(nearT, nearT, _MM_SHUFFLE(0, 2, 1, 0));
+        farT = _mm_shuffle_ps(farT, farT, _MM_SHUFFLE(0, 2, 1, 0));
+        nearT = _mm_max_ps(nearT, _mm_shuffle_ps(nearT, nearT, _MM_SHUFFLE(1, 0, 3, 2)));
+        nearT = _mm_max_ps(nearT, _mm_shuffle_ps(nearT, nearT, _MM_SHUFFLE(2, 3, 0, 1)));
+        farT = _mm_min_ps(farT, _mm_shuffle_ps(farT, farT, _MM_SHUFFLE(1, 0, 3, 2)));
+        farT = _mm_min_ps(farT, _mm_shuffle_ps(farT, farT, _MM_SHUFFLE(2, 3, 0, 1)));
+        const float tNear = std::max(_mm_cvtss_f32(nearT), 0.0f);
+        const float tFar = std::min(_mm_cvtss_f32(farT), maxT);
+#else
+        float tNear = 0.0f;
+        float tFar = maxT;
+        for (int a = 0; a < 3; ++a) {
+            const float t1 = (nodeMin[a] - radius - origin[a]) * inverse[a];
+            const float t2 = (nodeMax[a] + radius - origin[a]) * inverse[a];
+            tNear = std::max(tNear, std::min(t1, t2));
+            tFar = std::min(tFar, std::max(t1, t2));
+        }
+#endif
+        return tNear <= tFar ? tNear : std::numeric_limits<float>::infinity();
+    }
+};
+
+// Squared distance from the point to the node box
+inline float boxDistance2(const float* point, const float* nodeMin, const float* nodeMax)
+{
+#if defined(DTIFIBERLIB_BVH_SSE2)
+    const __m128 p = _mm_loadu_ps(point);
+    __m128 d = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(nodeMin), p), _mm_sub_ps(p, _mm_loadu_ps(nodeMax)));
+    d = _mm_max_ps(d, _mm_setzero_ps());
+    d = _mm_and_ps(d, _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1)));
+    d = _mm_mul_ps(d, d);
+    d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+    d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(d);
+#else
+    float distance2 = 0.0f;
+    for (int a = 0; a < 3; ++a) {
+        const float d = std::max(std::max(nodeMin[a] - point[a], point[a] - nodeMax[a]), 0.0f);
+        distance2 += d * d;
+    }
+    return distance2;
+#endif
+}
+
+inline bool boxOverlaps(const BoundingBox& box, const float* nodeMin, const float* nodeMax)
+{
+#if defined(DTIFIBERLIB_BVH_SSE2)
+    const __m128 outside = _mm_or_ps(_mm_cmpgt_ps(_mm_loadu_ps(nodeMin), _mm_setr_ps(box.max[0], box.max[1], box.max[2], 0.0f)),
+                                     _mm_cmplt_ps(_mm_loadu_ps(nodeMax), _mm_setr_ps(box.min[0], box.min[1], box.min[2], 0.0f)));
+    return (_mm_movemask_ps(outside) & 7) == 0;
+#else
+    for (int a = 0; a < 3; ++a) {
+        if (nodeMin[a] > box.max[a] || nodeMax[a] < box.min[a]) return false;
+    }
+    return true;
+#endif
+}
+
+// Clips the segment parameter range [0, 1] to the box
+bool segmentOverlapsBox(const float* a, const float* b, const BoundingBox& box)
+{
+    float t0 = 0.0f, t1 = 1.0f;
+    for (int axis = 0; axis < 3; ++axis) {
+        const float d = b[axis] - a[axis];
+        if (d == 0.0f) {
+            if (a[axis] < box.min[axis] || a[axis] > box.max[axis]) return false;
+            continue;
+        }
+        float u0 = (box.min[axis] - a[axis]) / d;
+        float u1 = (box.max[axis] - a[axis]) / d;
+        if (u0 > u1) std::swap(u0, u1);
+        t0 = std::max(t0, u0);
+        t1 = std::min(t1, u1);
+        if (t0 > t1) return false;
+    }
+    return true;
+}
+
+// Squared distance between segment a -> b and the point; s receives the segment parameter
+inline float pointSegmentDistance2(const float* p, const float* a, const float* b, float& s)
+{
+    const float e[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    const float r[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+    const float length2 = dot3(e, e);
+    s = length2 > 0.0f ? clamp01(dot3(r, e) / length2) : 0.0f;
+    const float d[3] = { r[0] - s * e[0], r[1] - s * e[1], r[2] - s * e[2] };
+    return dot3(d, d);
+}
+
+// Squared distance between the ray o + t * dir (unit dir, t in [0, maxT]) and segment a -> b
+float raySegmentDistance2(const float* o, const float* dir, float maxT, const float* a, const float* b, float& t, float& s)
+{
+    const float e[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    const float r[3] = { a[0] - o[0], a[1] - o[1], a[2] - o[2] };
+    const float de = dot3(dir, e);
+    const float dr = dot3(dir, r);
+    const float ee = dot3(e, e);
+    const float er = dot3(e, r);
+
+    // Unconstrained closest points, then clamped (Ericson, Real-Time Collision Detection 5.1.9)
+    if (ee <= 0.0f) {
+        s = 0.0f;
+        t = std::min(std::max(dr, 0.0f), maxT);
+    } else {
+        const float denominator = ee - de * de;
+        s = denominator > ee * 1e-6f ? clamp01((dr * de - er) / denominator) : 0.0f;
+        t = dr + s * de;
+        if (t < 0.0f) {
+            t = 0.0f;
+            s = clamp01(-er / ee);
+        } else if (t > maxT) {
+            t = maxT;
+            s = clamp01((maxT * de - er) / ee);
+        }
+    }
+    const float d[3] = { r[0] + s * e[0] - t * dir[0], r[1] + s * e[1] - t * dir[1], r[2] + s * e[2] - t * dir[2] };
+    return dot3(d, d);
+}
+
+} // namespace
+
+SegmentBVH::SegmentBVH()
+    : m_threadCount(0)
+    , m_leafSize(4)
+    , m_buildMs(0.0)
+{
+    static_assert(sizeof(Node) == 32, "Nodes must stay 32 bytes");
+    static_assert(sizeof(Segment) == 32, "Segments must stay 32 bytes");
+}
+
+void SegmentBVH::setThreadCount(int threads)
+{
+    m_threadCount = std::max(threads, 0);
+}
+
+void SegmentBVH::setLeafSize(int segments)
+{
+    m_leafSize = static_cast<uint32_t>(std::min(std::max(segments, 1), 64));
+}
+
+size_t SegmentBVH::threadCount(size_t items, size_t itemsPerThread) const
+{
+    size_t threads = m_threadCount > 0 ? static_cast<size_t>(m_threadCount) : std::thread::hardware_concurrency();
+    return std::max<size_t>(std::min(threads, (items + itemsPerThread - 1) / itemsPerThread), 1);
+}
+
+void SegmentBVH::clear()
+{
+    m_nodes.clear();
+    m_segments.clear();
+    m_codes.clear();
+}
+
+BoundingBox SegmentBVH::getBounds() const
+{
+    BoundingBox bounds;
+    if (!m_nodes.empty()) {
+        std::copy(m_nodes[0].min, m_nodes[0].min + 3, bounds.min);
+        std::copy(m_nodes[0].max, m_nodes[0].max + 3, bounds.max);
+    }
+    return bounds;
+}
+
+void SegmentBVH::build(const float* vertices, size_t vertexStride, const int* trackStarts, const int* trackCounts, size_t trackCount)
+{
+    clear();
+    const auto start = std::chrono::steady_clock::now();
+
+    // Segment offset of every track
+    std::vector<size_t> segmentStarts(trackCount + 1, 0);
+    for (size_t t = 0; t < trackCount; ++t) {
+        segmentStarts[t + 1] = segmentStarts[t] + static_cast<size_t>(std::max(trackCounts[t] - 1, 0));
+    }
+    const size_t segmentCount = segmentStarts[trackCount];
+    if (segmentCount == 0) {
+        return;
+    }
+    if (segmentCount > std::numeric_limits<uint32_t>::max()) {
+        std::cerr << "SegmentBVH: " << segmentCount << " segments exceed the 32-bit index range" << std::endl;
+        return;
+    }
+    const size_t threads = threadCount(segmentCount, kSegmentsPerBlock);
+
+    // Segments in input order and the bounds of their centroids, per thread over track ranges
+    std::vector<Segment> input(segmentCount);
+    std::vector<BoundingBox> threadBounds(threads);
+    runThreads(threads, [&](size_t thread) {
+        BoundingBox& bounds = threadBounds[thread];
+        const size_t firstTrack = trackCount * thread / threads;
+        const size_t lastTrack = trackCount * (thread + 1) / threads;
+        for (size_t t = firstTrack; t < lastTrack; ++t) {
+            Segment* segment = input.data() + segmentStarts[t];
+            const float* point = vertices + static_cast<size_t>(trackStarts[t]) * vertexStride;
+            for (int p = 0; p + 1 < trackCounts[t]; ++p, ++segment, point += vertexStride) {
+                std::copy(point, point + 3, segment->a);
+                std::copy(point + vertexStride, point + vertexStride + 3, segment->b);
+                segment->track = static_cast<uint32_t>(t);
+                segment->point = static_cast<uint32_t>(p);
+                bounds.expand((segment->a[0] + segment->b[0]) * 0.5f, (segment->a[1] + segment->b[1]) * 0.5f,
+                              (segment->a[2] + segment->b[2]) * 0.5f);
+            }
+        }
+    });
+    BoundingBox centroidBounds;
+    for (const BoundingBox& bounds : threadBounds) {
+        if (bounds.isValid()) centroidBounds.expand(bounds);
+    }
+
+    // Morton code of each centroid with its input index as the tie-break: unique sort keys
+    float scale[3];
+    for (int a = 0; a < 3; ++a) {
+        const float extent = centroidBounds.max[a] - centroidBounds.min[a];
+        scale[a] = extent > 0.0f ? 1023.0f / extent : 0.0f;
+    }
+    std::vector<uint64_t> keys(segmentCount);
+    runThreads(threads, [&](size_t thread) {
+        const size_t first = segmentCount * thread / threads;
+        const size_t last = segmentCount * (thread + 1) / threads;
+        for (size_t i = first; i < last; ++i) {
+            const Segment& segment = input[i];
+            uint32_t cell[3];
+            for (int a = 0; a < 3; ++a) {
+                const float centroid = (segment.a[a] + segment.b[a]) * 0.5f;
+                cell[a] = static_cast<uint32_t>(std::min(std::max((centroid - centroidBounds.min[a]) * scale[a], 0.0f), 1023.0f));
+            }
+            const uint32_t code = spreadBits(cell[0]) | (spreadBits(cell[1]) << 1) | (spreadBits(cell[2]) << 2);
+            keys[i] = (static_cast<uint64_t>(code) << 32) | i;
+        }
+    });
+
+    // Each thread sorts a run, then adjacent runs are merged pairwise in parallel rounds
+    std::vector<size_t> runStarts(threads + 1);
+    for (size_t i = 0; i <= threads; ++i) {
+        runStarts[i] = segmentCount * i / threads;
+    }
+    runThreads(threads, [&](size_t thread) {
+        std::sort(keys.begin() + runStarts[thread], keys.begin() + runStarts[thread + 1]);
+    });
+    std::vector<uint64_t> merged(threads > 1 ? segmentCount : 0);
+    while (runStarts.size() > 2) {
+        const size_t runs = runStarts.size() - 1;
+        const size_t pairs = runs / 2;
+        runThreads(std::min(threads, pairs), [&](size_t thread) {
+            for (size_t pair = thread; pair < pairs; pair += std::min(threads, pairs)) {
+                const size_t first = runStarts[pair * 2];
+                const size_t middle = runStarts[pair * 2 + 1];
+                const size_t last = runStarts[pair * 2 + 2];
+                std::merge(keys.begin() + first, keys.begin() + middle, keys.begin() + middle, keys.begin() + last,
+                           merged.begin() + first);
+            }
+        });
+        if (runs % 2 == 1) {
+            std::copy(keys.begin() + runStarts[runs - 1], keys.end(), merged.begin() + runStarts[runs - 1]);
+        }
+        keys.swap(merged);
+        std::vector<size_t> mergedStarts;
+        for (size_t i = 0; i < runStarts.size(); i += 2) {
+            mergedStarts.push_back(runStarts[i]);
+        }
+        if (mergedStarts.back() != segmentCount) {
+            mergedStarts.push_back(segmentCount);
+        }
+        runStarts.swap(mergedStarts);
+    }
+    std::vector<uint64_t>().swap(merged);
+
+    // Segments and codes in curve order
+    m_segments.resize(segmentCount);
+    m_codes.resize(segmentCount);
+    runThreads(threads, [&](size_t thread) {
+        const size_t first = segmentCount * thread / threads;
+        const size_t last = segmentCount * (thread + 1) / threads;
+        for (size_t i = first; i < last; ++i) {
+            m_segments[i] = input[keys[i] & 0xFFFFFFFFu];
+            m_codes[i] = static_cast<uint32_t>(keys[i] >> 32);
+        }
+    });
+    std::vector<Segment>().swap(input);
+    std::vector<uint64_t>().swap(keys);
+
+    // Top levels serially, subtrees below kTaskSegments by workers, spliced in task order
+    std::vector<BuildTask> tasks;
+    m_nodes.resize(1);
+    buildNodes(m_nodes, 0, 0, static_cast<uint32_t>(segmentCount), &tasks);
+    const uint32_t topNodeCount = static_cast<uint32_t>(m_nodes.size());
+    std::vector<std::vector<Node>> subtrees(tasks.size());
+    std::atomic<size_t> nextTask(0);
+    runThreads(std::min(threads, std::max<size_t>(tasks.size(), 1)), [&](size_t) {
+        for (size_t task = nextTask++; task < tasks.size(); task = nextTask++) {
+            subtrees[task].resize(1);
+            buildNodes(subtrees[task], 0, tasks[task].first, tasks[task].last, nullptr);
+        }
+    });
+    for (size_t task = 0; task < tasks.size(); ++task) {
+        // Local child indices start at 1
+        const uint32_t base = static_cast<uint32_t>(m_nodes.size()) - 1;
+        std::vector<Node>& subtree = subtrees[task];
+        for (Node& node : subtree) {
+            if (node.count == 0) node.index += base;
+        }
+        m_nodes[tasks[task].node] = subtree[0];
+        m_nodes.insert(m_nodes.end(), subtree.begin() + 1, subtree.end());
+        std::vector<Node>().swap(subtree);
+    }
+    topBounds(0, topNodeCount);
+    std::vector<uint32_t>().swap(m_codes);
+
+    m_buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint32_t SegmentBVH::splitRange(uint32_t first, uint32_t last) const
+{
+    const uint32_t firstCode = m_codes[first];
+    const uint32_t lastCode = m_codes[last - 1];
+    if (firstCode == lastCode) {
+        return first + (last - first) / 2;     // Identical codes: halve the range
+    }
+
+    // Codes below the highest differing bit are shared, so the range splits where it turns on
+    uint32_t bit = 31;
+    while (((firstCode ^ lastCode) >> bit) == 0) {
+        bit--;
+    }
+    const auto split = std::partition_point(m_codes.begin() + first, m_codes.begin() + last,
+                                            [bit](uint32_t code) { return ((code >> bit) & 1u) == 0; });
+    return static_cast<uint32_t>(split - m_codes.begin());
+}
+
+void SegmentBVH::leafBounds(Node& node) const
+{
+    BoundingBox bounds;
+    for (uint32_t i = node.index; i < node.index + node.count; ++i) {
+        const Segment& segment = m_segments[i];
+        bounds.expand(segment.a[0], segment.a[1], segment.a[2]);
+        bounds.expand(segment.b[0], segment.b[1], segment.b[2]);
+    }
+    std::copy(bounds.min, bounds.min + 3, node.min);
+    std::copy(bounds.max, bounds.max + 3, node.max);
+}
+
+void SegmentBVH::buildNodes(std::vector<Node>& nodes, uint32_t node, uint32_t first, uint32_t last,
+                            std::vector<BuildTask>* tasks) const
+{
+    if (last - first <= m_leafSize) {
+        nodes[node].index = first;
+        nodes[node].count = last - first;
+        leafBounds(nodes[node]);
+        return;
+    }
+    if (tasks && last - first <= kTaskSegments) {
+        tasks->push_back({ node, first, last });
+        return;
+    }
+
+    const uint32_t split = splitRange(first, last);
+    const uint32_t child = static_cast<uint32_t>(nodes.size());
+    nodes.resize(nodes.size() + 2);
+    nodes[node].index = child;
+    nodes[node].count = 0;
+    buildNodes(nodes, child, first, split, tasks);
+    buildNodes(nodes, child + 1, split, last, tasks);
+
+    // Bounds of the top levels wait for the workers (topBounds)
+    if (!tasks) {
+        for (int a = 0; a < 3; ++a) {
+            nodes[node].min[a] = std::min(nodes[child].min[a], nodes[child + 1].min[a]);
+            nodes[node].max[a] = std::max(nodes[child].max[a], nodes[child + 1].max[a]);
+        }
+    }
+}
+
+void SegmentBVH::topBounds(uint32_t node, uint32_t topNodeCount)
+{
+    // Leaves and spliced subtree roots (children past the top nodes) already have bounds
+    Node& current = m_nodes[node];
+    if (current.count > 0 || current.index >= topNodeCount) {
+        return;
+    }
+    const uint32_t child = current.index;
+    topBounds(child, topNodeCount);
+    topBounds(child + 1, topNodeCount);
+    for (int a = 0; a < 3; ++a) {
+        m_nodes[node].min[a] = std::min(m_nodes[child].min[a], m_nodes[child + 1].min[a]);
+        m_nodes[node].max[a] = std::max(m_nodes[child].max[a], m_nodes[child + 1].max[a]);
+    }
+}
+
+bool SegmentBVH::intersectRay(const float* origin, const float* direction, float radius, float maxT, SegmentHit& hit) const
+{
+    if (m_nodes.empty()) return false;
+
+    const float length = std::sqrt(dot3(direction, direction));
+    if (!(length > 0.0f)) return false;
+    const float dir[3] = { direction[0] / length, direction[1] / length, direction[2] / length };
+
+    // maxT is in units of the given direction
+    RayBoxTest test;
+    for (int a = 0; a < 3; ++a) {
+        test.origin[a] = origin[a];
+        test.inverse[a] = 1.0f / (dir[a] != 0.0f ? dir[a] : 1e-30f);   // Keeps 0 * inf out of the slabs
+    }
+    test.origin[3] = 0.0f;
+    test.inverse[3] = 0.0f;
+    test.radius = radius;
+    test.maxT = maxT * length;
+
+    // Nearest hit along the ray; boxes entered after it are skipped
+    const float radius2 = radius * radius;
+    float bestT = std::numeric_limits<float>::infinity();
+    TraversalStack<uint32_t> stack;
+    if (test.entry(m_nodes[0].min, m_nodes[0].max) <= test.maxT) {
+        stack.push(0);
+    }
+    while (!stack.empty()) {
+        const Node& node = m_nodes[stack.pop()];
+        if (node.count > 0) {
+            for (uint32_t i = node.index; i < node.index + node.count; ++i) {
+                const Segment& segment = m_segments[i];
+                float t, s;
+                const float distance2 = raySegmentDistance2(origin, dir, test.maxT, segment.a, segment.b, t, s);
+                if (distance2 <= radius2 && t < bestT) {
+                    bestT = t;
+                    hit.track = segment.track;
+                    hit.point = segment.point;
+                    hit.distance = std::sqrt(distance2);
+                    hit.t = t / length;
+                    for (int a = 0; a < 3; ++a) {
+                        hit.position[a] = segment.a[a] + s * (segment.b[a] - segment.a[a]);
+                    }
+                }
+            }
+            continue;
+        }
+
+        // Nearer child on top of the stack
+        const float entry0 = test.entry(m_nodes[node.index].min, m_nodes[node.index].max);
+        const float entry1 = test.entry(m_nodes[node.index + 1].min, m_nodes[node.index + 1].max);
+        const bool firstNearer = entry0 <= entry1;
+        const float nearEntry = firstNearer ? entry0 : entry1;
+        const float farEntry = firstNearer ? entry1 : entry0;
+        if (farEntry < bestT) stack.push(firstNearer ? node.index + 1 : node.index);
+        if (nearEntry < bestT) stack.push(firstNearer ? node.index : node.index + 1);
+    }
+    return bestT < std::numeric_limits<float>::infinity();
+}
+
+void SegmentBVH::queryBox(const BoundingBox& box, std::vector<SegmentRef>& segments) const
+{
+    segments.clear();
+    if (m_nodes.empty() || !box.isValid()) return;
+
+    TraversalStack<uint32_t> stack;
+    stack.push(0);
+    while (!stack.empty()) {
+        const Node& node = m_nodes[stack.pop()];
+        if (!boxOverlaps(box, node.min, node.max)) continue;
+
+        if (node.count > 0) {
+            for (uint32_t i = node.index; i < node.index + node.count; ++i) {
+                const Segment& segment = m_segments[i];
+                if (segmentOverlapsBox(segment.a, segment.b, box)) {
+                    segments.push_back({ segment.track, segment.point });
+                }
+            }
+        } else {
+            stack.push(node.index + 1);
+            stack.push(node.index);
+        }
+    }
+}
+
+size_t SegmentBVH::nearest(const float* point, size_t k, float maxDistance, bool distinctTracks, std::vector<SegmentHit>& hits) const
+{
+    hits.clear();
+    if (m_nodes.empty() || k == 0) return 0;
+
+    // hits is a max-heap on distance while searching; the kth distance bounds the search
+    const float p[4] = { point[0], point[1], point[2], 0.0f };
+    auto farther = [](const SegmentHit& a, const SegmentHit& b) { return a.distance < b.distance; };
+    auto bound2 = [&]() {
+        const float bound = hits.size() < k ? maxDistance : hits.front().distance;
+        return bound * bound;
+    };
+
+    struct Entry {
+        uint32_t node;
+        float distance2;
+    };
+    TraversalStack<Entry> stack;
+    stack.push({ 0, boxDistance2(p, m_nodes[0].min, m_nodes[0].max) });
+    while (!stack.empty()) {
+        const Entry entry = stack.pop();
+        if (entry.distance2 > bound2()) continue;
+
+        const Node& node = m_nodes[entry.node];
+        if (node.count > 0) {
+            for (uint32_t i = node.index; i < node.index + node.count; ++i) {
+                const Segment& segment = m_segments[i];
+                float s;
+                const float distance2 = pointSegmentDistance2(p, segment.a, segment.b, s);
+                if (distance2 > bound2()) continue;
+
+                SegmentHit hit;
+                hit.track = segment.track;
+                hit.point = segment.point;
+                hit.distance = std::sqrt(distance2);
+                hit.t = 0.0f;
+                for (int a = 0; a < 3; ++a) {
+                    hit.position[a] = segment.a[a] + s * (segment.b[a] - segment.a[a]);
+                }
+
+                // One entry per track: a nearer segment of a listed track replaces it
+                if (distinctTracks) {
+                    auto same = std::find_if(hits.begin(), hits.end(),
+                                             [&hit](const SegmentHit& other) { return other.track == hit.track; });
+                    if (same != hits.end()) {
+                        if (hit.distance < same->distance) {
+                            *same = hit;
+                            std::make_heap(hits.begin(), hits.end(), farther);
+                        }
+                        continue;
+                    }
+                }
+                hits.push_back(hit);
+                std::push_heap(hits.begin(), hits.end(), farther);
+                if (hits.size() > k) {
+                    std::pop_heap(hits.begin(), hits.end(), farther);
+                    hits.pop_back();
+                }
+            }
+            continue;
+        }
+
+        // Nearer child on top of the stack
+        const float distance0 = boxDistance2(p, m_nodes[node.index].min, m_nodes[node.index].max);
+        const float distance1 = boxDistance2(p, m_nodes[node.index + 1].min, m_nodes[node.index + 1].max);
+        const bool firstNearer = distance0 <= distance1;
+        stack.push({ firstNearer ? node.index + 1 : node.index, firstNearer ? distance1 : distance0 });
+        stack.push({ firstNearer ? node.index : node.index + 1, firstNearer ? distance0 : distance1 });
+    }
+
+    std::sort_heap(hits.begin(), hits.end(), farther);
+    return hits.size();
+}
+
+} // namespace DTIFiberLib
@@ -0,0 +1,187 @@
+#include "../header/TrackChunkBVH.h"
+#include <algorithm>
+#include <utility>
+
+namespace DTIFiberLib {
+
+namespace {
+
+// Spread the lower 10 bits of v so that there are two zero bits between each
+uint32_t expandBits(uint32_t v)
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+uint32_t mortonCode(float x, float y, float z)
+{
+    // Inputs are normalized to [0, 1]
+    uint32_t ix = static_cast<uint32_t>(std::min(std::max(x * 1024.0f, 0.0f), 1023.0f));
+    uint32_t iy = static_cast<uint32_t>(std::min(std::max(y * 1024.0f, 0.0f), 1023.0f));
+    uint32_t iz = static_cast<uint32_t>(std::min(std::max(z * 1024.0f, 0.0f), 1023.0f));
+    return (expandBits(ix) << 2) | (expandBits(iy) << 1) | expandBits(iz);
+}
+
+} // namespace
+
+TrackChunkBVH::TrackChunkBVH()
+{
+}
+
+void TrackChunkBVH::clear()
+{
+    m_slotOrder.clear();
+    m_chunks.clear();
+    m_nodes.clear();
+}
+
+void TrackChunkBVH::build(const std::vector<BoundingBox>& trackBounds, size_t tracksPerChunk)
+{
+    clear();
+    append(trackBounds, 0, tracksPerChunk);
+}
+
+void TrackChunkBVH::append(const std::vector<BoundingBox>& trackBounds, size_t firstTrack, size_t tracksPerChunk)
+{
+    if (firstTrack >= trackBounds.size()) {
+        return;
+    }
+    if (tracksPerChunk == 0) {
+        tracksPerChunk = 1;
+    }
+
+    appendChunks(trackBounds, firstTrack, tracksPerChunk);
+
+    // Chunks are already spatially sorted, so splitting ranges in half gives a balanced hierarchy.
+    // Rebuilding the nodes only touches chunks, not tracks.
+    m_nodes.clear();
+    m_nodes.reserve(m_chunks.size() * 2);
+    buildNode(0, static_cast<uint32_t>(m_chunks.size()));
+}
+
+void TrackChunkBVH::appendChunks(const std::vector<BoundingBox>& trackBounds, size_t firstTrack, size_t tracksPerChunk)
+{
+    // Scene bounds of the track centers, used to normalize Morton coordinates
+    BoundingBox centerBounds;
+    for (size_t i = firstTrack; i < trackBounds.size(); ++i) {
+        const auto& box = trackBounds[i];
+        if (!box.isValid()) continue;  // Empty tracks
+        centerBounds.expand(box.center(0), box.center(1), box.center(2));
+    }
+    float extent[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        float size = centerBounds.max[axis] - centerBounds.min[axis];
+        extent[axis] = size > 1e-6f ? 1.0f / size : 0.0f;
+    }
+
+    // Sort tracks along the Morton curve
+    std::vector<std::pair<uint32_t, uint32_t>> keyed(trackBounds.size() - firstTrack);
+    for (size_t i = firstTrack; i < trackBounds.size(); ++i) {
+        const auto& box = trackBounds[i];
+        uint32_t code = mortonCode((box.center(0) - centerBounds.min[0]) * extent[0],
+                                   (box.center(1) - centerBounds.min[1]) * extent[1],
+                                   (box.center(2) - centerBounds.min[2]) * extent[2]);
+        keyed[i - firstTrack] = std::make_pair(code, static_cast<uint32_t>(i));
+    }
+    std::sort(keyed.begin(), keyed.end());
+
+    const size_t firstSlot = m_slotOrder.size();
+    m_slotOrder.resize(firstSlot + keyed.size());
+    for (size_t i = 0; i < keyed.size(); ++i) {
+        m_slotOrder[firstSlot + i] = keyed[i].second;
+    }
+
+    // Cut the ordered slots into chunks
+    for (size_t first = firstSlot; first < m_slotOrder.size(); first += tracksPerChunk) {
+        TrackChunk chunk;
+        chunk.firstSlot = static_cast<uint32_t>(first);
+        chunk.slotCount = static_cast<uint32_t>(std::min(tracksPerChunk, m_slotOrder.size() - first));
+        for (uint32_t s = 0; s < chunk.slotCount; ++s) {
+            chunk.bounds.expand(trackBounds[m_slotOrder[first + s]]);
+        }
+        m_chunks.push_back(chunk);
+    }
+}
+
+int32_t TrackChunkBVH::buildNode(uint32_t firstChunk, uint32_t chunkCount)
+{
+    int32_t index = static_cast<int32_t>(m_nodes.size());
+    m_nodes.push_back(Node());
+
+    Node node;
+    node.firstChunk = firstChunk;
+    node.chunkCount = chunkCount;
+    node.left = -1;
+    node.right = -1;
+    for (uint32_t c = 0; c < chunkCount; ++c) {
+        node.bounds.expand(m_chunks[firstChunk + c].bounds);
+    }
+
+    if (chunkCount > 1) {
+        uint32_t half = chunkCount / 2;
+        node.left = buildNode(firstChunk, half);
+        node.right = buildNode(firstChunk + half, chunkCount - half);
+    }
+
+    m_nodes[index] = node;
+    return index;
+}
+
+void TrackChunkBVH::cullFrustum(const float* mvpMatrix, std::vector<SlotRange>& visibleRanges) const
+{
+    Frustum frustum;
+    frustum.extract(mvpMatrix);
+    cullFrustum(frustum, visibleRanges);
+}
+
+void TrackChunkBVH::cullFrustum(const Frustum& frustum, std::vector<SlotRange>& visibleRanges) const
+{
+    visibleRanges.clear();
+    if (m_nodes.empty()) {
+        return;
+    }
+
+    // Depth-first traversal keeps ranges in ascending slot order so neighbors merge
+    int32_t stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const Node& node = m_nodes[stack[--stackSize]];
+
+        Frustum::Containment containment = frustum.classify(node.bounds);
+        if (containment == Frustum::OUTSIDE) {
+            continue;
+        }
+
+        if (containment == Frustum::INSIDE || node.left < 0) {
+            const TrackChunk& first = m_chunks[node.firstChunk];
+            const TrackChunk& last = m_chunks[node.firstChunk + node.chunkCount - 1];
+            appendRange(visibleRanges, first.firstSlot, last.firstSlot + last.slotCount - first.firstSlot);
+            continue;
+        }
+
+        stack[stackSize++] = node.right;
+        stack[stackSize++] = node.left;
+    }
+}
+
+void TrackChunkBVH::appendRange(std::vector<SlotRange>& ranges, uint32_t firstSlot, uint32_t slotCount)
+{
+    if (!ranges.empty()) {
+        SlotRange& last = ranges.back();
+        if (last.firstSlot + last.slotCount == firstSlot) {
+            last.slotCount += slotCount;
+            return;
+        }
+    }
+    SlotRange range;
+    range.firstSlot = firstSlot;
+    range.slotCount = slotCount;
+    ranges.push_back(range);
+}
+
+} // namespace DTIFiberLib
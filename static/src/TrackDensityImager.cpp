@@ -0,0 +1,378 @@
+#include "../header/TrackDensityImager.h"
+#include "../header/NiftiWriter.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DTIFIBERLIB_TDI_SSE2
+#endif
+
+namespace DTIFiberLib {
+
+namespace {
+
+const size_t kTracksPerBlock = 256;                         // Work unit handed to a thread
+const size_t kMaxPartialBytes = size_t(2) << 30;            // Cap on all private partial volumes together
+
+inline int floorToInt(float v)
+{
+    const int i = static_cast<int>(v);
+    return i - (v < static_cast<float>(i) ? 1 : 0);
+}
+
+// dst[i] += src[i]
+void accumulate(float* dst, const float* src, size_t count)
+{
+    size_t i = 0;
+#if defined(__AVX__)
+    for (; i + 16 <= count; i += 16) {
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+        _mm256_storeu_ps(dst + i + 8, _mm256_add_ps(_mm256_loadu_ps(dst + i + 8), _mm256_loadu_ps(src + i + 8)));
+    }
+#elif defined(DTIFIBERLIB_TDI_SSE2)
+    for (; i + 8 <= count; i += 8) {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+        _mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_loadu_ps(dst + i + 4), _mm_loadu_ps(src + i + 4)));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] += src[i];
+    }
+}
+
+// Adds the fraction of segment a -> b (grid coordinates) inside every voxel it crosses, times
+// the whole-segment weights[c], to each of the Channels interleaved values of the voxel
+template <int Channels>
+void voxelizeSegment(const float* a, const float* b, const float* weights, const int* dim, float* volume)
+{
+    float d[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+
+    // Clip the parameter range [0, 1] to the grid box
+    float t0 = 0.0f, t1 = 1.0f;
+    for (int i = 0; i < 3; ++i) {
+        if (d[i] == 0.0f) {
+            if (a[i] < 0.0f || a[i] >= static_cast<float>(dim[i])) return;
+            continue;
+        }
+        float tNear = (0.0f - a[i]) / d[i];
+        float tFar = (static_cast<float>(dim[i]) - a[i]) / d[i];
+        if (tNear > tFar) std::swap(tNear, tFar);
+        t0 = std::max(t0, tNear);
+        t1 = std::min(t1, tFar);
+    }
+    if (t0 >= t1) return;
+
+    // Amanatides-Woo traversal; each step adds the length up to the next voxel boundary
+    int cell[3], step[3];
+    float tMax[3], tDelta[3];
+    for (int i = 0; i < 3; ++i) {
+        // The cell is taken at the clipped start, nudged inside so boundary starts pick the right side
+        float p = a[i] + d[i] * t0;
+        int c = floorToInt(p);
+        if (d[i] < 0.0f && static_cast<float>(c) == p) c--;
+        cell[i] = std::min(std::max(c, 0), dim[i] - 1);
+
+        if (d[i] > 0.0f) {
+            step[i] = 1;
+            tMax[i] = (static_cast<float>(cell[i] + 1) - a[i]) / d[i];
+            tDelta[i] = 1.0f / d[i];
+        } else if (d[i] < 0.0f) {
+            step[i] = -1;
+            tMax[i] = (static_cast<float>(cell[i]) - a[i]) / d[i];
+            tDelta[i] = -1.0f / d[i];
+        } else {
+            step[i] = 0;
+            tMax[i] = std::numeric_limits<float>::infinity();
+            tDelta[i] = std::numeric_limits<float>::infinity();
+        }
+    }
+
+    const size_t strideY = static_cast<size_t>(dim[0]);
+    const size_t strideZ = strideY * static_cast<size_t>(dim[1]);
+    float t = t0;
+    for (;;) {
+        const int axis = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+        const float tNext = std::min(tMax[axis], t1);
+        if (tNext > t) {
+            float* voxel = volume + (cell[0] + cell[1] * strideY + cell[2] * strideZ) * Channels;
+            for (int c = 0; c < Channels; ++c) {
+                voxel[c] += (tNext - t) * weights[c];
+            }
+            t = tNext;
+        }
+        if (tNext >= t1) break;
+
+        cell[axis] += step[axis];
+        if (cell[axis] < 0 || cell[axis] >= dim[axis]) break;
+        tMax[axis] += tDelta[axis];
+    }
+}
+
+void multiply(const float a[4][4], const float b[4][4], float out[4][4])
+{
+    for (int r = 0; r < 4; ++r) {
+        for (int c = 0; c < 4; ++c) {
+            out[r][c] = a[r][0] * b[0][c] + a[r][1] * b[1][c] + a[r][2] * b[2][c] + a[r][3] * b[3][c];
+        }
+    }
+}
+
+} // namespace
+
+TrackDensityImager::TrackDensityImager()
+    : m_threadCount(0)
+    , m_directionWeighted(false)
+    , m_totalLength(0.0)
+    , m_elapsedMs(0.0)
+{
+    std::memset(&m_grid, 0, sizeof(m_grid));
+}
+
+void TrackDensityImager::setGrid(const DensityGrid& grid)
+{
+    m_grid = grid;
+}
+
+bool TrackDensityImager::setGridFromHeader(const TractographyHeader& header, float voxelSize)
+{
+    float referenceSize[3];
+    for (int i = 0; i < 3; ++i) {
+        if (header.dim[i] == 0 || header.voxel_size[i] <= 0.0f) {
+            m_lastErrorMessage = "Header has no valid reference grid";
+            return false;
+        }
+        referenceSize[i] = header.voxel_size[i];
+    }
+
+    // Same extent as the reference volume, optionally with different voxels
+    for (int i = 0; i < 3; ++i) {
+        const float extent = header.dim[i] * referenceSize[i];
+        m_grid.voxelSize[i] = voxelSize > 0.0f ? voxelSize : referenceSize[i];
+        m_grid.dim[i] = voxelSize > 0.0f ? static_cast<int>(std::ceil(extent / voxelSize - 1e-4f)) : header.dim[i];
+        m_grid.origin[i] = 0.0f;
+    }
+
+    // voxmm points have their origin at the corner of reference voxel 0, while vox_to_ras maps
+    // reference voxel centers: reference index = (origin + (i + 0.5) * size) / referenceSize - 0.5
+    float gridToReference[4][4] = {};
+    for (int i = 0; i < 3; ++i) {
+        gridToReference[i][i] = m_grid.voxelSize[i] / referenceSize[i];
+        gridToReference[i][3] = (m_grid.origin[i] + 0.5f * m_grid.voxelSize[i]) / referenceSize[i] - 0.5f;
+    }
+    gridToReference[3][3] = 1.0f;
+
+    // Version 1 files (or writers that leave it empty) have no vox_to_ras; fall back to voxmm axes
+    float referenceToRas[4][4] = {};
+    if (header.vox_to_ras[3][3] != 0.0f) {
+        std::memcpy(referenceToRas, header.vox_to_ras, sizeof(referenceToRas));
+    } else {
+        for (int i = 0; i < 3; ++i) {
+            referenceToRas[i][i] = referenceSize[i];
+            referenceToRas[i][3] = 0.5f * referenceSize[i];
+        }
+        referenceToRas[3][3] = 1.0f;
+    }
+    multiply(referenceToRas, gridToReference, m_grid.voxToRas);
+    return true;
+}
+
+void TrackDensityImager::setThreadCount(int threads)
+{
+    m_threadCount = std::max(threads, 0);
+}
+
+void TrackDensityImager::setDirectionWeighted(bool enable)
+{
+    m_directionWeighted = enable;
+}
+
+template <int Channels>
+void TrackDensityImager::voxelizeTracks(const std::vector<FiberTrack>& tracks, const std::vector<uint32_t>* selection,
+                                        const std::vector<FiberTrack>* appended, size_t first, size_t last, float* volume) const
+{
+    const float scale[3] = { 1.0f / m_grid.voxelSize[0], 1.0f / m_grid.voxelSize[1], 1.0f / m_grid.voxelSize[2] };
+    const size_t strideY = static_cast<size_t>(m_grid.dim[0]);
+    const size_t strideZ = strideY * static_cast<size_t>(m_grid.dim[1]);
+    const unsigned dimX = static_cast<unsigned>(m_grid.dim[0]);
+    const unsigned dimY = static_cast<unsigned>(m_grid.dim[1]);
+    const unsigned dimZ = static_cast<unsigned>(m_grid.dim[2]);
+
+    for (size_t i = first; i < last; ++i) {
+        const size_t index = selection ? (*selection)[i] : i;
+        const FiberTrack& track = index < tracks.size() ? tracks[index] : (*appended)[index - tracks.size()];
+        if (track.size() < 2) continue;
+
+        float previous[3] = { (track[0].x - m_grid.origin[0]) * scale[0],
+                              (track[0].y - m_grid.origin[1]) * scale[1],
+                              (track[0].z - m_grid.origin[2]) * scale[2] };
+        int previousCell[3] = { floorToInt(previous[0]), floorToInt(previous[1]), floorToInt(previous[2]) };
+        for (size_t p = 1; p < track.size(); ++p) {
+            const TrackPoint& a = track[p - 1];
+            const TrackPoint& b = track[p];
+            const float current[3] = { (b.x - m_grid.origin[0]) * scale[0],
+                                       (b.y - m_grid.origin[1]) * scale[1],
+                                       (b.z - m_grid.origin[2]) * scale[2] };
+            const int cell[3] = { floorToInt(current[0]), floorToInt(current[1]), floorToInt(current[2]) };
+            const float dx = b.x - a.x, dy = b.y - a.y, dz = b.z - a.z;
+            const float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+            // Length alone, or |direction| * length in x, y, z followed by the length
+            float weights[Channels];
+            weights[Channels - 1] = length;
+            if (Channels == 4) {
+                weights[0] = std::fabs(dx);
+                weights[1] = std::fabs(dy);
+                weights[2] = std::fabs(dz);
+            }
+
+            // Steps are usually shorter than a voxel: both ends in one voxel need no traversal
+            if (cell[0] == previousCell[0] && cell[1] == previousCell[1] && cell[2] == previousCell[2]) {
+                // Unsigned compares also reject negative cells
+                if (static_cast<unsigned>(cell[0]) < dimX && static_cast<unsigned>(cell[1]) < dimY &&
+                    static_cast<unsigned>(cell[2]) < dimZ) {
+                    float* voxel = volume + (cell[0] + cell[1] * strideY + cell[2] * strideZ) * Channels;
+                    for (int c = 0; c < Channels; ++c) {
+                        voxel[c] += weights[c];
+                    }
+                }
+            } else {
+                voxelizeSegment<Channels>(previous, current, weights, m_grid.dim, volume);
+            }
+
+            std::memcpy(previous, current, sizeof(previous));
+            std::memcpy(previousCell, cell, sizeof(previousCell));
+        }
+    }
+}
+
+bool TrackDensityImager::compute(const std::vector<FiberTrack>& tracks)
+{
+    return computeTracks(tracks, nullptr, nullptr);
+}
+
+bool TrackDensityImager::compute(const std::vector<FiberTrack>& tracks, const std::vector<uint32_t>& selection,
+                                 const std::vector<FiberTrack>* appended)
+{
+    return computeTracks(tracks, &selection, appended);
+}
+
+bool TrackDensityImager::computeTracks(const std::vector<FiberTrack>& tracks, const std::vector<uint32_t>* selection,
+                                       const std::vector<FiberTrack>* appended)
+{
+    if (m_grid.dim[0] <= 0 || m_grid.dim[1] <= 0 || m_grid.dim[2] <= 0 ||
+        m_grid.voxelSize[0] <= 0.0f || m_grid.voxelSize[1] <= 0.0f || m_grid.voxelSize[2] <= 0.0f) {
+        m_lastErrorMessage = "Density grid is not set";
+        return false;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const size_t channels = m_directionWeighted ? 4 : 1;
+    const size_t voxelCount = static_cast<size_t>(m_grid.dim[0]) * m_grid.dim[1] * m_grid.dim[2];
+    const size_t valueCount = voxelCount * channels;
+    const size_t trackCount = selection ? selection->size() : tracks.size();
+
+    // Thread 0 writes straight into the result; every other thread needs a full private volume
+    size_t threadCount = m_threadCount > 0 ? static_cast<size_t>(m_threadCount) : std::thread::hardware_concurrency();
+    const size_t blockCount = (trackCount + kTracksPerBlock - 1) / kTracksPerBlock;
+    threadCount = std::min(threadCount, std::max<size_t>(blockCount, 1));
+    threadCount = std::min(threadCount, 1 + kMaxPartialBytes / (valueCount * sizeof(float)));
+    threadCount = std::max<size_t>(threadCount, 1);
+
+    m_density.assign(valueCount, 0.0f);
+    std::vector<std::vector<float>> partials(threadCount - 1);
+    std::atomic<size_t> nextBlock(0);
+
+    auto worker = [&](size_t thread) {
+        float* volume = m_density.data();
+        if (thread > 0) {
+            // Allocated by the thread that fills it, so its pages are local to that thread
+            partials[thread - 1].assign(valueCount, 0.0f);
+            volume = partials[thread - 1].data();
+        }
+        for (size_t block = nextBlock++; block < blockCount; block = nextBlock++) {
+            const size_t first = block * kTracksPerBlock;
+            const size_t last = std::min(trackCount, first + kTracksPerBlock);
+            if (m_directionWeighted) {
+                voxelizeTracks<4>(tracks, selection, appended, first, last, volume);
+            } else {
+                voxelizeTracks<1>(tracks, selection, appended, first, last, volume);
+            }
+        }
+    };
+
+    // Each thread sums one contiguous voxel range over all partials, so the reduction is parallel too
+    std::vector<double> rangeLength(threadCount, 0.0);
+    auto reduce = [&](size_t thread) {
+        const size_t begin = voxelCount * thread / threadCount * channels;
+        const size_t end = voxelCount * (thread + 1) / threadCount * channels;
+        for (const auto& partial : partials) {
+            accumulate(m_density.data() + begin, partial.data() + begin, end - begin);
+        }
+        double sum = 0.0;
+        for (size_t i = begin + channels - 1; i < end; i += channels) {
+            sum += m_density[i];
+        }
+        rangeLength[thread] = sum;
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threadCount; ++i) {
+        threads.emplace_back(worker, i);
+    }
+    worker(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+
+    for (size_t i = 1; i < threadCount; ++i) {
+        threads.emplace_back(reduce, i);
+    }
+    reduce(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    m_totalLength = 0.0;
+    for (double length : rangeLength) {
+        m_totalLength += length;
+    }
+    m_elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    return true;
+}
+
+bool TrackDensityImager::writeNifti(const std::string& path)
+{
+    if (m_density.empty()) {
+        m_lastErrorMessage = "No track density computed";
+        return false;
+    }
+
+    // Direction-weighted results are written as their length channel
+    std::vector<float> lengths;
+    const float* data = m_density.data();
+    if (m_directionWeighted) {
+        lengths.resize(m_density.size() / 4);
+        for (size_t i = 0; i < lengths.size(); ++i) {
+            lengths[i] = m_density[i * 4 + 3];
+        }
+        data = lengths.data();
+    }
+
+    if (!NiftiWriter::write(path, m_grid.dim, m_grid.voxelSize, m_grid.voxToRas, data,
+                            "Track density (mm per voxel)")) {
+        m_lastErrorMessage = "Failed to write " + path;
+        return false;
+    }
+    return true;
+}
+
+} // namespace DTIFiberLib
@@ -0,0 +1,471 @@
+#include "../header/TrackOctreeBuilder.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace DTIFiberLib {
+
+static_assert(sizeof(TractographyHeader) == 1000, "TRK header must be 1000 bytes");
+static_assert(sizeof(TrackOctreeFileHeader) == 56, "Track octree header layout changed");
+static_assert(sizeof(TrackOctreeNode) == 88, "Track octree node layout changed");
+
+namespace {
+
+const int kMaxSupportedDepth = 10;          // 30-bit Morton codes
+const float kSpacingDivisions = 128.0f;     // Root spacing is 1/128 of the root cube
+const double kTargetLeafPoints = 131072.0;  // Automatic depth aims for leaves of about this size
+const uint32_t kMaxTrackPoints = 10000;     // Same sanity limit as TrkFileReader
+const size_t kNodeFlushBytes = 1 << 20;
+
+uint64_t hashTrackIndex(uint64_t x)
+{
+    // splitmix64 finalizer
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+uint32_t spreadBits(uint32_t v)
+{
+    v &= 0x3FF;
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8)) & 0x0300F00F;
+    v = (v | (v << 4)) & 0x030C30C3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+uint32_t compactBits(uint32_t v)
+{
+    v &= 0x09249249;
+    v = (v | (v >> 2)) & 0x030C30C3;
+    v = (v | (v >> 4)) & 0x0300F00F;
+    v = (v | (v >> 8)) & 0x030000FF;
+    v = (v | (v >> 16)) & 0x3FF;
+    return v;
+}
+
+uint64_t nodeKey(uint32_t depth, const int* cell)
+{
+    const uint32_t morton = spreadBits(cell[0]) | (spreadBits(cell[1]) << 1) | (spreadBits(cell[2]) << 2);
+    return (static_cast<uint64_t>(depth) << 56) | morton;
+}
+
+void decodeNodeKey(uint64_t key, uint32_t& depth, int* cell)
+{
+    depth = static_cast<uint32_t>(key >> 56);
+    const uint32_t morton = static_cast<uint32_t>(key);
+    cell[0] = static_cast<int>(compactBits(morton));
+    cell[1] = static_cast<int>(compactBits(morton >> 1));
+    cell[2] = static_cast<int>(compactBits(morton >> 2));
+}
+
+void resetBounds(TrackOctreeNode& node)
+{
+    for (int i = 0; i < 3; ++i) {
+        node.boundsMin[i] = 1e30f;
+        node.boundsMax[i] = -1e30f;
+    }
+}
+
+void expandBounds(TrackOctreeNode& node, const float* boundsMin, const float* boundsMax)
+{
+    for (int i = 0; i < 3; ++i) {
+        node.boundsMin[i] = std::min(node.boundsMin[i], boundsMin[i]);
+        node.boundsMax[i] = std::max(node.boundsMax[i], boundsMax[i]);
+    }
+}
+
+} // namespace
+
+// Sequential .trk track reader that keeps only the current track
+struct TrackOctreeBuilder::TrkStream {
+    std::ifstream file;
+    std::vector<char> buffer;
+    size_t floatsPerPoint;
+    size_t propertyBytes;
+    std::vector<float> raw;
+    std::vector<float> points;      // xyz of the current track
+
+    bool open(const std::string& path, const TractographyHeader& header)
+    {
+        buffer.resize(4 << 20);
+        file.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        file.open(path, std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        file.seekg(1000, std::ios::beg);
+        floatsPerPoint = 3 + header.n_scalars;
+        propertyBytes = sizeof(float) * header.n_properties;
+        return true;
+    }
+
+    bool next()
+    {
+        uint32_t count = 0;
+        if (!file.read(reinterpret_cast<char*>(&count), sizeof(count)) || count == 0 || count > kMaxTrackPoints) {
+            return false;
+        }
+        // Properties are read with the points: seeking would discard the stream buffer every track
+        raw.resize(count * floatsPerPoint + propertyBytes / sizeof(float));
+        if (!file.read(reinterpret_cast<char*>(raw.data()), static_cast<std::streamsize>(raw.size() * sizeof(float)))) {
+            return false;
+        }
+
+        points.resize(count * 3);
+        for (size_t i = 0; i < count; ++i) {
+            std::memcpy(&points[i * 3], &raw[i * floatsPerPoint], 3 * sizeof(float));
+        }
+        return true;
+    }
+};
+
+// Scatters pieces to their nodes' file ranges through per-node buffers
+struct TrackOctreeBuilder::PieceWriter {
+    std::ofstream& file;
+    std::vector<uint64_t> cursors;
+    std::vector<std::vector<char>> buffers;
+    size_t bufferedBytes;
+    size_t budget;
+
+    PieceWriter(std::ofstream& out, const std::vector<TrackOctreeNode>& nodes, size_t bufferBudget)
+        : file(out), cursors(nodes.size()), buffers(nodes.size()), bufferedBytes(0), budget(bufferBudget)
+    {
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            cursors[i] = nodes[i].dataOffset;
+        }
+    }
+
+    void append(uint32_t node, const float* xyz, uint32_t count)
+    {
+        std::vector<char>& buffer = buffers[node];
+        const size_t bytes = sizeof(uint32_t) + count * 3 * sizeof(float);
+        const size_t offset = buffer.size();
+        buffer.resize(offset + bytes);
+        std::memcpy(buffer.data() + offset, &count, sizeof(uint32_t));
+        std::memcpy(buffer.data() + offset + sizeof(uint32_t), xyz, count * 3 * sizeof(float));
+        bufferedBytes += bytes;
+
+        if (buffer.size() >= kNodeFlushBytes) {
+            flush(node);
+        } else if (bufferedBytes > budget) {
+            flushAll();
+        }
+    }
+
+    void flush(uint32_t node)
+    {
+        std::vector<char>& buffer = buffers[node];
+        if (buffer.empty()) {
+            return;
+        }
+        file.seekp(static_cast<std::streamoff>(cursors[node]));
+        file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        cursors[node] += buffer.size();
+        bufferedBytes -= buffer.size();
+        std::vector<char>().swap(buffer);
+    }
+
+    void flushAll()
+    {
+        for (uint32_t node = 0; node < buffers.size(); ++node) {
+            flush(node);
+        }
+    }
+};
+
+TrackOctreeBuilder::TrackOctreeBuilder()
+    : m_maxDepthOption(0)
+    , m_writeBufferBytes(256u << 20)
+    , m_elapsedMs(0.0)
+{
+    std::memset(&m_fileHeader, 0, sizeof(m_fileHeader));
+}
+
+void TrackOctreeBuilder::setMaxDepth(int depth)
+{
+    m_maxDepthOption = std::min(std::max(depth, 0), kMaxSupportedDepth);
+}
+
+void TrackOctreeBuilder::setWriteBufferBytes(size_t bytes)
+{
+    m_writeBufferBytes = std::max<size_t>(bytes, kNodeFlushBytes);
+}
+
+uint32_t TrackOctreeBuilder::findNode(uint32_t depth, const int* cell)
+{
+    const uint64_t key = nodeKey(depth, cell);
+    auto it = m_nodeIndex.find(key);
+    if (it != m_nodeIndex.end()) {
+        return it->second;
+    }
+
+    TrackOctreeNode node;
+    std::memset(&node, 0, sizeof(node));
+    resetBounds(node);
+    node.depth = depth;
+    for (int c = 0; c < 8; ++c) {
+        node.children[c] = -1;
+    }
+    const uint32_t index = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.push_back(node);
+    m_nodeKeys.push_back(key);
+    m_nodeIndex.emplace(key, index);
+    return index;
+}
+
+template <typename PieceVisitor>
+bool TrackOctreeBuilder::forEachPiece(TrkStream& stream, PieceVisitor&& visit)
+{
+    const uint32_t maxDepth = m_fileHeader.maxDepth;
+
+    // Cumulative level probabilities, weights 8^level
+    std::vector<double> levelThresholds(maxDepth + 1);
+    double total = 0.0;
+    for (uint32_t level = 0; level <= maxDepth; ++level) {
+        total += std::pow(8.0, level);
+        levelThresholds[level] = total;
+    }
+    for (double& threshold : levelThresholds) {
+        threshold /= total;
+    }
+
+    std::vector<float> kept;
+    uint64_t trackIndex = 0;
+    for (; stream.next(); ++trackIndex) {
+        const double u = static_cast<double>(hashTrackIndex(trackIndex) >> 11) * (1.0 / 9007199254740992.0);
+        const uint32_t depth = static_cast<uint32_t>(
+            std::upper_bound(levelThresholds.begin(), levelThresholds.end() - 1, u) - levelThresholds.begin());
+        const float spacing = depth < maxDepth ? m_fileHeader.rootSize / (kSpacingDivisions * static_cast<float>(1u << depth)) : 0.0f;
+
+        // Decimate to the level spacing, always keeping both ends
+        const std::vector<float>& points = stream.points;
+        const size_t count = points.size() / 3;
+        kept.assign(points.begin(), points.begin() + 3);
+        for (size_t i = 1; i < count; ++i) {
+            const float* p = &points[i * 3];
+            const float* last = &kept[kept.size() - 3];
+            const float dx = p[0] - last[0], dy = p[1] - last[1], dz = p[2] - last[2];
+            if (i + 1 == count || dx * dx + dy * dy + dz * dz >= spacing * spacing) {
+                kept.insert(kept.end(), p, p + 3);
+            }
+        }
+
+        // Cut where the track changes cell; the crossing segment stays with the piece it leaves
+        const size_t keptCount = kept.size() / 3;
+        const int cellsPerAxis = 1 << depth;
+        const float cellScale = static_cast<float>(cellsPerAxis) / m_fileHeader.rootSize;
+        auto cellOf = [&](const float* p, int* cell) {
+            for (int a = 0; a < 3; ++a) {
+                const int c = static_cast<int>(std::floor((p[a] - m_fileHeader.rootMin[a]) * cellScale));
+                cell[a] = std::min(std::max(c, 0), cellsPerAxis - 1);
+            }
+        };
+
+        int pieceCell[3];
+        cellOf(&kept[0], pieceCell);
+        size_t pieceStart = 0;
+        for (size_t i = 1; i <= keptCount; ++i) {
+            int cell[3] = { pieceCell[0], pieceCell[1], pieceCell[2] };
+            if (i < keptCount) {
+                cellOf(&kept[i * 3], cell);
+            }
+            const bool cellChanged = cell[0] != pieceCell[0] || cell[1] != pieceCell[1] || cell[2] != pieceCell[2];
+            if (i == keptCount || cellChanged) {
+                const size_t pieceEnd = std::min(i + (cellChanged ? 1 : 0), keptCount);
+                if (pieceEnd - pieceStart >= 2) {
+                    visit(depth, pieceCell, &kept[pieceStart * 3], static_cast<uint32_t>(pieceEnd - pieceStart));
+                    m_fileHeader.pointCount += pieceEnd - pieceStart;
+                }
+                pieceStart = i;
+                std::memcpy(pieceCell, cell, sizeof(cell));
+            }
+        }
+    }
+    m_fileHeader.trackCount = trackIndex;
+    return !stream.file.bad();
+}
+
+void TrackOctreeBuilder::finalizeNodes()
+{
+    // Every ancestor of an occupied node exists, so traversal can reach it from the root
+    for (size_t i = 0; i < m_nodeKeys.size(); ++i) {
+        uint32_t depth;
+        int cell[3];
+        decodeNodeKey(m_nodeKeys[i], depth, cell);
+        while (depth > 0) {
+            --depth;
+            cell[0] >>= 1; cell[1] >>= 1; cell[2] >>= 1;
+            if (m_nodeIndex.count(nodeKey(depth, cell))) {
+                break;
+            }
+            findNode(depth, cell);
+        }
+    }
+
+    // Breadth-first order: by depth, then along the Morton curve; the root is node 0
+    std::vector<uint32_t> order(m_nodes.size());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return m_nodeKeys[a] < m_nodeKeys[b]; });
+
+    std::vector<TrackOctreeNode> nodes(m_nodes.size());
+    std::vector<uint64_t> keys(m_nodes.size());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        nodes[i] = m_nodes[order[i]];
+        keys[i] = m_nodeKeys[order[i]];
+        m_nodeIndex[keys[i]] = i;
+    }
+    m_nodes.swap(nodes);
+    m_nodeKeys.swap(keys);
+
+    // Link children and widen bounds to whole subtrees, deepest nodes first
+    for (size_t i = m_nodes.size(); i-- > 1;) {
+        uint32_t depth;
+        int cell[3];
+        decodeNodeKey(m_nodeKeys[i], depth, cell);
+        const int slot = (cell[0] & 1) | ((cell[1] & 1) << 1) | ((cell[2] & 1) << 2);
+        int parentCell[3] = { cell[0] >> 1, cell[1] >> 1, cell[2] >> 1 };
+        TrackOctreeNode& parent = m_nodes[m_nodeIndex[nodeKey(depth - 1, parentCell)]];
+        parent.children[slot] = static_cast<int32_t>(i);
+        expandBounds(parent, m_nodes[i].boundsMin, m_nodes[i].boundsMax);
+    }
+
+    uint64_t offset = sizeof(TrackOctreeFileHeader) + m_nodes.size() * sizeof(TrackOctreeNode);
+    for (TrackOctreeNode& node : m_nodes) {
+        node.dataOffset = offset;
+        offset += node.dataBytes;
+    }
+    m_fileHeader.nodeCount = static_cast<uint32_t>(m_nodes.size());
+}
+
+bool TrackOctreeBuilder::build(const std::string& trkPath, const std::string& octreePath)
+{
+    const auto start = std::chrono::steady_clock::now();
+    m_lastErrorMessage.clear();
+    m_nodes.clear();
+    m_nodeKeys.clear();
+    m_nodeIndex.clear();
+    std::memset(&m_fileHeader, 0, sizeof(m_fileHeader));
+
+    // Header only; the tracks are streamed below
+    TractographyHeader header;
+    std::ifstream headerFile(trkPath, std::ios::binary | std::ios::ate);
+    if (!headerFile.is_open()) {
+        m_lastErrorMessage = "Cannot open file: " + trkPath;
+        return false;
+    }
+    const uint64_t fileBytes = static_cast<uint64_t>(headerFile.tellg());
+    headerFile.seekg(0, std::ios::beg);
+    if (!headerFile.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::strncmp(header.magic, "TRACK", 5) != 0) {
+        m_lastErrorMessage = "Invalid file format: not a valid TRK file";
+        return false;
+    }
+    headerFile.close();
+
+    // The reference volume extent in voxmm is the root cube
+    float rootSize = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+        rootSize = std::max(rootSize, header.dim[i] * header.voxel_size[i]);
+    }
+    if (!(rootSize > 0.0f)) {
+        m_lastErrorMessage = "Invalid volume dimensions";
+        return false;
+    }
+
+    std::memcpy(m_fileHeader.magic, "TRKOCT1", 8);
+    m_fileHeader.version = 1;
+    m_fileHeader.rootSize = rootSize;
+    if (m_maxDepthOption > 0) {
+        m_fileHeader.maxDepth = static_cast<uint32_t>(m_maxDepthOption);
+    } else {
+        // Assume about a quarter of the leaf cells are occupied
+        const double estimatedPoints = static_cast<double>(fileBytes) / (sizeof(float) * (3 + header.n_scalars));
+        uint32_t depth = 1;
+        while (depth < 8 && estimatedPoints / (std::pow(8.0, depth) * 0.25) > kTargetLeafPoints) {
+            ++depth;
+        }
+        m_fileHeader.maxDepth = depth;
+    }
+
+    // Pass 1: node sizes and bounds
+    TrkStream sizing;
+    if (!sizing.open(trkPath, header)) {
+        m_lastErrorMessage = "Cannot open file: " + trkPath;
+        return false;
+    }
+    bool ok = forEachPiece(sizing, [this](uint32_t depth, const int* cell, const float* xyz, uint32_t count) {
+        TrackOctreeNode& node = m_nodes[findNode(depth, cell)];
+        for (uint32_t i = 0; i < count; ++i) {
+            expandBounds(node, xyz + i * 3, xyz + i * 3);
+        }
+        node.pointCount += count;
+        node.pieceCount++;
+        node.dataBytes += sizeof(uint32_t) + count * 3 * sizeof(float);
+    });
+    if (!ok || m_nodes.empty()) {
+        m_lastErrorMessage = "No tracks could be read from " + trkPath;
+        return false;
+    }
+    finalizeNodes();
+    for (TrackOctreeNode& node : m_nodes) {
+        node.spacing = node.depth < m_fileHeader.maxDepth ? rootSize / (kSpacingDivisions * static_cast<float>(1u << node.depth)) : 0.0f;
+    }
+
+    // Pass 2: the same pieces again, scattered into the node ranges. Written under a temporary
+    // name so a failed or interrupted build never leaves a partial octree at octreePath
+    const std::string tempPath = octreePath + ".tmp";
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        m_lastErrorMessage = "Cannot create file: " + tempPath;
+        return false;
+    }
+    std::error_code error;
+    auto discard = [&](const std::string& message) {
+        out.close();
+        std::filesystem::remove(tempPath, error);
+        m_lastErrorMessage = message;
+        return false;
+    };
+    const uint64_t trackCount = m_fileHeader.trackCount;
+    const uint64_t pointCount = m_fileHeader.pointCount;
+    out.write(reinterpret_cast<const char*>(&m_fileHeader), sizeof(m_fileHeader));
+    out.write(reinterpret_cast<const char*>(m_nodes.data()), static_cast<std::streamsize>(m_nodes.size() * sizeof(TrackOctreeNode)));
+
+    TrkStream writing;
+    if (!writing.open(trkPath, header)) {
+        return discard("Cannot open file: " + trkPath);
+    }
+    PieceWriter writer(out, m_nodes, m_writeBufferBytes);
+    m_fileHeader.pointCount = 0;
+    ok = forEachPiece(writing, [this, &writer](uint32_t depth, const int* cell, const float* xyz, uint32_t count) {
+        writer.append(m_nodeIndex[nodeKey(depth, cell)], xyz, count);
+    });
+    writer.flushAll();
+
+    for (size_t i = 0; ok && i < m_nodes.size(); ++i) {
+        ok = writer.cursors[i] == m_nodes[i].dataOffset + m_nodes[i].dataBytes;
+    }
+    if (!ok || m_fileHeader.trackCount != trackCount || m_fileHeader.pointCount != pointCount) {
+        return discard("Source changed while building the octree: " + trkPath);
+    }
+    out.close();
+    if (!out) {
+        return discard("Failed to write file: " + tempPath);
+    }
+    std::filesystem::rename(tempPath, octreePath, error);
+    if (error) {
+        return discard("Cannot replace file: " + octreePath);
+    }
+
+    m_elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+} // namespace DTIFiberLib
@@ -0,0 +1,555 @@
+#include "../header/TrackROIFilter.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+namespace DTIFiberLib {
+
+namespace {
+
+const size_t kTracksPerBlock = 4096;        // Work unit handed to a thread
+const size_t kVoxelsPerBlock = 4096;
+const size_t kRunsPerThread = 16384;       // Fewer cut-voxel runs are tested on the calling thread
+const size_t kMaxVoxels = size_t(1) << 23;  // The grid coarsens beyond this
+const size_t kMaxRunPoint = (size_t(1) << 24) - 1;  // Points past this in one track are not indexed
+
+// Runs body(thread) on `threadCount` threads, the calling thread being thread 0
+template <typename Body>
+void runThreads(size_t threadCount, const Body& body)
+{
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threadCount; ++i) {
+        threads.emplace_back(body, i);
+    }
+    body(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+inline bool pointInROI(const TrackROI& roi, float x, float y, float z)
+{
+    const float dx = x - roi.center[0];
+    const float dy = y - roi.center[1];
+    const float dz = z - roi.center[2];
+    if (roi.shape == ROIShape::SPHERE) {
+        return dx * dx + dy * dy + dz * dz <= roi.size[0] * roi.size[0];
+    }
+    return std::fabs(dx) <= roi.size[0] && std::fabs(dy) <= roi.size[1] && std::fabs(dz) <= roi.size[2];
+}
+
+// Axis-aligned bounds of the ROI
+inline void roiBounds(const TrackROI& roi, float* lower, float* upper)
+{
+    for (int a = 0; a < 3; ++a) {
+        const float extent = roi.shape == ROIShape::SPHERE ? roi.size[0] : roi.size[a];
+        lower[a] = roi.center[a] - extent;
+        upper[a] = roi.center[a] + extent;
+    }
+}
+
+enum class Overlap { OUTSIDE, PARTIAL, INSIDE };
+
+Overlap voxelOverlap(const TrackROI& roi, const float* lower, const float* upper)
+{
+    if (roi.shape == ROIShape::BOX) {
+        bool inside = true;
+        for (int a = 0; a < 3; ++a) {
+            const float boxLower = roi.center[a] - roi.size[a];
+            const float boxUpper = roi.center[a] + roi.size[a];
+            if (upper[a] < boxLower || lower[a] > boxUpper) return Overlap::OUTSIDE;
+            inside = inside && lower[a] >= boxLower && upper[a] <= boxUpper;
+        }
+        return inside ? Overlap::INSIDE : Overlap::PARTIAL;
+    }
+
+    // Nearest and farthest voxel points from the center
+    float nearest = 0.0f;
+    float farthest = 0.0f;
+    for (int a = 0; a < 3; ++a) {
+        const float toLower = roi.center[a] - lower[a];
+        const float toUpper = upper[a] - roi.center[a];
+        const float gap = std::max(std::max(-toLower, -toUpper), 0.0f);
+        const float far = std::max(toLower, toUpper);
+        nearest += gap * gap;
+        farthest += far * far;
+    }
+    const float radius2 = roi.size[0] * roi.size[0];
+    if (nearest > radius2) return Overlap::OUTSIDE;
+    return farthest <= radius2 ? Overlap::INSIDE : Overlap::PARTIAL;
+}
+
+} // namespace
+
+TrackROIFilter::TrackROIFilter()
+    : m_threadCount(0)
+    , m_voxelSize(4.0f)
+    , m_gridVoxelSize(4.0f)
+    , m_gridInverseSize(0.25f)
+    , m_includeCount(0)
+    , m_selectedCount(0)
+    , m_resultDirty(true)
+    , m_countersDirty(true)
+    , m_buildMs(0.0)
+    , m_evaluateMs(0.0)
+{
+    std::memset(m_gridOrigin, 0, sizeof(m_gridOrigin));
+    std::memset(m_gridDims, 0, sizeof(m_gridDims));
+}
+
+void TrackROIFilter::setThreadCount(int threads)
+{
+    m_threadCount = std::max(threads, 0);
+}
+
+void TrackROIFilter::setVoxelSize(float size)
+{
+    m_voxelSize = std::max(size, 0.1f);
+}
+
+size_t TrackROIFilter::threadCount(size_t items, size_t itemsPerThread) const
+{
+    size_t threads = m_threadCount > 0 ? static_cast<size_t>(m_threadCount) : std::thread::hardware_concurrency();
+    return std::max<size_t>(std::min(threads, (items + itemsPerThread - 1) / itemsPerThread), 1);
+}
+
+const FiberTrack* TrackROIFilter::findTrack(uint32_t sourceIndex) const
+{
+    if (sourceIndex < m_tracks->size()) {
+        return &(*m_tracks)[sourceIndex];
+    }
+    const size_t offset = sourceIndex - m_tracks->size();
+    return m_appended && offset < m_appended->size() ? &(*m_appended)[offset] : nullptr;
+}
+
+void TrackROIFilter::clear()
+{
+    m_tracks.reset();
+    m_appended.reset();
+    m_selection.clear();
+    m_voxelStarts.clear();
+    m_voxelRuns.clear();
+    m_includeHits.clear();
+    m_excludeHits.clear();
+    m_scratch.clear();
+    m_result.clear();
+    m_changedTracks.clear();
+    m_selectedCount = 0;
+    std::memset(m_gridDims, 0, sizeof(m_gridDims));
+    for (ROIState& state : m_rois) {
+        state.hits.clear();
+        state.hitList.clear();
+        state.dirty = true;
+    }
+    m_resultDirty = true;
+    m_countersDirty = true;
+}
+
+size_t TrackROIFilter::voxelOf(const TrackPoint& point, uint32_t& cell) const
+{
+    // Half-voxel coordinates: the low bit picks the sub-voxel
+    const float scale = m_gridInverseSize * 2.0f;
+    const int i = std::min(static_cast<int>((point.x - m_gridOrigin[0]) * scale), m_gridDims[0] * 2 - 1);
+    const int j = std::min(static_cast<int>((point.y - m_gridOrigin[1]) * scale), m_gridDims[1] * 2 - 1);
+    const int k = std::min(static_cast<int>((point.z - m_gridOrigin[2]) * scale), m_gridDims[2] * 2 - 1);
+    cell = static_cast<uint32_t>((i & 1) | ((j & 1) << 1) | ((k & 1) << 2));
+    return (static_cast<size_t>(k >> 1) * m_gridDims[1] + (j >> 1)) * m_gridDims[0] + (i >> 1);
+}
+
+bool TrackROIFilter::build(std::shared_ptr<const std::vector<FiberTrack>> tracks, std::vector<uint32_t> selection,
+                           std::shared_ptr<const std::vector<FiberTrack>> appended)
+{
+    clear();
+    if (!tracks) {
+        std::cerr << "ROI filter: no track data" << std::endl;
+        return false;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    m_tracks = std::move(tracks);
+    m_appended = std::move(appended);
+    m_selection = std::move(selection);
+    const size_t trackCount = m_selection.size();
+    const size_t trackBlocks = (trackCount + kTracksPerBlock - 1) / kTracksPerBlock;
+    const size_t threads = threadCount(trackCount, kTracksPerBlock);
+
+    // Data bounds from per-thread partials
+    const float inf = std::numeric_limits<float>::infinity();
+    std::vector<float> threadBounds(threads * 6);
+    std::atomic<size_t> nextBlock(0);
+    runThreads(threads, [&](size_t thread) {
+        float lower[3] = { inf, inf, inf };
+        float upper[3] = { -inf, -inf, -inf };
+        for (size_t block = nextBlock++; block < trackBlocks; block = nextBlock++) {
+            const size_t last = std::min(trackCount, (block + 1) * kTracksPerBlock);
+            for (size_t t = block * kTracksPerBlock; t < last; ++t) {
+                const FiberTrack* track = findTrack(m_selection[t]);
+                if (!track) continue;
+                for (const TrackPoint& point : *track) {
+                    lower[0] = std::min(lower[0], point.x);
+                    lower[1] = std::min(lower[1], point.y);
+                    lower[2] = std::min(lower[2], point.z);
+                    upper[0] = std::max(upper[0], point.x);
+                    upper[1] = std::max(upper[1], point.y);
+                    upper[2] = std::max(upper[2], point.z);
+                }
+            }
+        }
+        std::copy(lower, lower + 3, &threadBounds[thread * 6]);
+        std::copy(upper, upper + 3, &threadBounds[thread * 6 + 3]);
+    });
+    float lower[3] = { inf, inf, inf };
+    float upper[3] = { -inf, -inf, -inf };
+    for (size_t i = 0; i < threads; ++i) {
+        for (int a = 0; a < 3; ++a) {
+            lower[a] = std::min(lower[a], threadBounds[i * 6 + a]);
+            upper[a] = std::max(upper[a], threadBounds[i * 6 + 3 + a]);
+        }
+    }
+    if (!(lower[0] <= upper[0])) {
+        lower[0] = lower[1] = lower[2] = 0.0f;     // No points at all
+        upper[0] = upper[1] = upper[2] = 0.0f;
+    }
+
+    // Grid over the data, coarsened until it fits the voxel limit
+    m_gridVoxelSize = m_voxelSize;
+    size_t voxelCount = 0;
+    for (;;) {
+        voxelCount = 1;
+        for (int a = 0; a < 3; ++a) {
+            m_gridOrigin[a] = lower[a];
+            m_gridDims[a] = static_cast<int>(std::floor((upper[a] - lower[a]) / m_gridVoxelSize)) + 1;
+            voxelCount *= static_cast<size_t>(m_gridDims[a]);
+        }
+        if (voxelCount <= kMaxVoxels) break;
+        m_gridVoxelSize *= 1.5f;
+    }
+    m_gridInverseSize = 1.0f / m_gridVoxelSize;
+
+    // Calls emit(voxel, run) for every run of consecutive points in one voxel
+    auto forEachRun = [&](size_t t, const auto& emit) {
+        const FiberTrack* found = findTrack(m_selection[t]);
+        if (!found) return;
+        const FiberTrack& track = *found;
+        const size_t pointCount = std::min(track.size(), kMaxRunPoint);
+        VoxelRun run;
+        run.track = static_cast<uint32_t>(t);
+        size_t runVoxel = voxelCount;
+        for (size_t p = 0; p < pointCount; ++p) {
+            uint32_t cell;
+            const size_t voxel = voxelOf(track[p], cell);
+            if (voxel != runVoxel) {
+                if (runVoxel != voxelCount) emit(runVoxel, run);
+                run.firstPoint = static_cast<uint32_t>(p);
+                run.cells = 0;
+                runVoxel = voxel;
+            }
+            run.cells |= 1u << cell;
+        }
+        if (runVoxel != voxelCount) emit(runVoxel, run);
+    };
+
+    // Count runs per voxel, then scatter them into the CSR lists
+    std::vector<std::atomic<uint32_t>> counts(voxelCount);
+    for (auto& count : counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    nextBlock = 0;
+    runThreads(threads, [&](size_t) {
+        for (size_t block = nextBlock++; block < trackBlocks; block = nextBlock++) {
+            const size_t last = std::min(trackCount, (block + 1) * kTracksPerBlock);
+            for (size_t t = block * kTracksPerBlock; t < last; ++t) {
+                forEachRun(t, [&](size_t voxel, const VoxelRun&) { counts[voxel].fetch_add(1, std::memory_order_relaxed); });
+            }
+        }
+    });
+    m_voxelStarts.resize(voxelCount + 1);
+    m_voxelStarts[0] = 0;
+    for (size_t v = 0; v < voxelCount; ++v) {
+        m_voxelStarts[v + 1] = m_voxelStarts[v] + counts[v].load(std::memory_order_relaxed);
+        counts[v].store(0, std::memory_order_relaxed);
+    }
+    m_voxelRuns.resize(m_voxelStarts[voxelCount]);
+    nextBlock = 0;
+    runThreads(threads, [&](size_t) {
+        for (size_t block = nextBlock++; block < trackBlocks; block = nextBlock++) {
+            const size_t last = std::min(trackCount, (block + 1) * kTracksPerBlock);
+            for (size_t t = block * kTracksPerBlock; t < last; ++t) {
+                forEachRun(t, [&](size_t voxel, const VoxelRun& run) {
+                    m_voxelRuns[m_voxelStarts[voxel] + counts[voxel].fetch_add(1, std::memory_order_relaxed)] = run;
+                });
+            }
+        }
+    });
+
+    // Scatter order depends on thread timing; runs ordered by track do not
+    const size_t voxelBlocks = (voxelCount + kVoxelsPerBlock - 1) / kVoxelsPerBlock;
+    std::atomic<size_t> nextVoxelBlock(0);
+    runThreads(threads, [&](size_t) {
+        for (size_t block = nextVoxelBlock++; block < voxelBlocks; block = nextVoxelBlock++) {
+            const size_t last = std::min(voxelCount, (block + 1) * kVoxelsPerBlock);
+            for (size_t v = block * kVoxelsPerBlock; v < last; ++v) {
+                std::sort(m_voxelRuns.begin() + m_voxelStarts[v], m_voxelRuns.begin() + m_voxelStarts[v + 1],
+                          [](const VoxelRun& a, const VoxelRun& b) {
+                              return a.track != b.track ? a.track < b.track : a.firstPoint < b.firstPoint;
+                          });
+            }
+        }
+    });
+
+    // Every present track passes until ROIs say otherwise
+    m_scratch.assign(trackCount, 0);
+    m_result.resize(trackCount);
+    m_selectedCount = 0;
+    for (size_t t = 0; t < trackCount; ++t) {
+        m_result[t] = findTrack(m_selection[t]) ? 1 : 0;
+        m_selectedCount += m_result[t];
+    }
+
+    m_buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+size_t TrackROIFilter::addROI(const TrackROI& roi)
+{
+    ROIState state;
+    state.roi = roi;
+    state.dirty = true;
+    m_rois.push_back(std::move(state));
+    m_resultDirty = true;
+    m_countersDirty = true;
+    return m_rois.size() - 1;
+}
+
+void TrackROIFilter::setROI(size_t index, const TrackROI& roi)
+{
+    if (index >= m_rois.size()) return;
+
+    ROIState& state = m_rois[index];
+    if (std::memcmp(&state.roi, &roi, sizeof(TrackROI)) == 0) return;
+    if (state.roi.mode != roi.mode) {
+        m_countersDirty = true;
+    }
+    state.roi = roi;
+    state.dirty = true;
+    m_resultDirty = true;
+}
+
+void TrackROIFilter::removeROI(size_t index)
+{
+    if (index >= m_rois.size()) return;
+
+    m_rois.erase(m_rois.begin() + index);
+    m_resultDirty = true;
+    m_countersDirty = true;
+}
+
+void TrackROIFilter::clearROIs()
+{
+    m_rois.clear();
+    m_resultDirty = true;
+    m_countersDirty = true;
+}
+
+bool TrackROIFilter::runHits(const VoxelRun& run, size_t voxel, const TrackROI& roi) const
+{
+    const FiberTrack& track = *findTrack(m_selection[run.track]);
+    for (size_t p = run.firstPoint; p < track.size(); ++p) {
+        const TrackPoint& point = track[p];
+        uint32_t cell;
+        if (voxelOf(point, cell) != voxel) break;
+        if (pointInROI(roi, point.x, point.y, point.z)) return true;
+    }
+    return false;
+}
+
+void TrackROIFilter::collectHits(const TrackROI& roi, std::vector<uint32_t>& hits)
+{
+    hits.clear();
+    if (m_voxelStarts.empty()) return;
+
+    // Voxel range covering the ROI
+    float lower[3], upper[3];
+    roiBounds(roi, lower, upper);
+    int first[3], last[3];
+    for (int a = 0; a < 3; ++a) {
+        first[a] = std::max(static_cast<int>(std::floor((lower[a] - m_gridOrigin[a]) * m_gridInverseSize)), 0);
+        last[a] = std::min(static_cast<int>(std::floor((upper[a] - m_gridOrigin[a]) * m_gridInverseSize)), m_gridDims[a] - 1);
+        if (first[a] > last[a]) return;
+    }
+
+    // Interior voxels pass their tracks outright; cut voxels are classified per sub-voxel
+    struct CutVoxel {
+        size_t voxel;
+        uint32_t insideCells;
+        uint32_t cutCells;
+    };
+    std::vector<CutVoxel> cutVoxels;
+    size_t cutRuns = 0;
+    const float half = m_gridVoxelSize * 0.5f;
+    auto mark = [&](uint32_t track) {
+        if (!m_scratch[track]) {
+            m_scratch[track] = 1;
+            hits.push_back(track);
+        }
+    };
+    for (int k = first[2]; k <= last[2]; ++k) {
+        for (int j = first[1]; j <= last[1]; ++j) {
+            for (int i = first[0]; i <= last[0]; ++i) {
+                const float voxelLower[3] = { m_gridOrigin[0] + i * m_gridVoxelSize, m_gridOrigin[1] + j * m_gridVoxelSize,
+                                              m_gridOrigin[2] + k * m_gridVoxelSize };
+                const float voxelUpper[3] = { voxelLower[0] + m_gridVoxelSize, voxelLower[1] + m_gridVoxelSize,
+                                              voxelLower[2] + m_gridVoxelSize };
+                const Overlap overlap = voxelOverlap(roi, voxelLower, voxelUpper);
+                if (overlap == Overlap::OUTSIDE) continue;
+
+                const size_t voxel = (static_cast<size_t>(k) * m_gridDims[1] + j) * m_gridDims[0] + i;
+                if (overlap == Overlap::INSIDE) {
+                    for (size_t e = m_voxelStarts[voxel]; e < m_voxelStarts[voxel + 1]; ++e) {
+                        mark(m_voxelRuns[e].track);
+                    }
+                    continue;
+                }
+                CutVoxel cut = { voxel, 0, 0 };
+                for (uint32_t cell = 0; cell < 8; ++cell) {
+                    float cellLower[3], cellUpper[3];
+                    for (int a = 0; a < 3; ++a) {
+                        cellLower[a] = voxelLower[a] + ((cell >> a) & 1) * half;
+                        cellUpper[a] = cellLower[a] + half;
+                    }
+                    const Overlap cellOverlap = voxelOverlap(roi, cellLower, cellUpper);
+                    if (cellOverlap == Overlap::INSIDE) cut.insideCells |= 1u << cell;
+                    if (cellOverlap == Overlap::PARTIAL) cut.cutCells |= 1u << cell;
+                }
+                cutVoxels.push_back(cut);
+                cutRuns += m_voxelStarts[voxel + 1] - m_voxelStarts[voxel];
+            }
+        }
+    }
+
+    // Threads take cut voxels in turn and only read m_scratch; their hits are merged after
+    const size_t threads = threadCount(cutRuns, kRunsPerThread);
+    std::vector<std::vector<uint32_t>> threadHits(threads);
+    std::atomic<size_t> nextVoxel(0);
+    runThreads(threads, [&](size_t thread) {
+        std::vector<uint32_t>& found = threadHits[thread];
+        for (size_t v = nextVoxel++; v < cutVoxels.size(); v = nextVoxel++) {
+            const CutVoxel& cut = cutVoxels[v];
+            for (size_t e = m_voxelStarts[cut.voxel]; e < m_voxelStarts[cut.voxel + 1]; ++e) {
+                const VoxelRun& run = m_voxelRuns[e];
+                if (m_scratch[run.track]) continue;
+                if ((run.cells & cut.insideCells) || ((run.cells & cut.cutCells) && runHits(run, cut.voxel, roi))) {
+                    found.push_back(run.track);
+                }
+            }
+        }
+    });
+    for (const std::vector<uint32_t>& found : threadHits) {
+        for (uint32_t track : found) {
+            mark(track);
+        }
+    }
+}
+
+void TrackROIFilter::updateHits(ROIState& state, std::vector<uint32_t>& touched)
+{
+    std::vector<uint32_t> hits;
+    collectHits(state.roi, hits);
+    state.dirty = false;
+    if (state.hits.size() != m_selection.size()) {
+        state.hits.assign(m_selection.size(), 0);
+        state.hitList.clear();
+    }
+
+    // Only tracks entering or leaving the ROI change its counters; m_scratch marks the new hits
+    std::vector<uint16_t>& counters = state.roi.mode == ROIMode::INCLUDE ? m_includeHits : m_excludeHits;
+    const bool counted = !m_countersDirty;
+    for (uint32_t track : state.hitList) {
+        if (!m_scratch[track]) {
+            state.hits[track] = 0;
+            if (counted) {
+                counters[track]--;
+                touched.push_back(track);
+            }
+        }
+    }
+    for (uint32_t track : hits) {
+        m_scratch[track] = 0;
+        if (!state.hits[track]) {
+            state.hits[track] = 1;
+            if (counted) {
+                counters[track]++;
+                touched.push_back(track);
+            }
+        }
+    }
+    state.hitList.swap(hits);
+}
+
+void TrackROIFilter::rebuildCounters()
+{
+    m_includeHits.assign(m_selection.size(), 0);
+    m_excludeHits.assign(m_selection.size(), 0);
+    m_includeCount = 0;
+    for (const ROIState& state : m_rois) {
+        const bool include = state.roi.mode == ROIMode::INCLUDE;
+        std::vector<uint16_t>& counters = include ? m_includeHits : m_excludeHits;
+        for (uint32_t track : state.hitList) {
+            counters[track]++;
+        }
+        m_includeCount += include ? 1 : 0;
+    }
+    m_countersDirty = false;
+}
+
+const std::vector<uint8_t>& TrackROIFilter::evaluate()
+{
+    m_changedTracks.clear();
+    if (!m_resultDirty || !isBuilt()) {
+        return m_result;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const size_t sourceSize = m_tracks->size() + (m_appended ? m_appended->size() : 0);
+    auto passes = [&](size_t t) -> uint8_t {
+        return m_selection[t] < sourceSize && m_includeHits[t] == m_includeCount && m_excludeHits[t] == 0 ? 1 : 0;
+    };
+
+    // A moved ROI touches only its changed tracks; added, removed or retyped ROIs recount everything
+    std::vector<uint32_t> touched;
+    for (ROIState& state : m_rois) {
+        if (state.dirty) {
+            updateHits(state, touched);
+        }
+    }
+    if (m_countersDirty) {
+        rebuildCounters();
+        for (size_t t = 0; t < m_result.size(); ++t) {
+            const uint8_t pass = passes(t);
+            if (pass != m_result[t]) {
+                m_result[t] = pass;
+                m_changedTracks.push_back(static_cast<uint32_t>(t));
+            }
+        }
+    } else {
+        for (uint32_t track : touched) {
+            const uint8_t pass = passes(track);
+            if (pass != m_result[track]) {
+                m_result[track] = pass;
+                m_changedTracks.push_back(track);
+            }
+        }
+    }
+    for (uint32_t track : m_changedTracks) {
+        m_selectedCount = m_result[track] ? m_selectedCount + 1 : m_selectedCount - 1;
+    }
+
+    m_resultDirty = false;
+    m_evaluateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return m_result;
+}
+
+} // namespace DTIFiberLib
@@ -0,0 +1,293 @@
+#include "../header/TrackSampler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+namespace DTIFiberLib {
+
+namespace {
+
+const size_t kTracksPerBlock = 4096;    // Work unit handed to a thread
+const size_t kCellsPerBlock = 256;
+const uint64_t kEmptyTrackKey = ~uint64_t(0);
+
+inline uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// 21 bits per axis, offset so negative coordinates stay distinct
+inline uint64_t packCell(float x, float y, float z, float inverseSize)
+{
+    const uint64_t mask = (uint64_t(1) << 21) - 1;
+    const int64_t offset = int64_t(1) << 20;
+    const uint64_t i = static_cast<uint64_t>(static_cast<int64_t>(std::floor(x * inverseSize)) + offset) & mask;
+    const uint64_t j = static_cast<uint64_t>(static_cast<int64_t>(std::floor(y * inverseSize)) + offset) & mask;
+    const uint64_t k = static_cast<uint64_t>(static_cast<int64_t>(std::floor(z * inverseSize)) + offset) & mask;
+    return i | (j << 21) | (k << 42);
+}
+
+// Runs body(thread) on `threadCount` threads, the calling thread being thread 0
+template <typename Body>
+void runThreads(size_t threadCount, const Body& body)
+{
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threadCount; ++i) {
+        threads.emplace_back(body, i);
+    }
+    body(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+} // namespace
+
+TrackSampler::TrackSampler()
+    : m_seed(0x5EEDu)
+    , m_threadCount(0)
+    , m_cellSize(10.0f)
+    , m_orientationBins(4)
+    , m_cellCount(0)
+    , m_elapsedMs(0.0)
+{
+}
+
+void TrackSampler::setThreadCount(int threads)
+{
+    m_threadCount = std::max(threads, 0);
+}
+
+void TrackSampler::setCellSize(float size)
+{
+    m_cellSize = std::max(size, 1e-3f);
+}
+
+void TrackSampler::setOrientationBins(int bins)
+{
+    m_orientationBins = std::max(bins, 1);
+}
+
+std::vector<uint32_t> TrackSampler::selectAll(size_t trackCount)
+{
+    std::vector<uint32_t> selection(trackCount);
+    for (size_t i = 0; i < trackCount; ++i) {
+        selection[i] = static_cast<uint32_t>(i);
+    }
+    return selection;
+}
+
+std::vector<uint32_t> TrackSampler::selectRandom(size_t trackCount, size_t count) const
+{
+    if (count >= trackCount) {
+        return selectAll(trackCount);
+    }
+
+    // Selection sampling (Knuth's algorithm S): one pass, indices come out ascending
+    std::vector<uint32_t> selection;
+    selection.reserve(count);
+    std::mt19937_64 generator(m_seed);
+    size_t remaining = count;
+    for (size_t i = 0; i < trackCount && remaining > 0; ++i) {
+        std::uniform_int_distribution<size_t> dist(0, trackCount - i - 1);
+        if (dist(generator) < remaining) {
+            selection.push_back(static_cast<uint32_t>(i));
+            remaining--;
+        }
+    }
+    return selection;
+}
+
+uint64_t TrackSampler::cellKey(const FiberTrack& track) const
+{
+    if (track.empty()) {
+        return kEmptyTrackKey;
+    }
+    const TrackPoint& first = track.front();
+    const TrackPoint& last = track.back();
+    const TrackPoint& middle = track[track.size() / 2];
+    const float inverseSize = 1.0f / m_cellSize;
+
+    // Endpoints in either order describe the same track
+    uint64_t a = packCell(first.x, first.y, first.z, inverseSize);
+    uint64_t b = packCell(last.x, last.y, last.z, inverseSize);
+    if (a > b) {
+        std::swap(a, b);
+    }
+    const uint64_t m = packCell(middle.x, middle.y, middle.z, inverseSize);
+
+    // End-to-end direction up to sign: the largest component is made positive
+    float d[3] = { last.x - first.x, last.y - first.y, last.z - first.z };
+    const float length = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    uint64_t orientation = 0;
+    if (length > 0.0f) {
+        const int major = std::fabs(d[0]) >= std::fabs(d[1]) ? (std::fabs(d[0]) >= std::fabs(d[2]) ? 0 : 2)
+                                                              : (std::fabs(d[1]) >= std::fabs(d[2]) ? 1 : 2);
+        const float sign = d[major] < 0.0f ? -1.0f : 1.0f;
+        for (int i = 0; i < 3; ++i) {
+            const float unit = d[i] * sign / length;   // [-1, 1]
+            const int bin = std::min(static_cast<int>((unit + 1.0f) * 0.5f * m_orientationBins), m_orientationBins - 1);
+            orientation = orientation * static_cast<uint64_t>(m_orientationBins) + static_cast<uint64_t>(bin);
+        }
+        orientation++;
+    }
+
+    uint64_t key = splitmix64(a);
+    key = splitmix64(key ^ b);
+    key = splitmix64(key ^ m);
+    key = splitmix64(key ^ orientation);
+    return key == kEmptyTrackKey ? key - 1 : key;
+}
+
+std::vector<uint32_t> TrackSampler::selectStratified(const std::vector<FiberTrack>& tracks, size_t count)
+{
+    const auto start = std::chrono::steady_clock::now();
+    m_cellCount = 0;
+    if (count >= tracks.size()) {
+        // Room for every track: no cells to fill, only the empty ones are left out
+        std::vector<uint32_t> selection;
+        selection.reserve(tracks.size());
+        for (size_t i = 0; i < tracks.size(); ++i) {
+            if (!tracks[i].empty()) {
+                selection.push_back(static_cast<uint32_t>(i));
+            }
+        }
+        m_elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return selection;
+    }
+    const size_t trackCount = tracks.size();
+    size_t threadCount = m_threadCount > 0 ? static_cast<size_t>(m_threadCount) : std::thread::hardware_concurrency();
+    threadCount = std::max<size_t>(std::min(threadCount, (trackCount + kTracksPerBlock - 1) / kTracksPerBlock), 1);
+
+    // Cell key of every track, in parallel blocks
+    std::vector<uint64_t> keys(trackCount);
+    std::atomic<size_t> nextBlock(0);
+    const size_t trackBlocks = (trackCount + kTracksPerBlock - 1) / kTracksPerBlock;
+    runThreads(threadCount, [&](size_t) {
+        for (size_t block = nextBlock++; block < trackBlocks; block = nextBlock++) {
+            const size_t last = std::min(trackCount, (block + 1) * kTracksPerBlock);
+            for (size_t i = block * kTracksPerBlock; i < last; ++i) {
+                keys[i] = cellKey(tracks[i]);
+            }
+        }
+    });
+
+    // Dense cell ids in order of first appearance
+    std::unordered_map<uint64_t, uint32_t> cellIds;
+    std::vector<uint32_t> cellOf(trackCount);
+    std::vector<uint32_t> cellSizes;
+    std::vector<uint64_t> cellKeys;
+    for (size_t i = 0; i < trackCount; ++i) {
+        if (keys[i] == kEmptyTrackKey) {
+            cellOf[i] = ~0u;
+            continue;
+        }
+        auto inserted = cellIds.emplace(keys[i], static_cast<uint32_t>(cellSizes.size()));
+        if (inserted.second) {
+            cellSizes.push_back(0);
+            cellKeys.push_back(keys[i]);
+        }
+        cellOf[i] = inserted.first->second;
+        cellSizes[inserted.first->second]++;
+    }
+    std::vector<uint64_t>().swap(keys);
+    const size_t cellCount = cellSizes.size();
+    m_cellCount = cellCount;
+
+    // Water-filling: the largest quota q with sum(min(size, q)) <= count; leftover slots go
+    // one each to over-quota cells in seeded hash order
+    std::vector<uint32_t> sortedSizes(cellSizes);
+    std::sort(sortedSizes.begin(), sortedSizes.end());
+    size_t remaining = count;
+    size_t quota = sortedSizes.empty() ? 0 : sortedSizes.back();
+    size_t leftover = 0;
+    for (size_t j = 0; j < cellCount; ++j) {
+        const size_t cellsLeft = cellCount - j;
+        if (static_cast<size_t>(sortedSizes[j]) * cellsLeft > remaining) {
+            quota = remaining / cellsLeft;
+            leftover = remaining % cellsLeft;
+            break;
+        }
+        remaining -= sortedSizes[j];
+    }
+    std::vector<uint32_t> cellQuotas(cellCount);
+    std::vector<std::pair<uint64_t, uint32_t>> overQuota;
+    for (size_t c = 0; c < cellCount; ++c) {
+        cellQuotas[c] = static_cast<uint32_t>(std::min<size_t>(cellSizes[c], quota));
+        if (cellSizes[c] > quota) {
+            overQuota.emplace_back(splitmix64(cellKeys[c] ^ m_seed), static_cast<uint32_t>(c));
+        }
+    }
+    if (leftover > 0) {
+        std::nth_element(overQuota.begin(), overQuota.begin() + (leftover - 1), overQuota.end());
+        for (size_t i = 0; i < leftover; ++i) {
+            cellQuotas[overQuota[i].second]++;
+        }
+    }
+
+    // Tracks grouped by cell, ascending within each
+    std::vector<size_t> cellStarts(cellCount + 1, 0);
+    for (size_t c = 0; c < cellCount; ++c) {
+        cellStarts[c + 1] = cellStarts[c] + cellSizes[c];
+    }
+    std::vector<uint32_t> members(cellStarts[cellCount]);
+    {
+        std::vector<size_t> fill(cellStarts.begin(), cellStarts.end() - 1);
+        for (size_t i = 0; i < trackCount; ++i) {
+            if (cellOf[i] != ~0u) {
+                members[fill[cellOf[i]]++] = static_cast<uint32_t>(i);
+            }
+        }
+    }
+
+    // Each over-quota cell keeps the tracks with the lowest seeded hash of their index
+    std::vector<uint8_t> keep(trackCount, 0);
+    std::atomic<size_t> nextCellBlock(0);
+    const size_t cellBlocks = (cellCount + kCellsPerBlock - 1) / kCellsPerBlock;
+    runThreads(std::min(threadCount, std::max<size_t>(cellBlocks, 1)), [&](size_t) {
+        std::vector<std::pair<uint64_t, uint32_t>> ranked;
+        for (size_t block = nextCellBlock++; block < cellBlocks; block = nextCellBlock++) {
+            const size_t lastCell = std::min(cellCount, (block + 1) * kCellsPerBlock);
+            for (size_t c = block * kCellsPerBlock; c < lastCell; ++c) {
+                const uint32_t* first = members.data() + cellStarts[c];
+                const size_t size = cellSizes[c];
+                const size_t keepCount = cellQuotas[c];
+                if (keepCount >= size) {
+                    for (size_t i = 0; i < size; ++i) {
+                        keep[first[i]] = 1;
+                    }
+                    continue;
+                }
+                if (keepCount == 0) continue;
+                ranked.resize(size);
+                for (size_t i = 0; i < size; ++i) {
+                    ranked[i] = std::make_pair(splitmix64(m_seed ^ (uint64_t(first[i]) * 0xD6E8FEB86659FD93ull)), first[i]);
+                }
+                std::nth_element(ranked.begin(), ranked.begin() + (keepCount - 1), ranked.end());
+                for (size_t i = 0; i < keepCount; ++i) {
+                    keep[ranked[i].second] = 1;
+                }
+            }
+        }
+    });
+
+    std::vector<uint32_t> selection;
+    selection.reserve(count);
+    for (size_t i = 0; i < trackCount; ++i) {
+        if (keep[i]) {
+            selection.push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    m_elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return selection;
+}
+
+} // namespace DTIFiberLib
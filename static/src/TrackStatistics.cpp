@@ -0,0 +1,416 @@
+#include "../header/TrackStatistics.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DTIFIBERLIB_STATS_SSE2
+#endif
+
+namespace DTIFiberLib {
+
+namespace {
+
+const size_t kTracksPerBlock = 1024;        // Work unit handed to a thread
+const int kRadixBits = 11;                  // Three passes over the 32-bit sort keys
+const uint32_t kRadixMask = (1u << kRadixBits) - 1;
+
+// Runs body(thread) on `threadCount` threads, the calling thread being thread 0
+template <typename Body>
+void runThreads(size_t threadCount, const Body& body)
+{
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threadCount; ++i) {
+        threads.emplace_back(body, i);
+    }
+    body(0);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+#if defined(DTIFIBERLIB_STATS_SSE2)
+inline float horizontalSum(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+#endif
+
+float sum(const float* v, size_t n)
+{
+    float total = 0.0f;
+    size_t i = 0;
+#if defined(DTIFIBERLIB_STATS_SSE2)
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm_add_ps(acc, _mm_loadu_ps(v + i));
+    }
+    total = horizontalSum(acc);
+#endif
+    for (; i < n; ++i) {
+        total += v[i];
+    }
+    return total;
+}
+
+// n >= 1
+void minMax(const float* v, size_t n, float& lower, float& upper)
+{
+    lower = upper = v[0];
+    size_t i = 0;
+#if defined(DTIFIBERLIB_STATS_SSE2)
+    if (n >= 4) {
+        __m128 lo = _mm_loadu_ps(v);
+        __m128 hi = lo;
+        for (i = 4; i + 4 <= n; i += 4) {
+            const __m128 x = _mm_loadu_ps(v + i);
+            lo = _mm_min_ps(lo, x);
+            hi = _mm_max_ps(hi, x);
+        }
+        lo = _mm_min_ps(lo, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(1, 0, 3, 2)));
+        lo = _mm_min_ps(lo, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(2, 3, 0, 1)));
+        hi = _mm_max_ps(hi, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(1, 0, 3, 2)));
+        hi = _mm_max_ps(hi, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(2, 3, 0, 1)));
+        lower = _mm_cvtss_f32(lo);
+        upper = _mm_cvtss_f32(hi);
+    }
+#endif
+    for (; i < n; ++i) {
+        lower = std::min(lower, v[i]);
+        upper = std::max(upper, v[i]);
+    }
+}
+
+// Sum of the n - 1 segment lengths
+float polylineLength(const float* x, const float* y, const float* z, size_t n)
+{
+    float total = 0.0f;
+    size_t i = 0;
+#if defined(DTIFIBERLIB_STATS_SSE2)
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 5 <= n; i += 4) {
+        const __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + i + 1), _mm_loadu_ps(x + i));
+        const __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + i + 1), _mm_loadu_ps(y + i));
+        const __m128 dz = _mm_sub_ps(_mm_loadu_ps(z + i + 1), _mm_loadu_ps(z + i));
+        acc = _mm_add_ps(acc, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz))));
+    }
+    total = horizontalSum(acc);
+#endif
+    for (; i + 1 < n; ++i) {
+        const float dx = x[i + 1] - x[i], dy = y[i + 1] - y[i], dz = z[i + 1] - z[i];
+        total += std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+    return total;
+}
+
+// Curvature of the circle through three points: 2 |a x b| / (|a| |b| |a + b|), 0 when degenerate
+inline float mengerCurvature(float ax, float ay, float az, float bx, float by, float bz)
+{
+    const float cx = ay * bz - az * by, cy = az * bx - ax * bz, cz = ax * by - ay * bx;
+    const float sx = ax + bx, sy = ay + by, sz = az + bz;
+    const float denominator = (ax * ax + ay * ay + az * az) * (bx * bx + by * by + bz * bz) * (sx * sx + sy * sy + sz * sz);
+    return denominator > 1e-30f ? 2.0f * std::sqrt((cx * cx + cy * cy + cz * cz) / denominator) : 0.0f;
+}
+
+// Sum of the curvatures at the n - 2 interior points
+float curvatureSum(const float* x, const float* y, const float* z, size_t n)
+{
+    float total = 0.0f;
+    size_t i = 0;
+#if defined(DTIFIBERLIB_STATS_SSE2)
+    const __m128 tiny = _mm_set1_ps(1e-30f);
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 6 <= n; i += 4) {
+        const __m128 x1 = _mm_loadu_ps(x + i + 1), y1 = _mm_loadu_ps(y + i + 1), z1 = _mm_loadu_ps(z + i + 1);
+        const __m128 ax = _mm_sub_ps(x1, _mm_loadu_ps(x + i));
+        const __m128 ay = _mm_sub_ps(y1, _mm_loadu_ps(y + i));
+        const __m128 az = _mm_sub_ps(z1, _mm_loadu_ps(z + i));
+        const __m128 bx = _mm_sub_ps(_mm_loadu_ps(x + i + 2), x1);
+        const __m128 by = _mm_sub_ps(_mm_loadu_ps(y + i + 2), y1);
+        const __m128 bz = _mm_sub_ps(_mm_loadu_ps(z + i + 2), z1);
+        const __m128 cx = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by));
+        const __m128 cy = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz));
+        const __m128 cz = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx));
+        const __m128 sx = _mm_add_ps(ax, bx), sy = _mm_add_ps(ay, by), sz = _mm_add_ps(az, bz);
+        const __m128 aa = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, ax), _mm_mul_ps(ay, ay)), _mm_mul_ps(az, az));
+        const __m128 bb = _mm_add_ps(_mm_add_ps(_mm_mul_ps(bx, bx), _mm_mul_ps(by, by)), _mm_mul_ps(bz, bz));
+        const __m128 ss = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, sx), _mm_mul_ps(sy, sy)), _mm_mul_ps(sz, sz));
+        const __m128 cc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)), _mm_mul_ps(cz, cz));
+        const __m128 denominator = _mm_mul_ps(_mm_mul_ps(aa, bb), ss);
+        const __m128 valid = _mm_cmpgt_ps(denominator, tiny);
+        const __m128 curvature = _mm_sqrt_ps(_mm_div_ps(cc, _mm_max_ps(denominator, tiny)));
+        acc = _mm_add_ps(acc, _mm_and_ps(valid, curvature));
+    }
+    total = 2.0f * horizontalSum(acc);
+#endif
+    for (; i + 2 < n; ++i) {
+        total += mengerCurvature(x[i + 1] - x[i], y[i + 1] - y[i], z[i + 1] - z[i],
+                                 x[i + 2] - x[i + 1], y[i + 2] - y[i + 1], z[i + 2] - z[i + 1]);
+    }
+    return total;
+}
+
+// Unsigned key with the order of the float value
+inline uint32_t sortKey(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+// Stable LSD radix sort of the tracks by value; tracks come in ascending, so ties stay by track
+void sortByValue(const std::vector<float>& values, std::vector<uint32_t>& tracks)
+{
+    const size_t n = tracks.size();
+    std::vector<uint32_t> keys(n), keysOut(n), tracksOut(n);
+    for (size_t i = 0; i < n; ++i) {
+        keys[i] = sortKey(values[tracks[i]]);
+    }
+    std::vector<size_t> offsets(size_t(1) << kRadixBits);
+    for (int shift = 0; shift < 32; shift += kRadixBits) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (size_t i = 0; i < n; ++i) {
+            offsets[(keys[i] >> shift) & kRadixMask]++;
+        }
+        if (offsets[(keys.empty() ? 0 : keys[0] >> shift) & kRadixMask] == n) {
+            continue;   // One bucket: this digit is the same everywhere
+        }
+        size_t position = 0;
+        for (size_t& offset : offsets) {
+            const size_t count = offset;
+            offset = position;
+            position += count;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            const size_t target = offsets[(keys[i] >> shift) & kRadixMask]++;
+            keysOut[target] = keys[i];
+            tracksOut[target] = tracks[i];
+        }
+        keys.swap(keysOut);
+        tracks.swap(tracksOut);
+    }
+}
+
+} // namespace
+
+TrackStatistics::TrackStatistics()
+    : m_threadCount(0)
+    , m_trackCount(0)
+    , m_buildMs(0.0)
+{
+}
+
+void TrackStatistics::setThreadCount(int threads)
+{
+    m_threadCount = std::max(threads, 0);
+}
+
+size_t TrackStatistics::threadCount(size_t items, size_t itemsPerThread) const
+{
+    size_t threads = m_threadCount > 0 ? static_cast<size_t>(m_threadCount) : std::thread::hardware_concurrency();
+    return std::max<size_t>(std::min(threads, (items + itemsPerThread - 1) / itemsPerThread), 1);
+}
+
+void TrackStatistics::clear()
+{
+    m_trackCount = 0;
+    m_columns.clear();
+    m_sortedTracks.clear();
+    m_unsortedTracks.clear();
+}
+
+std::string TrackStatistics::getColumnName(size_t column) const
+{
+    static const char* kNames[] = { "length", "points", "mean curvature",
+                                    "min x", "min y", "min z", "max x", "max y", "max z",
+                                    "start x", "start y", "start z", "end x", "end y", "end z" };
+    if (column < SCALAR_MEAN) {
+        return kNames[column];
+    }
+    return "scalar " + std::to_string(column - SCALAR_MEAN) + " mean";
+}
+
+bool TrackStatistics::build(const std::vector<FiberTrack>& tracks, const std::vector<uint32_t>& selection,
+                            const std::vector<FiberTrack>* appended)
+{
+    clear();
+    const auto start = std::chrono::steady_clock::now();
+    const size_t trackCount = selection.size();
+    auto findTrack = [&](uint32_t index) -> const FiberTrack* {
+        if (index < tracks.size()) {
+            return &tracks[index];
+        }
+        const size_t offset = index - tracks.size();
+        return appended && offset < appended->size() ? &(*appended)[offset] : nullptr;
+    };
+
+    // Scalars per point, from the first point of the data
+    size_t scalarCount = 0;
+    for (uint32_t index : selection) {
+        const FiberTrack* track = findTrack(index);
+        if (track && !track->empty()) {
+            scalarCount = (*track)[0].scalars.size();
+            break;
+        }
+    }
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    m_trackCount = trackCount;
+    m_columns.assign(SCALAR_MEAN + scalarCount, std::vector<float>(trackCount, nan));
+    m_sortedTracks.resize(m_columns.size());
+
+    // Each track is gathered into coordinate (and scalar) arrays, then reduced column by column
+    const size_t trackBlocks = (trackCount + kTracksPerBlock - 1) / kTracksPerBlock;
+    const size_t threads = threadCount(trackCount, kTracksPerBlock);
+    std::vector<std::vector<uint32_t>> threadEmpty(threads);
+    std::atomic<size_t> nextBlock(0);
+    runThreads(threads, [&](size_t thread) {
+        std::vector<float> x, y, z, scalars;
+        for (size_t block = nextBlock++; block < trackBlocks; block = nextBlock++) {
+            const size_t last = std::min(trackCount, (block + 1) * kTracksPerBlock);
+            for (size_t t = block * kTracksPerBlock; t < last; ++t) {
+                const FiberTrack* found = findTrack(selection[t]);
+                if (!found || found->empty()) {
+                    m_columns[LENGTH][t] = 0.0f;
+                    m_columns[POINT_COUNT][t] = 0.0f;
+                    threadEmpty[thread].push_back(static_cast<uint32_t>(t));
+                    continue;
+                }
+                const FiberTrack& track = *found;
+                const size_t n = track.size();
+                x.resize(n);
+                y.resize(n);
+                z.resize(n);
+                scalars.resize(n * scalarCount);
+                for (size_t p = 0; p < n; ++p) {
+                    const TrackPoint& point = track[p];
+                    x[p] = point.x;
+                    y[p] = point.y;
+                    z[p] = point.z;
+                    const size_t available = std::min(point.scalars.size(), scalarCount);
+                    for (size_t s = 0; s < scalarCount; ++s) {
+                        scalars[s * n + p] = s < available ? point.scalars[s] : 0.0f;
+                    }
+                }
+
+                m_columns[LENGTH][t] = polylineLength(x.data(), y.data(), z.data(), n);
+                m_columns[POINT_COUNT][t] = static_cast<float>(n);
+                m_columns[MEAN_CURVATURE][t] = n > 2 ? curvatureSum(x.data(), y.data(), z.data(), n) / (n - 2) : 0.0f;
+                const float* coordinates[3] = { x.data(), y.data(), z.data() };
+                for (int a = 0; a < 3; ++a) {
+                    minMax(coordinates[a], n, m_columns[MIN_X + a][t], m_columns[MAX_X + a][t]);
+                    m_columns[START_X + a][t] = coordinates[a][0];
+                    m_columns[END_X + a][t] = coordinates[a][n - 1];
+                }
+                for (size_t s = 0; s < scalarCount; ++s) {
+                    m_columns[SCALAR_MEAN + s][t] = sum(scalars.data() + s * n, n) / n;
+                }
+            }
+        }
+    });
+    std::vector<uint32_t> emptyTracks;
+    for (const auto& empty : threadEmpty) {
+        emptyTracks.insert(emptyTracks.end(), empty.begin(), empty.end());
+    }
+    std::sort(emptyTracks.begin(), emptyTracks.end());
+
+    // Sorted orders, one column per thread at a time. NaN (e.g. a NaN scalar in the file)
+    // would break the ordering the range searches rely on, so non-finite values stay out
+    m_unsortedTracks.resize(m_columns.size());
+    std::atomic<size_t> nextColumn(0);
+    runThreads(std::min(threads, m_columns.size()), [&](size_t) {
+        for (size_t column = nextColumn++; column < m_columns.size(); column = nextColumn++) {
+            const std::vector<float>& values = m_columns[column];
+            std::vector<uint32_t>& order = m_sortedTracks[column];
+            std::vector<uint32_t>& unsorted = m_unsortedTracks[column];
+            order.reserve(trackCount - emptyTracks.size());
+            for (size_t t = 0, e = 0; t < trackCount; ++t) {
+                if (e < emptyTracks.size() && emptyTracks[e] == t) {
+                    e++;
+                    unsorted.push_back(static_cast<uint32_t>(t));
+                } else if (std::isfinite(values[t])) {
+                    order.push_back(static_cast<uint32_t>(t));
+                } else {
+                    unsorted.push_back(static_cast<uint32_t>(t));
+                }
+            }
+            sortByValue(values, order);
+        }
+    });
+
+    m_buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+bool TrackStatistics::getRange(size_t column, float& minValue, float& maxValue) const
+{
+    if (column >= m_sortedTracks.size() || m_sortedTracks[column].empty()) {
+        return false;
+    }
+    minValue = m_columns[column][m_sortedTracks[column].front()];
+    maxValue = m_columns[column][m_sortedTracks[column].back()];
+    return true;
+}
+
+std::pair<size_t, size_t> TrackStatistics::findRange(size_t column, float minValue, float maxValue) const
+{
+    if (column >= m_sortedTracks.size() || !(minValue <= maxValue)) {
+        return std::pair<size_t, size_t>(0, 0);
+    }
+    const std::vector<float>& values = m_columns[column];
+    const std::vector<uint32_t>& order = m_sortedTracks[column];
+    const auto first = std::lower_bound(order.begin(), order.end(), minValue,
+                                        [&values](uint32_t track, float value) { return values[track] < value; });
+    const auto last = std::upper_bound(first, order.end(), maxValue,
+                                       [&values](float value, uint32_t track) { return value < values[track]; });
+    return std::pair<size_t, size_t>(first - order.begin(), last - order.begin());
+}
+
+size_t TrackStatistics::countRange(size_t column, float minValue, float maxValue) const
+{
+    const std::pair<size_t, size_t> span = findRange(column, minValue, maxValue);
+    return span.second - span.first;
+}
+
+void TrackStatistics::selectRange(size_t column, float minValue, float maxValue, std::vector<uint8_t>& mask) const
+{
+    mask.assign(m_trackCount, 0);
+    if (column >= m_sortedTracks.size()) {
+        return;
+    }
+    const std::pair<size_t, size_t> span = findRange(column, minValue, maxValue);
+    const std::vector<uint32_t>& order = m_sortedTracks[column];
+    for (size_t i = span.first; i < span.second; ++i) {
+        mask[order[i]] = 1;
+    }
+}
+
+void TrackStatistics::restrictRange(size_t column, float minValue, float maxValue, std::vector<uint8_t>& mask) const
+{
+    mask.resize(m_trackCount, 1);
+    if (column >= m_sortedTracks.size()) {
+        std::fill(mask.begin(), mask.end(), 0);
+        return;
+    }
+    const std::pair<size_t, size_t> span = findRange(column, minValue, maxValue);
+
+    // Only the tracks outside the span are touched
+    const std::vector<uint32_t>& order = m_sortedTracks[column];
+    for (size_t i = 0; i < span.first; ++i) {
+        mask[order[i]] = 0;
+    }
+    for (size_t i = span.second; i < order.size(); ++i) {
+        mask[order[i]] = 0;
+    }
+    for (uint32_t track : m_unsortedTracks[column]) {
+        mask[track] = 0;
+    }
+}
+
+} // namespace DTIFiberLib
@@ -3,10 +3,13 @@
 #include <fstream>
 #include <cstring>
 #include <algorithm>
+#include <utility>
 
 namespace DTIFiberLib {
 
-    TrkFileReader::TrkFileReader() : m_isValidFile(false) {
+    TrkFileReader::TrkFileReader()
+        : m_fiberTracks(std::make_shared<std::vector<FiberTrack>>())
+        , m_isValidFile(false) {
         std::memset(&m_tractographyHeader, 0, sizeof(TractographyHeader));
     }
 
@@ -18,7 +21,7 @@ namespace DTIFiberLib {
 
     bool TrkFileReader::LoadTractographyFile(const std::string& filename) {
         m_isValidFile = false;
-        m_fiberTracks.clear();
+        m_fiberTracks = std::make_shared<std::vector<FiberTrack>>();
         m_lastErrorMessage.clear();
 
         m_file.open(filename, std::ios::binary);
@@ -39,7 +42,7 @@ namespace DTIFiberLib {
 
         m_file.close();
         m_isValidFile = true;
-        m_lastErrorMessage = "Successfully loaded " + std::to_string(m_fiberTracks.size()) + " fiber tracks";
+        m_lastErrorMessage = "Successfully loaded " + std::to_string(m_fiberTracks->size()) + " fiber tracks";
         return true;
     }
 
@@ -86,7 +89,7 @@ namespace DTIFiberLib {
 
     bool TrkFileReader::ExtractFiberTracks() {
         m_file.seekg(1000, std::ios::beg);
-        m_fiberTracks.clear();
+        m_fiberTracks->clear();
 
         size_t trackIndex = 0;
         while (!m_file.eof()) {
@@ -142,7 +145,7 @@ namespace DTIFiberLib {
                           << ", Actual bytes read = " << (posAfter - posBefore) << std::endl;
             }
 
-            m_fiberTracks.push_back(track);
+            m_fiberTracks->push_back(std::move(track));
         }
 
         return true;
@@ -163,10 +166,10 @@ namespace DTIFiberLib {
     }
 
     const FiberTrack& TrkFileReader::GetTrack(size_t index) const {
-        if (index >= m_fiberTracks.size()) {
+        if (index >= m_fiberTracks->size()) {
             throw std::out_of_range("Track index out of range");
         }
-        return m_fiberTracks[index];
+        return (*m_fiberTracks)[index];
     }
 
     void TrkFileReader::PrintHeaderInfo() const {
@@ -181,11 +184,11 @@ namespace DTIFiberLib {
         std::cout << "Scalar count: " << m_tractographyHeader.n_scalars << std::endl;
         std::cout << "Property count: " << m_tractographyHeader.n_properties << std::endl;
         std::cout << "Header size: " << m_tractographyHeader.hdr_size << std::endl;
-        std::cout << "Actual loaded tracks: " << m_fiberTracks.size() << std::endl;
+        std::cout << "Actual loaded tracks: " << m_fiberTracks->size() << std::endl;
     }
 
     bool TrkFileReader::ExportToJSON(const std::string& outputPath, size_t maxTracks) const {
-        if (!m_isValidFile || m_fiberTracks.empty()) {
+        if (!m_isValidFile || m_fiberTracks->empty()) {
             return false;
         }
 
@@ -212,11 +215,11 @@ namespace DTIFiberLib {
         jsonFile << "  },\n";
 
         // 输出轨迹数据
-        size_t tracksToExport = std::min(maxTracks, m_fiberTracks.size());
+        size_t tracksToExport = std::min(maxTracks, m_fiberTracks->size());
         jsonFile << "  \"tracks\": [\n";
         
         for (size_t trackIdx = 0; trackIdx < tracksToExport; ++trackIdx) {
-            const auto& track = m_fiberTracks[trackIdx];
+            const auto& track = (*m_fiberTracks)[trackIdx];
             jsonFile << "    {\n";
             jsonFile << "      \"track_id\": " << trackIdx << ",\n";
             jsonFile << "      \"point_count\": " << track.size() << ",\n";
@@ -248,7 +251,7 @@ namespace DTIFiberLib {
         
         jsonFile << "  ],\n";
         jsonFile << "  \"exported_count\": " << tracksToExport << ",\n";
-        jsonFile << "  \"total_tracks\": " << m_fiberTracks.size() << "\n";
+        jsonFile << "  \"total_tracks\": " << m_fiberTracks->size() << "\n";
         jsonFile << "}\n";
 
         jsonFile.close();
@@ -0,0 +1,202 @@
+/**
+ * fiber_snapshot - headless batch snapshots of .trk files
+ *
+ * Usage: fiber_snapshot [options] -o <output dir> <file.trk>...
+ *   -j <n>          Worker processes (default: number of CPUs)
+ *   -s <w>x<h>      Image size (default 1024x1024)
+ *   -p <a,b,...>    Camera presets: left, right, anterior, posterior, superior, inferior,
+ *                   oblique, or all (default: left,superior,anterior)
+ *   -m <samples>    Multisample count (default 4, 0 disables)
+ *   -w <width>      Line width (default 1.5)
+ *
+ * Each worker process creates its own surfaceless EGL context and renders every n-th file,
+ * writing <output dir>/<file stem>_<preset>.png. The exit status is non-zero if any file failed.
+ */
+#include "DTIFiberLib.h"
+#include "GLHeadlessContext.h"
+#include "GLSnapshotRenderer.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace DTIFiberLib;
+
+namespace {
+
+struct Options {
+    std::string outputDir;
+    std::vector<std::string> inputs;
+    std::vector<CameraPreset> presets;
+    int jobs = 0;
+    int width = 1024;
+    int height = 1024;
+    int samples = 4;
+    float lineWidth = 1.5f;
+};
+
+void printUsage()
+{
+    std::cerr << "Usage: fiber_snapshot [-j jobs] [-s WxH] [-p presets] [-m samples] [-w line width] "
+                 "-o <output dir> <file.trk>..." << std::endl;
+}
+
+bool parsePresets(const std::string& list, std::vector<CameraPreset>& presets)
+{
+    presets.clear();
+    std::stringstream stream(list);
+    std::string name;
+    while (std::getline(stream, name, ',')) {
+        if (name == "all") {
+            for (int i = 0; i < static_cast<int>(CameraPreset::COUNT); ++i) {
+                presets.push_back(static_cast<CameraPreset>(i));
+            }
+            continue;
+        }
+        CameraPreset preset;
+        if (!GLSnapshotRenderer::presetFromName(name, preset)) {
+            std::cerr << "Unknown camera preset: " << name << std::endl;
+            return false;
+        }
+        presets.push_back(preset);
+    }
+    return !presets.empty();
+}
+
+bool parseArguments(int argc, char** argv, Options& options)
+{
+    options.presets = { CameraPreset::LEFT, CameraPreset::SUPERIOR, CameraPreset::ANTERIOR };
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "-o" && hasValue) {
+            options.outputDir = argv[++i];
+        } else if (arg == "-j" && hasValue) {
+            options.jobs = std::atoi(argv[++i]);
+        } else if (arg == "-s" && hasValue) {
+            if (std::sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2) {
+                return false;
+            }
+        } else if (arg == "-p" && hasValue) {
+            if (!parsePresets(argv[++i], options.presets)) {
+                return false;
+            }
+        } else if (arg == "-m" && hasValue) {
+            options.samples = std::atoi(argv[++i]);
+        } else if (arg == "-w" && hasValue) {
+            options.lineWidth = static_cast<float>(std::atof(argv[++i]));
+        } else if (!arg.empty() && arg[0] == '-') {
+            return false;
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+    return !options.outputDir.empty() && !options.inputs.empty() && options.width > 0 && options.height > 0;
+}
+
+// Renders files worker, worker + workerCount, ...; returns the number of failures
+int runWorker(const Options& options, int worker, int workerCount)
+{
+    // The context is created after fork(): EGL/GL state must never be shared across processes
+    GLHeadlessContext context;
+    if (!context.create()) {
+        return 1;
+    }
+
+    int failures = 0;
+    {
+        GLFiberRenderer renderer;
+        renderer.initialize();
+        renderer.setProfilingEnabled(false);
+        renderer.setLineWidth(options.lineWidth);
+        renderer.setColorMode(FiberColoringMode::DIRECTION_RGB);
+
+        GLSnapshotRenderer snapshot;
+        if (!renderer.isInitialized() || !snapshot.initialize(options.width, options.height, options.samples)) {
+            return 1;
+        }
+
+        for (size_t i = static_cast<size_t>(worker); i < options.inputs.size(); i += static_cast<size_t>(workerCount)) {
+            const std::string& input = options.inputs[i];
+            TrkFileReader reader;
+            if (!reader.LoadTractographyFile(input)) {
+                std::cerr << "[worker " << worker << "] Failed to load " << input << std::endl;
+                ++failures;
+                continue;
+            }
+            renderer.setTracks(reader.GetAllTracks());
+
+            const std::string stem = std::filesystem::path(input).stem().string();
+            for (CameraPreset preset : options.presets) {
+                const std::string path = (std::filesystem::path(options.outputDir) /
+                                          (stem + "_" + GLSnapshotRenderer::presetName(preset) + ".png")).string();
+                if (!snapshot.writeSnapshot(renderer, preset, path)) {
+                    ++failures;
+                }
+            }
+            std::cout << "[worker " << worker << "] " << input << " -> " << options.presets.size() << " snapshots" << std::endl;
+        }
+        renderer.cleanup();
+    }
+    return failures;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseArguments(argc, argv, options)) {
+        printUsage();
+        return 2;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(options.outputDir, error);
+
+    int workerCount = options.jobs > 0 ? options.jobs : static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+    workerCount = std::max(1, std::min(workerCount, static_cast<int>(options.inputs.size())));
+    if (workerCount == 1) {
+        return runWorker(options, 0, 1) == 0 ? 0 : 1;
+    }
+
+    // Separate processes rather than threads: each gets its own driver instance and context
+    std::vector<pid_t> workers;
+    int forkedCount = 0;
+    for (; forkedCount < workerCount; ++forkedCount) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            std::exit(runWorker(options, forkedCount, workerCount) == 0 ? 0 : 1);
+        }
+        if (pid < 0) {
+            std::cerr << "fork failed; the remaining shares run in this process" << std::endl;
+            break;
+        }
+        workers.push_back(pid);
+    }
+
+    int failedWorkers = 0;
+    for (pid_t pid : workers) {
+        int status = 0;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            ++failedWorkers;
+        }
+    }
+    for (int worker = forkedCount; worker < workerCount; ++worker) {
+        if (runWorker(options, worker, workerCount) != 0) {
+            ++failedWorkers;
+        }
+    }
+
+    if (failedWorkers > 0) {
+        std::cerr << failedWorkers << " of " << workerCount << " workers reported failures" << std::endl;
+        return 1;
+    }
+    return 0;
+}